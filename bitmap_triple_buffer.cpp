@@ -0,0 +1,110 @@
+// bitmap_triple_buffer.cpp : Lock-free handoff of BGRA frames between threads
+//
+
+#include "bitmap_triple_buffer.h"
+
+namespace
+{
+  // Stale regions of a slot above this count are merged into their
+  // bounding rectangle, the slot held by the consumer is not refreshed
+  // until it is taken, so its list would grow with every frame
+  const size_t kMaxStaleRects = 16;
+}
+
+BitmapTripleBuffer::Frame::Frame()
+  : image(),
+    dirty_rects(),
+    is_full_update(true),
+    sequence(0),
+    publish_time(0),
+    write_time(0),
+    stale_rects() {
+}
+
+BitmapTripleBuffer::BitmapTripleBuffer()
+  : m_ready(1),
+    m_clock(),
+    m_write_index(0),
+    m_last_published_index(-1),
+    m_write_start(0),
+    m_write_sequence(0),
+    m_dropped(0),
+    m_read_index(2),
+    m_is_read_valid(false) {
+  m_clock.start();
+}
+
+BitmapTripleBuffer::Frame& BitmapTripleBuffer::BeginWrite()
+{
+  m_write_start = m_clock.nsecsElapsed();
+  return m_frames[m_write_index];
+}
+
+const BitmapTripleBuffer::Frame* BitmapTripleBuffer::LastPublished() const
+{
+  return m_last_published_index < 0 ? 0 : &m_frames[m_last_published_index];
+}
+
+void BitmapTripleBuffer::Publish()
+{
+  Frame& frame = m_frames[m_write_index];
+  frame.sequence = ++m_write_sequence;
+  frame.publish_time = m_clock.nsecsElapsed();
+  frame.write_time = frame.publish_time - m_write_start;
+
+  // Regions of this frame are missing in the other two slots
+  for (int i = 0; i < 3; ++i) {
+    if (i == m_write_index)
+      continue;
+    std::vector<QRect>& stale_rects = m_frames[i].stale_rects;
+    if (frame.is_full_update) {
+      stale_rects.assign(1, frame.image.rect());
+    }
+    else {
+      stale_rects.insert(stale_rects.end(), frame.dirty_rects.begin(),
+        frame.dirty_rects.end());
+      if (stale_rects.size() > kMaxStaleRects) {
+        QRect bounds;
+        for (size_t r = 0; r < stale_rects.size(); ++r)
+          bounds |= stale_rects[r];
+        stale_rects.assign(1, bounds & frame.image.rect());
+      }
+    }
+  }
+  frame.stale_rects.clear();
+
+  // Ordered exchange makes the pixels visible before the index
+  int previous = m_ready.fetchAndStoreOrdered(m_write_index | kFreshFlag);
+  if (previous & kFreshFlag)
+    m_dropped.ref();
+
+  m_last_published_index = m_write_index;
+  m_write_index = previous & kIndexMask;
+}
+
+const BitmapTripleBuffer::Frame* BitmapTripleBuffer::Acquire()
+{
+  if (!(m_ready.fetchAndAddOrdered(0) & kFreshFlag))
+    return 0;
+
+  int previous = m_ready.fetchAndStoreOrdered(m_read_index);
+  m_read_index = previous & kIndexMask;
+  m_is_read_valid = true;
+  return &m_frames[m_read_index];
+}
+
+const BitmapTripleBuffer::Frame* BitmapTripleBuffer::Current() const
+{
+  return m_is_read_valid ? &m_frames[m_read_index] : 0;
+}
+
+quint32 BitmapTripleBuffer::DroppedCount() const
+{
+  return static_cast<quint32>(
+    const_cast<QAtomicInt&>(m_dropped).fetchAndAddOrdered(0));
+}
+
+qint64 BitmapTripleBuffer::Now() const
+{
+  return m_clock.nsecsElapsed();
+}
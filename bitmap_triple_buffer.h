@@ -0,0 +1,94 @@
+// bitmap_triple_buffer.h : Lock-free handoff of BGRA frames between threads
+//
+
+#ifndef BITMAP_TRIPLE_BUFFER_H
+#define BITMAP_TRIPLE_BUFFER_H
+#pragma once
+
+#include <vector>
+#include <QImage>
+#include <QRect>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+
+// Single producer / single consumer triple buffer of bitmap frames. The
+// producer writes into its own slot and publishes it by swapping it with the
+// ready slot, the consumer takes the ready slot by swapping it with its own.
+// Both swaps are one atomic exchange, so neither side ever waits for the
+// other. A frame published before the previous one was taken replaces it
+// and is counted as dropped.
+//
+// Every bitmap layer owns its buffer, there is no state shared between them.
+class BitmapTripleBuffer
+{
+public:
+  struct Frame
+  {
+    Frame();
+
+    // Pixels in bitmap row order (bottom-up)
+    QImage             image;
+    // Regions changed since the previous frame, in bitmap coordinates
+    std::vector<QRect> dirty_rects;
+    // Whole image should be uploaded, dirty_rects are not used then
+    bool               is_full_update;
+    // Number of the frame, starting from 1
+    quint32            sequence;
+    // Time of publishing, ns of the buffer clock
+    qint64             publish_time;
+    // Time spent by the producer on writing the frame, ns
+    qint64             write_time;
+
+    // Producer only: regions written into other slots since this one was
+    // written, they are refreshed from the last published frame
+    std::vector<QRect> stale_rects;
+  };
+
+  BitmapTripleBuffer();
+
+  // Producer side. Returns slot to be filled, it is owned by the producer
+  // until Publish is called.
+  Frame&       BeginWrite();
+  // Returns the previously published frame, it is not written by anyone
+  // until the next Publish, so the producer can copy from it. NULL, if no
+  // frame has been published yet.
+  const Frame* LastPublished() const;
+  void         Publish();
+
+  // Consumer side. Returns the newest published frame or NULL, if there is
+  // no new one. Frame stays valid until the next Acquire.
+  const Frame* Acquire();
+  // Returns frame taken by the last Acquire or NULL
+  const Frame* Current() const;
+
+  // Frames replaced before being taken
+  quint32      DroppedCount() const;
+  // Time of the buffer clock, ns
+  qint64       Now() const;
+
+private:
+  // Index of the ready slot and flag of the frame not taken yet
+  enum { kIndexMask = 3, kFreshFlag = 4 };
+
+  // Disable copying
+  BitmapTripleBuffer(const BitmapTripleBuffer&);
+  BitmapTripleBuffer& operator=(const BitmapTripleBuffer&);
+
+private:
+  Frame         m_frames[3];
+  QAtomicInt    m_ready;
+  QElapsedTimer m_clock;
+
+  // Producer only
+  int           m_write_index;
+  int           m_last_published_index;
+  qint64        m_write_start;
+  quint32       m_write_sequence;
+  QAtomicInt    m_dropped;
+
+  // Consumer only
+  int           m_read_index;
+  bool          m_is_read_valid;
+};
+
+#endif // BITMAP_TRIPLE_BUFFER_H
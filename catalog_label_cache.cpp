@@ -0,0 +1,296 @@
+// catalog_label_cache.cpp : Labels of feature catalog classes and listed values
+//
+#include <algorithm>
+
+#include <QDebug>
+
+#include <base/inc/sdk_any_handler.h>
+#include <base/inc/sdk_string_handler.h>
+#include <base/inc/sdk_results_enum.h>
+#include <datalayer/inc/geodatabase/gdb_const.h>
+#include "utils.h"
+#include "catalog_label_cache.h"
+
+namespace
+{
+  // Listed values above it are not cached, they do not fit the key
+  const SDKUInt64 kMaxCachedListedValue = 0xFFFFFFFFu;
+
+  bool LookupListedValue(const sdk::gdb::IAttributeClassSP& attr_class,
+    SDKUInt64 value, std::wstring& label)
+  {
+    sdk::gdb::IClassListedValueSP listed_val_iterface;
+    sdk::ScopedAny listed_val;
+    if (SDK_FAILED(attr_class->FindListedValue(value, &listed_val_iterface))
+      || SDK_FAILED(listed_val_iterface->GetProperty(
+      sdk::gdb::kClassListedValueProperty_Label, listed_val))
+      || !ANY_IS_STR(&listed_val))
+      return false;
+    label = sdk::WideFromSDKString(*ANY_STR(&listed_val));
+    return true;
+  }
+}
+
+CatalogLabels::CatalogLabels(const sdk::gdb::IClassCatalogSP& feature_catalog)
+  : m_feature_catalog(feature_catalog),
+    m_lock(),
+    m_classes(),
+    m_listed_values(),
+    m_lookups(0),
+    m_hits(0)
+{
+}
+
+bool CatalogLabels::GetClassName(sdk::gdb::ClassType class_type,
+  sdk::gdb::ClassCode class_code, std::wstring& name)
+{
+  ClassEntry entry;
+  if (!FindClass(class_type, class_code, entry) || !entry.is_found)
+    return false;
+  name = entry.name;
+  return true;
+}
+
+bool CatalogLabels::GetListedValueLabel(sdk::gdb::ClassCode attr_class_code,
+  SDKUInt64 value, std::wstring& label)
+{
+  ClassEntry attr_entry;
+  if (!FindClass(sdk::gdb::kClassType_AttributeClass, attr_class_code, attr_entry)
+    || !attr_entry.enum_class)
+    return false;
+
+  if (value > kMaxCachedListedValue)
+    return LookupListedValue(attr_entry.enum_class, value, label);
+
+  const quint64 key = ListedValueKey(attr_class_code, value);
+  {
+    QMutexLocker lock(&m_lock);
+    QHash<quint64, LabelEntry>::const_iterator it = m_listed_values.constFind(key);
+    if (it != m_listed_values.constEnd())
+    {
+      ++m_hits;
+      if (!it->is_found)
+        return false;
+      label = it->label;
+      return true;
+    }
+  }
+
+  // Catalog is not called under the lock
+  LabelEntry entry;
+  entry.is_found = LookupListedValue(attr_entry.enum_class, value, entry.label);
+
+  QMutexLocker lock(&m_lock);
+  ++m_lookups;
+  m_listed_values.insert(key, entry);
+  if (!entry.is_found)
+    return false;
+  label = entry.label;
+  return true;
+}
+
+void CatalogLabels::Prefetch(sdk::gdb::ClassType class_type,
+  const std::vector<sdk::gdb::ClassCode>& class_codes)
+{
+  // Missing codes are collected first, so the lock is taken twice only
+  std::vector<sdk::gdb::ClassCode> missing;
+  {
+    QMutexLocker lock(&m_lock);
+    for (size_t i = 0; i < class_codes.size(); ++i)
+    {
+      if (!m_classes.contains(ClassKey(class_type, class_codes[i])))
+        missing.push_back(class_codes[i]);
+    }
+  }
+  std::sort(missing.begin(), missing.end());
+  missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+  if (missing.empty())
+    return;
+
+  std::vector<ClassEntry> entries(missing.size());
+  for (size_t i = 0; i < missing.size(); ++i)
+    entries[i] = LookupClass(class_type, missing[i]);
+
+  QMutexLocker lock(&m_lock);
+  m_lookups += missing.size();
+  for (size_t i = 0; i < missing.size(); ++i)
+    m_classes.insert(ClassKey(class_type, missing[i]), entries[i]);
+}
+
+quint64 CatalogLabels::GetLookupCount() const
+{
+  QMutexLocker lock(&m_lock);
+  return m_lookups;
+}
+
+quint64 CatalogLabels::GetHitCount() const
+{
+  QMutexLocker lock(&m_lock);
+  return m_hits;
+}
+
+quint64 CatalogLabels::ClassKey(sdk::gdb::ClassType class_type,
+  sdk::gdb::ClassCode class_code)
+{
+  return (static_cast<quint64>(class_type) << 32) | static_cast<quint32>(class_code);
+}
+
+quint64 CatalogLabels::ListedValueKey(sdk::gdb::ClassCode attr_class_code,
+  SDKUInt64 value)
+{
+  return (static_cast<quint64>(static_cast<quint32>(attr_class_code)) << 32) |
+    static_cast<quint32>(value);
+}
+
+CatalogLabels::ClassEntry CatalogLabels::LookupClass(
+  sdk::gdb::ClassType class_type, sdk::gdb::ClassCode class_code) const
+{
+  ClassEntry entry;
+  entry.is_found = false;
+
+  sdk::gdb::IClassSP class_base;
+  if (!m_feature_catalog || SDK_FAILED(m_feature_catalog->FindClassByCode(
+    class_type, class_code, &class_base)) || !class_base)
+    return entry;
+
+  sdk::ScopedAny class_name;
+  if (SDK_OK(class_base->GetProperty(sdk::gdb::kClassProperty_Name, class_name)) &&
+    ANY_IS_STR(&class_name))
+  {
+    entry.is_found = true;
+    entry.name = sdk::WideFromSDKString(*ANY_STR(&class_name));
+  }
+
+  if (class_type == sdk::gdb::kClassType_AttributeClass)
+  {
+    sdk::gdb::IAttributeClassSP attr_class =
+      sdk::GetInterfaceT<sdk::gdb::IAttributeClass>(class_base);
+    sdk::gdb::AttributeClassType attr_class_type;
+    if (attr_class && SDK_OK(attr_class->GetAttributeClassType(attr_class_type)) &&
+      attr_class_type == sdk::gdb::kAttributeClassType_Enum)
+      entry.enum_class = attr_class;
+  }
+  return entry;
+}
+
+bool CatalogLabels::FindClass(sdk::gdb::ClassType class_type,
+  sdk::gdb::ClassCode class_code, ClassEntry& entry)
+{
+  const quint64 key = ClassKey(class_type, class_code);
+  {
+    QMutexLocker lock(&m_lock);
+    QHash<quint64, ClassEntry>::const_iterator it = m_classes.constFind(key);
+    if (it != m_classes.constEnd())
+    {
+      ++m_hits;
+      entry = *it;
+      return true;
+    }
+  }
+
+  // Catalog is not called under the lock, a concurrent lookup of the
+  // same class stores the same entry
+  entry = LookupClass(class_type, class_code);
+
+  QMutexLocker lock(&m_lock);
+  ++m_lookups;
+  m_classes.insert(key, entry);
+  return true;
+}
+
+CatalogLabelCache::CatalogLabelCache()
+  : m_lock(),
+    m_catalogs()
+{
+}
+
+CatalogLabelCache::~CatalogLabelCache()
+{
+  ReportStatistics();
+}
+
+CatalogLabelsSP CatalogLabelCache::GetLabels(const sdk::gdb::IWorkspaceSP& wks,
+  SDKUInt32 prsp)
+{
+  if (!wks)
+    return CatalogLabelsSP();
+
+  const Key key(static_cast<const void*>(wks.operator->()), prsp);
+  {
+    QMutexLocker lock(&m_lock);
+    Catalogs::const_iterator it = m_catalogs.find(key);
+    if (it != m_catalogs.end())
+      return it->second.m_labels;
+  }
+
+  sdk::gdb::IClassCatalogSP feature_catalog;
+  if (SDK_FAILED(wks->GetFeatureCatalog(prsp, &feature_catalog)) || !feature_catalog)
+    return CatalogLabelsSP();
+
+  QMutexLocker lock(&m_lock);
+  Entry& entry = m_catalogs[key];
+  if (!entry.m_labels)
+  {
+    entry.m_wks = wks;
+    entry.m_labels = CatalogLabelsSP(new CatalogLabels(feature_catalog));
+  }
+  return entry.m_labels;
+}
+
+CatalogLabelsSP CatalogLabelCache::GetLabels(const sdk::gdb::IFeatureDatasetSP& dataset)
+{
+  if (!dataset)
+    return CatalogLabelsSP();
+
+  sdk::gdb::IWorkspaceSP wks;
+  if (SDK_FAILED(dataset->GetWorkspace(&wks)) || !wks)
+    return CatalogLabelsSP();
+
+  sdk::ScopedAny prsp;
+  if (SDK_FAILED(dataset->GetDatasetProperty(sdk::gdb::kDSP_PRSP, prsp)))
+    return CatalogLabelsSP();
+  prsp.ChangeType(kSDKAnyType_Uint32);
+
+  return GetLabels(wks, ANY_UI32(&prsp));
+}
+
+void CatalogLabelCache::Clear()
+{
+  ReportStatistics();
+
+  QMutexLocker lock(&m_lock);
+  m_catalogs.clear();
+}
+
+void CatalogLabelCache::Remove(const sdk::gdb::IWorkspaceSP& wks)
+{
+  if (!wks)
+    return;
+
+  const void* wks_key = static_cast<const void*>(wks.operator->());
+  QMutexLocker lock(&m_lock);
+  Catalogs::iterator it = m_catalogs.lower_bound(Key(wks_key, 0));
+  while (it != m_catalogs.end() && it->first.first == wks_key)
+    m_catalogs.erase(it++);
+}
+
+void CatalogLabelCache::ReportStatistics() const
+{
+  if (!IsTimingLogEnabled())
+    return;
+
+  quint64 lookups = 0;
+  quint64 hits = 0;
+  {
+    QMutexLocker lock(&m_lock);
+    for (Catalogs::const_iterator it = m_catalogs.begin(); it != m_catalogs.end(); ++it)
+    {
+      lookups += it->second.m_labels->GetLookupCount();
+      hits += it->second.m_labels->GetHitCount();
+    }
+  }
+
+  if (lookups)
+    qDebug() << "Catalog labels:" << lookups << "catalog lookups," << hits
+      << "read from cache";
+}
@@ -0,0 +1,120 @@
+// catalog_label_cache.h : Labels of feature catalog classes and listed values
+//
+#ifndef CATALOG_LABEL_CACHE_H
+#define CATALOG_LABEL_CACHE_H
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <QHash>
+#include <QMutex>
+
+#include <base/inc/platform.h>
+#include <datalayer/inc/geodatabase/gdb_workspace.h>
+
+// Labels of one feature catalog. Class names and listed value labels are
+// looked up in the catalog once and then read from hash tables, missing
+// ones are remembered as well. Labels may be read from any thread.
+class CatalogLabels
+{
+public:
+  explicit CatalogLabels(const sdk::gdb::IClassCatalogSP& feature_catalog);
+
+  // Returns name of the class, false if the catalog has no such class
+  bool GetClassName(sdk::gdb::ClassType class_type,
+    sdk::gdb::ClassCode class_code, std::wstring& name);
+  // Returns label of the listed value of enumeration attribute class,
+  // false if the class is not enumeration or has no such value
+  bool GetListedValueLabel(sdk::gdb::ClassCode attr_class_code,
+    SDKUInt64 value, std::wstring& label);
+
+  // Looks up names of all of given classes at once
+  void Prefetch(sdk::gdb::ClassType class_type,
+    const std::vector<sdk::gdb::ClassCode>& class_codes);
+
+  // Catalog lookups made and labels read from the tables
+  quint64 GetLookupCount() const;
+  quint64 GetHitCount() const;
+
+private:
+  struct ClassEntry
+  {
+    bool                        is_found;
+    std::wstring                name;
+    // Attribute class of enumeration, its listed values are looked up
+    sdk::gdb::IAttributeClassSP enum_class;
+  };
+
+  struct LabelEntry
+  {
+    bool         is_found;
+    std::wstring label;
+  };
+
+  // Keys of the tables, class type or class code is in the high half
+  static quint64 ClassKey(sdk::gdb::ClassType class_type,
+    sdk::gdb::ClassCode class_code);
+  static quint64 ListedValueKey(sdk::gdb::ClassCode attr_class_code,
+    SDKUInt64 value);
+
+  // Looks the class up in the catalog, the lock is not held
+  ClassEntry LookupClass(sdk::gdb::ClassType class_type,
+    sdk::gdb::ClassCode class_code) const;
+  // Returns the table entry of the class, looks it up if missing
+  bool FindClass(sdk::gdb::ClassType class_type, sdk::gdb::ClassCode class_code,
+    ClassEntry& entry);
+
+private:
+  const sdk::gdb::IClassCatalogSP m_feature_catalog;
+
+  mutable QMutex                  m_lock;
+  QHash<quint64, ClassEntry>      m_classes;
+  QHash<quint64, LabelEntry>      m_listed_values;
+  quint64                         m_lookups;
+  quint64                         m_hits;
+};
+typedef std::tr1::shared_ptr<CatalogLabels> CatalogLabelsSP;
+
+// Labels of feature catalogs of open workspaces by workspace and PRSP.
+// It is shared by the chart widget and its dialogs and may be used from
+// any thread.
+class CatalogLabelCache
+{
+public:
+  CatalogLabelCache();
+  ~CatalogLabelCache();
+
+  // Returns labels of the workspace feature catalog of the PRSP, the
+  // catalog is read from the workspace on the first call
+  CatalogLabelsSP GetLabels(const sdk::gdb::IWorkspaceSP& wks, SDKUInt32 prsp);
+  // Returns labels of the feature catalog of the feature dataset
+  CatalogLabelsSP GetLabels(const sdk::gdb::IFeatureDatasetSP& dataset);
+
+  // Forgets all of catalogs, it is called when workspaces are changed
+  void Clear();
+  // Forgets catalogs of the workspace, it is called when it is replaced
+  void Remove(const sdk::gdb::IWorkspaceSP& wks);
+
+private:
+  struct Entry
+  {
+    // Workspace is held, so its address is not reused by another one
+    sdk::gdb::IWorkspaceSP m_wks;
+    CatalogLabelsSP        m_labels;
+  };
+  typedef std::pair<const void*, SDKUInt32> Key;
+  typedef std::map<Key, Entry> Catalogs;
+
+  // Logs lookups and hits of all of catalogs, if TIMING_LOG is set
+  void ReportStatistics() const;
+
+private:
+  mutable QMutex m_lock;
+  Catalogs       m_catalogs;
+};
+typedef std::tr1::shared_ptr<CatalogLabelCache> CatalogLabelCacheSP;
+
+#endif // CATALOG_LABEL_CACHE_H
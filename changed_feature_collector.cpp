@@ -0,0 +1,380 @@
+// changed_feature_collector.cpp : Collects features changed since an update and prepares their marks off the UI thread
+//
+#include <algorithm>
+#include <set>
+
+#include <QRunnable>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QDebug>
+
+#include <base/inc/sdk_any_handler.h>
+#include <base/inc/sdk_string_handler.h>
+#include <base/inc/sdk_results_enum.h>
+#include <base/inc/interfaces/sql/sql_interface.h>
+#include <datalayer/inc/senc/senc_exchange_set.h>
+#include "utils.h"
+#include "update_history_summary.h"
+#include "changed_feature_collector.h"
+
+using namespace SDK_NAMESPACE;
+using namespace SDK_GDB_NAMESPACE;
+
+namespace
+{
+  // Features of one geometry batch, sorted features of a batch mostly
+  // belong to one dataset, so its base projection is made once
+  const size_t kBatchFeatures = 256;
+
+  // S-57 record update instruction deleting the feature
+  const SDKUInt32 kRUIN_Delete = 2;
+
+  struct ObjectIDLess
+  {
+    bool operator()(const ObjectID& l, const ObjectID& r) const
+    {
+      if (l.did != r.did)
+        return l.did < r.did;
+      return l.oid < r.oid;
+    }
+  };
+}
+
+class ChangedFeatureCollector::CollectTask : public QRunnable
+{
+public:
+  CollectTask(ChangedFeatureCollector* collector, int sequence,
+    const Request& request)
+    : m_collector(collector),
+      m_sequence(sequence),
+      m_request(request)
+  {
+  }
+
+  void run()
+  {
+    m_collector->Collect(m_sequence, m_request);
+  }
+
+private:
+  ChangedFeatureCollector* m_collector;
+  int                      m_sequence;
+  Request                  m_request;
+};
+
+class ChangedFeatureCollector::PrepareTask : public QRunnable
+{
+public:
+  PrepareTask(ChangedFeatureCollector* collector, int sequence,
+    const std::vector<ObjectID>& oids, const sdk::crs::IProjectionSP& projection)
+    : m_collector(collector),
+      m_sequence(sequence),
+      m_oids(oids),
+      m_projection(projection)
+  {
+  }
+
+  void run()
+  {
+    m_collector->Prepare(m_sequence, m_oids, m_projection);
+  }
+
+private:
+  ChangedFeatureCollector* m_collector;
+  int                      m_sequence;
+  std::vector<ObjectID>    m_oids;
+  sdk::crs::IProjectionSP  m_projection;
+};
+
+ChangedFeatureCollector::ChangedFeatureCollector(
+  const MarkedFeatureRendererSP& renderer, QObject* parent)
+  : QObject(parent),
+    m_renderer(renderer),
+    m_collect_pool(),
+    m_prepare_pool(),
+    m_sequence(0),
+    m_prepare_lock(),
+    m_prepared(),
+    m_lock(),
+    m_result(),
+    m_has_result(false)
+{
+  m_collect_pool.setMaxThreadCount(1);
+  m_prepare_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
+}
+
+ChangedFeatureCollector::~ChangedFeatureCollector()
+{
+  Cancel();
+  m_collect_pool.waitForDone();
+  m_prepare_pool.waitForDone();
+}
+
+void ChangedFeatureCollector::Start(const Request& request)
+{
+  int sequence = m_sequence.fetchAndAddOrdered(1) + 1;
+  {
+    // Result of the previous request may be done but not taken yet
+    QMutexLocker lock(&m_lock);
+    m_has_result = false;
+  }
+  m_collect_pool.start(new CollectTask(this, sequence, request));
+}
+
+void ChangedFeatureCollector::Cancel()
+{
+  m_sequence.fetchAndAddOrdered(1);
+
+  QMutexLocker lock(&m_lock);
+  m_has_result = false;
+}
+
+bool ChangedFeatureCollector::TakeResult(Result& result)
+{
+  QMutexLocker lock(&m_lock);
+  if (!m_has_result)
+    return false;
+  std::swap(result, m_result);
+  m_has_result = false;
+  return true;
+}
+
+void ChangedFeatureCollector::Collect(int sequence, const Request& request)
+{
+  if (sequence != m_sequence)
+    return; // Superseded while waiting in queue
+
+  QElapsedTimer timer;
+  timer.start();
+
+  Result result;
+  result.m_dataset_count = 0;
+  result.m_update_count = 0;
+  result.m_feature_count = 0;
+
+  // Changed features of all of workspaces
+  std::vector<ObjectID> oids;
+  IWorkspaceCollectionSP wks_collection;
+  SDKUInt32 wks_count = 0;
+  if (!request.m_wks_factory || !request.m_geometry_filter ||
+    SDK_FAILED(request.m_wks_factory->GetWorkspaces(&wks_collection)) ||
+    SDK_FAILED(wks_collection->GetWorkspaceCount(wks_count)))
+    result.m_error = tr("Failed to get the workspaces.");
+
+  for (SDKUInt32 c = 0; c < wks_count; ++c)
+  {
+    ScopedString wks_name;
+    IWorkspaceSP wks;
+    if (SDK_FAILED(wks_collection->GetWorkspaceName(c, wks_name)) ||
+      SDK_FAILED(wks_collection->GetWorkspace(wks_name, &wks)) || !wks)
+      continue;
+
+    // Workspace without update history has no changes
+    IWorkspaceUpdateHistorySP wks_uph;
+    if (SDK_FAILED(wks->GetWorkspaceUpdateHistory(&wks_uph)) || !wks_uph)
+      continue;
+
+    if (!CollectWorkspace(sequence, request, wks, wks_uph, oids, result))
+      break;
+  }
+  if (sequence != m_sequence)
+    return; // Superseded while being read
+
+  // Failed request has no marks, they would show only a part of changes
+  if (!result.m_error.isEmpty())
+    oids.clear();
+
+  const qint64 read_time = timer.elapsed();
+  result.m_feature_count = oids.size();
+
+  // Geometries are read in parallel batches of neighbouring features
+  std::sort(oids.begin(), oids.end(), ObjectIDLess());
+  {
+    QMutexLocker lock(&m_prepare_lock);
+    m_prepared.clear();
+    m_prepared.reserve(oids.size());
+  }
+  for (size_t b = 0; b < oids.size(); b += kBatchFeatures)
+  {
+    const size_t e = std::min(oids.size(), b + kBatchFeatures);
+    m_prepare_pool.start(new PrepareTask(this, sequence,
+      std::vector<ObjectID>(oids.begin() + b, oids.begin() + e),
+      request.m_projection));
+  }
+  m_prepare_pool.waitForDone();
+  if (sequence != m_sequence)
+    return; // Superseded while being prepared
+
+  {
+    QMutexLocker lock(&m_prepare_lock);
+    result.m_marks.swap(m_prepared);
+  }
+
+  if (IsTimingLogEnabled())
+    qDebug() << "Changed features:" << result.m_feature_count << "of"
+      << result.m_update_count << "updates in" << result.m_dataset_count
+      << "datasets read in" << read_time << "ms," << result.m_marks.size()
+      << "marks prepared in" << timer.elapsed() - read_time << "ms";
+
+  {
+    QMutexLocker lock(&m_lock);
+    if (sequence != m_sequence)
+      return;
+    std::swap(m_result, result);
+    m_has_result = true;
+  }
+
+  emit signalChangesReady();
+}
+
+void ChangedFeatureCollector::Prepare(int sequence,
+  const std::vector<ObjectID>& oids, const sdk::crs::IProjectionSP& projection)
+{
+  if (sequence != m_sequence || !m_renderer)
+    return; // Superseded while waiting in queue
+
+  std::vector<MarkedFeatureRenderer::PreparedMark> prepared;
+  m_renderer->PrepareMarks(oids, projection, prepared);
+
+  QMutexLocker lock(&m_prepare_lock);
+  m_prepared.insert(m_prepared.end(), prepared.begin(), prepared.end());
+}
+
+bool ChangedFeatureCollector::CollectWorkspace(int sequence,
+  const Request& request, const IWorkspaceSP& wks,
+  const IWorkspaceUpdateHistorySP& wks_uph, std::vector<ObjectID>& oids,
+  Result& result) const
+{
+  // Datasets intersecting the view
+  IEnumDatasetIDSP dataset_ids;
+  if (SDK_FAILED(wks->GetDatasetIDs(request.m_geometry_filter, NULL,
+    &dataset_ids)) || !dataset_ids)
+  {
+    result.m_error = tr("Failed to get datasets of the view.");
+    return false;
+  }
+
+  DatasetID did;
+  while (SDK_OK(dataset_ids->Next(&did)))
+  {
+    if (sequence != m_sequence)
+      return false;
+
+    IDatasetSP dataset;
+    if (SDK_FAILED(wks->GetDataset(did, &dataset)) || !dataset)
+      continue;
+    ScopedAny dataset_name;
+    if (SDK_FAILED(dataset->GetDatasetProperty(kDSP_FileName, dataset_name)) ||
+      !ANY_IS_STR(&dataset_name))
+      continue;
+
+    ++result.m_dataset_count;
+    if (!CollectDataset(request.m_since, wks_uph, did,
+      ASCIIFromSDKString(*ANY_STR(&dataset_name)), oids, result))
+      return false;
+  }
+  return true;
+}
+
+bool ChangedFeatureCollector::CollectDataset(const Since& since,
+  const IWorkspaceUpdateHistorySP& wks_uph, const DatasetID& did,
+  const std::string& dsnm, std::vector<ObjectID>& oids, Result& result) const
+{
+  // Dataset without update history has no changes
+  sql::IRowSetSP upd_rs;
+  if (SDK_FAILED(wks_uph->GetDatasetUpdateHistory(dsnm.c_str(), &upd_rs)) ||
+    !upd_rs)
+    return true;
+
+  // Updates issued since the date or numbered above the update number
+  const QString since_date = since.m_date.isValid() ?
+    since.m_date.toString("yyyyMMdd") : QString();
+  std::vector<SDKUInt32> updates;
+  if (SDK_OK(upd_rs->MoveFirst()))
+  {
+    do
+    {
+      ScopedAny updn;
+      if (SDK_FAILED(upd_rs->GetValue(kUPH_UPDN, updn)))
+      {
+        result.m_error = tr("Failed to get UPDN.");
+        return false;
+      }
+      updn.ChangeType(kSDKAnyType_Uint32);
+
+      if (since_date.isEmpty())
+      {
+        if (ANY_UI32(&updn) > since.m_updn)
+          updates.push_back(ANY_UI32(&updn));
+        continue;
+      }
+
+      // Without issue dates the date filter can not be applied, it is
+      // reported instead of finding no changes
+      ScopedAny isdt;
+      if (SDK_FAILED(upd_rs->GetValueByColumnName(kUpdateColumn_ISDT, isdt)) ||
+        !ANY_IS_STR(&isdt))
+      {
+        result.m_error = tr("Update history of %1 has no %2 column, changes "
+          "can not be found by date.").arg(QString::fromStdString(dsnm))
+          .arg(kUpdateColumn_ISDT);
+        return false;
+      }
+      if (QString::fromStdWString(isdt.GetAsWString()) >= since_date)
+        updates.push_back(ANY_UI32(&updn));
+    }
+    while (SDK_OK(upd_rs->MoveNext()));
+  }
+  if (updates.empty())
+    return true;
+
+  // Records are applied in order of updates, so a feature deleted by a
+  // later update is not marked
+  std::sort(updates.begin(), updates.end());
+  std::set<SDKUInt32> changed;
+  for (size_t u = 0; u < updates.size(); ++u)
+  {
+    sql::IRowSetSP rec_rs;
+    if (SDK_FAILED(wks_uph->GetDatasetUpdateRecords(dsnm.c_str(), updates[u],
+      &rec_rs)))
+    {
+      result.m_error = tr("Failed to get UPDN records.");
+      return false;
+    }
+    ++result.m_update_count;
+
+    if (!rec_rs || SDK_FAILED(rec_rs->MoveFirst()))
+      continue;
+    do
+    {
+      ScopedAny rind, ruin;
+      if (SDK_FAILED(rec_rs->GetValue(kUPH_REC_RIND, rind)) ||
+        SDK_FAILED(rec_rs->GetValue(kUPH_REC_RUIN, ruin)))
+      {
+        result.m_error = tr("Failed to get RIND or RUIN.");
+        return false;
+      }
+      rind.ChangeType(kSDKAnyType_Int32);
+      ruin.ChangeType(kSDKAnyType_Uint32);
+      if (ANY_I32(&rind) < 0)
+        continue; // Feature has been deleted since
+
+      const SDKUInt32 reference = static_cast<SDKUInt32>(ANY_I32(&rind));
+      if (ANY_UI32(&ruin) == kRUIN_Delete)
+        changed.erase(reference);
+      else
+        changed.insert(reference);
+    }
+    while (SDK_OK(rec_rs->MoveNext()));
+  }
+
+  for (std::set<SDKUInt32>::const_iterator it = changed.begin();
+    it != changed.end(); ++it)
+  {
+    ObjectID oid;
+    oid.did = did;
+    oid.oid = ObjectID_OID(senc::SECI_FEATS, *it);
+    oids.push_back(oid);
+  }
+  return true;
+}
@@ -0,0 +1,119 @@
+// changed_feature_collector.h : Collects features changed since an update and prepares their marks off the UI thread
+//
+#ifndef CHANGED_FEATURE_COLLECTOR_H
+#define CHANGED_FEATURE_COLLECTOR_H
+#pragma once
+
+#include <vector>
+#include <QObject>
+#include <QMutex>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QString>
+#include <QDate>
+
+#include <datalayer/inc/geodatabase/gdb_workspace.h>
+#include <datalayer/inc/geodatabase/gdb_update_history.h>
+#include <geometry/inc/coordinate_systems/crs_projection.h>
+#include "markedfeaturerenderer.h"
+
+// Finds features inserted or modified by the updates issued since a date,
+// or numbered above an update number, in all of datasets of the view. The
+// update records are read dataset by dataset, the geometries of the found
+// features are read and projected in parallel batches. Only the latest
+// request is delivered, superseded requests are dropped.
+class ChangedFeatureCollector : public QObject
+{
+  Q_OBJECT
+
+public:
+  // Updates, which changes are collected
+  struct Since
+  {
+    // Issue date is used if it is valid, otherwise the update number
+    QDate     m_date;
+    SDKUInt32 m_updn;
+  };
+
+  struct Request
+  {
+    Since                         m_since;
+    sdk::gdb::IWorkspaceFactorySP m_wks_factory;
+    // Geographic filter of the view, datasets intersecting it are used
+    sdk::geometry::IGeometrySP    m_geometry_filter;
+    sdk::crs::IProjectionSP       m_projection;
+  };
+
+  struct Result
+  {
+    std::vector<MarkedFeatureRenderer::PreparedMark> m_marks;
+    size_t  m_dataset_count;
+    size_t  m_update_count;
+    // Changed features, some of them may have no geometry
+    size_t  m_feature_count;
+    // Reading failed, marks found before the failure are delivered
+    QString m_error;
+  };
+
+  explicit ChangedFeatureCollector(const MarkedFeatureRendererSP& renderer,
+    QObject* parent = 0);
+  ~ChangedFeatureCollector();
+
+  // Queues the request, superseding all of previous requests
+  void Start(const Request& request);
+  // Drops all of pending requests
+  void Cancel();
+
+  // Takes the result of the latest request, returns false if there is no
+  // ready result
+  bool TakeResult(Result& result);
+
+signals:
+  // Emitted from worker thread when the latest request is done
+  void signalChangesReady();
+
+private:
+  class CollectTask;
+  class PrepareTask;
+  friend class CollectTask;
+  friend class PrepareTask;
+
+  // Called by worker tasks
+  void Collect(int sequence, const Request& request);
+  void Prepare(int sequence, const std::vector<sdk::gdb::ObjectID>& oids,
+    const sdk::crs::IProjectionSP& projection);
+
+  // Reads changed features of the datasets of the workspace in the view
+  bool CollectWorkspace(int sequence, const Request& request,
+    const sdk::gdb::IWorkspaceSP& wks,
+    const sdk::gdb::IWorkspaceUpdateHistorySP& wks_uph,
+    std::vector<sdk::gdb::ObjectID>& oids, Result& result) const;
+  // Reads changed features of the dataset, features deleted by a later
+  // update are dropped
+  bool CollectDataset(const Since& since,
+    const sdk::gdb::IWorkspaceUpdateHistorySP& wks_uph,
+    const sdk::gdb::DatasetID& did, const std::string& dsnm,
+    std::vector<sdk::gdb::ObjectID>& oids, Result& result) const;
+
+private:
+  // Renderer which prepares the geometries
+  const MarkedFeatureRendererSP m_renderer;
+
+  // Single collecting worker, so requests are processed in order
+  QThreadPool       m_collect_pool;
+  // Geometry batches are prepared in parallel
+  QThreadPool       m_prepare_pool;
+
+  // Sequence number of the latest request
+  QAtomicInt        m_sequence;
+
+  // Marks of the batches of the running request
+  QMutex            m_prepare_lock;
+  std::vector<MarkedFeatureRenderer::PreparedMark> m_prepared;
+
+  // Latest done request
+  QMutex            m_lock;
+  Result            m_result;
+  bool              m_has_result;
+};
+#endif // CHANGED_FEATURE_COLLECTOR_H
@@ -0,0 +1,316 @@
+// chart_directory_watcher.cpp : Opens chart folders added to or updated in the chart directory
+//
+#include <QRunnable>
+#include <QDir>
+#include <QFileInfo>
+#include <QDebug>
+
+#include "utils.h"
+#include "chart_directory_watcher.h"
+
+namespace
+{
+  // Time without reported changes before a folder is checked, ms
+  const int kSettleDelay = 2000;
+
+  // Root catalog file of a SENC geodatabase folder, it is rewritten when
+  // the geodatabase is updated
+  const char kRootCatalogFileName[] = "root.cat";
+}
+
+class ChartDirectoryWatcher::Task : public QRunnable
+{
+public:
+  // Stamps the existing folders, or checks the changed one
+  Task(ChartDirectoryWatcher* watcher, const QStringList& folders,
+    bool is_check)
+    : m_watcher(watcher),
+      m_folders(folders),
+      m_is_check(is_check),
+      m_entries()
+  {
+  }
+
+  // Opens the workspaces
+  Task(ChartDirectoryWatcher* watcher,
+    const std::vector<WorkspaceOpener::Entry>& entries)
+    : m_watcher(watcher),
+      m_folders(),
+      m_is_check(false),
+      m_entries(entries)
+  {
+  }
+
+  void run()
+  {
+    if (!m_entries.empty())
+    {
+      for (size_t i = 0; i < m_entries.size(); ++i)
+        m_watcher->OpenEntry(m_entries[i]);
+    }
+    else if (m_is_check)
+      m_watcher->Check(m_folders.front());
+    else
+      m_watcher->Stamp(m_folders);
+  }
+
+private:
+  ChartDirectoryWatcher* m_watcher;
+  QStringList            m_folders;
+  bool                   m_is_check;
+  std::vector<WorkspaceOpener::Entry> m_entries;
+};
+
+ChartDirectoryWatcher::ChartDirectoryWatcher(const QString& chart_directory,
+  const sdk::gdb::IWorkspaceFactorySP& wks_factory,
+  const RootCatalogCacheSP& root_catalog_cache,
+  const std::wstring& hw_id, const QString& permits_file_name, QObject* parent)
+  : QObject(parent),
+    m_chart_directory(QDir(chart_directory).absolutePath()),
+    m_wks_factory(wks_factory),
+    m_root_catalog_cache(root_catalog_cache),
+    m_hw_id(hw_id),
+    m_permits_file_name(permits_file_name),
+    m_watcher(),
+    m_open_folders(),
+    m_pending(),
+    m_settle_timer(),
+    m_clock(),
+    m_pool(),
+    m_is_stopped(0),
+    m_opened_stamps(),
+    m_checked_stamps(),
+    m_lock(),
+    m_opened()
+{
+  m_pool.setMaxThreadCount(1);
+  m_clock.start();
+
+  m_settle_timer.setSingleShot(true);
+  connect(&m_settle_timer, SIGNAL(timeout()), this, SLOT(OnSettleTimeout()));
+  connect(&m_watcher, SIGNAL(directoryChanged(const QString&)),
+    this, SLOT(OnDirectoryChanged(const QString&)));
+  connect(&m_watcher, SIGNAL(fileChanged(const QString&)),
+    this, SLOT(OnFileChanged(const QString&)));
+  connect(this, SIGNAL(signalFolderChanging(QString)),
+    this, SLOT(OnFolderChanging(QString)), Qt::QueuedConnection);
+}
+
+ChartDirectoryWatcher::~ChartDirectoryWatcher()
+{
+  m_is_stopped.fetchAndStoreOrdered(1);
+  m_pool.waitForDone();
+}
+
+void ChartDirectoryWatcher::Start()
+{
+  if (!QFileInfo(m_chart_directory).isDir())
+    return;
+
+  m_watcher.addPath(m_chart_directory);
+
+  // Folders opened at startup are only stamped
+  QStringList folders = WatchFolders();
+  for (int i = 0; i < m_open_folders.size(); ++i)
+    folders.removeAll(m_open_folders.at(i));
+  if (!folders.isEmpty())
+    m_pool.start(new Task(this, folders, false));
+}
+
+void ChartDirectoryWatcher::Open(
+  const std::vector<WorkspaceOpener::Entry>& entries)
+{
+  if (entries.empty())
+    return;
+
+  for (size_t i = 0; i < entries.size(); ++i)
+    m_open_folders <<
+      QDir(QString::fromStdWString(entries[i].m_wks_path)).absolutePath();
+  m_pool.start(new Task(this, entries));
+}
+
+void ChartDirectoryWatcher::TakeOpened(
+  std::vector<WorkspaceOpener::Entry>& entries)
+{
+  QMutexLocker lock(&m_lock);
+  entries.swap(m_opened);
+  m_opened.clear();
+}
+
+void ChartDirectoryWatcher::OnDirectoryChanged(const QString& path)
+{
+  if (path != m_chart_directory)
+  {
+    // Files of the chart folder are added or removed, root catalog may
+    // have been written meanwhile
+    const QString root_cat_file = QDir(path).filePath(kRootCatalogFileName);
+    if (QFileInfo(root_cat_file).isFile() &&
+      !m_watcher.files().contains(root_cat_file))
+      m_watcher.addPath(root_cat_file);
+    AddPending(path);
+    return;
+  }
+
+  // New folders in the chart directory
+  const QStringList folders = WatchFolders();
+  for (int i = 0; i < folders.size(); ++i)
+    AddPending(folders.at(i));
+}
+
+void ChartDirectoryWatcher::OnFileChanged(const QString& path)
+{
+  // Root catalog of the folder is changed
+  const QFileInfo info(path);
+  AddPending(info.absolutePath());
+
+  // Replaced file is not watched any more
+  if (info.isFile() && !m_watcher.files().contains(path))
+    m_watcher.addPath(path);
+}
+
+void ChartDirectoryWatcher::OnFolderChanging(QString folder)
+{
+  AddPending(folder);
+}
+
+void ChartDirectoryWatcher::OnSettleTimeout()
+{
+  // Folders without changes for the delay are checked
+  const qint64 now = m_clock.elapsed();
+  qint64 next_check = -1;
+  for (std::map<QString, qint64>::iterator it = m_pending.begin();
+    it != m_pending.end(); )
+  {
+    const qint64 check_time = it->second + kSettleDelay;
+    if (check_time > now)
+    {
+      if (next_check < 0 || check_time < next_check)
+        next_check = check_time;
+      ++it;
+      continue;
+    }
+    m_pool.start(new Task(this, QStringList() << it->first, true));
+    m_pending.erase(it++);
+  }
+
+  if (next_check >= 0)
+    m_settle_timer.start(static_cast<int>(next_check - now));
+}
+
+void ChartDirectoryWatcher::Stamp(const QStringList& folders)
+{
+  for (int i = 0; i < folders.size(); ++i)
+  {
+    if (m_is_stopped)
+      return;
+    const UpdateHistorySummary::Stamp stamp =
+      UpdateHistorySummary::ReadStamp(folders.at(i));
+    m_opened_stamps[folders.at(i)] = stamp;
+    m_checked_stamps[folders.at(i)] = stamp;
+  }
+}
+
+void ChartDirectoryWatcher::Check(const QString& folder)
+{
+  if (m_is_stopped)
+    return;
+  if (!QFileInfo(folder).isDir())
+    return; // Removed meanwhile
+
+  // Files, which are still being written, are checked again later
+  const UpdateHistorySummary::Stamp stamp =
+    UpdateHistorySummary::ReadStamp(folder);
+  std::map<QString, UpdateHistorySummary::Stamp>::iterator checked_it =
+    m_checked_stamps.find(folder);
+  if (checked_it == m_checked_stamps.end() || !(checked_it->second == stamp))
+  {
+    m_checked_stamps[folder] = stamp;
+    emit signalFolderChanging(folder);
+    return;
+  }
+
+  // Changes of files, which are not a part of the workspace, are ignored
+  std::map<QString, UpdateHistorySummary::Stamp>::iterator opened_it =
+    m_opened_stamps.find(folder);
+  const bool is_reopened = opened_it != m_opened_stamps.end();
+  if (is_reopened && opened_it->second == stamp)
+    return;
+  m_opened_stamps[folder] = stamp;
+
+  WorkspaceOpener::Entry entry;
+  entry.m_wks_path = folder.toStdWString();
+  entry.m_hw_id = m_hw_id;
+  entry.m_permits_path =
+    QDir(folder).filePath(m_permits_file_name).toStdWString();
+  entry.m_open_time = 0;
+  if (!WorkspaceOpener::OpenEntry(m_wks_factory, m_root_catalog_cache, entry))
+  {
+    qWarning() << "Chart folder" << folder << "failed to open";
+    return;
+  }
+
+  if (IsTimingLogEnabled())
+    qDebug() << "Chart folder" << folder
+      << (is_reopened ? "reopened in" : "opened in") << entry.m_open_time << "ms";
+  AddOpened(entry);
+}
+
+void ChartDirectoryWatcher::OpenEntry(WorkspaceOpener::Entry& entry)
+{
+  if (m_is_stopped)
+    return;
+
+  const QString folder = QString::fromStdWString(entry.m_wks_path);
+  if (!WorkspaceOpener::OpenEntry(m_wks_factory, m_root_catalog_cache, entry))
+  {
+    qWarning() << "Failed to open workspace" << folder;
+    return;
+  }
+
+  // Later changes of the folder are compared with the opened one
+  const UpdateHistorySummary::Stamp stamp =
+    UpdateHistorySummary::ReadStamp(folder);
+  m_opened_stamps[folder] = stamp;
+  m_checked_stamps[folder] = stamp;
+  AddOpened(entry);
+}
+
+QStringList ChartDirectoryWatcher::WatchFolders()
+{
+  const QStringList watched = m_watcher.directories();
+
+  QStringList folders;
+  QDir dir(m_chart_directory);
+  dir.setFilter(QDir::AllDirs | QDir::NoDotAndDotDot);
+  dir.setSorting(QDir::Name);
+  const QFileInfoList list = dir.entryInfoList();
+  for (int i = 0; i < list.size(); ++i)
+  {
+    const QString folder = list.at(i).absoluteFilePath();
+    if (watched.contains(folder))
+      continue;
+
+    m_watcher.addPath(folder);
+    const QString root_cat_file = QDir(folder).filePath(kRootCatalogFileName);
+    if (QFileInfo(root_cat_file).isFile())
+      m_watcher.addPath(root_cat_file);
+    folders << folder;
+  }
+  return folders;
+}
+
+void ChartDirectoryWatcher::AddOpened(const WorkspaceOpener::Entry& entry)
+{
+  {
+    QMutexLocker lock(&m_lock);
+    m_opened.push_back(entry);
+  }
+  emit signalWorkspaceOpened();
+}
+
+void ChartDirectoryWatcher::AddPending(const QString& folder)
+{
+  m_pending[folder] = m_clock.elapsed();
+  if (!m_settle_timer.isActive())
+    m_settle_timer.start(kSettleDelay);
+}
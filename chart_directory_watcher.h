@@ -0,0 +1,111 @@
+// chart_directory_watcher.h : Opens chart folders added to or updated in the chart directory
+//
+#ifndef CHART_DIRECTORY_WATCHER_H
+#define CHART_DIRECTORY_WATCHER_H
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include <QObject>
+#include <QMutex>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QFileSystemWatcher>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QStringList>
+
+#include "workspace_opener.h"
+#include "update_history_summary.h"
+
+// Watches the chart directory and its chart folders. A folder, which has
+// been added or changed, is checked when no change has been reported for
+// the settle delay. It is opened when its files are the same on two checks
+// in a row and differ from the ones of its last opening. Checking and
+// opening are done on a worker thread, opened workspaces are taken by the
+// UI thread. Workspaces, which have not been opened at startup, may be
+// opened in background by the same worker.
+class ChartDirectoryWatcher : public QObject
+{
+  Q_OBJECT
+
+public:
+  ChartDirectoryWatcher(const QString& chart_directory,
+    const sdk::gdb::IWorkspaceFactorySP& wks_factory,
+    const RootCatalogCacheSP& root_catalog_cache,
+    const std::wstring& hw_id, const QString& permits_file_name,
+    QObject* parent = 0);
+  ~ChartDirectoryWatcher();
+
+  // Starts watching, the existing folders are taken as opened already,
+  // except the ones given to Open
+  void Start();
+  // Opens the workspaces one by one in the given order after the pending
+  // tasks, each of them is taken as soon as it is opened. Called before
+  // Start, the workspaces are opened before the other folders are stamped.
+  void Open(const std::vector<WorkspaceOpener::Entry>& entries);
+
+  // Takes the workspaces opened since the last call
+  void TakeOpened(std::vector<WorkspaceOpener::Entry>& entries);
+
+signals:
+  // Emitted from worker thread when a workspace has been opened
+  void signalWorkspaceOpened();
+  // Emitted from worker thread when the folder is still being written
+  void signalFolderChanging(QString folder);
+
+private slots:
+  void OnDirectoryChanged(const QString& path);
+  void OnFileChanged(const QString& path);
+  void OnFolderChanging(QString folder);
+  void OnSettleTimeout();
+
+private:
+  class Task;
+  friend class Task;
+
+  // Called by worker task
+  void Stamp(const QStringList& folders);
+  void Check(const QString& folder);
+  void OpenEntry(WorkspaceOpener::Entry& entry);
+
+  // Watches the chart folders, which are not watched yet, and returns them
+  QStringList WatchFolders();
+  // Remembers the change of the folder, it is checked after the delay
+  void AddPending(const QString& folder);
+  // Passes the opened workspace to the UI thread
+  void AddOpened(const WorkspaceOpener::Entry& entry);
+
+private:
+  const QString                       m_chart_directory;
+  const sdk::gdb::IWorkspaceFactorySP m_wks_factory;
+  const RootCatalogCacheSP            m_root_catalog_cache;
+  // Used if the database is encrypted, permits file is in the folder
+  const std::wstring                  m_hw_id;
+  const QString                       m_permits_file_name;
+
+  QFileSystemWatcher                  m_watcher;
+
+  // Folders given to Open, they are stamped when opened, used by UI
+  // thread only
+  QStringList                         m_open_folders;
+  // Changed folders by time of the last change, used by UI thread only
+  std::map<QString, qint64>           m_pending;
+  QTimer                              m_settle_timer;
+  QElapsedTimer                       m_clock;
+
+  // Single worker, folders are checked and opened one by one
+  QThreadPool                         m_pool;
+  // Set when the watcher is destroyed, queued tasks do nothing
+  QAtomicInt                          m_is_stopped;
+  // Files of folders at the last opening and the last check, used by
+  // worker thread only
+  std::map<QString, UpdateHistorySummary::Stamp> m_opened_stamps;
+  std::map<QString, UpdateHistorySummary::Stamp> m_checked_stamps;
+
+  // Workspaces opened, but not taken yet
+  QMutex                              m_lock;
+  std::vector<WorkspaceOpener::Entry> m_opened;
+};
+#endif // CHART_DIRECTORY_WATCHER_H
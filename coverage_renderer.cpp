@@ -32,6 +32,8 @@ CoverageRenderer::CoverageRenderer(
   const S52ResourceManagerSP& s52_res_manager,
   const IWorkspaceFactorySP& wks_factory)
   : m_s52_resource_manager(s52_res_manager),
+    m_resource_owner(s52_res_manager ?
+      s52_res_manager->CreateResourceOwner() : 0),
     m_wks_factory(wks_factory),
     m_ref(0),
     m_render_target(),
@@ -44,6 +46,8 @@ CoverageRenderer::CoverageRenderer(
 
 CoverageRenderer::~CoverageRenderer()
 {
+  if (m_s52_resource_manager)
+    m_s52_resource_manager->ReleaseResources(m_resource_owner);
 }
 
 SDKUInt32 CoverageRenderer::AddRef() const throw()
@@ -109,9 +113,10 @@ SDKResult CoverageRenderer::SetContext(
   if (SDK_FAILED(res) || !m_render_target)
     return Err_InternalError;
 
-  // Creating render target stroke style to draw bounds
-  if (SDK_FAILED(m_render_target->CreateStrokeStyle(gfx::StrokeStyleOptions(),
-    0, 0, m_stroke)) || !m_stroke)
+  // Getting render target stroke style to draw bounds
+  if (!m_s52_resource_manager ||
+    !m_s52_resource_manager->GetStrokeStyle(m_resource_owner, m_render_target,
+      m_stroke))
     return Err_InternalError;
 
   return Ok;
@@ -152,10 +157,10 @@ SDKResult CoverageRenderer::Render(
   // Filling up background with transparent color
   m_render_target->FillBackground(ColorF(0.0f, 0.0f, 0.0f, 0.0f));
 
-  // Creating brush for drawing boundaries
+  // Getting brush for drawing boundaries
   gfx::RenderTargetBrushSP brush;
-  if (SDK_FAILED(m_render_target->CreateSolidColorBrush(
-    m_s52_resource_manager->GetColor(s52::kColorIndex_NINFO), brush)) || !brush)
+  if (!m_s52_resource_manager->GetSolidBrush(m_resource_owner, m_render_target,
+    s52::kColorIndex_NINFO, 1.0f, brush))
     return Err_InternalError;
 
   // Iterate all coverage one by one and draw them
@@ -2,10 +2,12 @@
 #define DATABASEUPDATEHISTORYDLG_H
 
 #include <QDialog>
-#include <QTreeWidgetItem>
+#include <QModelIndex>
 
 #include <datalayer/inc/geodatabase/gdb_workspace.h>
 #include "mark_unmark_feature_interface.h"
+#include "catalog_label_cache.h"
+#include "update_history_model.h"
 
 namespace Ui { class DatabaseUpdateHistoryDlg; }
 
@@ -16,6 +18,8 @@ class DatabaseUpdateHistoryDlg : public QDialog
 public:
   explicit DatabaseUpdateHistoryDlg(MarkUnmarkFeature* mark_unmark_feature,
     const sdk::gdb::IWorkspaceFactorySP& wks_factory,
+    const CatalogLabelCacheSP& label_cache,
+    const UpdateHistorySummaryBuilder* summaries,
     QWidget *parent = 0);
   ~DatabaseUpdateHistoryDlg();
   
@@ -23,8 +27,9 @@ public:
   void FillUpUpdateHistory();
 
 private slots:
-  void on_tree_itemExpanded(QTreeWidgetItem *item);
+  void OnTreeCollapsed(const QModelIndex& index);
   void OnHighlightFeature();
+  void OnHighlightChanges();
   void OnClearHighlight();
 
 private:
@@ -34,6 +39,9 @@ private:
   // Workspace factory
   const sdk::gdb::IWorkspaceFactorySP m_wks_factory;
 
+  // Update history read in background on expansion
+  UpdateHistoryModel*                 m_model;
+
   // Mark/unmark feature object interface
   MarkUnmarkFeature*                  m_mark_unmark_feature;
 };
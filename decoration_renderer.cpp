@@ -14,6 +14,8 @@ DecorationRenderer::DecorationRenderer(const S52ResourceManagerSP& s52_res_manag
     kFontSize(18.0f),
     kTextColor(0.0f, 0.0f, 0.0f, 1.0f),
     m_s52_resource_manager(s52_res_manager),
+    m_resource_owner(s52_res_manager ?
+      s52_res_manager->CreateResourceOwner() : 0),
     m_ref(0),
     m_text(),
     m_render_target(),
@@ -23,6 +25,8 @@ DecorationRenderer::DecorationRenderer(const S52ResourceManagerSP& s52_res_manag
 
 DecorationRenderer::~DecorationRenderer()
 {
+  if (m_s52_resource_manager)
+    m_s52_resource_manager->ReleaseResources(m_resource_owner);
 }
 
 SDKUInt32 DecorationRenderer::AddRef() const throw()
@@ -119,11 +123,10 @@ SDKResult DecorationRenderer::Render(
   // Filling up the background with transparent color
   m_render_target->FillBackground(sdk::ColorF(0.0f, 0.0f, 0.0f, 0.0f));
 
-  // Creating a brush to use for drawing
+  // Getting a brush to use for drawing
   sdk::gfx::RenderTargetBrushSP brush;
-  if (SDK_FAILED(m_render_target->CreateSolidColorBrush(
-    m_s52_resource_manager->GetColor(sdk::vis::s52::kColorIndex_CHBLK), brush))
-    || !brush)
+  if (!m_s52_resource_manager->GetSolidBrush(m_resource_owner, m_render_target,
+    sdk::vis::s52::kColorIndex_CHBLK, 1.0f, brush))
     return sdk::Err_InternalError;
 
   // Writing each of texts now
@@ -55,6 +55,8 @@ private:
 
   // S-52 resource manager
   const S52ResourceManagerSP      m_s52_resource_manager;
+  // Owner of resources cached by the manager for this renderer
+  const S52ResourceManager::ResourceOwnerID m_resource_owner;
 
   // Number of references
   mutable SDKUInt32               m_ref;
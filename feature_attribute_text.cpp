@@ -0,0 +1,160 @@
+// feature_attribute_text.cpp : Decodes feature attribute values to text
+//
+#include <sstream>
+#include <vector>
+
+#include <base/inc/sdk_any_handler.h>
+#include <base/inc/sdk_string_handler.h>
+#include <base/inc/sdk_results_enum.h>
+#include <datalayer/inc/geodatabase/gdb_const.h>
+#include "feature_attribute_text.h"
+
+namespace
+{
+  // Writes the value as the feature info dialog shows it
+  void WriteValue(const sdk::gdb::IAttributeSP& attr, sdk::ScopedAny& v,
+    sdk::gdb::ClassCode attr_class_code, const CatalogLabelsSP& labels,
+    std::wostringstream& attr_s)
+  {
+    std::wstring label;
+    switch(ANY_TYPE(&v))
+    {
+    case   kSDKAnyType_Null:
+      attr_s << "Undefined";
+      break;
+    case   kSDKAnyType_SDKTime:
+      {
+        SDKUInt64 flags;
+        attr->GetFlags(flags);
+
+        SDKTimeStruct exploaded;
+        if (SDK_OK(SDKTimeToSDKTimeStruct(ANY_TIME(&v), exploaded)))
+        {
+          if (flags & sdk::gdb::kDTF_VALID_DAY)
+            attr_s <<  exploaded.mday << ".";
+          else
+            attr_s <<  "-.";
+
+          if (flags & sdk::gdb::kDTF_VALID_MONTH)
+            attr_s << exploaded.month << ".";
+          else
+            attr_s <<  "-.";
+
+          if (flags & sdk::gdb::kDTF_VALID_YEAR)
+            attr_s << exploaded.year << ";";
+          else
+            attr_s <<  "-;";
+
+          if (flags & sdk::gdb::kDTF_VALID_HOUR)
+            attr_s << exploaded.hour << ":";
+          else
+            attr_s <<  "-:";
+
+          if (flags & sdk::gdb::kDTF_VALID_MINUTE)
+            attr_s << exploaded.minute << ":";
+          else
+            attr_s <<  "-:";
+
+          if (flags & sdk::gdb::kDTF_VALID_SECOND)
+            attr_s << exploaded.second;
+          else
+            attr_s <<  "-";
+        }
+      }
+      break;
+    case kSDKAnyType_SDKStringPtr:
+      attr_s << sdk::WideFromSDKString(*ANY_STR(&v));
+      break;
+    case kSDKAnyType_Uint8:
+    case kSDKAnyType_Uint16:
+    case kSDKAnyType_Uint32:
+    case kSDKAnyType_Uint64:
+      {
+        v.ChangeType(kSDKAnyType_Uint64);
+        if (labels && labels->GetListedValueLabel(attr_class_code, ANY_UI64(&v), label))
+          attr_s << label;
+        else
+          attr_s << ANY_UI64(&v);
+      }
+      break;
+    case kSDKAnyType_Int8:
+    case kSDKAnyType_Int16:
+    case kSDKAnyType_Int32:
+    case kSDKAnyType_Int64:
+      v.ChangeType(kSDKAnyType_Int64);
+      attr_s << ANY_I64(&v);
+      break;
+    case kSDKAnyType_Float:
+      attr_s << ANY_FLOAT(&v);
+      break;
+    case kSDKAnyType_Double:
+      attr_s << ANY_DOUBLE(&v);
+      break;
+    case kSDKAnyType_SDKArrayPtr:
+      {
+        sdk::ScopedArray arr(*ANY_ARRAY(&v));
+        v.Detach();
+
+        std::vector<SDKUInt32> values;
+        SDKUInt8* ptr = arr.GetBuffer();
+
+        switch(arr.GetType())
+        {
+          case kSDKAnyType_Uint8:
+            values.insert(values.begin(), reinterpret_cast<SDKUInt8*>(ptr),
+              reinterpret_cast<SDKUInt8*>(ptr) + arr.GetElementsCount());
+            break;
+          case kSDKAnyType_Uint16:
+            values.insert(values.begin(), reinterpret_cast<SDKUInt16*>(ptr),
+              reinterpret_cast<SDKUInt16*>(ptr) + arr.GetElementsCount());
+            break;
+        }
+
+        for (std::vector<SDKUInt32>::iterator it = values.begin();
+          it != values.end(); ++it)
+        {
+          if (it != values.begin())
+            attr_s << L", ";
+
+          if (labels && labels->GetListedValueLabel(attr_class_code, *it, label))
+            attr_s << label;
+          else
+            attr_s << *it;
+        }
+      }
+      break;
+    }
+  }
+}
+
+bool DecodeAttribute(const sdk::gdb::IAttributeSP& attr,
+  const CatalogLabelsSP& labels, AttributeText& text)
+{
+  text.m_name.clear();
+  text.m_value.clear();
+
+  if (SDK_FAILED(attr->GetAttributeClassCode(text.m_class_code)))
+    return false;
+
+  std::wstring label;
+  if (labels && labels->GetClassName(sdk::gdb::kClassType_AttributeClass,
+    text.m_class_code, label))
+  {
+    text.m_name = label;
+  }
+  else
+  {
+    std::wostringstream name_s;
+    name_s << text.m_class_code;
+    text.m_name = name_s.str();
+  }
+
+  sdk::ScopedAny v;
+  if (SDK_OK(attr->GetValue(v)))
+  {
+    std::wostringstream attr_s;
+    WriteValue(attr, v, text.m_class_code, labels, attr_s);
+    text.m_value = attr_s.str();
+  }
+  return true;
+}
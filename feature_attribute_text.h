@@ -0,0 +1,28 @@
+// feature_attribute_text.h : Decodes feature attribute values to text
+//
+#ifndef FEATURE_ATTRIBUTE_TEXT_H
+#define FEATURE_ATTRIBUTE_TEXT_H
+#pragma once
+
+#include <string>
+
+#include <datalayer/inc/geodatabase/gdb_workspace.h>
+#include "catalog_label_cache.h"
+
+// Attribute name and value as text
+struct AttributeText
+{
+  sdk::gdb::ClassCode m_class_code;
+  // Attribute class name, or its code if the catalog has no name
+  std::wstring        m_name;
+  // Enumeration values are given by their labels, list values are separated
+  // by commas, empty if the value cannot be read
+  std::wstring        m_value;
+};
+
+// Decodes the attribute, labels may be empty. Returns false if the
+// attribute class code cannot be read.
+bool DecodeAttribute(const sdk::gdb::IAttributeSP& attr,
+  const CatalogLabelsSP& labels, AttributeText& text);
+
+#endif // FEATURE_ATTRIBUTE_TEXT_H
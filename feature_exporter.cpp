@@ -0,0 +1,683 @@
+// feature_exporter.cpp : Streams features of a chart area into a file
+//
+#include <algorithm>
+
+#include <QRunnable>
+#include <QThread>
+#include <QMutexLocker>
+#include <QDataStream>
+#include <QFileInfo>
+#include <QDebug>
+
+#include <base/inc/sdk_results_enum.h>
+#include <base/inc/geometry/geometry_base_types_helpers.h>
+#include "utils.h"
+#include "feature_attribute_text.h"
+#include "markedfeaturerenderer.h"
+#include "feature_exporter.h"
+
+namespace
+{
+  // Features read into one chunk
+  const size_t kChunkFeatures = 512;
+  // Chunks being encoded or waiting for writing at once
+  const int kMaxChunks = 8;
+  // Cancellation is checked while waiting for a free chunk
+  const int kChunkWaitTimeout = 100; // ms
+  // Progress is reported at most this often
+  const qint64 kProgressInterval = 250; // ms
+
+  const char kBinaryMagic[] = "SKMF";
+  const quint16 kBinaryVersion = 1;
+  // Attribute value length is stored in 16 bits
+  const int kMaxBinaryValueSize = 0xFFFF;
+
+  // UTF-8 text cut to the size at a character boundary
+  QByteArray TruncateUtf8(const QByteArray& text, int size)
+  {
+    if (text.size() <= size)
+      return text;
+    // Continuation bytes are 10xxxxxx, the cut is moved before them
+    while (size > 0 && (static_cast<uchar>(text.at(size)) & 0xC0) == 0x80)
+      --size;
+    return text.left(size);
+  }
+
+  // Geometry kinds of the binary format
+  enum GeometryKind
+  {
+    kGeometry_None = 0,
+    kGeometry_Point,
+    kGeometry_MultiPoint,
+    kGeometry_Line,
+    kGeometry_Polygon
+  };
+
+  // Exported feature before encoding
+  struct FeatureRecord
+  {
+    sdk::gdb::ObjectID            oid;
+    sdk::gdb::ClassCode           class_code;
+    QString                       class_name;
+    GeometryKind                  geometry_kind;
+    std::vector<sdk::GeoIntPoint> points;
+    std::vector<AttributeText>    attributes;
+  };
+
+  GeometryKind GetGeometryKind(const sdk::geometry::IGeometrySP& geometry)
+  {
+    sdk::geometry::GeometryType geometry_type;
+    if (SDK_FAILED(geometry->GetGeometryType(geometry_type)))
+      return kGeometry_None;
+
+    switch (geometry_type)
+    {
+    case sdk::geometry::kGMT_Point:
+      return kGeometry_Point;
+    case sdk::geometry::kGMT_Multipoint:
+      return kGeometry_MultiPoint;
+    case sdk::geometry::kGMT_Curve:
+    case sdk::geometry::kGMT_CompositeCurve:
+    case sdk::geometry::kGMT_MultiCurve:
+    case sdk::geometry::kGMT_MultiCompositeCurve:
+      return kGeometry_Line;
+    case sdk::geometry::kGMT_Surface:
+      return kGeometry_Polygon;
+    default:
+      return kGeometry_None;
+    }
+  }
+
+  QByteArray FormatOID(const sdk::gdb::ObjectID& oid)
+  {
+    return QByteArray::number(DatasetID_WorkspaceID(oid.did)) + '.' +
+      QByteArray::number(DatasetID_DatasetID(oid.did)) + '.' +
+      QByteArray::number(ObjectID_Section(oid)) + '.' +
+      QByteArray::number(ObjectID_Record(oid));
+  }
+
+  // Longitude and latitude in degrees separated by the separator
+  void AppendCoords(const sdk::GeoIntPoint& point, char separator, QByteArray& data)
+  {
+    data += QByteArray::number(sdk::DegFromGeoInt(point.x), 'f', 7);
+    data += separator;
+    data += QByteArray::number(sdk::DegFromGeoInt(point.y), 'f', 7);
+  }
+
+  // Polygon rings are closed in text formats
+  bool IsRingOpen(const FeatureRecord& record)
+  {
+    return record.geometry_kind == kGeometry_Polygon && !record.points.empty() &&
+      (record.points.front().x != record.points.back().x ||
+      record.points.front().y != record.points.back().y);
+  }
+
+  QByteArray QuoteCsv(const QString& text)
+  {
+    QByteArray quoted = text.toUtf8();
+    quoted.replace("\"", "\"\"");
+    return '"' + quoted + '"';
+  }
+
+  QByteArray QuoteJson(const QString& text)
+  {
+    QByteArray quoted("\"");
+    const QByteArray utf8 = text.toUtf8();
+    for (int i = 0; i < utf8.size(); ++i)
+    {
+      const char c = utf8.at(i);
+      switch (c)
+      {
+      case '"':  quoted += "\\\""; break;
+      case '\\': quoted += "\\\\"; break;
+      case '\n': quoted += "\\n"; break;
+      case '\r': quoted += "\\r"; break;
+      case '\t': quoted += "\\t"; break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20)
+          quoted += QString("\\u%1").arg(static_cast<int>(c), 4, 16,
+            QChar('0')).toLatin1();
+        else
+          quoted += c;
+      }
+    }
+    quoted += '"';
+    return quoted;
+  }
+
+  // oid,class,wkt,attributes
+  void EncodeCsv(const FeatureRecord& record, QByteArray& data)
+  {
+    data += FormatOID(record.oid);
+    data += ',';
+    data += QuoteCsv(record.class_name);
+    data += ',';
+
+    QByteArray wkt;
+    if (!record.points.empty())
+    {
+      switch (record.geometry_kind)
+      {
+      case kGeometry_Point:      wkt = "POINT("; break;
+      case kGeometry_MultiPoint: wkt = "MULTIPOINT("; break;
+      case kGeometry_Line:       wkt = "LINESTRING("; break;
+      case kGeometry_Polygon:    wkt = "POLYGON(("; break;
+      default: break;
+      }
+    }
+    if (!wkt.isEmpty())
+    {
+      for (size_t i = 0; i < record.points.size(); ++i)
+      {
+        if (i)
+          wkt += ',';
+        AppendCoords(record.points[i], ' ', wkt);
+      }
+      if (IsRingOpen(record))
+      {
+        wkt += ',';
+        AppendCoords(record.points.front(), ' ', wkt);
+      }
+      wkt += record.geometry_kind == kGeometry_Polygon ? "))" : ")";
+    }
+    data += QuoteCsv(QString::fromLatin1(wkt));
+    data += ',';
+
+    QString attributes;
+    for (size_t i = 0; i < record.attributes.size(); ++i)
+    {
+      if (i)
+        attributes += ';';
+      attributes += QString::fromStdWString(record.attributes[i].m_name) + '=' +
+        QString::fromStdWString(record.attributes[i].m_value);
+    }
+    data += QuoteCsv(attributes);
+    data += '\n';
+  }
+
+  // One feature of the FeatureCollection
+  void EncodeGeoJson(const FeatureRecord& record, QByteArray& data)
+  {
+    data += "{\"type\":\"Feature\",\"id\":\"";
+    data += FormatOID(record.oid);
+    data += "\",\"geometry\":";
+
+    const char* type = NULL;
+    if (!record.points.empty())
+    {
+      switch (record.geometry_kind)
+      {
+      case kGeometry_Point:      type = "Point"; break;
+      case kGeometry_MultiPoint: type = "MultiPoint"; break;
+      case kGeometry_Line:       type = "LineString"; break;
+      case kGeometry_Polygon:    type = "Polygon"; break;
+      default: break;
+      }
+    }
+    if (!type)
+      data += "null";
+    else
+    {
+      data += "{\"type\":\"";
+      data += type;
+      data += "\",\"coordinates\":";
+      if (record.geometry_kind == kGeometry_Point)
+      {
+        data += '[';
+        AppendCoords(record.points.front(), ',', data);
+        data += ']';
+      }
+      else
+      {
+        data += record.geometry_kind == kGeometry_Polygon ? "[[" : "[";
+        for (size_t i = 0; i < record.points.size(); ++i)
+        {
+          data += i ? ",[" : "[";
+          AppendCoords(record.points[i], ',', data);
+          data += ']';
+        }
+        if (IsRingOpen(record))
+        {
+          data += ",[";
+          AppendCoords(record.points.front(), ',', data);
+          data += ']';
+        }
+        data += record.geometry_kind == kGeometry_Polygon ? "]]" : "]";
+      }
+      data += '}';
+    }
+
+    data += ",\"properties\":{\"class\":";
+    data += QuoteJson(record.class_name);
+    for (size_t i = 0; i < record.attributes.size(); ++i)
+    {
+      data += ',';
+      data += QuoteJson(QString::fromStdWString(record.attributes[i].m_name));
+      data += ':';
+      data += QuoteJson(QString::fromStdWString(record.attributes[i].m_value));
+    }
+    data += "}}";
+  }
+
+  // Length prefixed record, see the format in the header
+  void EncodeBinary(const FeatureRecord& record, QByteArray& data)
+  {
+    QByteArray body;
+    {
+      QDataStream stream(&body, QIODevice::WriteOnly);
+      stream.setByteOrder(QDataStream::LittleEndian);
+      stream << static_cast<quint32>(DatasetID_WorkspaceID(record.oid.did))
+        << static_cast<quint32>(DatasetID_DatasetID(record.oid.did))
+        << static_cast<quint32>(ObjectID_Section(record.oid))
+        << static_cast<quint32>(ObjectID_Record(record.oid))
+        << static_cast<quint32>(record.class_code)
+        << static_cast<quint8>(record.geometry_kind)
+        << static_cast<quint32>(record.points.size());
+      for (size_t i = 0; i < record.points.size(); ++i)
+        stream << static_cast<qint32>(record.points[i].x)
+          << static_cast<qint32>(record.points[i].y);
+
+      stream << static_cast<quint16>(record.attributes.size());
+      for (size_t i = 0; i < record.attributes.size(); ++i)
+      {
+        const QByteArray value = TruncateUtf8(
+          QString::fromStdWString(record.attributes[i].m_value).toUtf8(),
+          kMaxBinaryValueSize);
+        stream << static_cast<quint32>(record.attributes[i].m_class_code)
+          << static_cast<quint16>(value.size());
+        stream.writeRawData(value.constData(), value.size());
+      }
+    }
+
+    QDataStream stream(&data, QIODevice::WriteOnly | QIODevice::Append);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << static_cast<quint32>(body.size());
+    stream.writeRawData(body.constData(), body.size());
+  }
+}
+
+class FeatureExporter::ReadTask : public QRunnable
+{
+public:
+  ReadTask(FeatureExporter* exporter, const Request& request)
+    : m_exporter(exporter),
+      m_request(request)
+  {
+  }
+
+  void run()
+  {
+    m_exporter->Read(m_request);
+  }
+
+private:
+  FeatureExporter* m_exporter;
+  Request          m_request;
+};
+
+class FeatureExporter::EncodeTask : public QRunnable
+{
+public:
+  EncodeTask(FeatureExporter* exporter, int index,
+    const std::vector<sdk::gdb::IFeatureSP>& features)
+    : m_exporter(exporter),
+      m_index(index),
+      m_features(features)
+  {
+  }
+
+  void run()
+  {
+    m_exporter->Encode(m_index, m_features);
+  }
+
+private:
+  FeatureExporter*                  m_exporter;
+  int                               m_index;
+  std::vector<sdk::gdb::IFeatureSP> m_features;
+};
+
+class FeatureExporter::WriteTask : public QRunnable
+{
+public:
+  explicit WriteTask(FeatureExporter* exporter)
+    : m_exporter(exporter)
+  {
+  }
+
+  void run()
+  {
+    m_exporter->Write();
+  }
+
+private:
+  FeatureExporter* m_exporter;
+};
+
+FeatureExporter::FeatureExporter(const CatalogLabelCacheSP& label_cache,
+  QObject* parent)
+  : QObject(parent),
+    m_label_cache(label_cache),
+    m_pool(),
+    m_encode_pool(),
+    m_free_chunks(kMaxChunks),
+    m_is_cancelled(0),
+    m_is_running(0),
+    m_file(),
+    m_format(kFormat_Csv),
+    m_timer(),
+    m_lock(),
+    m_chunk_ready(),
+    m_chunks(),
+    m_chunk_count(0),
+    m_is_read_done(false),
+    m_error()
+{
+  // Reader and writer
+  m_pool.setMaxThreadCount(2);
+  // Reader and writer mostly wait, encoding takes the rest of cores
+  m_encode_pool.setMaxThreadCount(
+    std::max(1, QThread::idealThreadCount() - 1));
+}
+
+FeatureExporter::~FeatureExporter()
+{
+  Cancel();
+  m_pool.waitForDone();
+  m_encode_pool.waitForDone();
+}
+
+bool FeatureExporter::Start(const Request& request)
+{
+  if (!request.m_scene_info || !m_is_running.testAndSetOrdered(0, 1))
+    return false;
+
+  // Previous export may be still leaving its tasks
+  m_pool.waitForDone();
+  m_encode_pool.waitForDone();
+
+  m_file.setFileName(request.m_file_name);
+  if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+  {
+    m_is_running = 0;
+    return false;
+  }
+
+  m_format = request.m_format;
+  m_is_cancelled = 0;
+  m_free_chunks.release(kMaxChunks - m_free_chunks.available());
+  m_chunks.clear();
+  m_chunk_count = 0;
+  m_is_read_done = false;
+  m_error.clear();
+  m_timer.start();
+
+  m_pool.start(new WriteTask(this));
+  m_pool.start(new ReadTask(this, request));
+  return true;
+}
+
+void FeatureExporter::Cancel()
+{
+  m_is_cancelled = 1;
+
+  QMutexLocker lock(&m_lock);
+  m_chunk_ready.wakeAll();
+}
+
+bool FeatureExporter::IsRunning() const
+{
+  return m_is_running != 0;
+}
+
+FeatureExporter::Format FeatureExporter::FormatFromFileName(const QString& file_name)
+{
+  const QString suffix = QFileInfo(file_name).suffix().toLower();
+  if (suffix == "geojson" || suffix == "json")
+    return kFormat_GeoJson;
+  if (suffix == "skmf")
+    return kFormat_Binary;
+  return kFormat_Csv;
+}
+
+void FeatureExporter::Read(const Request& request)
+{
+  int chunk_index = 0;
+  std::vector<sdk::gdb::IFeatureSP> chunk;
+  chunk.reserve(kChunkFeatures);
+
+  sdk::gdb::IEnumFeatureSP found;
+  if (SDK_FAILED(request.m_scene_info->FindFeatures(
+    request.m_geometry_filter, NULL, NULL, found)) || !found)
+    Fail(tr("Failed to find features."));
+  else
+  {
+    bool is_last = false;
+    while (!is_last && !IsCancelled())
+    {
+      sdk::gdb::IFeatureSP feature;
+      is_last = SDK_FAILED(found->Next(&feature));
+      if (!is_last && feature)
+        chunk.push_back(feature);
+      if (chunk.size() < kChunkFeatures && !(is_last && !chunk.empty()))
+        continue;
+
+      // Waiting for the writer, so at most kMaxChunks chunks are in memory
+      while (!m_free_chunks.tryAcquire(1, kChunkWaitTimeout))
+      {
+        if (IsCancelled())
+          break;
+      }
+      if (IsCancelled())
+        break;
+
+      m_encode_pool.start(new EncodeTask(this, chunk_index++, chunk));
+      chunk.clear();
+    }
+  }
+
+  QMutexLocker lock(&m_lock);
+  m_chunk_count = chunk_index;
+  m_is_read_done = true;
+  m_chunk_ready.wakeAll();
+}
+
+void FeatureExporter::Encode(int index,
+  const std::vector<sdk::gdb::IFeatureSP>& features)
+{
+  Chunk chunk;
+  chunk.m_feature_count = 0;
+  for (size_t i = 0; i < features.size() && !IsCancelled(); ++i)
+  {
+    QByteArray data;
+    if (!EncodeFeature(features[i], data))
+      continue;
+    if (m_format == kFormat_GeoJson && chunk.m_feature_count)
+      chunk.m_data += ",\n";
+    chunk.m_data += data;
+    ++chunk.m_feature_count;
+  }
+
+  // Empty chunk is stored as well, so the writer goes on with the next one
+  QMutexLocker lock(&m_lock);
+  m_chunks[index] = chunk;
+  m_chunk_ready.wakeAll();
+}
+
+bool FeatureExporter::EncodeFeature(const sdk::gdb::IFeatureSP& feature,
+  QByteArray& data) const
+{
+  FeatureRecord record;
+  if (!feature || SDK_FAILED(feature->GetObjectID(record.oid)) ||
+    SDK_FAILED(feature->GetObjectClassCode(record.class_code)))
+    return false;
+
+  CatalogLabelsSP labels;
+  sdk::gdb::IFeatureDatasetSP dataset;
+  if (m_label_cache && SDK_OK(feature->GetFeatureDataset(&dataset)))
+    labels = m_label_cache->GetLabels(dataset);
+
+  std::wstring class_name;
+  if (labels && labels->GetClassName(sdk::gdb::kClassType_FeatureClass,
+    record.class_code, class_name))
+    record.class_name = QString::fromStdWString(class_name);
+  else
+    record.class_name = QString::number(record.class_code);
+
+  // Features without geometry are exported with their attributes only
+  record.geometry_kind = kGeometry_None;
+  sdk::geometry::IGeometrySP shape;
+  if (SDK_OK(feature->GetShape(&shape)) && shape)
+  {
+    record.geometry_kind = GetGeometryKind(shape);
+    if (record.geometry_kind == kGeometry_None ||
+      !MarkedFeatureRenderer::CrackGeometry(shape, record.points))
+    {
+      record.geometry_kind = kGeometry_None;
+      record.points.clear();
+    }
+  }
+
+  sdk::gdb::IAttributeCollectionSP attributes;
+  if (SDK_OK(feature->GetAttributes(&attributes)))
+  {
+    sdk::gdb::IAttributeSP attr;
+    for (SDKUInt32 i = 0; SDK_OK(attributes->GetAttribute(i, &attr)); attr.Release(), ++i)
+    {
+      AttributeText text;
+      if (DecodeAttribute(attr, labels, text))
+        record.attributes.push_back(text);
+    }
+  }
+
+  switch (m_format)
+  {
+  case kFormat_GeoJson:
+    EncodeGeoJson(record, data);
+    break;
+  case kFormat_Binary:
+    EncodeBinary(record, data);
+    break;
+  default:
+    EncodeCsv(record, data);
+    break;
+  }
+  return true;
+}
+
+void FeatureExporter::Write()
+{
+  // File prologue
+  QByteArray prologue;
+  switch (m_format)
+  {
+  case kFormat_GeoJson:
+    prologue = "{\"type\":\"FeatureCollection\",\"features\":[\n";
+    break;
+  case kFormat_Binary:
+    {
+      QDataStream stream(&prologue, QIODevice::WriteOnly);
+      stream.setByteOrder(QDataStream::LittleEndian);
+      stream.writeRawData(kBinaryMagic, 4);
+      stream << kBinaryVersion << static_cast<quint16>(0);
+    }
+    break;
+  default:
+    prologue = "oid,class,wkt,attributes\n";
+    break;
+  }
+  if (m_file.write(prologue) != prologue.size())
+    Fail(m_file.errorString());
+
+  quint64 exported = 0;
+  qint64 last_progress = 0;
+  for (int index = 0; !IsCancelled(); ++index)
+  {
+    Chunk chunk;
+    {
+      QMutexLocker lock(&m_lock);
+      while (!IsCancelled() && m_chunks.find(index) == m_chunks.end() &&
+        !(m_is_read_done && index >= m_chunk_count))
+        m_chunk_ready.wait(&m_lock);
+      if (IsCancelled() || (m_is_read_done && index >= m_chunk_count))
+        break;
+      std::map<int, Chunk>::iterator it = m_chunks.find(index);
+      chunk = it->second;
+      m_chunks.erase(it);
+    }
+    m_free_chunks.release();
+
+    if (!chunk.m_feature_count)
+      continue;
+    if (m_format == kFormat_GeoJson && exported)
+      chunk.m_data.prepend(",\n");
+    if (m_file.write(chunk.m_data) != chunk.m_data.size())
+    {
+      Fail(m_file.errorString());
+      break;
+    }
+    exported += chunk.m_feature_count;
+
+    if (m_timer.elapsed() - last_progress >= kProgressInterval)
+    {
+      last_progress = m_timer.elapsed();
+      emit signalProgress(exported);
+    }
+  }
+
+  if (!IsCancelled() && m_format == kFormat_GeoJson &&
+    m_file.write("\n]}\n") < 0)
+    Fail(m_file.errorString());
+  m_file.close();
+
+  // Reader and encoders are left before the export is reported done
+  {
+    QMutexLocker lock(&m_lock);
+    while (!m_is_read_done)
+      m_chunk_ready.wait(&m_lock);
+  }
+  m_encode_pool.waitForDone();
+
+  QString error;
+  {
+    QMutexLocker lock(&m_lock);
+    m_chunks.clear();
+    error = m_error;
+  }
+
+  const bool succeeded = !IsCancelled();
+  if (!succeeded)
+    m_file.remove();
+
+  if (!succeeded && !error.isEmpty())
+    qWarning() << "Feature export failed:" << error;
+
+  if (IsTimingLogEnabled())
+  {
+    const qint64 elapsed = m_timer.elapsed();
+    qDebug() << "Feature export:" << exported << "features in" << elapsed << "ms,"
+      << (elapsed ? exported * 1000 / elapsed : exported) << "features/s"
+      << (succeeded ? "" : error.isEmpty() ? "cancelled" : "failed");
+  }
+
+  m_is_running = 0;
+  if (succeeded)
+    emit signalFinished(true, exported, QString());
+  else
+    emit signalFinished(false, exported, error.isEmpty() ? tr("Export cancelled.") : error);
+}
+
+void FeatureExporter::Fail(const QString& message)
+{
+  {
+    QMutexLocker lock(&m_lock);
+    if (m_error.isEmpty())
+      m_error = message;
+  }
+  Cancel();
+}
+
+bool FeatureExporter::IsCancelled() const
+{
+  return m_is_cancelled != 0;
+}
@@ -0,0 +1,132 @@
+// feature_exporter.h : Streams features of a chart area into a file
+//
+#ifndef FEATURE_EXPORTER_H
+#define FEATURE_EXPORTER_H
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include <QObject>
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QString>
+
+#include <visualizationlayer/inc/visman/scene_manager_interface.h>
+#include "catalog_label_cache.h"
+
+// Exports features found by the geometry filter with their geometry and
+// decoded attributes. Features are read in chunks on a reader thread,
+// chunks are encoded on a pool of workers and written in order by a writer
+// thread. Only a few chunks exist at once, so memory does not grow with the
+// number of exported features.
+//
+// Binary format, little endian:
+//   header  "SKMF", quint16 version, quint16 reserved
+//   record  quint32 length of the rest of the record,
+//           quint32 workspace, dataset, section and record of ObjectID,
+//           quint32 feature class code, quint8 geometry kind,
+//           quint32 point count, qint32 lon/lat GeoInt pairs,
+//           quint16 attribute count, per attribute quint32 class code and
+//           quint16 length of UTF-8 value followed by the value
+class FeatureExporter : public QObject
+{
+  Q_OBJECT
+
+public:
+  enum Format
+  {
+    kFormat_Csv = 0,    // oid, class, WKT geometry, attributes
+    kFormat_GeoJson,    // FeatureCollection, attributes as properties
+    kFormat_Binary      // Length prefixed records, see above
+  };
+
+  // Features to be exported
+  struct Request
+  {
+    sdk::vis::ISceneInformationSP m_scene_info;
+    sdk::geometry::IGeometrySP    m_geometry_filter;
+    QString                       m_file_name;
+    Format                        m_format;
+  };
+
+  explicit FeatureExporter(const CatalogLabelCacheSP& label_cache,
+    QObject* parent = 0);
+  ~FeatureExporter();
+
+  // Starts the export, returns false if another one is running or the file
+  // cannot be created
+  bool Start(const Request& request);
+  // Stops the running export, the partial file is removed
+  void Cancel();
+  bool IsRunning() const;
+
+  // Format of the file name extension, CSV if it is not known
+  static Format FormatFromFileName(const QString& file_name);
+
+signals:
+  // Emitted from writer thread several times a second
+  void signalProgress(quint64 exported);
+  // Emitted from writer thread when the export is done, failed or cancelled
+  void signalFinished(bool succeeded, quint64 exported, QString message);
+
+private:
+  class ReadTask;
+  class EncodeTask;
+  class WriteTask;
+  friend class ReadTask;
+  friend class EncodeTask;
+  friend class WriteTask;
+
+  // Encoded features of one chunk
+  struct Chunk
+  {
+    QByteArray m_data;
+    int        m_feature_count;
+  };
+
+  // Called by worker tasks
+  void Read(const Request& request);
+  void Encode(int index, const std::vector<sdk::gdb::IFeatureSP>& features);
+  void Write();
+
+  // Encodes one feature in the export format, returns false if it is skipped
+  bool EncodeFeature(const sdk::gdb::IFeatureSP& feature, QByteArray& data) const;
+
+  // Marks the export as failed, the first message is kept
+  void Fail(const QString& message);
+  bool IsCancelled() const;
+
+private:
+  const CatalogLabelCacheSP m_label_cache;
+
+  // Reader and writer threads, encoding workers
+  QThreadPool    m_pool;
+  QThreadPool    m_encode_pool;
+
+  // Free slots of chunks being encoded or waiting for writing
+  QSemaphore     m_free_chunks;
+  QAtomicInt     m_is_cancelled;
+  QAtomicInt     m_is_running;
+
+  // Output, used by the writer thread only
+  QFile          m_file;
+  Format         m_format;
+  QElapsedTimer  m_timer;
+
+  // Encoded chunks by their index
+  mutable QMutex m_lock;
+  QWaitCondition m_chunk_ready;
+  std::map<int, Chunk> m_chunks;
+  int            m_chunk_count;
+  bool           m_is_read_done;
+  QString        m_error;
+};
+
+#endif // FEATURE_EXPORTER_H
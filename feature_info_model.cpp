@@ -0,0 +1,376 @@
+// feature_info_model.cpp : Tree model of features, which details are read on expansion
+//
+#include <sstream>
+
+#include <base/inc/sdk_any_handler.h>
+#include <base/inc/sdk_string_handler.h>
+#include <base/inc/sdk_results_enum.h>
+#include <datalayer/inc/geodatabase/gdb_const.h>
+#include <datalayer/inc/geodatabase/gdb_relationship.h>
+#include "feature_attribute_text.h"
+#include "feature_info_model.h"
+
+struct FeatureInfoModel::Node
+{
+  enum Kind
+  {
+    kKind_Root = 0,
+    kKind_Feature,
+    kKind_Text
+  };
+
+  Node(Kind node_kind, Node* parent_node, int node_row)
+    : kind(node_kind),
+      parent(parent_node),
+      row(node_row),
+      children(),
+      text(),
+      oid(),
+      feature(),
+      is_header_ready(false),
+      is_fetched(false)
+  {
+  }
+
+  ~Node()
+  {
+    for (size_t i = 0; i < children.size(); ++i)
+      delete children[i];
+  }
+
+  Kind               kind;
+  Node*              parent;
+  int                row;
+  std::vector<Node*> children;
+  QString            text;
+
+  // Feature node only, the feature is held until its header is formatted
+  sdk::gdb::ObjectID   oid;
+  sdk::gdb::IFeatureSP feature;
+  bool                 is_header_ready;
+  bool                 is_fetched;
+};
+
+FeatureInfoModel::FeatureInfoModel(const CatalogLabelCacheSP& label_cache,
+  QObject* parent)
+  : QAbstractItemModel(parent),
+    m_label_cache(label_cache),
+    m_root(new Node(Node::kKind_Root, NULL, 0)),
+    m_workspaces(),
+    m_formatted_headers(0)
+{
+}
+
+FeatureInfoModel::~FeatureInfoModel()
+{
+  delete m_root;
+}
+
+void FeatureInfoModel::SetFeatures(const std::vector<sdk::gdb::IFeatureSP>& features)
+{
+  beginResetModel();
+
+  delete m_root;
+  m_root = new Node(Node::kKind_Root, NULL, 0);
+  m_workspaces.clear();
+  m_formatted_headers = 0;
+
+  for (size_t i = 0; i < features.size(); ++i)
+  {
+    const sdk::gdb::IFeatureSP& feature = features[i];
+    if (!feature)
+      continue;
+    if (SDK_OK(feature->GetMaster(NULL)))
+      continue; // Skip slaves.
+
+    sdk::gdb::ObjectID oid;
+    if (SDK_FAILED(feature->GetObjectID(oid)))
+      continue;
+    AddFeatureNode(m_root, feature, oid);
+  }
+
+  endResetModel();
+}
+
+bool FeatureInfoModel::GetObjectID(const QModelIndex& index,
+  sdk::gdb::ObjectID& oid) const
+{
+  for (Node* node = NodeFromIndex(index); node; node = node->parent)
+  {
+    if (node->kind == Node::kKind_Feature)
+    {
+      oid = node->oid;
+      return true;
+    }
+  }
+  return false;
+}
+
+int FeatureInfoModel::GetFeatureCount() const
+{
+  return static_cast<int>(m_root->children.size());
+}
+
+QModelIndex FeatureInfoModel::index(int row, int column,
+  const QModelIndex& parent) const
+{
+  Node* parent_node = parent.isValid() ? NodeFromIndex(parent) : m_root;
+  if (!parent_node || column != 0 || row < 0 ||
+    row >= static_cast<int>(parent_node->children.size()))
+    return QModelIndex();
+  return createIndex(row, column, parent_node->children[row]);
+}
+
+QModelIndex FeatureInfoModel::parent(const QModelIndex& child) const
+{
+  Node* node = NodeFromIndex(child);
+  if (!node || !node->parent || node->parent == m_root)
+    return QModelIndex();
+  return createIndex(node->parent->row, 0, node->parent);
+}
+
+int FeatureInfoModel::rowCount(const QModelIndex& parent) const
+{
+  Node* parent_node = parent.isValid() ? NodeFromIndex(parent) : m_root;
+  return parent_node ? static_cast<int>(parent_node->children.size()) : 0;
+}
+
+int FeatureInfoModel::columnCount(const QModelIndex& /*parent*/) const
+{
+  return 1;
+}
+
+QVariant FeatureInfoModel::data(const QModelIndex& index, int role) const
+{
+  Node* node = NodeFromIndex(index);
+  if (!node || role != Qt::DisplayRole)
+    return QVariant();
+
+  if (node->kind == Node::kKind_Feature && !node->is_header_ready)
+    FormatHeader(node);
+  return node->text;
+}
+
+bool FeatureInfoModel::hasChildren(const QModelIndex& parent) const
+{
+  Node* parent_node = parent.isValid() ? NodeFromIndex(parent) : m_root;
+  if (!parent_node)
+    return false;
+
+  // Not fetched feature is expandable, so the view shows it
+  if (parent_node->kind == Node::kKind_Feature && !parent_node->is_fetched)
+    return true;
+  return !parent_node->children.empty();
+}
+
+bool FeatureInfoModel::canFetchMore(const QModelIndex& parent) const
+{
+  Node* node = NodeFromIndex(parent);
+  return node && node->kind == Node::kKind_Feature && !node->is_fetched;
+}
+
+void FeatureInfoModel::fetchMore(const QModelIndex& parent)
+{
+  Node* node = NodeFromIndex(parent);
+  if (!node || node->kind != Node::kKind_Feature || node->is_fetched)
+    return;
+
+  // Children are made aside and inserted at once
+  Node staging(Node::kKind_Root, NULL, 0);
+  FetchFeature(node, &staging);
+  node->is_fetched = true;
+  if (staging.children.empty())
+    return;
+
+  beginInsertRows(parent, 0, static_cast<int>(staging.children.size()) - 1);
+  node->children.swap(staging.children);
+  for (size_t i = 0; i < node->children.size(); ++i)
+    node->children[i]->parent = node;
+  endInsertRows();
+}
+
+FeatureInfoModel::Node* FeatureInfoModel::NodeFromIndex(const QModelIndex& index) const
+{
+  return index.isValid() ? static_cast<Node*>(index.internalPointer()) : NULL;
+}
+
+void FeatureInfoModel::AddFeatureNode(Node* parent,
+  const sdk::gdb::IFeatureSP& feature, const sdk::gdb::ObjectID& oid)
+{
+  Node* node = new Node(Node::kKind_Feature, parent,
+    static_cast<int>(parent->children.size()));
+  node->oid = oid;
+  node->feature = feature;
+  parent->children.push_back(node);
+}
+
+void FeatureInfoModel::AddTextNode(Node* parent, const QString& text)
+{
+  Node* node = new Node(Node::kKind_Text, parent,
+    static_cast<int>(parent->children.size()));
+  node->text = text;
+  parent->children.push_back(node);
+}
+
+void FeatureInfoModel::FormatHeader(Node* node) const
+{
+  node->is_header_ready = true;
+  ++m_formatted_headers;
+
+  const sdk::gdb::ObjectID& oid = node->oid;
+  std::wostringstream oid_s;
+  oid_s << L"OID[" << DatasetID_WorkspaceID(oid.did) << L"."
+    << DatasetID_DatasetID(oid.did) << L"." << ObjectID_Section(oid) << L"."
+    << ObjectID_Record(oid) << L"] ";
+
+  sdk::gdb::IFeatureSP feature;
+  sdk::gdb::ClassCode class_code;
+  sdk::gdb::IFeatureDatasetSP dataset;
+  CatalogLabelsSP labels;
+  sdk::ScopedString dataset_name;
+  if (!GetFeature(node, feature) ||
+    SDK_FAILED(feature->GetObjectClassCode(class_code)) ||
+    !GetCatalogLabels(feature, dataset, labels) ||
+    SDK_FAILED(dataset->GetDatasetName(dataset_name)))
+  {
+    node->text = QString::fromStdWString(oid_s.str());
+    return;
+  }
+
+  std::wostringstream s;
+  s << sdk::WideFromSDKString(dataset_name) << L" " << oid_s.str();
+
+  std::wstring feature_class_name;
+  labels->GetClassName(sdk::gdb::kClassType_FeatureClass, class_code,
+    feature_class_name);
+  if (feature_class_name.empty())
+    s << class_code;
+  else
+    s << feature_class_name;
+
+  node->text = QString::fromStdWString(s.str());
+
+  // Feature is read again by ObjectID, if the node is expanded
+  node->feature.Release();
+}
+
+void FeatureInfoModel::FetchFeature(const Node* node, Node* children)
+{
+  sdk::gdb::IFeatureSP feature;
+  sdk::gdb::IFeatureDatasetSP dataset;
+  CatalogLabelsSP labels;
+  if (!GetFeature(node, feature) ||
+    !GetCatalogLabels(feature, dataset, labels))
+  {
+    AddTextNode(children, tr("Failed to read the feature."));
+    return;
+  }
+
+  // Attributes
+  sdk::gdb::IAttributeCollectionSP attributes;
+  if (SDK_OK(feature->GetAttributes(&attributes)))
+  {
+    sdk::gdb::IAttributeSP attr;
+    for (SDKUInt32 i = 0; SDK_OK(attributes->GetAttribute(i, &attr)); attr.Release(), ++i)
+      AddTextNode(children, FormatAttribute(attr, labels));
+  }
+
+  // Slaves and relations are shown for top level features only
+  if (node->parent != m_root)
+    return;
+
+  // Feature slaves
+  sdk::gdb::IEnumFeatureSP slaves;
+  if (SDK_OK(feature->GetSlaves(&slaves)))
+  {
+    for (sdk::gdb::IFeatureSP slave; SDK_OK(slaves->Next(&slave)); slave.Release())
+    {
+      sdk::gdb::ObjectID slave_oid;
+      if (SDK_OK(slave->GetObjectID(slave_oid)))
+        AddFeatureNode(children, slave, slave_oid);
+    }
+  }
+
+  // Feature relations
+  sdk::gdb::IRelationshipCollectionSP asso;
+  if (SDK_FAILED(feature->GetRelationships(sdk::gdb::kRelationshipClass_AssociationMaster,
+    sdk::gdb::kRelationshipRole_Any, &asso)))
+    return;
+  sdk::gdb::IObjectSP asso_obj;
+  if (SDK_FAILED(asso->GetRelationship(0, &asso_obj, NULL, NULL)))
+    return;
+  sdk::gdb::IRelationshipCollectionSP relations;
+  if (SDK_FAILED(asso_obj->GetRelationships(sdk::gdb::kRelationshipClass_PeerToPeer,
+    sdk::gdb::kRelationshipRole_Any, &relations)))
+    return;
+
+  AddTextNode(children, tr("Relationships"));
+  Node* relations_node = children->children.back();
+
+  SDKUInt32 r_count = 0;
+  relations->GetRelationshipCount(r_count);
+  for (SDKUInt32 r = 0; r < r_count; ++r)
+  {
+    sdk::gdb::IObjectSP r_obj;
+    if (SDK_FAILED(relations->GetRelationship(r, &r_obj, NULL, NULL)))
+      continue;
+
+    sdk::gdb::ObjectID r_obj_oid;
+    if (SDK_FAILED(r_obj->GetObjectID(r_obj_oid)))
+      continue;
+    if (IsEqualObjectID(node->oid, r_obj_oid))
+      continue; // Do not add the feature itself
+
+    sdk::gdb::IFeatureSP r_feature = sdk::GetInterfaceT<sdk::gdb::IFeature>(r_obj);
+    if (r_feature)
+      AddFeatureNode(relations_node, r_feature, r_obj_oid);
+  }
+}
+
+bool FeatureInfoModel::GetFeature(const Node* node, sdk::gdb::IFeatureSP& feature) const
+{
+  feature = node->feature;
+  if (feature)
+    return true;
+
+  WorkspaceContainer::const_iterator it =
+    m_workspaces.find(DatasetID_WorkspaceID(node->oid.did));
+  if (it == m_workspaces.end())
+    return false;
+  return SDK_OK(it->second->GetFeature(node->oid, &feature)) && feature;
+}
+
+bool FeatureInfoModel::GetCatalogLabels(const sdk::gdb::IFeatureSP& feature,
+  sdk::gdb::IFeatureDatasetSP& dataset, CatalogLabelsSP& labels) const
+{
+  if (!m_label_cache)
+    return false;
+
+  sdk::gdb::ObjectID oid;
+  if (SDK_FAILED(feature->GetObjectID(oid)))
+    return false;
+  if (SDK_FAILED(feature->GetFeatureDataset(&dataset)) || !dataset)
+    return false;
+
+  sdk::gdb::IWorkspaceSP wks;
+  if (SDK_FAILED(dataset->GetWorkspace(&wks)) || !wks)
+    return false;
+  m_workspaces[DatasetID_WorkspaceID(oid.did)] = wks;
+
+  sdk::ScopedAny prsp;
+  if (SDK_FAILED(dataset->GetDatasetProperty(sdk::gdb::kDSP_PRSP, prsp)))
+    return false;
+  prsp.ChangeType(kSDKAnyType_Uint32);
+
+  labels = m_label_cache->GetLabels(wks, ANY_UI32(&prsp));
+  return labels.get() != NULL;
+}
+
+QString FeatureInfoModel::FormatAttribute(const sdk::gdb::IAttributeSP& attr,
+  const CatalogLabelsSP& labels) const
+{
+  AttributeText text;
+  if (!DecodeAttribute(attr, labels, text))
+    return tr("Failed to get attribute class code.");
+  return QString::fromStdWString(text.m_name + L" - " + text.m_value);
+}
@@ -0,0 +1,93 @@
+// feature_info_model.h : Tree model of features, which details are read on expansion
+//
+#ifndef FEATURE_INFO_MODEL_H
+#define FEATURE_INFO_MODEL_H
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include <QAbstractItemModel>
+
+#include <datalayer/inc/geodatabase/gdb_dataset.h>
+#include <datalayer/inc/geodatabase/gdb_workspace.h>
+#include "catalog_label_cache.h"
+
+// Features are shown by their header line only. The header is formatted
+// when the view asks for it, so only visible rows cost SDK calls. Attributes,
+// slaves and related features of a feature are read, when its item is
+// expanded. Features are kept by ObjectID and read again from their
+// workspace for the expansion.
+class FeatureInfoModel : public QAbstractItemModel
+{
+  Q_OBJECT
+
+public:
+  FeatureInfoModel(const CatalogLabelCacheSP& label_cache, QObject* parent = 0);
+  ~FeatureInfoModel();
+
+  // Replaces features of the top level, slaves are skipped
+  void SetFeatures(const std::vector<sdk::gdb::IFeatureSP>& features);
+
+  // Returns ObjectID of the feature of the item or of its nearest feature
+  // parent, false for items outside of features
+  bool GetObjectID(const QModelIndex& index, sdk::gdb::ObjectID& oid) const;
+
+  // Number of features of the top level
+  int GetFeatureCount() const;
+  // Number of headers formatted since SetFeatures
+  int GetFormattedHeaderCount() const { return m_formatted_headers; }
+
+  // QAbstractItemModel
+  QModelIndex index(int row, int column,
+    const QModelIndex& parent = QModelIndex()) const;
+  QModelIndex parent(const QModelIndex& child) const;
+  int rowCount(const QModelIndex& parent = QModelIndex()) const;
+  int columnCount(const QModelIndex& parent = QModelIndex()) const;
+  QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
+  bool hasChildren(const QModelIndex& parent = QModelIndex()) const;
+  bool canFetchMore(const QModelIndex& parent) const;
+  void fetchMore(const QModelIndex& parent);
+
+private:
+  struct Node;
+
+  Node* NodeFromIndex(const QModelIndex& index) const;
+
+  // Adds node of the feature, which header is formatted later
+  void AddFeatureNode(Node* parent, const sdk::gdb::IFeatureSP& feature,
+    const sdk::gdb::ObjectID& oid);
+  // Adds node of the text
+  void AddTextNode(Node* parent, const QString& text);
+
+  // Formats the header of the feature node
+  void FormatHeader(Node* node) const;
+  // Reads attributes, slaves and relations of the feature node into
+  // children of the staging node
+  void FetchFeature(const Node* node, Node* children);
+
+  // Returns feature of the node, it is read by ObjectID if the node does
+  // not hold it any more
+  bool GetFeature(const Node* node, sdk::gdb::IFeatureSP& feature) const;
+  // Returns catalog labels of the feature and remembers its workspace
+  bool GetCatalogLabels(const sdk::gdb::IFeatureSP& feature,
+    sdk::gdb::IFeatureDatasetSP& dataset, CatalogLabelsSP& labels) const;
+  // Formats attribute line as "Name - value"
+  QString FormatAttribute(const sdk::gdb::IAttributeSP& attr,
+    const CatalogLabelsSP& labels) const;
+
+private:
+  // Class and listed value labels shared with other views
+  const CatalogLabelCacheSP m_label_cache;
+
+  // Invisible root, its children are top level features
+  Node*       m_root;
+
+  // Workspaces of shown features by workspace identifier
+  typedef std::map<SDKUInt32, sdk::gdb::IWorkspaceSP> WorkspaceContainer;
+  mutable WorkspaceContainer m_workspaces;
+
+  mutable int m_formatted_headers;
+};
+
+#endif // FEATURE_INFO_MODEL_H
@@ -1,14 +1,15 @@
 #ifndef FEATUREINFODLG_H
 #define FEATUREINFODLG_H
 
-#include <map>
+#include <vector>
 
 #include <QDialog>
-#include <QTreeWidgetItem>
+#include <QElapsedTimer>
 
 #include <datalayer/inc/geodatabase/gdb_dataset.h>
 #include <datalayer/inc/geodatabase/gdb_workspace.h>
 #include "mark_unmark_feature_interface.h"
+#include "feature_info_model.h"
 
 namespace Ui { class FeatureInfoDlg; }
 
@@ -17,28 +18,34 @@ class FeatureInfoDlg : public QDialog
   Q_OBJECT
   
 public:
-  explicit FeatureInfoDlg(MarkUnmarkFeature* mark_unmark_feature, QWidget *parent = 0);
+  FeatureInfoDlg(MarkUnmarkFeature* mark_unmark_feature,
+    const CatalogLabelCacheSP& label_cache, QWidget *parent = 0);
   ~FeatureInfoDlg();
   
-  // Fills up features info window with data
+  // Fills up features info window with data. Only feature headers are
+  // shown, details are read when the feature is expanded.
   void FillUpFeaturesInfo(const sdk::gdb::IEnumFeatureSP& features);
+  void FillUpFeaturesInfo(const std::vector<sdk::gdb::IFeatureSP>& features);
 
 protected:
-  bool AddFeatureToTree(const sdk::gdb::IFeatureSP& feature,
-    QTreeWidgetItem* parent, QTreeWidgetItem** feature_item,
-    uint& tree_item_id);
+  // Catches the first paint of the tree after filling up
+  bool eventFilter(QObject* o, QEvent* e);
 
 private slots:
   void OnHighlightFeature();
   void OnClearHighlight();
+  void OnFirstPaint();
 
 private:
   // UI
   Ui::FeatureInfoDlg *ui;
 
   // Collected features
-  typedef std::map<uint, sdk::gdb::ObjectID> FeatureContainer;
-  FeatureContainer m_features;
+  FeatureInfoModel* m_model;
+
+  // Time from filling up to the first paint of the tree
+  QElapsedTimer m_first_paint_timer;
+  bool m_is_first_paint_pending;
 
   // Mark/unmark feature object interface
   MarkUnmarkFeature* m_mark_unmark_feature;
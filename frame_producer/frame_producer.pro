@@ -0,0 +1,29 @@
+#-------------------------------------------------
+#
+# Test producer of shared memory frames for step_5_demo_qt
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = frame_producer
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += \
+    . \
+    ..
+
+unix {
+LIBS += \
+    -lrt
+}
+
+SOURCES += main.cpp \
+    ../shared_frame_ring.cpp
+
+HEADERS += \
+    ../shared_frame_ring.h
@@ -0,0 +1,147 @@
+// main.cpp : Test producer of shared memory frames
+//
+// Publishes synthetic BGRA frames into the ring read by the demo, which is
+// started with SHARED_FRAMES_NAME set to the same name.
+//
+//   frame_producer [name [width height [rate]]]
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QStringList>
+#include <QtCore/QThread>
+#include <QtCore/QtGlobal>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+
+#include "../shared_frame_ring.h"
+
+namespace
+{
+  const char* const kDefaultName = "step_5_demo_frames";
+  const int kDefaultWidth = 1024;
+  const int kDefaultHeight = 1024;
+  const int kDefaultRate = 60; // frames per second
+  const int kSlotCount = 3;
+
+  volatile sig_atomic_t g_stop = 0;
+
+  void OnSignal(int) { g_stop = 1; }
+
+  // Needed only for access to the protected sleep function in Qt 4
+  class Sleeper : public QThread
+  {
+  public:
+    static void Sleep(unsigned long us) { QThread::usleep(us); }
+  };
+
+  // Draws rotating sweep over concentric rings
+  void FillFrame(uchar* bits, int width, int height, int bytes_per_line,
+    quint32 frame)
+  {
+    const double kPi = 3.14159265358979323846;
+    const double sweep = fmod(frame * 0.05, 2.0 * kPi);
+    const double cx = width / 2.0;
+    const double cy = height / 2.0;
+    const double radius = qMin(cx, cy);
+
+    for (int y = 0; y < height; ++y)
+    {
+      quint32* row = reinterpret_cast<quint32*>(bits + y * bytes_per_line);
+      for (int x = 0; x < width; ++x)
+      {
+        const double dx = x - cx;
+        const double dy = y - cy;
+        const double r = sqrt(dx * dx + dy * dy);
+        if (r > radius)
+        {
+          row[x] = 0; // Transparent outside of the scan
+          continue;
+        }
+
+        // Echo intensity fades behind the sweep
+        double behind = sweep - atan2(dy, dx);
+        if (behind < 0.0)
+          behind += 2.0 * kPi;
+        int level = static_cast<int>(255.0 * (1.0 - behind / (2.0 * kPi)));
+        if ((static_cast<int>(r) / 32) % 4 == 0)
+          level = qMin(255, level + 64);
+
+        // Premultiplied green, alpha follows intensity
+        row[x] = (static_cast<quint32>(level) << 24) |
+          (static_cast<quint32>(level) << 8);
+      }
+    }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication a(argc, argv);
+  QStringList args = a.arguments();
+
+  QString name = args.size() > 1 ? args.at(1) : QString(kDefaultName);
+  int width = args.size() > 3 ? args.at(2).toInt() : kDefaultWidth;
+  int height = args.size() > 3 ? args.at(3).toInt() : kDefaultHeight;
+  int rate = args.size() > 4 ? args.at(4).toInt() : kDefaultRate;
+  if (width <= 0 || height <= 0 || rate <= 0)
+  {
+    fprintf(stderr, "usage: frame_producer [name [width height [rate]]]\n");
+    return 1;
+  }
+
+  SharedFrameRing ring;
+  if (!ring.Create(name, width, height, kSlotCount))
+  {
+    fprintf(stderr, "Failed to create shared memory '%s'\n",
+      name.toLocal8Bit().constData());
+    return 1;
+  }
+
+  signal(SIGINT, OnSignal);
+  signal(SIGTERM, OnSignal);
+
+  printf("Publishing %dx%d frames at %d Hz into '%s'\n",
+    width, height, rate, name.toLocal8Bit().constData());
+  fflush(stdout);
+
+  const qint64 frame_interval = 1000000000LL / rate; // ns
+  QElapsedTimer clock;
+  clock.start();
+
+  qint64 next_frame = 0;
+  qint64 next_report = 1000000000LL;
+  quint32 frame = 0;
+  while (!g_stop)
+  {
+    // Ring is full, if the consumer is behind. The frame is dropped and
+    // the next one is produced on schedule.
+    uchar* bits = ring.BeginWrite();
+    if (bits)
+    {
+      FillFrame(bits, width, height, ring.BytesPerLine(), frame);
+      ring.EndWrite();
+    }
+    ++frame;
+
+    if (clock.nsecsElapsed() >= next_report)
+    {
+      SharedFrameRing::Statistics statistics = ring.GetStatistics();
+      printf("published %u shown %u skipped %u dropped %u\n",
+        statistics.published, statistics.consumed, statistics.skipped,
+        statistics.dropped);
+      fflush(stdout);
+      next_report += 1000000000LL;
+    }
+
+    next_frame += frame_interval;
+    qint64 wait = next_frame - clock.nsecsElapsed();
+    if (wait > 0)
+      Sleeper::Sleep(static_cast<unsigned long>(wait / 1000));
+    else
+      next_frame = clock.nsecsElapsed(); // Too slow, no catching up
+  }
+
+  ring.Close();
+  return 0;
+}
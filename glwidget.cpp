@@ -48,15 +48,32 @@
 #define GL_MULTISAMPLE  0x809D
 #endif
 
+#ifndef GL_BGRA
+#define GL_BGRA         0x80E1
+#endif
+
 GLWidget::GLWidget(QWidget *parent, const UserBmpLayerRendererSP& renderer)
     : QGLWidget(QGLFormat(QGL::SampleBuffers | QGL::AlphaChannel), parent),
       m_renderer(renderer),
-      m_parent(parent)
+      m_parent(parent),
+      m_frame_timer(),
+      m_frame_interval(0),
+      m_pixel_buffer_index(0),
+      m_frames_in_flight(0),
+      m_pixel_buffers_supported(true)
 {
-    startTimer(40);
+    for (int i = 0; i < kPixelBufferCount; ++i)
+        m_pixel_buffers[i] = 0;
+
     setWindowTitle(tr("Sample Buffers"));
 }
 
+GLWidget::~GLWidget()
+{
+    makeCurrent();
+    destroyPixelBuffers();
+}
+
 void GLWidget::initializeGL()
 {
     glMatrixMode(GL_PROJECTION);
@@ -103,16 +120,111 @@ void GLWidget::paintGL()
     //renderText(0.15, 0.4, 0.0, "Multisampling disabled");
 
     // Get image data and pass it to the renderer
-    glFlush();
-    QImage image = grabFrameBuffer(true);
-    m_renderer->SetBits(image);
+    if (!readBackFrame())
+        return;
 
     // Tell main window that layer need to be repainted
     (static_cast<step_5_demo_widget*>(m_parent))->GLDataUpdated();
 }
 
-void GLWidget::timerEvent(QTimerEvent *)
+bool GLWidget::readBackFrame()
+{
+    const int w = width();
+    const int h = height();
+    if (w <= 0 || h <= 0)
+        return false;
+
+    if (m_pixel_buffers_supported && m_pixel_buffers_size != QSize(w, h))
+        m_pixel_buffers_supported = createPixelBuffers(w, h);
+
+    // Blocking readback, if pixel buffers are not available
+    if (!m_pixel_buffers_supported) {
+        glFlush();
+        QImage image = grabFrameBuffer(true);
+        m_renderer->SetBits(image.constBits(), image.width(), image.height(),
+            image.bytesPerLine(), true);
+        return true;
+    }
+
+    // Queue readback of this frame, glReadPixels returns at once when
+    // a pixel pack buffer is bound
+    QGLBuffer* buffer = m_pixel_buffers[m_pixel_buffer_index];
+    buffer->bind();
+    glReadPixels(0, 0, w, h, GL_BGRA, GL_UNSIGNED_BYTE, 0);
+    buffer->release();
+
+    m_pixel_buffer_index = (m_pixel_buffer_index + 1) % kPixelBufferCount;
+    if (m_frames_in_flight < kPixelBufferCount)
+        ++m_frames_in_flight;
+    if (m_frames_in_flight < kPixelBufferCount)
+        return false; // Nothing is completed yet
+
+    // The next buffer holds the oldest frame, which is done by now.
+    // Rows are bottom-up as the renderer expects, so no flip is needed.
+    bool passed = false;
+    buffer = m_pixel_buffers[m_pixel_buffer_index];
+    buffer->bind();
+    const uchar* bits = static_cast<const uchar*>(buffer->map(QGLBuffer::ReadOnly));
+    if (bits) {
+        m_renderer->SetBits(bits, w, h, w * 4, false);
+        buffer->unmap();
+        passed = true;
+    }
+    buffer->release();
+
+    return passed;
+}
+
+bool GLWidget::createPixelBuffers(int w, int h)
+{
+    destroyPixelBuffers();
+
+    for (int i = 0; i < kPixelBufferCount; ++i) {
+        m_pixel_buffers[i] = new QGLBuffer(QGLBuffer::PixelPackBuffer);
+        m_pixel_buffers[i]->setUsagePattern(QGLBuffer::StreamRead);
+        if (!m_pixel_buffers[i]->create()) {
+            destroyPixelBuffers();
+            return false;
+        }
+        m_pixel_buffers[i]->bind();
+        m_pixel_buffers[i]->allocate(w * h * 4);
+        m_pixel_buffers[i]->release();
+    }
+
+    m_pixel_buffers_size = QSize(w, h);
+    return true;
+}
+
+void GLWidget::destroyPixelBuffers()
+{
+    for (int i = 0; i < kPixelBufferCount; ++i) {
+        if (m_pixel_buffers[i])
+            m_pixel_buffers[i]->destroy();
+        delete m_pixel_buffers[i];
+        m_pixel_buffers[i] = 0;
+    }
+
+    m_pixel_buffers_size = QSize();
+    m_pixel_buffer_index = 0;
+    m_frames_in_flight = 0;
+}
+
+void GLWidget::setFrameInterval(int msec)
+{
+    if (msec == m_frame_interval)
+        return;
+    m_frame_interval = msec;
+
+    if (msec > 0)
+        m_frame_timer.start(msec, this);
+    else
+        m_frame_timer.stop();
+}
+
+void GLWidget::timerEvent(QTimerEvent *e)
 {
+  if (e->timerId() != m_frame_timer.timerId())
+    return;
   updateGL();
 //  update();
 }
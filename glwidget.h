@@ -49,6 +49,14 @@ class GLWidget : public QGLWidget
 {
 public:
     GLWidget(QWidget *parent, const UserBmpLayerRendererSP& renderer);
+    ~GLWidget();
+
+    // Interval of frames, while the overlay is shown
+    static const int kFrameInterval = 40; // ms
+
+    // Starts drawing frames at given interval, 0 stops it. Nothing is
+    // drawn until the interval is set.
+    void setFrameInterval(int msec);
 
 protected:
     void initializeGL();
@@ -60,9 +68,31 @@ protected:
     void quad(GLenum primitive, GLdouble x1, GLdouble y1, GLdouble x2, GLdouble y2,
               GLdouble x3, GLdouble y3, GLdouble x4, GLdouble y4);
 
+    // Starts asynchronous readback of the current frame and passes the
+    // oldest completed frame to the renderer. Returns true, if a frame
+    // has been passed.
+    bool readBackFrame();
+    // (Re)creates pixel buffers for given frame size
+    bool createPixelBuffers(int w, int h);
+    void destroyPixelBuffers();
+
 private:
+    // Number of frames in flight during readback
+    static const int kPixelBufferCount = 2;
+
     GLuint list;
     UserBmpLayerRendererSP m_renderer;
     QWidget*               m_parent; // Temporary solution.
+
+    // Frame timer, stopped while nobody shows the overlay
+    QBasicTimer            m_frame_timer;
+    int                    m_frame_interval;
+
+    // Pixel pack buffers, frames are read into them in turn
+    QGLBuffer*             m_pixel_buffers[kPixelBufferCount];
+    QSize                  m_pixel_buffers_size;
+    int                    m_pixel_buffer_index;
+    int                    m_frames_in_flight;
+    bool                   m_pixel_buffers_supported;
 };
 
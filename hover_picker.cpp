@@ -0,0 +1,303 @@
+// HoverPicker.cpp : Finds features under resting cursor for the tooltip off the UI thread
+//
+#include <algorithm>
+
+#include <QRunnable>
+#include <QStringList>
+#include <QDebug>
+
+#include <base/inc/sdk_any_handler.h>
+#include <base/inc/sdk_string_handler.h>
+#include <base/inc/sdk_results_enum.h>
+#include "hover_picker.h"
+
+namespace
+{
+  // Tooltip size limits
+  const size_t kMaxTooltipFeatures = 5;
+  const size_t kMaxTooltipAttributes = 2; // text attributes of one feature
+
+  // Number of tooltips, which latency percentiles are logged together
+  const size_t kLatencyReportCount = 100;
+
+  // Returns name of the class from the catalog labels, or its code
+  QString GetClassName(const CatalogLabelsSP& labels,
+    sdk::gdb::ClassType class_type, sdk::gdb::ClassCode class_code)
+  {
+    std::wstring class_name;
+    if (labels && labels->GetClassName(class_type, class_code, class_name))
+      return QString::fromStdWString(class_name);
+    return QString::number(class_code);
+  }
+}
+
+class HoverPicker::Task : public QRunnable
+{
+public:
+  Task(HoverPicker* picker, int sequence, const Query& query)
+    : m_picker(picker),
+      m_sequence(sequence),
+      m_query(query)
+  {
+  }
+
+  void run()
+  {
+    m_picker->Pick(m_sequence, m_query);
+  }
+
+private:
+  HoverPicker* m_picker;
+  int          m_sequence;
+  Query        m_query;
+};
+
+HoverPicker::HoverPicker(const CatalogLabelCacheSP& label_cache, QObject* parent)
+  : QObject(parent),
+    m_label_cache(label_cache),
+    m_pool(),
+    m_sequence(0),
+    m_lock(),
+    m_result(),
+    m_has_result(false),
+    m_is_pending(false),
+    m_pending_rect(),
+    m_pending_generation(0),
+    m_has_last(false),
+    m_last(),
+    m_clock(),
+    m_latencies()
+{
+  m_pool.setMaxThreadCount(1);
+  m_clock.start();
+}
+
+HoverPicker::~HoverPicker()
+{
+  Cancel();
+  m_pool.waitForDone();
+  ReportLatency();
+}
+
+void HoverPicker::Request(const Query& query)
+{
+  m_is_pending = true;
+  m_pending_rect = query.m_rect;
+  m_pending_generation = query.m_generation;
+  m_has_last = false;
+
+  int sequence = m_sequence.fetchAndAddOrdered(1) + 1;
+  {
+    // Result of the previous request may be done but not taken yet
+    QMutexLocker lock(&m_lock);
+    m_has_result = false;
+  }
+  m_pool.start(new Task(this, sequence, query));
+}
+
+void HoverPicker::Cancel()
+{
+  m_sequence.fetchAndAddOrdered(1);
+  m_is_pending = false;
+  m_has_last = false;
+
+  QMutexLocker lock(&m_lock);
+  m_has_result = false;
+}
+
+bool HoverPicker::TakeResult(Result& result)
+{
+  {
+    QMutexLocker lock(&m_lock);
+    if (!m_has_result)
+      return false;
+    result = m_result;
+    m_has_result = false;
+  }
+
+  m_is_pending = false;
+  m_has_last = true;
+  m_last = result;
+  return true;
+}
+
+bool HoverPicker::IsCovered(const QPoint& position, int generation) const
+{
+  if (m_is_pending)
+    return m_pending_generation == generation && m_pending_rect.contains(position);
+  return m_has_last && m_last.m_generation == generation &&
+    m_last.m_rect.contains(position);
+}
+
+bool HoverPicker::GetLastResult(Result& result) const
+{
+  if (!m_has_last)
+    return false;
+  result = m_last;
+  return true;
+}
+
+qint64 HoverPicker::Now() const
+{
+  return m_clock.elapsed();
+}
+
+void HoverPicker::AccountLatency(qint64 latency)
+{
+  m_latencies.push_back(latency);
+  if (m_latencies.size() >= kLatencyReportCount)
+    ReportLatency();
+}
+
+void HoverPicker::ReportLatency()
+{
+  if (m_latencies.empty())
+    return;
+
+  std::sort(m_latencies.begin(), m_latencies.end());
+  const size_t count = m_latencies.size();
+  qDebug() << "Hover tooltips:" << count << "shown, latency median"
+    << m_latencies[count / 2] << "ms, p95" << m_latencies[(count * 95) / 100]
+    << "ms, max" << m_latencies.back() << "ms";
+  m_latencies.clear();
+}
+
+void HoverPicker::Pick(int sequence, const Query& query)
+{
+  if (sequence != m_sequence)
+    return; // Superseded while waiting in queue
+
+  std::vector<sdk::gdb::IFeatureSP> features;
+  if (!ReadFeatures(sequence, query, features))
+    return;
+
+  Result result;
+  result.m_rect = query.m_rect;
+  result.m_generation = query.m_generation;
+  result.m_move_time = query.m_move_time;
+  if (!FormatText(sequence, features, result.m_text))
+    return;
+
+  {
+    QMutexLocker lock(&m_lock);
+    if (sequence != m_sequence)
+      return; // Superseded while being picked
+    m_result = result;
+    m_has_result = true;
+  }
+
+  emit signalTooltipReady();
+}
+
+bool HoverPicker::ReadFeatures(int sequence, const Query& query,
+  std::vector<sdk::gdb::IFeatureSP>& features) const
+{
+  features.clear();
+
+  if (!query.m_is_picked)
+  {
+    // Index is being built, features are found by SDK
+    sdk::gdb::IEnumFeatureSP found;
+    if (!query.m_scene_info || SDK_FAILED(query.m_scene_info->FindFeatures(
+      query.m_geometry_filter, NULL, NULL, found)) || !found)
+      return true;
+    for (sdk::gdb::IFeatureSP feature; SDK_OK(found->Next(&feature)); feature.Release())
+    {
+      if (sequence != m_sequence)
+        return false;
+      features.push_back(feature);
+    }
+    return true;
+  }
+
+  if (query.m_feature_ids.empty() || !query.m_wks_factory)
+    return true;
+  sdk::gdb::IWorkspaceCollectionSP wks_collection;
+  if (SDK_FAILED(query.m_wks_factory->GetWorkspaces(&wks_collection)))
+    return true;
+
+  for (size_t i = 0; i < query.m_feature_ids.size(); ++i)
+  {
+    if (sequence != m_sequence)
+      return false;
+
+    sdk::gdb::IWorkspaceSP wks;
+    if (SDK_FAILED(wks_collection->GetWorkspaceByID(
+      DatasetID_WorkspaceID(query.m_feature_ids[i].did), &wks)) || !wks)
+      continue;
+
+    sdk::gdb::IFeatureSP feature;
+    if (SDK_OK(wks->GetFeature(query.m_feature_ids[i], &feature)) && feature)
+      features.push_back(feature);
+  }
+  return true;
+}
+
+bool HoverPicker::FormatText(int sequence,
+  const std::vector<sdk::gdb::IFeatureSP>& features, QString& text) const
+{
+  // One line of class name and text attributes per master feature, like
+  // the top level items of the feature info dialog
+  QStringList lines;
+  size_t more = 0;
+  for (size_t i = 0; i < features.size(); ++i)
+  {
+    const sdk::gdb::IFeatureSP& feature = features[i];
+    if (!feature)
+      continue;
+    if (SDK_OK(feature->GetMaster(NULL)))
+      continue; // Skip slaves.
+
+    if (static_cast<size_t>(lines.size()) == kMaxTooltipFeatures)
+    {
+      ++more;
+      continue;
+    }
+
+    if (sequence != m_sequence)
+      return false;
+
+    sdk::gdb::ClassCode class_code;
+    if (SDK_FAILED(feature->GetObjectClassCode(class_code)))
+      continue;
+    sdk::gdb::IFeatureDatasetSP dataset;
+    CatalogLabelsSP labels;
+    if (m_label_cache && SDK_OK(feature->GetFeatureDataset(&dataset)))
+      labels = m_label_cache->GetLabels(dataset);
+
+    QString line = GetClassName(labels,
+      sdk::gdb::kClassType_FeatureClass, class_code);
+
+    sdk::gdb::IAttributeCollectionSP attributes;
+    if (SDK_OK(feature->GetAttributes(&attributes)))
+    {
+      size_t shown = 0;
+      sdk::gdb::IAttributeSP attr;
+      for (SDKUInt32 a = 0; shown < kMaxTooltipAttributes &&
+        SDK_OK(attributes->GetAttribute(a, &attr)); attr.Release(), ++a)
+      {
+        sdk::ScopedAny v;
+        if (SDK_FAILED(attr->GetValue(v)) || !ANY_IS_STR(&v))
+          continue;
+        const QString value =
+          QString::fromStdWString(sdk::WideFromSDKString(*ANY_STR(&v)));
+        if (value.isEmpty())
+          continue;
+
+        sdk::gdb::ClassCode attr_class_code;
+        if (SDK_FAILED(attr->GetAttributeClassCode(attr_class_code)))
+          continue;
+        line += QString("\n  %1 - %2").arg(GetClassName(labels,
+          sdk::gdb::kClassType_AttributeClass, attr_class_code)).arg(value);
+        ++shown;
+      }
+    }
+    lines.append(line);
+  }
+
+  if (more)
+    lines.append(tr("... and %1 more").arg(more));
+
+  text = lines.join("\n");
+  return true;
+}
@@ -0,0 +1,128 @@
+// HoverPicker.h : Finds features under resting cursor for the tooltip off the UI thread
+//
+#ifndef HOVER_PICKER_H
+#define HOVER_PICKER_H
+#pragma once
+
+#include <vector>
+#include <QObject>
+#include <QMutex>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QString>
+#include <QRect>
+
+#include <datalayer/inc/geodatabase/gdb_workspace.h>
+#include <visualizationlayer/inc/visman/scene_manager_interface.h>
+#include "catalog_label_cache.h"
+
+// Reads features under the cursor and makes the tooltip text of them on a
+// worker thread. Only the latest request is delivered, superseded requests
+// are dropped. The text of the last delivered request is kept, so it is
+// shown again without query while the cursor stays inside its rectangle.
+class HoverPicker : public QObject
+{
+  Q_OBJECT
+
+public:
+  // Features to be described
+  struct Query
+  {
+    // Window rectangle around the cursor and number of the view
+    QRect                         m_rect;
+    int                           m_generation;
+    // Time of the cursor move, which started the query
+    qint64                        m_move_time;
+
+    // Features picked from the pick index ...
+    bool                          m_is_picked;
+    std::vector<sdk::gdb::ObjectID> m_feature_ids;
+    sdk::gdb::IWorkspaceFactorySP m_wks_factory;
+    // ... or scene information and filter of the rectangle to find them
+    sdk::vis::ISceneInformationSP m_scene_info;
+    sdk::geometry::IGeometrySP    m_geometry_filter;
+  };
+
+  // Tooltip of the query
+  struct Result
+  {
+    QRect   m_rect;
+    int     m_generation;
+    qint64  m_move_time;
+    // Empty if there is no feature under the cursor
+    QString m_text;
+  };
+
+  explicit HoverPicker(const CatalogLabelCacheSP& label_cache,
+    QObject* parent = 0);
+  ~HoverPicker();
+
+  // Queues the query, superseding all of previous requests
+  void Request(const Query& query);
+  // Drops all of pending requests and the last tooltip
+  void Cancel();
+
+  // Takes the tooltip of the latest request, returns false if there is no
+  // ready one. It becomes the last tooltip.
+  bool TakeResult(Result& result);
+
+  // Returns true if the position of the view is inside of rectangle of the
+  // pending request or of the last tooltip
+  bool IsCovered(const QPoint& position, int generation) const;
+  // Returns the last tooltip, false if it is still being made
+  bool GetLastResult(Result& result) const;
+
+  // Milliseconds of the picker clock, used for query move time
+  qint64 Now() const;
+  // Collects time from the cursor move to the shown tooltip, it is logged
+  // every 100 tooltips and on destruction
+  void AccountLatency(qint64 latency);
+
+signals:
+  // Emitted from worker thread when the latest request is done
+  void signalTooltipReady();
+
+private:
+  class Task;
+  friend class Task;
+
+  // Called by worker task
+  void Pick(int sequence, const Query& query);
+  // Reads features of the query, returns false if superseded meanwhile
+  bool ReadFeatures(int sequence, const Query& query,
+    std::vector<sdk::gdb::IFeatureSP>& features) const;
+  // Makes tooltip text of master features
+  bool FormatText(int sequence,
+    const std::vector<sdk::gdb::IFeatureSP>& features, QString& text) const;
+
+  // Logs the tooltip latency percentiles and forgets the samples
+  void ReportLatency();
+
+private:
+  // Class names of described features
+  const CatalogLabelCacheSP m_label_cache;
+
+  // Single worker, so requests are processed in order
+  QThreadPool          m_pool;
+
+  // Sequence number of the latest request
+  QAtomicInt           m_sequence;
+
+  // Latest done request
+  QMutex               m_lock;
+  Result               m_result;
+  bool                 m_has_result;
+
+  // Requested and shown tooltips, used by UI thread only
+  bool                 m_is_pending;
+  QRect                m_pending_rect;
+  int                  m_pending_generation;
+  bool                 m_has_last;
+  Result               m_last;
+
+  // Tooltip latencies in milliseconds
+  QElapsedTimer        m_clock;
+  std::vector<qint64>  m_latencies;
+};
+#endif // HOVER_PICKER_H
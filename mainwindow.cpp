@@ -24,6 +24,7 @@ MainWindow::MainWindow(QWidget *parent)
   connect(this, SIGNAL(signalRotate()), m_widget, SLOT(OnRotate()));
   connect(this, SIGNAL(signalOpenDatabaseWorkspace()), m_widget, SLOT(OnOpenDatabaseWorkspace()));
   connect(this, SIGNAL(signalGeodatabaseUpdateHistory()), m_widget, SLOT(OnGeodatabaseUpdateHistory()));
+  connect(this, SIGNAL(signalExportFeatures()), m_widget, SLOT(OnExportFeatures()));
   connect(this, SIGNAL(signalAddBookmark()), m_widget, SLOT(OnAddBookmark()));
   connect(this, SIGNAL(signalBookmarksList()), m_widget, SLOT(OnBookmarksList()));
   connect(this, SIGNAL(signalChangePortrayal(char*)), m_widget, SLOT(OnChangePortrayal(char*)));
@@ -142,6 +143,11 @@ void MainWindow::OnGeodatabaseUpdateHistory()
   emit signalGeodatabaseUpdateHistory();
 }
 
+void MainWindow::OnExportFeatures()
+{
+  emit signalExportFeatures();
+}
+
 void MainWindow::OnAddBookmark()
 {
   emit signalAddBookmark();
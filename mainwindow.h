@@ -30,6 +30,7 @@ signals:
   void signalRotate();
   void signalOpenDatabaseWorkspace();
   void signalGeodatabaseUpdateHistory();
+  void signalExportFeatures();
   void signalAddBookmark();
   void signalBookmarksList();
   void signalChangePortrayal(char*);
@@ -52,6 +53,7 @@ private slots:
   void OnRotate();
   void OnOpenDatabaseWorkspace();
   void OnGeodatabaseUpdateHistory();
+  void OnExportFeatures();
   void OnAddBookmark();
   void OnBookmarksList();
   void OnS52Portrayal();
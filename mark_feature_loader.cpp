@@ -0,0 +1,111 @@
+// MarkFeatureLoader.cpp : Prepares marked feature geometry off the UI thread
+//
+
+#include <QRunnable>
+
+#include "mark_feature_loader.h"
+
+class MarkFeatureLoader::Task : public QRunnable
+{
+public:
+  Task(MarkFeatureLoader* loader, int sequence,
+    const sdk::gdb::ObjectID& oid, const sdk::crs::IProjectionSP& projection)
+    : m_loader(loader),
+      m_sequence(sequence),
+      m_oid(oid),
+      m_projection(projection)
+  {
+  }
+
+  void run()
+  {
+    m_loader->Prepare(m_sequence, m_oid, m_projection);
+  }
+
+private:
+  MarkFeatureLoader*      m_loader;
+  int                     m_sequence;
+  sdk::gdb::ObjectID      m_oid;
+  sdk::crs::IProjectionSP m_projection;
+};
+
+MarkFeatureLoader::MarkFeatureLoader(const MarkedFeatureRendererSP& renderer,
+  QObject* parent)
+  : QObject(parent),
+    m_renderer(renderer),
+    m_pool(),
+    m_sequence(0),
+    m_lock(),
+    m_result(),
+    m_is_prepared(false),
+    m_has_result(false)
+{
+  m_pool.setMaxThreadCount(1);
+}
+
+MarkFeatureLoader::~MarkFeatureLoader()
+{
+  Cancel();
+  m_pool.waitForDone();
+}
+
+void MarkFeatureLoader::Request(const sdk::gdb::ObjectID& oid,
+  const sdk::crs::IProjectionSP& projection)
+{
+  if (!m_renderer || !projection)
+    return;
+
+  // Projection is cloned, so the worker does not share it with the scene
+  sdk::crs::IProjectionSP projection_copy;
+  if (SDK_FAILED(projection->Clone(&projection_copy)) || !projection_copy)
+    return;
+
+  int sequence = m_sequence.fetchAndAddOrdered(1) + 1;
+  m_pool.start(new Task(this, sequence, oid, projection_copy));
+}
+
+void MarkFeatureLoader::Cancel()
+{
+  m_sequence.fetchAndAddOrdered(1);
+
+  QMutexLocker lock(&m_lock);
+  m_has_result = false;
+  m_result = MarkedFeatureRenderer::PreparedMark();
+}
+
+bool MarkFeatureLoader::TakeResult(MarkedFeatureRenderer::PreparedMark& prepared,
+  bool& is_prepared)
+{
+  QMutexLocker lock(&m_lock);
+  if (!m_has_result)
+    return false;
+
+  prepared = m_result;
+  is_prepared = m_is_prepared;
+  m_result = MarkedFeatureRenderer::PreparedMark();
+  m_is_prepared = false;
+  m_has_result = false;
+  return true;
+}
+
+void MarkFeatureLoader::Prepare(int sequence, const sdk::gdb::ObjectID& oid,
+  const sdk::crs::IProjectionSP& projection)
+{
+  if (sequence != m_sequence)
+    return; // Superseded while waiting in queue
+
+  // Failure is delivered too, so the caller can report it
+  MarkedFeatureRenderer::PreparedMark prepared;
+  bool is_prepared = m_renderer->PrepareMark(oid, projection, prepared);
+
+  {
+    QMutexLocker lock(&m_lock);
+    if (sequence != m_sequence)
+      return; // Superseded while being prepared
+    m_result = prepared;
+    m_is_prepared = is_prepared;
+    m_has_result = true;
+  }
+
+  emit signalMarkReady();
+}
@@ -0,0 +1,66 @@
+// MarkFeatureLoader.h : Prepares marked feature geometry off the UI thread
+//
+#ifndef MARK_FEATURE_LOADER_H
+#define MARK_FEATURE_LOADER_H
+#pragma once
+
+#include <QObject>
+#include <QMutex>
+#include <QThreadPool>
+#include <QAtomicInt>
+
+#include <geometry/inc/coordinate_systems/crs_projection.h>
+#include "markedfeaturerenderer.h"
+
+// Runs MarkedFeatureRenderer::PrepareMark on a worker thread. Only the
+// latest request is delivered, superseded requests are dropped.
+class MarkFeatureLoader : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit MarkFeatureLoader(const MarkedFeatureRendererSP& renderer,
+    QObject* parent = 0);
+  ~MarkFeatureLoader();
+
+  // Queues the mark preparation, superseding all of previous requests
+  void Request(const sdk::gdb::ObjectID& oid,
+    const sdk::crs::IProjectionSP& projection);
+  // Drops all of pending requests
+  void Cancel();
+
+  // Takes the result of the latest request, returns false if there is no
+  // ready result. is_prepared is false if the feature could not be read.
+  bool TakeResult(MarkedFeatureRenderer::PreparedMark& prepared,
+    bool& is_prepared);
+
+signals:
+  // Emitted from worker thread when the latest request is done, whether
+  // the mark is prepared or not
+  void signalMarkReady();
+
+private:
+  class Task;
+  friend class Task;
+
+  // Called by worker task
+  void Prepare(int sequence, const sdk::gdb::ObjectID& oid,
+    const sdk::crs::IProjectionSP& projection);
+
+private:
+  // Renderer which prepares the geometry
+  const MarkedFeatureRendererSP       m_renderer;
+
+  // Single worker, so requests are processed in order
+  QThreadPool                         m_pool;
+
+  // Sequence number of the latest request
+  QAtomicInt                          m_sequence;
+
+  // Result of the latest request
+  QMutex                              m_lock;
+  MarkedFeatureRenderer::PreparedMark m_result;
+  bool                                m_is_prepared;
+  bool                                m_has_result;
+};
+#endif // MARK_FEATURE_LOADER_H
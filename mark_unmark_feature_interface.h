@@ -4,12 +4,23 @@
 #define MARK_UNMARK_FEATURE_INTERFACE_H
 #pragma once
 
+#include <vector>
+#include "changed_feature_collector.h"
+
 // Interface to mark/unmark feature on chart
 class MarkUnmarkFeature
 {
 public:
-  // Marks feature specified by the ObjectID.
+  // Marks feature specified by the ObjectID. The mark is prepared
+  // asynchronously, true means the request is queued, failure to read the
+  // feature is reported when the request is done.
   virtual bool MarkFeature(sdk::gdb::ObjectID& feature_id) = 0;
+  // Marks all of features specified by the ObjectIDs, previous marks are removed.
+  virtual bool MarkFeatures(const std::vector<sdk::gdb::ObjectID>& feature_ids) = 0;
+  // Marks features changed since the update in the datasets of the view,
+  // previous marks are removed. Marks are shown when they are prepared.
+  virtual bool MarkChangedFeatures(
+    const ChangedFeatureCollector::Since& since) = 0;
   // Removes the feature object marking.
   virtual bool UnmarkFeature() = 0;
 };
@@ -1,10 +1,13 @@
 // MarkedFeatureRenderer.cpp : Renders the marked feature object above chart
 //
 
+#include <algorithm>
+
 #include <base/inc/sdk_string_handler.h>
 #include <base/inc/sdk_any_helpers.h>
 #include <base/inc/sdk_any_handler.h>
 #include <base/inc/math/matrix3x2.h>
+#include <base/inc/base_library/base_types_functions.h>
 #include <geometry/inc/coordinate_systems/crs_basic_transformation.inl>
 #include <geometry/inc/coordinate_systems/crs_coordinate_transformation.h>
 #include <visualizationlayer/inc/graphics/2d_render_target_factory_interface.h>
@@ -27,32 +30,35 @@ MarkedFeatureRenderer::MarkedFeatureRenderer(
   const S52ResourceManagerSP& s52_res_manager)
   : m_wks_factory(wks_factory),
     m_s52_resource_manager(s52_res_manager),
+    m_resource_owner(s52_res_manager ?
+      s52_res_manager->CreateResourceOwner() : 0),
     m_ref(0),
     m_render_target(),
-    m_feature_object_path(),
-    m_base_scale(0.0),
-    m_base_center(),
-    m_feature_geometry_type(sdk::geometry::kGMT_Null)
+    m_lock(),
+    m_groups(),
+    m_mark_ids()
 {
 }
 
 MarkedFeatureRenderer::~MarkedFeatureRenderer()
 {
+  if (m_s52_resource_manager)
+    m_s52_resource_manager->ReleaseResources(m_resource_owner);
 }
 
 SDKUInt32 MarkedFeatureRenderer::AddRef() const throw()
 {
-  ++m_ref;
+  // Renderer is shared with the mark preparation worker
+  SDKAtomicRefCountInc(&m_ref);
   return m_ref;
 }
 
 SDKUInt32 MarkedFeatureRenderer::Release() const throw()
 {
-  unsigned long references = --m_ref;
-  if (0 == references)
+  SDKResult is_non_zero = SDKAtomicRefCountDec(&m_ref);
+  if (!is_non_zero)
     delete this;
-
-  return references;
+  return is_non_zero ? m_ref : 0;
 }
 
 SDKResult MarkedFeatureRenderer::GetInterface(const sdk::Uuid& iid, 
@@ -112,12 +118,6 @@ SDKResult MarkedFeatureRenderer::Render(
   if (!m_render_target || !m_s52_resource_manager)
     return sdk::Err_Uninitialized;
 
-  sdk::ScopedAny any_ss_catalog;
-  if (SDK_FAILED(context->GetParameter(sdk::vis::kSceneRendererParameter_SymbolSetCatalog, any_ss_catalog)))
-    return sdk::Err_InternalError;
-  sdk::vis::sdl::ISymbolSetCatalogSP ss_catalog(
-    sdk::GetInterfaceT<sdk::vis::sdl::ISymbolSetCatalog>(ANY_COMPONENT(&any_ss_catalog)));
-  
   sdk::ScopedAny any_projection;
   if (SDK_FAILED(context->GetParameter(sdk::vis::kSceneRendererParameter_Projection, any_projection)))
     return sdk::Err_InternalError;
@@ -138,20 +138,13 @@ SDKResult MarkedFeatureRenderer::Render(
   // Clean up the texture
   m_render_target->FillBackground(sdk::ColorF(0.f, 0.f, 0.f, 0.f));
 
-  // Trying to draw the feature object mark, if it exists
-  if (m_feature_object_path)
+  // Trying to draw the feature object marks, if they exist
+  QMutexLocker lock(&m_lock);
+  if (!m_groups.empty())
   {
-    // Changing the center of coordinate system
-    sdk::crs::ICoordinateTransformationSP coord_transform =
-      sdk::GetInterfaceT<sdk::crs::ICoordinateTransformation>(projection);
     if (!coord_transform)
       return sdk::Err_InternalError;
 
-    sdk::CMatrix3X2 matrix_translate;
-    SDKPointF2D base_center;
-    coord_transform->ForwardIF(1, &m_base_center, &base_center);
-    matrix_translate.Translate(base_center.x, base_center.y);
-
     double scale = 1.0;
     sdk::crs::IProjectionParametersSP proj_param;
     if (SDK_FAILED(projection->GetProjectionParameters(&proj_param)) || !proj_param) 
@@ -159,45 +152,71 @@ SDKResult MarkedFeatureRenderer::Render(
     if (SDK_FAILED(proj_param->GetParameterValueByID(kProjPar_ScaleFactor, scale)))
       return sdk::Err_InternalError;
 
-    double k = m_base_scale / scale;
-    sdk::CMatrix3X2 matrix_scale;
-    matrix_scale.Scale(float(k), float(k));
+    sdk::gfx::RenderTargetFactorySP rtf;
+    if (SDK_FAILED(m_render_target->GetParent(rtf)) || !rtf)
+      return sdk::Err_InternalError;
 
-    m_render_target->PushTransformationMatrix(matrix_translate);
-    m_render_target->PushTransformationMatrix(matrix_scale);
+    // Render target bounds, used to skip groups outside of the view
+    SDKSize size;
+    if (SDK_FAILED(m_render_target->GetRenderTargetSize(size)))
+      return sdk::Err_InternalError;
+    const float half_width = float(size.width) / 2.0f;
+    const float half_height = float(size.height) / 2.0f;
 
-    // Creating appropriate brushes and stroke style
-    sdk::ColorF brush_color = m_s52_resource_manager->GetColor(
-      ss_catalog, sdk::vis::s52::kColorIndex_NINFO);
+    // Getting appropriate brushes and stroke style from the shared cache
     sdk::gfx::RenderTargetBrushSP draw_brush;
-    if (SDK_FAILED(m_render_target->CreateSolidColorBrush(brush_color, 
-      draw_brush)))
+    if (!m_s52_resource_manager->GetSolidBrush(m_resource_owner,
+      m_render_target, sdk::vis::s52::kColorIndex_NINFO, 1.0f, draw_brush))
       return sdk::Err_InternalError;
 
-    brush_color.a = 0.5f;
     sdk::gfx::RenderTargetBrushSP fill_brush;
-    if (SDK_FAILED(m_render_target->CreateSolidColorBrush(brush_color, 
-      fill_brush)))
+    if (!m_s52_resource_manager->GetSolidBrush(m_resource_owner,
+      m_render_target, sdk::vis::s52::kColorIndex_NINFO, 0.5f, fill_brush))
       return sdk::Err_InternalError;
 
     sdk::gfx::RenderTargetStrokeStyleSP stroke_style;
-    if (SDK_FAILED(m_render_target->CreateStrokeStyle(
-      sdk::gfx::StrokeStyleOptions(), NULL, 0, stroke_style)) || !stroke_style)
+    if (!m_s52_resource_manager->GetStrokeStyle(m_resource_owner,
+      m_render_target, stroke_style))
       return sdk::Err_InternalError;
 
-    // Rendering the appropriate feature object mark
-    switch(m_feature_geometry_type)
+    for (MarkGroups::iterator it = m_groups.begin(); it != m_groups.end(); ++it)
     {
-      case sdk::geometry::kGMT_Surface:
-      case sdk::geometry::kGMT_MultiSurface:
-        m_render_target->FillPath(m_feature_object_path, fill_brush);
-      case sdk::geometry::kGMT_Point:
-      case sdk::geometry::kGMT_Curve:
-      case sdk::geometry::kGMT_CompositeCurve:
-        m_render_target->DrawPath(m_feature_object_path, draw_brush, float(6/k),
+      MarkGroup& group = it->second;
+      if (group.m_marks.empty())
+        continue;
+
+      // Changing the center of coordinate system
+      SDKPointF2D base_center;
+      coord_transform->ForwardIF(1, &group.m_base.m_base_center, &base_center);
+      double k = group.m_base.m_base_scale / scale;
+
+      // Skipping the group, if its bounds are outside of render target
+      float xmin = base_center.x + float(group.m_min.x * k);
+      float xmax = base_center.x + float(group.m_max.x * k);
+      float ymin = base_center.y + float(group.m_min.y * k);
+      float ymax = base_center.y + float(group.m_max.y * k);
+      if (xmax < -half_width || xmin > half_width ||
+          ymax < -half_height || ymin > half_height)
+        continue;
+
+      if (group.m_dirty && !BuildGroupPaths(rtf, group))
+        continue;
+
+      sdk::CMatrix3X2 matrix_translate;
+      matrix_translate.Translate(base_center.x, base_center.y);
+      sdk::CMatrix3X2 matrix_scale;
+      matrix_scale.Scale(float(k), float(k));
+
+      m_render_target->RemoveTransformationMatrixes();
+      m_render_target->PushTransformationMatrix(matrix_translate);
+      m_render_target->PushTransformationMatrix(matrix_scale);
+
+      // One fill call for all of surfaces and one stroke call for all of marks
+      if (group.m_fill_path)
+        m_render_target->FillPath(group.m_fill_path, fill_brush);
+      if (group.m_draw_path)
+        m_render_target->DrawPath(group.m_draw_path, draw_brush, float(6/k),
           stroke_style);
-      default:
-        break;
     }
   }
 
@@ -221,27 +240,154 @@ SDKResult MarkedFeatureRenderer::GetProperty(const sdk::SDKPropertyID& id,
 bool MarkedFeatureRenderer::SetMark(const sdk::gdb::ObjectID& oid, const sdk::crs::IProjectionSP& projection_source,
   sdk::GeoIntPoint& feature_object_position, double& dataset_min_disp_scale)
 {
-  m_feature_object_path.Release();
-  m_base_scale = 0.0;
-  m_base_center = sdk::GeoIntPoint();
-  m_feature_geometry_type = sdk::geometry::kGMT_Null;
+  RemoveMark();
 
-  if (!projection_source || !m_wks_factory || !m_render_target)
-    return false; // Uninitialized.
+  PreparedMark prepared;
+  if (!PrepareMark(oid, projection_source, prepared))
+    return false;
+  if (!ApplyMark(prepared, true))
+    return false;
+
+  feature_object_position = prepared.m_position;
+  dataset_min_disp_scale = prepared.m_min_disp_scale;
+  return true;
+}
+
+size_t MarkedFeatureRenderer::AddMarks(
+  const std::vector<sdk::gdb::ObjectID>& oids,
+  const sdk::crs::IProjectionSP& projection_source)
+{
+  // Already marked features are not read again
+  std::vector<sdk::gdb::ObjectID> new_oids;
+  new_oids.reserve(oids.size());
+  {
+    QMutexLocker lock(&m_lock);
+    for (std::vector<sdk::gdb::ObjectID>::const_iterator it = oids.begin();
+      it != oids.end(); ++it)
+    {
+      if (m_mark_ids.find(*it) == m_mark_ids.end())
+        new_oids.push_back(*it);
+    }
+  }
+
+  std::vector<PreparedMark> prepared;
+  PrepareMarks(new_oids, projection_source, prepared);
+  return ApplyMarks(prepared);
+}
+
+size_t MarkedFeatureRenderer::PrepareMarks(
+  const std::vector<sdk::gdb::ObjectID>& oids,
+  const sdk::crs::IProjectionSP& projection_source,
+  std::vector<PreparedMark>& prepared) const
+{
+  if (!projection_source || !m_wks_factory)
+    return 0; // Uninitialized.
 
-  // Getting appropriate workspace, containing required feature
   sdk::gdb::IWorkspaceCollectionSP wks_collection;
   if (SDK_FAILED(m_wks_factory->GetWorkspaces(&wks_collection)))
-    return false;
+    return 0;
+
+  // Processing features dataset by dataset, so each of base projections is
+  // prepared only once and workspace lookups are shared
+  std::vector<sdk::gdb::ObjectID> sorted_oids(oids);
+  std::sort(sorted_oids.begin(), sorted_oids.end(), ObjectIDLess());
+
+  std::map<sdk::gdb::DatasetID, MarkBase> bases;
+  const size_t prepared_before = prepared.size();
+  prepared.reserve(prepared_before + sorted_oids.size());
 
   sdk::gdb::IWorkspaceSP wks;
-  if (SDK_FAILED(wks_collection->GetWorkspaceByID(
-    DatasetID_WorkspaceID(oid.did), &wks)))
-    return false;
+  bool wks_valid = false;
+  sdk::gdb::WorkspaceID wks_id = 0;
+
+  for (std::vector<sdk::gdb::ObjectID>::const_iterator it = sorted_oids.begin();
+    it != sorted_oids.end(); ++it)
+  {
+    if (it != sorted_oids.begin() && !ObjectIDLess()(*(it - 1), *it))
+      continue; // Duplicate
+
+    if (!wks_valid || wks_id != DatasetID_WorkspaceID(it->did))
+    {
+      wks.Release();
+      wks_id = DatasetID_WorkspaceID(it->did);
+      wks_valid = SDK_OK(wks_collection->GetWorkspaceByID(wks_id, &wks));
+      if (!wks)
+        wks_valid = false;
+    }
+    if (!wks_valid)
+      continue;
+
+    sdk::gdb::IFeatureSP feature;
+    if (SDK_FAILED(wks->GetFeature(*it, &feature)) || !feature)
+      continue;
+
+    std::map<sdk::gdb::DatasetID, MarkBase>::iterator base_it =
+      bases.find(it->did);
+    if (base_it == bases.end())
+    {
+      sdk::gdb::IFeatureDatasetSP feature_dataset;
+      if (SDK_FAILED(feature->GetFeatureDataset(&feature_dataset)))
+        continue;
+      sdk::gdb::IDatasetSP dataset =
+        sdk::GetInterfaceT<sdk::gdb::IDataset>(feature_dataset);
+      if (!dataset)
+        continue;
+
+      MarkBase base;
+      if (!PrepareBase(dataset, projection_source, base))
+        continue;
+      base_it = bases.insert(std::make_pair(it->did, base)).first;
+    }
+
+    PreparedMark mark;
+    mark.m_oid = *it;
+    mark.m_base = base_it->second;
+    if (!PrepareGeometry(feature, mark.m_base, mark.m_mark, NULL))
+      continue;
+
+    prepared.push_back(mark);
+  }
+
+  return prepared.size() - prepared_before;
+}
+
+size_t MarkedFeatureRenderer::ApplyMarks(const std::vector<PreparedMark>& prepared)
+{
+  // Publishing all of prepared marks at once
+  QMutexLocker lock(&m_lock);
+  size_t added = 0;
+  for (std::vector<PreparedMark>::const_iterator it = prepared.begin();
+    it != prepared.end(); ++it)
+  {
+    if (m_mark_ids.find(it->m_oid) != m_mark_ids.end())
+      continue;
+    InsertMark(it->m_oid, it->m_base, it->m_mark);
+    ++added;
+  }
+
+  return added;
+}
+
+bool MarkedFeatureRenderer::RemoveMark()
+{
+  // Releasing the graphic paths, which belong to marked features
+  QMutexLocker lock(&m_lock);
+  m_groups.clear();
+  m_mark_ids.clear();
+
+  return true;
+}
+
+bool MarkedFeatureRenderer::PrepareMark(const sdk::gdb::ObjectID& oid,
+  const sdk::crs::IProjectionSP& projection_source,
+  PreparedMark& prepared) const
+{
+  if (!projection_source)
+    return false; // Uninitialized.
 
   // Getting feature itself
   sdk::gdb::IFeatureSP feature;
-  if (SDK_FAILED(wks->GetFeature(oid, &feature)) || !feature)
+  if (!GetFeature(oid, feature))
     return false;
 
   // And feature dataset
@@ -253,19 +399,74 @@ bool MarkedFeatureRenderer::SetMark(const sdk::gdb::ObjectID& oid, const sdk::cr
   if (!dataset)
     return false;
 
-  // Getting dataset scale/center
-  sdk::ScopedAny scale;
-  if (SDK_FAILED(dataset->GetDatasetProperty(sdk::gdb::kDSP_CompilationScale, 
-    scale)))
-    return false;
-  m_base_scale = static_cast<double>(ANY_UI32(&scale) / 2.0);
-
   sdk::ScopedAny min_disp_scale;
   if (SDK_FAILED(dataset->GetDatasetProperty(sdk::gdb::kDSP_MinDispScale,
     min_disp_scale)))
     return false;
   min_disp_scale.ChangeType(kSDKAnyType_Double);
-  dataset_min_disp_scale = ANY_DOUBLE(&min_disp_scale);
+  prepared.m_min_disp_scale = ANY_DOUBLE(&min_disp_scale);
+
+  if (!PrepareBase(dataset, projection_source, prepared.m_base))
+    return false;
+  if (!PrepareGeometry(feature, prepared.m_base, prepared.m_mark,
+    &prepared.m_position))
+    return false;
+
+  prepared.m_oid = oid;
+  return true;
+}
+
+bool MarkedFeatureRenderer::ApplyMark(const PreparedMark& prepared,
+  bool replace)
+{
+  QMutexLocker lock(&m_lock);
+
+  if (replace)
+  {
+    m_groups.clear();
+    m_mark_ids.clear();
+  }
+  else if (m_mark_ids.find(prepared.m_oid) != m_mark_ids.end())
+    return true; // Already marked
+
+  InsertMark(prepared.m_oid, prepared.m_base, prepared.m_mark);
+  return true;
+}
+
+size_t MarkedFeatureRenderer::GetMarkCount() const
+{
+  QMutexLocker lock(&m_lock);
+  return m_mark_ids.size();
+}
+
+bool MarkedFeatureRenderer::GetFeature(const sdk::gdb::ObjectID& oid,
+  sdk::gdb::IFeatureSP& feature) const
+{
+  if (!m_wks_factory)
+    return false; // Uninitialized.
+
+  // Getting appropriate workspace, containing required feature
+  sdk::gdb::IWorkspaceCollectionSP wks_collection;
+  if (SDK_FAILED(m_wks_factory->GetWorkspaces(&wks_collection)))
+    return false;
+
+  sdk::gdb::IWorkspaceSP wks;
+  if (SDK_FAILED(wks_collection->GetWorkspaceByID(
+    DatasetID_WorkspaceID(oid.did), &wks)))
+    return false;
+
+  return SDK_OK(wks->GetFeature(oid, &feature)) && feature;
+}
+
+bool MarkedFeatureRenderer::PrepareBase(const sdk::gdb::IDatasetSP& dataset,
+  const sdk::crs::IProjectionSP& projection_source, MarkBase& base) const
+{
+  // Getting dataset scale/center
+  sdk::ScopedAny scale;
+  if (SDK_FAILED(dataset->GetDatasetProperty(sdk::gdb::kDSP_CompilationScale, 
+    scale)))
+    return false;
+  base.m_base_scale = static_cast<double>(ANY_UI32(&scale) / 2.0);
 
   sdk::geometry::IEnvelopeSP dataset_envelope_ptr;
   if (SDK_FAILED(dataset->GetBounds(&dataset_envelope_ptr)))
@@ -275,9 +476,9 @@ bool MarkedFeatureRenderer::SetMark(const sdk::gdb::ObjectID& oid, const sdk::cr
     &dataset_envelope.xmin, &dataset_envelope.ymin,
     &dataset_envelope.xmax, &dataset_envelope.ymax)))
     return false;
-  m_base_center.x = dataset_envelope.xmin +
+  base.m_base_center.x = dataset_envelope.xmin +
     ((dataset_envelope.xmax - dataset_envelope.xmin) / 2);
-  m_base_center.y = (dataset_envelope.ymin + dataset_envelope.ymax) / 2;
+  base.m_base_center.y = (dataset_envelope.ymin + dataset_envelope.ymax) / 2;
 
   // Preparing projection
   sdk::crs::IProjectionSP projection;
@@ -288,177 +489,221 @@ bool MarkedFeatureRenderer::SetMark(const sdk::gdb::ObjectID& oid, const sdk::cr
     return false;
   proj_params->SetParameterValueByID(kProjPar_LatitudeOfCenter, 0.0);
   proj_params->SetParameterValueByID(kProjPar_LatitudeOfOrigin,
-    sdk::DegFromGeoInt(m_base_center.y));
+    sdk::DegFromGeoInt(base.m_base_center.y));
   proj_params->SetParameterValueByID(kProjPar_LongitudeOfOrigin,
-    sdk::DegFromGeoInt(m_base_center.x));
+    sdk::DegFromGeoInt(base.m_base_center.x));
   proj_params->SetParameterValueByID(kProjPar_ScaleFactor,
-    m_base_scale);
+    base.m_base_scale);
   if (SDK_FAILED(projection->SetProjectionParameters(proj_params)))
     return false;
 
+  base.m_projection = projection;
+  return true;
+}
+
+bool MarkedFeatureRenderer::PrepareGeometry(const sdk::gdb::IFeatureSP& feature,
+  const MarkBase& base, Mark& mark, sdk::GeoIntPoint* position) const
+{
   // Getting feature shape
   sdk::geometry::IGeometrySP feature_shape;
   if (SDK_FAILED(feature->GetShape(&feature_shape)) || !feature_shape)
     return false;
-  if (SDK_FAILED(feature->GetShapeType(m_feature_geometry_type)))
+  if (SDK_FAILED(feature->GetShapeType(mark.m_geometry_type)))
     return false;
 
-  // Getting feature shape envelope
-  sdk::geometry::IEnvelopeSP feature_shape_envelope;
-  if (SDK_FAILED(feature_shape->GetEnvelope(&feature_shape_envelope))
-    || !feature_shape_envelope)
-    return false;
+  if (position)
+  {
+    // Getting feature shape envelope
+    sdk::geometry::IEnvelopeSP feature_shape_envelope;
+    if (SDK_FAILED(feature_shape->GetEnvelope(&feature_shape_envelope))
+      || !feature_shape_envelope)
+      return false;
+
+    sdk::GeoIntRect feature_shape_envelope_rect;
+    if (SDK_FAILED(feature_shape_envelope->GetCoordinates(kSDKAnyType_GeoInt,
+      &feature_shape_envelope_rect.min.x, &feature_shape_envelope_rect.min.y,
+      &feature_shape_envelope_rect.max.x, &feature_shape_envelope_rect.max.y)))
+      return false;
+    *position = feature_shape_envelope_rect.Center();
+  }
 
-  sdk::GeoIntRect feature_shape_envelope_rect;
-  if (SDK_FAILED(feature_shape_envelope->GetCoordinates(kSDKAnyType_GeoInt,
-    &feature_shape_envelope_rect.min.x, &feature_shape_envelope_rect.min.y,
-    &feature_shape_envelope_rect.max.x, &feature_shape_envelope_rect.max.y)))
-    return false;
-  feature_object_position = feature_shape_envelope_rect.Center();
+  switch(mark.m_geometry_type)
+  {
+  case sdk::geometry::kGMT_Point:
+  case sdk::geometry::kGMT_Multipoint:
+  case sdk::geometry::kGMT_Curve:
+  case sdk::geometry::kGMT_CompositeCurve:
+  case sdk::geometry::kGMT_Surface:
+  case sdk::geometry::kGMT_MultiSurface:
+    break;
+  default:
+    return false; // Geometry type is not supported
+  }
 
   // Processing the feature geometry
   std::vector<sdk::GeoIntPoint> geoint_points;
-  if (!CrackGeometry(feature_shape, geoint_points) || geoint_points.empty())
+  const bool is_cracked =
+    mark.m_geometry_type == sdk::geometry::kGMT_MultiSurface ?
+    CrackMultiSurface(feature_shape, geoint_points, mark.m_ring_sizes) :
+    CrackGeometry(feature_shape, geoint_points);
+  if (!is_cracked || geoint_points.empty())
     return false;
   sdk::crs::ICoordinateTransformationSP coord_transform =
-    sdk::GetInterfaceT<sdk::crs::ICoordinateTransformation>(projection);
+    sdk::GetInterfaceT<sdk::crs::ICoordinateTransformation>(base.m_projection);
   if (!coord_transform)
     return false;
   coord_transform->ForwardIF(
     static_cast<SDKUInt32>(geoint_points.size()), &geoint_points.front(),
     reinterpret_cast<sdk::PointF2D*>(&geoint_points.front()));
 
-  // Creating a graphics path from given geopoints
-  sdk::gfx::RenderTargetFactorySP rtf;
-  if (SDK_FAILED(m_render_target->GetParent(rtf)) || !rtf)
-    return false;
-
   const sdk::PointF2D* points =
     reinterpret_cast<const sdk::PointF2D*>(&(geoint_points.front()));
+  mark.m_points.assign(points, points + geoint_points.size());
+
+  return true;
+}
 
-  switch(m_feature_geometry_type)
+void MarkedFeatureRenderer::InsertMark(const sdk::gdb::ObjectID& oid,
+  const MarkBase& base, const Mark& mark)
+{
+  // Getting dataset group, creating it if needed
+  MarkGroups::iterator group_it = m_groups.find(oid.did);
+  if (group_it == m_groups.end())
   {
-  case sdk::geometry::kGMT_Point:
-    {
-      // Creating a cross mark
-      sdk::gfx::GraphicsPathSP path;
-      if (SDK_FAILED(rtf->CreateGraphicsPath(path)) || !path)
-        return false;
-      sdk::gfx::GraphicsPathEditorSP path_editor;
-      if (SDK_FAILED(path->StartEdit(path_editor)) || !path_editor)
-        return false;
+    MarkGroup group;
+    group.m_base = base;
+    group_it = m_groups.insert(std::make_pair(oid.did, group)).first;
+  }
+  MarkGroup& group = group_it->second;
 
-      sdk::PointF2D p[2];
-      p[0] = points[0];
-      p[0].x -= 10;
-      p[1] = points[0];
-      p[1].x += 10;
-
-      path_editor->StartFigure(p[0], sdk::gfx::StartFigureStyle_Filled);
-      path_editor->AddLine(p[1]);
-      path_editor->FinishFigure(sdk::gfx::FinishFigureRule_LeaveOpened);
-
-      p[0] = points[0];
-      p[0].y += 10;
-      p[1] = points[0];
-      p[1].y -= 10;
-      path_editor->StartFigure(p[0], sdk::gfx::StartFigureStyle_Filled);
-      path_editor->AddLine(p[1]);
-      path_editor->FinishFigure(sdk::gfx::FinishFigureRule_LeaveOpened);
-
-      path->FinishEdit();
-      m_feature_object_path = path;
-    }
-    break;
-  case sdk::geometry::kGMT_Multipoint:
+  // Updating group bounds, point marks are extended by the cross size
+  const float margin = (mark.m_geometry_type == sdk::geometry::kGMT_Point ||
+    mark.m_geometry_type == sdk::geometry::kGMT_Multipoint) ? 10.0f : 0.0f;
+  for (size_t c = 0; c < mark.m_points.size(); ++c)
+  {
+    const sdk::PointF2D& p = mark.m_points[c];
+    if (group.m_marks.empty() && 0 == c)
     {
-      // Creating a set of cross marks
-      sdk::gfx::GraphicsPathSP path;
-      if (SDK_FAILED(rtf->CreateGraphicsPath(path)) || !path)
-        return false;
-      sdk::gfx::GraphicsPathEditorSP path_editor;
-      if (SDK_FAILED(path->StartEdit(path_editor)) || !path_editor)
-        return false;
-
-      for (size_t c = 0; c < geoint_points.size(); ++c)
-      {
-        sdk::PointF2D p[2];
-        p[0] = points[c];
-        p[0].x -= 10;
-        p[1] = points[c];
-        p[1].x += 10;
-
-        path_editor->StartFigure(p[0], sdk::gfx::StartFigureStyle_Filled);
-        path_editor->AddLine(p[1]);
-        path_editor->FinishFigure(sdk::gfx::FinishFigureRule_LeaveOpened);
-
-        p[0] = points[c];
-        p[0].y += 10;
-        p[1] = points[c];
-        p[1].y -= 10;
-        path_editor->StartFigure(p[0], sdk::gfx::StartFigureStyle_Filled);
-        path_editor->AddLine(p[1]);
-        path_editor->FinishFigure(sdk::gfx::FinishFigureRule_LeaveOpened);
-      }
-
-      path->FinishEdit();
-      m_feature_object_path = path;
+      group.m_min = sdk::PointF2D(p.x - margin, p.y - margin);
+      group.m_max = sdk::PointF2D(p.x + margin, p.y + margin);
+      continue;
     }
-    break;
-  case sdk::geometry::kGMT_Curve:
-  case sdk::geometry::kGMT_CompositeCurve:
-    {
-      // Making a feature object contour mark
-      sdk::gfx::GraphicsPathSP path;
-      if (SDK_FAILED(rtf->CreateGraphicsPath(path)) || !path)
-        return false;
-      sdk::gfx::GraphicsPathEditorSP path_editor;
-      if (SDK_FAILED(path->StartEdit(path_editor)) || !path_editor)
-        return false;
+    group.m_min.x = std::min(group.m_min.x, p.x - margin);
+    group.m_min.y = std::min(group.m_min.y, p.y - margin);
+    group.m_max.x = std::max(group.m_max.x, p.x + margin);
+    group.m_max.y = std::max(group.m_max.y, p.y + margin);
+  }
 
-      path_editor->StartFigure(points[0], sdk::gfx::StartFigureStyle_Filled);
-      path_editor->AddLines(&points[1],
-        static_cast<SDKUInt32>(geoint_points.size() - 1));
-      path_editor->FinishFigure(sdk::gfx::FinishFigureRule_LeaveOpened);
+  group.m_marks.push_back(mark);
+  group.m_dirty = true;
+  m_mark_ids.insert(oid);
+}
 
-      path->FinishEdit();
-      m_feature_object_path = path;
-    }
-    break;
-  case sdk::geometry::kGMT_Surface:
-    {
-      // Making a feature object contour mark
-      sdk::gfx::GraphicsPathSP path;
-      if (SDK_FAILED(rtf->CreateGraphicsPath(path)) || !path)
-        return false;
-      sdk::gfx::GraphicsPathEditorSP path_editor;
-      if (SDK_FAILED(path->StartEdit(path_editor)) || !path_editor)
-        return false;
+bool MarkedFeatureRenderer::BuildGroupPaths(
+  const sdk::gfx::RenderTargetFactorySP& rtf, MarkGroup& group)
+{
+  group.m_fill_path.Release();
+  group.m_draw_path.Release();
+
+  sdk::gfx::GraphicsPathSP fill_path;
+  sdk::gfx::GraphicsPathEditorSP fill_editor;
+  sdk::gfx::GraphicsPathSP draw_path;
+  sdk::gfx::GraphicsPathEditorSP draw_editor;
+  if (SDK_FAILED(rtf->CreateGraphicsPath(draw_path)) || !draw_path)
+    return false;
+  if (SDK_FAILED(draw_path->StartEdit(draw_editor)) || !draw_editor)
+    return false;
 
-      path_editor->StartFigure(points[0], sdk::gfx::StartFigureStyle_Filled);
-      path_editor->AddLines(&points[1],
-        static_cast<SDKUInt32>(geoint_points.size() - 1));
-      path_editor->FinishFigure(sdk::gfx::FinishFigureRule_CloseFigure);
+  for (std::vector<Mark>::const_iterator it = group.m_marks.begin();
+    it != group.m_marks.end(); ++it)
+  {
+    const sdk::PointF2D* points = &it->m_points.front();
+    const SDKUInt32 count = static_cast<SDKUInt32>(it->m_points.size());
 
-      path->FinishEdit();
-      m_feature_object_path = path;
+    switch(it->m_geometry_type)
+    {
+    case sdk::geometry::kGMT_Point:
+    case sdk::geometry::kGMT_Multipoint:
+      {
+        // Creating a set of cross marks
+        for (SDKUInt32 c = 0; c < count; ++c)
+        {
+          sdk::PointF2D p[2];
+          p[0] = points[c];
+          p[0].x -= 10;
+          p[1] = points[c];
+          p[1].x += 10;
+
+          draw_editor->StartFigure(p[0], sdk::gfx::StartFigureStyle_Filled);
+          draw_editor->AddLine(p[1]);
+          draw_editor->FinishFigure(sdk::gfx::FinishFigureRule_LeaveOpened);
+
+          p[0] = points[c];
+          p[0].y += 10;
+          p[1] = points[c];
+          p[1].y -= 10;
+          draw_editor->StartFigure(p[0], sdk::gfx::StartFigureStyle_Filled);
+          draw_editor->AddLine(p[1]);
+          draw_editor->FinishFigure(sdk::gfx::FinishFigureRule_LeaveOpened);
+        }
+      }
+      break;
+    case sdk::geometry::kGMT_Curve:
+    case sdk::geometry::kGMT_CompositeCurve:
+      {
+        // Making a feature object contour mark
+        draw_editor->StartFigure(points[0], sdk::gfx::StartFigureStyle_Filled);
+        draw_editor->AddLines(&points[1], count - 1);
+        draw_editor->FinishFigure(sdk::gfx::FinishFigureRule_LeaveOpened);
+      }
+      break;
+    case sdk::geometry::kGMT_Surface:
+    case sdk::geometry::kGMT_MultiSurface:
+      {
+        if (!fill_editor)
+        {
+          if (SDK_FAILED(rtf->CreateGraphicsPath(fill_path)) || !fill_path)
+            return false;
+          if (SDK_FAILED(fill_path->StartEdit(fill_editor)) || !fill_editor)
+            return false;
+        }
+
+        // Making a feature object contour and area marks, one for each of
+        // multi-surface exterior rings
+        const size_t ring_count =
+          it->m_ring_sizes.empty() ? 1 : it->m_ring_sizes.size();
+        const sdk::PointF2D* ring = points;
+        for (size_t r = 0; r < ring_count; ++r)
+        {
+          const SDKUInt32 ring_size =
+            it->m_ring_sizes.empty() ? count : it->m_ring_sizes[r];
+
+          draw_editor->StartFigure(ring[0], sdk::gfx::StartFigureStyle_Filled);
+          draw_editor->AddLines(&ring[1], ring_size - 1);
+          draw_editor->FinishFigure(sdk::gfx::FinishFigureRule_CloseFigure);
+
+          fill_editor->StartFigure(ring[0], sdk::gfx::StartFigureStyle_Filled);
+          fill_editor->AddLines(&ring[1], ring_size - 1);
+          fill_editor->FinishFigure(sdk::gfx::FinishFigureRule_CloseFigure);
+
+          ring += ring_size;
+        }
+      }
+      break;
+    default:
+      break;
     }
-    break;
-  default:
-    break;
   }
 
-  return true;
-}
-
-bool MarkedFeatureRenderer::RemoveMark()
-{
-  // Releasing the graphic path, which belongs to marked feature
-  m_feature_object_path.Release();
-  m_base_scale = 0.0;
-  m_base_center = sdk::GeoIntPoint();
-  m_feature_geometry_type = sdk::geometry::kGMT_Null;
+  draw_path->FinishEdit();
+  group.m_draw_path = draw_path;
+  if (fill_path)
+  {
+    fill_path->FinishEdit();
+    group.m_fill_path = fill_path;
+  }
 
+  group.m_dirty = false;
   return true;
 }
 
@@ -579,3 +824,39 @@ bool MarkedFeatureRenderer::CrackGeometry(
 
   return true;
 }
+
+bool MarkedFeatureRenderer::CrackMultiSurface(
+  const sdk::geometry::IGeometrySP& geometry,
+  std::vector<sdk::GeoIntPoint>& points, std::vector<SDKUInt32>& ring_sizes)
+{
+  points.clear();
+  ring_sizes.clear();
+
+  sdk::geometry::IGeometryCollectionSP surface_collection;
+  if (SDK_FAILED(geometry->GetInterface(IGeometryCollection::IID(),
+    reinterpret_cast<void**>(&surface_collection))))
+    return false;
+
+  SDKUInt32 surface_count = 0;
+  if (SDK_FAILED(surface_collection->GetGeometryCount(surface_count)))
+    return false;
+
+  for (SDKUInt32 c = 0; c < surface_count; ++c)
+  {
+    sdk::geometry::IGeometrySP surface;
+    if (SDK_FAILED(surface_collection->GetGeometry(c, &surface)) || !surface)
+      return false;
+
+    // Every surface gives its exterior ring only
+    std::vector<sdk::GeoIntPoint> ring;
+    if (!CrackGeometry(surface, ring))
+      return false;
+    if (ring.empty())
+      continue;
+
+    points.insert(points.end(), ring.begin(), ring.end());
+    ring_sizes.push_back(static_cast<SDKUInt32>(ring.size()));
+  }
+
+  return true;
+}
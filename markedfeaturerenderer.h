@@ -5,6 +5,9 @@
 #pragma once
 
 #include <vector>
+#include <map>
+#include <set>
+#include <QMutex>
 #include <base/inc/platform.h>
 #include <base/inc/sdk_results_enum.h>
 #include <base/inc/sdk_ref_ptr.h>
@@ -45,35 +48,145 @@ public:
   SDKResult SDK_CALLTYPE GetProperty(const sdk::SDKPropertyID& id, 
     SDKAny& value) const throw();
 
+  // Feature mark geometry, prepared in its dataset base projection
+  struct Mark
+  {
+    sdk::geometry::GeometryType   m_geometry_type;
+    std::vector<sdk::PointF2D>    m_points;
+    // Point counts of multi-surface exterior rings, which follow one
+    // another in m_points
+    std::vector<SDKUInt32>        m_ring_sizes;
+
+    Mark() : m_geometry_type(sdk::geometry::kGMT_Null), m_points(),
+      m_ring_sizes() {}
+  };
+
+  // Dataset base projection, marks are built and drawn relative to it
+  struct MarkBase
+  {
+    double                        m_base_scale;
+    sdk::GeoIntPoint              m_base_center;
+    sdk::crs::IProjectionSP       m_projection;
+
+    MarkBase() : m_base_scale(0.0), m_base_center(), m_projection() {}
+  };
+
+  // Result of the mark preparation, which may be done on any thread
+  struct PreparedMark
+  {
+    sdk::gdb::ObjectID            m_oid;
+    MarkBase                      m_base;
+    Mark                          m_mark;
+    // Feature envelope center and dataset minimal display scale
+    sdk::GeoIntPoint              m_position;
+    double                        m_min_disp_scale;
+
+    PreparedMark() : m_oid(), m_base(), m_mark(), m_position(),
+      m_min_disp_scale(0.0) {}
+  };
+
+  // Replaces all of marks with the single feature mark
   bool SetMark(const sdk::gdb::ObjectID& oid, const sdk::crs::IProjectionSP& projection,
     sdk::GeoIntPoint& feature_object_position, double& dataset_min_disp_scale);
+  // Adds a set of feature marks, returns number of marks added
+  size_t AddMarks(const std::vector<sdk::gdb::ObjectID>& oids,
+    const sdk::crs::IProjectionSP& projection);
+  // Removes all of marks
   bool RemoveMark();
 
-private:
-  // Extracts points from IGeometry
-  bool CrackGeometry(const sdk::geometry::IGeometrySP& geometry,
+  // Reads and projects the feature geometry. Does not change the renderer
+  // state, so it may be called from a worker thread.
+  bool PrepareMark(const sdk::gdb::ObjectID& oid,
+    const sdk::crs::IProjectionSP& projection, PreparedMark& prepared) const;
+  // Adds previously prepared mark, optionally replacing all of existing marks
+  bool ApplyMark(const PreparedMark& prepared, bool replace);
+
+  // Reads and projects geometries of a set of features, appending them to
+  // prepared. Dataset base projections are made once per call, positions
+  // and minimal display scales are not read. May be called from a worker thread.
+  size_t PrepareMarks(const std::vector<sdk::gdb::ObjectID>& oids,
+    const sdk::crs::IProjectionSP& projection,
+    std::vector<PreparedMark>& prepared) const;
+  // Adds previously prepared marks at once, returns number of marks added
+  size_t ApplyMarks(const std::vector<PreparedMark>& prepared);
+
+  // Returns number of marked features
+  size_t GetMarkCount() const;
+
+  // Extracts points from IGeometry, surfaces give their exterior ring only
+  static bool CrackGeometry(const sdk::geometry::IGeometrySP& geometry,
     std::vector<sdk::GeoIntPoint>& points);
 
+private:
+  // Marks sharing the same dataset base projection. All of them are drawn
+  // with one fill and one stroke path.
+  struct MarkGroup
+  {
+    MarkBase                      m_base;
+    // Bounds of all marks in base projection coordinates
+    sdk::PointF2D                 m_min;
+    sdk::PointF2D                 m_max;
+    std::vector<Mark>             m_marks;
+    sdk::gfx::GraphicsPathSP      m_fill_path;
+    sdk::gfx::GraphicsPathSP      m_draw_path;
+    bool                          m_dirty;
+
+    MarkGroup() : m_base(), m_min(), m_max(), m_marks(), m_fill_path(),
+      m_draw_path(), m_dirty(true) {}
+  };
+  typedef std::map<sdk::gdb::DatasetID, MarkGroup> MarkGroups;
+
+  struct ObjectIDLess
+  {
+    bool operator()(const sdk::gdb::ObjectID& l,
+      const sdk::gdb::ObjectID& r) const
+    {
+      if (l.did != r.did)
+        return l.did < r.did;
+      return l.oid < r.oid;
+    }
+  };
+  typedef std::set<sdk::gdb::ObjectID, ObjectIDLess> MarkIDs;
+
+  // Gets the feature by its ObjectID
+  bool GetFeature(const sdk::gdb::ObjectID& oid,
+    sdk::gdb::IFeatureSP& feature) const;
+  // Calculates dataset base scale, center and projection
+  bool PrepareBase(const sdk::gdb::IDatasetSP& dataset,
+    const sdk::crs::IProjectionSP& projection_source, MarkBase& base) const;
+  // Reads the feature shape and projects it into the base projection
+  bool PrepareGeometry(const sdk::gdb::IFeatureSP& feature,
+    const MarkBase& base, Mark& mark, sdk::GeoIntPoint* position) const;
+  // Puts the mark into the dataset group, m_lock should be held
+  void InsertMark(const sdk::gdb::ObjectID& oid, const MarkBase& base,
+    const Mark& mark);
+  // Rebuilds group fill/stroke paths from its marks
+  bool BuildGroupPaths(const sdk::gfx::RenderTargetFactorySP& rtf,
+    MarkGroup& group);
+
+  // Extracts exterior rings of all of surfaces of IGeometry multi-surface
+  static bool CrackMultiSurface(const sdk::geometry::IGeometrySP& geometry,
+    std::vector<sdk::GeoIntPoint>& points, std::vector<SDKUInt32>& ring_sizes);
+
 private:
   // Workspaces factory
   const sdk::gdb::IWorkspaceFactorySP m_wks_factory;
   // S-52 resource manager
   const S52ResourceManagerSP          m_s52_resource_manager;
+  // Owner of resources cached by the manager for this renderer
+  const S52ResourceManager::ResourceOwnerID m_resource_owner;
 
   // Number of references
-  mutable SDKUInt32                   m_ref;
+  mutable volatile SDKInt32           m_ref;
 
   // Render target to use for text drawing
   sdk::gfx::RenderTargetSP            m_render_target;
 
-  // Feature object graphic path
-  sdk::gfx::GraphicsPathSP            m_feature_object_path;
-
-  // Dataset base scale
-  double                              m_base_scale;
-  // Dataset base center
-  sdk::GeoIntPoint                    m_base_center;
-  // Feature geometry type
-  sdk::geometry::GeometryType         m_feature_geometry_type;
+  // Guards marks, which are changed on UI thread and read during rendering
+  mutable QMutex                      m_lock;
+  // Marks grouped by dataset
+  MarkGroups                          m_groups;
+  // Identifiers of marked features
+  MarkIDs                             m_mark_ids;
 };
 #endif // MARKEDFEATURERENDERER_H
@@ -0,0 +1,310 @@
+// pick_index.cpp : Window-space grid of features for picking under cursor
+//
+
+#include <math.h>
+#include <algorithm>
+
+#include "pick_index.h"
+
+namespace
+{
+  // Liang-Barsky clipping of the segment by the box, the part inside is
+  // a + (b - a) * [t0, t1]
+  bool ClipSegment(const QPointF& a, const QPointF& b, double left,
+    double top, double right, double bottom, double& t0, double& t1)
+  {
+    const double dx = b.x() - a.x();
+    const double dy = b.y() - a.y();
+    const double p[4] = { -dx, dx, -dy, dy };
+    const double q[4] = {
+      a.x() - left, right - a.x(), a.y() - top, bottom - a.y() };
+
+    t0 = 0.0;
+    t1 = 1.0;
+    for (int i = 0; i < 4; ++i)
+    {
+      if (p[i] == 0.0)
+      {
+        if (q[i] < 0.0)
+          return false; // Parallel and outside
+        continue;
+      }
+      const double t = q[i] / p[i];
+      if (p[i] < 0.0)
+        t0 = std::max(t0, t);
+      else
+        t1 = std::min(t1, t);
+      if (t0 > t1)
+        return false;
+    }
+    return true;
+  }
+
+  bool SegmentIntersectsBox(const QPointF& a, const QPointF& b,
+    float left, float top, float right, float bottom)
+  {
+    double t0 = 0.0, t1 = 1.0;
+    return ClipSegment(a, b, left, top, right, bottom, t0, t1);
+  }
+
+  // Crossing number test
+  bool IsInsideRing(const QPointF* points, quint32 count, const QPointF& position)
+  {
+    bool is_inside = false;
+    for (quint32 i = 0, j = count - 1; i < count; j = i++)
+    {
+      const QPointF& a = points[i];
+      const QPointF& b = points[j];
+      if ((a.y() > position.y()) != (b.y() > position.y()) &&
+        position.x() < (b.x() - a.x()) * (position.y() - a.y()) / (b.y() - a.y()) + a.x())
+        is_inside = !is_inside;
+    }
+    return is_inside;
+  }
+}
+
+PickIndex::PickIndex(const QSize& window_size, int cell_size)
+  : m_window_size(window_size),
+    m_cell_size(std::max(cell_size, 1)),
+    m_columns(std::max((window_size.width() + m_cell_size - 1) / m_cell_size, 1)),
+    m_rows(std::max((window_size.height() + m_cell_size - 1) / m_cell_size, 1)),
+    m_features(),
+    m_points(),
+    m_references(),
+    m_cell_begin(),
+    m_cell_features()
+{
+  for (int i = 0; i < kShapeKind_Count; ++i)
+    m_tolerance[i] = 0.0f;
+}
+
+void PickIndex::SetTolerance(ShapeKind kind, float tolerance)
+{
+  m_tolerance[kind] = std::max(tolerance, 0.0f);
+}
+
+void PickIndex::AddFeature(const sdk::gdb::ObjectID& oid, ShapeKind kind,
+  const std::vector<QPointF>& points)
+{
+  if (points.empty())
+    return;
+
+  const quint32 feature_index = static_cast<quint32>(m_features.size());
+  Feature feature = { oid, kind, static_cast<quint32>(m_points.size()),
+    static_cast<quint32>(points.size()) };
+  m_features.push_back(feature);
+  m_points.insert(m_points.end(), points.begin(), points.end());
+
+  const float tolerance = m_tolerance[kind];
+  const size_t count = points.size();
+  if (kind == kShapeKind_Point || count == 1)
+  {
+    for (size_t i = 0; i < count; ++i)
+    {
+      const float x = static_cast<float>(points[i].x());
+      const float y = static_cast<float>(points[i].y());
+      AddCells(feature_index, x - tolerance, y - tolerance,
+        x + tolerance, y + tolerance);
+    }
+    return;
+  }
+
+  // Segments are clipped by the window grown by the tolerance, then split
+  // by cell size, so long diagonal ones do not take all of cells of their
+  // bounding box. Surface ring is closed.
+  const double clip_left = -tolerance;
+  const double clip_top = -tolerance;
+  const double clip_right = m_window_size.width() + tolerance;
+  const double clip_bottom = m_window_size.height() + tolerance;
+  const size_t segment_count = kind == kShapeKind_Surface ? count : count - 1;
+  for (size_t i = 0; i < segment_count; ++i)
+  {
+    const QPointF& a = points[i];
+    const QPointF& b = points[(i + 1) % count];
+    double t0 = 0.0, t1 = 1.0;
+    if (!ClipSegment(a, b, clip_left, clip_top, clip_right, clip_bottom,
+      t0, t1))
+      continue;
+
+    const double dx = b.x() - a.x();
+    const double dy = b.y() - a.y();
+    const float ax = static_cast<float>(a.x() + dx * t0);
+    const float ay = static_cast<float>(a.y() + dy * t0);
+    const float cdx = static_cast<float>(dx * (t1 - t0));
+    const float cdy = static_cast<float>(dy * (t1 - t0));
+    const int pieces = std::max(1,
+      static_cast<int>(ceil(sqrt(cdx * cdx + cdy * cdy) / m_cell_size)));
+    for (int p = 0; p < pieces; ++p)
+    {
+      const float x0 = ax + cdx * p / pieces;
+      const float y0 = ay + cdy * p / pieces;
+      const float x1 = ax + cdx * (p + 1) / pieces;
+      const float y1 = ay + cdy * (p + 1) / pieces;
+      AddCells(feature_index,
+        std::min(x0, x1) - tolerance, std::min(y0, y1) - tolerance,
+        std::max(x0, x1) + tolerance, std::max(y0, y1) + tolerance);
+    }
+  }
+
+  if (kind == kShapeKind_Surface)
+    AddInterior(feature_index, &m_points[feature.m_first_point],
+      feature.m_point_count);
+}
+
+void PickIndex::AddCells(quint32 feature, float left, float top, float right,
+  float bottom)
+{
+  if (right < 0.0f || bottom < 0.0f ||
+    left >= m_window_size.width() || top >= m_window_size.height())
+    return;
+
+  // Clamped to the window, so converting to int can not overflow
+  left = std::max(left, 0.0f);
+  top = std::max(top, 0.0f);
+  right = std::min(right, static_cast<float>(m_window_size.width()));
+  bottom = std::min(bottom, static_cast<float>(m_window_size.height()));
+
+  const int first_column = std::max(static_cast<int>(left) / m_cell_size, 0);
+  const int last_column = std::min(static_cast<int>(right) / m_cell_size, m_columns - 1);
+  const int first_row = std::max(static_cast<int>(top) / m_cell_size, 0);
+  const int last_row = std::min(static_cast<int>(bottom) / m_cell_size, m_rows - 1);
+
+  for (int row = first_row; row <= last_row; ++row)
+  {
+    for (int column = first_column; column <= last_column; ++column)
+    {
+      Reference reference = { static_cast<quint32>(row * m_columns + column), feature };
+      m_references.push_back(reference);
+    }
+  }
+}
+
+void PickIndex::AddInterior(quint32 feature, const QPointF* points,
+  quint32 count)
+{
+  if (count < 3)
+    return;
+
+  // Cell rows are scanned through their centers, cells between pairs of
+  // ring crossings are inside
+  // Crossings are clamped to one cell around the window, so converting
+  // to int can not overflow
+  const double min_crossing = -m_cell_size;
+  const double max_crossing = m_window_size.width() + m_cell_size;
+  std::vector<float> crossings;
+  for (int row = 0; row < m_rows; ++row)
+  {
+    const float y = (row + 0.5f) * m_cell_size;
+    crossings.clear();
+    for (quint32 i = 0, j = count - 1; i < count; j = i++)
+    {
+      const QPointF& a = points[i];
+      const QPointF& b = points[j];
+      if ((a.y() > y) != (b.y() > y))
+        crossings.push_back(static_cast<float>(std::min(max_crossing,
+          std::max(min_crossing,
+          a.x() + (y - a.y()) * (b.x() - a.x()) / (b.y() - a.y())))));
+    }
+    std::sort(crossings.begin(), crossings.end());
+
+    for (size_t i = 0; i + 1 < crossings.size(); i += 2)
+    {
+      const int first_column = std::max(
+        static_cast<int>(ceil(crossings[i] / m_cell_size - 0.5f)), 0);
+      const int last_column = std::min(
+        static_cast<int>(floor(crossings[i + 1] / m_cell_size - 0.5f)), m_columns - 1);
+      for (int column = first_column; column <= last_column; ++column)
+      {
+        Reference reference = { static_cast<quint32>(row * m_columns + column), feature };
+        m_references.push_back(reference);
+      }
+    }
+  }
+}
+
+void PickIndex::Finish()
+{
+  const size_t cell_count = static_cast<size_t>(m_columns) * m_rows;
+
+  // Counting sort by cell keeps references of one feature adjacent, so
+  // repeated ones are removed by comparing with the previous one
+  std::vector<quint32> begin(cell_count + 1, 0);
+  for (size_t i = 0; i < m_references.size(); ++i)
+    ++begin[m_references[i].m_cell + 1];
+  for (size_t c = 0; c < cell_count; ++c)
+    begin[c + 1] += begin[c];
+
+  std::vector<quint32> sorted(m_references.size());
+  std::vector<quint32> position(begin.begin(), begin.end() - 1);
+  for (size_t i = 0; i < m_references.size(); ++i)
+    sorted[position[m_references[i].m_cell]++] = m_references[i].m_feature;
+
+  m_cell_begin.assign(cell_count + 1, 0);
+  m_cell_features.clear();
+  m_cell_features.reserve(sorted.size());
+  for (size_t c = 0; c < cell_count; ++c)
+  {
+    for (quint32 i = begin[c]; i < begin[c + 1]; ++i)
+    {
+      if (i == begin[c] || sorted[i] != sorted[i - 1])
+        m_cell_features.push_back(sorted[i]);
+    }
+    m_cell_begin[c + 1] = static_cast<quint32>(m_cell_features.size());
+  }
+
+  std::vector<Reference>().swap(m_references);
+}
+
+void PickIndex::Pick(const QPoint& position,
+  std::vector<sdk::gdb::ObjectID>& oids) const
+{
+  oids.clear();
+  if (m_cell_begin.empty() || position.x() < 0 || position.y() < 0 ||
+    position.x() >= m_window_size.width() || position.y() >= m_window_size.height())
+    return;
+
+  const int cell = (position.y() / m_cell_size) * m_columns +
+    position.x() / m_cell_size;
+  const QPointF point(position.x(), position.y());
+  for (quint32 i = m_cell_begin[cell]; i < m_cell_begin[cell + 1]; ++i)
+  {
+    const Feature& feature = m_features[m_cell_features[i]];
+    if (HitTest(feature, point))
+      oids.push_back(feature.m_oid);
+  }
+}
+
+bool PickIndex::HitTest(const Feature& feature, const QPointF& position) const
+{
+  const QPointF* points = &m_points[feature.m_first_point];
+  const quint32 count = feature.m_point_count;
+  const float tolerance = m_tolerance[feature.m_kind];
+  const float left = static_cast<float>(position.x()) - tolerance;
+  const float top = static_cast<float>(position.y()) - tolerance;
+  const float right = static_cast<float>(position.x()) + tolerance;
+  const float bottom = static_cast<float>(position.y()) + tolerance;
+
+  if (feature.m_kind == kShapeKind_Point || count == 1)
+  {
+    for (quint32 i = 0; i < count; ++i)
+    {
+      if (points[i].x() >= left && points[i].x() <= right &&
+        points[i].y() >= top && points[i].y() <= bottom)
+        return true;
+    }
+    return false;
+  }
+
+  if (feature.m_kind == kShapeKind_Surface && IsInsideRing(points, count, position))
+    return true;
+
+  const quint32 segment_count =
+    feature.m_kind == kShapeKind_Surface ? count : count - 1;
+  for (quint32 i = 0; i < segment_count; ++i)
+  {
+    if (SegmentIntersectsBox(points[i], points[(i + 1) % count],
+      left, top, right, bottom))
+      return true;
+  }
+  return false;
+}
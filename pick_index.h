@@ -0,0 +1,92 @@
+// pick_index.h : Window-space grid of features for picking under cursor
+//
+#ifndef PICK_INDEX_H
+#define PICK_INDEX_H
+#pragma once
+
+#include <vector>
+#include <QPoint>
+#include <QPointF>
+#include <QSize>
+#include <base/inc/platform.h>
+#include <datalayer/inc/geodatabase/gdb_workspace.h>
+
+// Features of one view put into square cells of the window. A feature is
+// referenced from every cell its geometry, grown by the hit tolerance of its
+// geometry type, touches. Picking reads one cell and tests only the features
+// referenced from it, so no SDK call is made.
+//
+// The index is built once per view and is not changed afterwards, so it may
+// be built on a worker thread and read on any thread.
+class PickIndex
+{
+public:
+  // Kind of the hit test, taken from the feature geometry type
+  enum ShapeKind
+  {
+    kShapeKind_Point = 0,   // Point or multipoint, hit near any point
+    kShapeKind_Curve,       // Polyline, hit near any segment
+    kShapeKind_Surface,     // Exterior ring, hit inside or near the boundary
+    kShapeKind_Count
+  };
+
+  PickIndex(const QSize& window_size, int cell_size);
+
+  // Hit tolerance in pixels, it should be set before features are added
+  void   SetTolerance(ShapeKind kind, float tolerance);
+  float  GetTolerance(ShapeKind kind) const { return m_tolerance[kind]; }
+
+  // Adds feature geometry in window coordinates
+  void   AddFeature(const sdk::gdb::ObjectID& oid, ShapeKind kind,
+    const std::vector<QPointF>& points);
+  // Groups cell references, should be called after the last AddFeature
+  void   Finish();
+
+  // Returns features hit at the window position, each of them once
+  void   Pick(const QPoint& position,
+    std::vector<sdk::gdb::ObjectID>& oids) const;
+
+  QSize  GetWindowSize() const { return m_window_size; }
+  size_t GetFeatureCount() const { return m_features.size(); }
+  size_t GetReferenceCount() const { return m_cell_features.size(); }
+
+private:
+  struct Feature
+  {
+    sdk::gdb::ObjectID m_oid;
+    ShapeKind          m_kind;
+    quint32            m_first_point;
+    quint32            m_point_count;
+  };
+
+  // Cell references collected before Finish
+  struct Reference
+  {
+    quint32 m_cell;
+    quint32 m_feature;
+  };
+
+  // References the feature from all cells of the window rectangle
+  void AddCells(quint32 feature, float left, float top, float right,
+    float bottom);
+  // References the surface from cells, which centers are inside of it
+  void AddInterior(quint32 feature, const QPointF* points, quint32 count);
+
+  bool HitTest(const Feature& feature, const QPointF& position) const;
+
+private:
+  const QSize            m_window_size;
+  const int              m_cell_size;
+  const int              m_columns;
+  const int              m_rows;
+  float                  m_tolerance[kShapeKind_Count];
+
+  std::vector<Feature>   m_features;
+  std::vector<QPointF>   m_points;
+  std::vector<Reference> m_references;
+
+  // Features of cell N are m_cell_features[m_cell_begin[N]..m_cell_begin[N+1])
+  std::vector<quint32>   m_cell_begin;
+  std::vector<quint32>   m_cell_features;
+};
+#endif // PICK_INDEX_H
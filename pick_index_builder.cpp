@@ -0,0 +1,189 @@
+// PickIndexBuilder.cpp : Builds the pick index of the current view off the UI thread
+//
+
+#include <QRunnable>
+
+#include <geometry/inc/coordinate_systems/crs_basic_transformation.inl>
+#include <geometry/inc/coordinate_systems/crs_coordinate_transformation.h>
+#include "markedfeaturerenderer.h"
+#include "pick_index_builder.h"
+
+namespace
+{
+  const int kPickIndexCellSize = 32; // pixels
+
+  // Hit tolerances, point features are drawn with symbols around the point
+  const float kPointTolerance = 8.0f;   // pixels
+  const float kCurveTolerance = 5.0f;   // pixels
+  const float kSurfaceTolerance = 5.0f; // pixels
+
+  bool ShapeKindFromGeometryType(sdk::geometry::GeometryType geometry_type,
+    PickIndex::ShapeKind& kind)
+  {
+    switch (geometry_type)
+    {
+    case sdk::geometry::kGMT_Point:
+    case sdk::geometry::kGMT_Multipoint:
+      kind = PickIndex::kShapeKind_Point;
+      return true;
+    case sdk::geometry::kGMT_Curve:
+    case sdk::geometry::kGMT_CompositeCurve:
+    case sdk::geometry::kGMT_MultiCurve:
+    case sdk::geometry::kGMT_MultiCompositeCurve:
+      kind = PickIndex::kShapeKind_Curve;
+      return true;
+    case sdk::geometry::kGMT_Surface:
+      kind = PickIndex::kShapeKind_Surface;
+      return true;
+    default:
+      return false;
+    }
+  }
+}
+
+class PickIndexBuilder::Task : public QRunnable
+{
+public:
+  Task(PickIndexBuilder* builder, int sequence, const View& view)
+    : m_builder(builder),
+      m_sequence(sequence),
+      m_view(view)
+  {
+  }
+
+  void run()
+  {
+    m_builder->Build(m_sequence, m_view);
+  }
+
+private:
+  PickIndexBuilder* m_builder;
+  int               m_sequence;
+  View              m_view;
+};
+
+PickIndexBuilder::PickIndexBuilder(QObject* parent)
+  : QObject(parent),
+    m_pool(),
+    m_sequence(0),
+    m_lock(),
+    m_result(),
+    m_result_generation(0)
+{
+  m_pool.setMaxThreadCount(1);
+}
+
+PickIndexBuilder::~PickIndexBuilder()
+{
+  Cancel();
+  m_pool.waitForDone();
+}
+
+void PickIndexBuilder::Request(const View& view)
+{
+  if (!view.m_scene_info || !view.m_geometry_filter || !view.m_projection)
+    return;
+
+  // Projection is cloned, so the worker does not share it with the scene
+  View view_copy(view);
+  view_copy.m_projection.Release();
+  if (SDK_FAILED(view.m_projection->Clone(&view_copy.m_projection)) ||
+    !view_copy.m_projection)
+    return;
+
+  int sequence = m_sequence.fetchAndAddOrdered(1) + 1;
+  m_pool.start(new Task(this, sequence, view_copy));
+}
+
+void PickIndexBuilder::Cancel()
+{
+  m_sequence.fetchAndAddOrdered(1);
+
+  QMutexLocker lock(&m_lock);
+  m_result.reset();
+}
+
+bool PickIndexBuilder::TakeResult(PickIndexSP& index, int& generation)
+{
+  QMutexLocker lock(&m_lock);
+  if (!m_result)
+    return false;
+
+  index = m_result;
+  generation = m_result_generation;
+  m_result.reset();
+  return true;
+}
+
+void PickIndexBuilder::Build(int sequence, const View& view)
+{
+  if (sequence != m_sequence)
+    return; // Superseded while waiting in queue
+
+  sdk::crs::ICoordinateTransformationSP coord_transform =
+    sdk::GetInterfaceT<sdk::crs::ICoordinateTransformation>(view.m_projection);
+  if (!coord_transform)
+    return;
+
+  // All of features, which the scene shows in the window
+  sdk::gdb::IEnumFeatureSP features;
+  if (SDK_FAILED(view.m_scene_info->FindFeatures(view.m_geometry_filter,
+    NULL, NULL, features)) || !features)
+    return;
+
+  std::tr1::shared_ptr<PickIndex> index(
+    new PickIndex(view.m_window_size, kPickIndexCellSize));
+  index->SetTolerance(PickIndex::kShapeKind_Point, kPointTolerance);
+  index->SetTolerance(PickIndex::kShapeKind_Curve, kCurveTolerance);
+  index->SetTolerance(PickIndex::kShapeKind_Surface, kSurfaceTolerance);
+
+  std::vector<sdk::GeoIntPoint> geoint_points;
+  std::vector<QPointF> window_points;
+  for (sdk::gdb::IFeatureSP feature; SDK_OK(features->Next(&feature)); feature.Release())
+  {
+    if (sequence != m_sequence)
+      return; // Superseded while being built
+
+    sdk::gdb::ObjectID oid;
+    if (SDK_FAILED(feature->GetObjectID(oid)))
+      continue;
+
+    sdk::geometry::GeometryType geometry_type;
+    PickIndex::ShapeKind kind;
+    if (SDK_FAILED(feature->GetShapeType(geometry_type)) ||
+      !ShapeKindFromGeometryType(geometry_type, kind))
+      continue;
+
+    sdk::geometry::IGeometrySP shape;
+    if (SDK_FAILED(feature->GetShape(&shape)) || !shape)
+      continue;
+    if (!MarkedFeatureRenderer::CrackGeometry(shape, geoint_points) ||
+      geoint_points.empty())
+      continue;
+
+    // Geographic points to scene coordinates and then to window pixels
+    coord_transform->ForwardIF(
+      static_cast<SDKUInt32>(geoint_points.size()), &geoint_points.front(),
+      reinterpret_cast<sdk::PointF2D*>(&geoint_points.front()));
+    const sdk::PointF2D* scene_points =
+      reinterpret_cast<const sdk::PointF2D*>(&geoint_points.front());
+
+    window_points.resize(geoint_points.size());
+    for (size_t i = 0; i < geoint_points.size(); ++i)
+      window_points[i] = view.m_scene_to_window.map(
+        QPointF(scene_points[i].x, scene_points[i].y));
+
+    index->AddFeature(oid, kind, window_points);
+  }
+  index->Finish();
+
+  {
+    QMutexLocker lock(&m_lock);
+    if (sequence != m_sequence)
+      return; // Superseded while being built
+    m_result = index;
+    m_result_generation = view.m_generation;
+  }
+
+  emit signalIndexReady();
+}
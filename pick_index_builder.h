@@ -0,0 +1,76 @@
+// PickIndexBuilder.h : Builds the pick index of the current view off the UI thread
+//
+#ifndef PICK_INDEX_BUILDER_H
+#define PICK_INDEX_BUILDER_H
+#pragma once
+
+#include <memory>
+#include <QObject>
+#include <QMutex>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QTransform>
+
+#include <geometry/inc/coordinate_systems/crs_projection.h>
+#include <visualizationlayer/inc/visman/scene_manager_interface.h>
+#include "pick_index.h"
+
+typedef std::tr1::shared_ptr<const PickIndex> PickIndexSP;
+
+// Queries features of the view and puts them into a PickIndex on a worker
+// thread. Only the latest request is delivered, superseded requests are
+// dropped.
+class PickIndexBuilder : public QObject
+{
+  Q_OBJECT
+
+public:
+  // View to be indexed
+  struct View
+  {
+    // Scene information and filter of the whole window
+    sdk::vis::ISceneInformationSP m_scene_info;
+    sdk::geometry::IGeometrySP    m_geometry_filter;
+    // Scene projection and its coordinates to window transformation
+    sdk::crs::IProjectionSP       m_projection;
+    QTransform                    m_scene_to_window;
+    QSize                         m_window_size;
+    // Number of the view, it is returned with the index
+    int                           m_generation;
+  };
+
+  explicit PickIndexBuilder(QObject* parent = 0);
+  ~PickIndexBuilder();
+
+  // Queues the index building, superseding all of previous requests
+  void Request(const View& view);
+  // Drops all of pending requests
+  void Cancel();
+
+  // Takes the built index, returns false if there is no ready index
+  bool TakeResult(PickIndexSP& index, int& generation);
+
+signals:
+  // Emitted from worker thread when the latest request is built
+  void signalIndexReady();
+
+private:
+  class Task;
+  friend class Task;
+
+  // Called by worker task
+  void Build(int sequence, const View& view);
+
+private:
+  // Single worker, so requests are processed in order
+  QThreadPool m_pool;
+
+  // Sequence number of the latest request
+  QAtomicInt  m_sequence;
+
+  // Latest built index
+  QMutex      m_lock;
+  PickIndexSP m_result;
+  int         m_result_generation;
+};
+#endif // PICK_INDEX_BUILDER_H
@@ -0,0 +1,148 @@
+// RadarScanConverter.cpp : Converts polar radar spokes into a bitmap
+//
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RADAR_USE_SSE2
+#endif
+
+#include "radar_scan_converter.h"
+
+RadarScanConverter::RadarScanConverter(int image_size,
+  int spokes_per_rotation, int samples_per_spoke)
+  : m_image_size(image_size),
+    m_spokes_per_rotation(spokes_per_rotation),
+    m_samples_per_spoke(samples_per_spoke),
+    m_spoke_begin(),
+    m_spoke_pixels(),
+    m_intensity(((image_size * image_size + 15) / 16) * 16, 0)
+{
+  // Echoes are green turning yellow when strong, opacity follows intensity
+  for (int i = 0; i < 256; ++i)
+  {
+    quint32 alpha = i < 16 ? 0 : qMin(255, i + 48);
+    quint32 red = i > 192 ? (i - 192) * 4 : 0;
+    m_palette[i] = (alpha << 24) | ((red * alpha / 255) << 16) | (alpha << 8);
+  }
+
+  BuildLookupTable();
+}
+
+void RadarScanConverter::AddSpoke(int azimuth, const quint8* samples)
+{
+  if (!samples || azimuth < 0 || azimuth >= m_spokes_per_rotation)
+    return;
+
+  const SpokePixel* pixel = &m_spoke_pixels[0] + m_spoke_begin[azimuth];
+  const SpokePixel* end = &m_spoke_pixels[0] + m_spoke_begin[azimuth + 1];
+  quint8* intensity = &m_intensity[0];
+
+  // New echo replaces the faded one, if it is stronger
+  for (; pixel != end; ++pixel)
+  {
+    quint8 value = samples[pixel->sample];
+    if (value > intensity[pixel->offset])
+      intensity[pixel->offset] = value;
+  }
+}
+
+void RadarScanConverter::Fade(quint8 amount)
+{
+  if (!amount)
+    return;
+
+  quint8* intensity = &m_intensity[0];
+  const size_t size = m_intensity.size();
+
+#if defined(RADAR_USE_SSE2)
+  // Saturating subtraction of 16 pixels at once
+  const __m128i decrement = _mm_set1_epi8(static_cast<char>(amount));
+  for (size_t i = 0; i < size; i += 16)
+  {
+    __m128i* block = reinterpret_cast<__m128i*>(intensity + i);
+    _mm_storeu_si128(block, _mm_subs_epu8(_mm_loadu_si128(block), decrement));
+  }
+#else
+  for (size_t i = 0; i < size; ++i)
+    intensity[i] = intensity[i] > amount ? intensity[i] - amount : 0;
+#endif
+}
+
+void RadarScanConverter::Colorize(uchar* bits, int bytes_per_line) const
+{
+  if (!bits)
+    return;
+
+  const quint8* intensity = &m_intensity[0];
+  for (int y = 0; y < m_image_size; ++y)
+  {
+    quint32* row = reinterpret_cast<quint32*>(bits + y * bytes_per_line);
+    const quint8* source = intensity + y * m_image_size;
+    for (int x = 0; x < m_image_size; ++x)
+      row[x] = m_palette[source[x]];
+  }
+}
+
+void RadarScanConverter::Clear()
+{
+  memset(&m_intensity[0], 0, m_intensity.size());
+}
+
+void RadarScanConverter::BuildLookupTable()
+{
+  const double kPi = 3.14159265358979323846;
+  const double center = m_image_size / 2.0;
+  const double radius = center;
+
+  // Spoke and sample of every pixel inside the range circle
+  std::vector<int> pixel_spoke(m_image_size * m_image_size, -1);
+  std::vector<quint16> pixel_sample(m_image_size * m_image_size, 0);
+  std::vector<quint32> spoke_count(m_spokes_per_rotation, 0);
+
+  for (int y = 0; y < m_image_size; ++y)
+  {
+    for (int x = 0; x < m_image_size; ++x)
+    {
+      const double dx = x + 0.5 - center;
+      const double dy = center - (y + 0.5);
+      const double r = sqrt(dx * dx + dy * dy);
+      if (r >= radius)
+        continue;
+
+      // Bearing is clockwise from north
+      double bearing = atan2(dx, dy);
+      if (bearing < 0.0)
+        bearing += 2.0 * kPi;
+      int spoke = static_cast<int>(bearing / (2.0 * kPi) * m_spokes_per_rotation);
+      if (spoke >= m_spokes_per_rotation)
+        spoke = m_spokes_per_rotation - 1;
+      int sample = static_cast<int>(r / radius * m_samples_per_spoke);
+      if (sample >= m_samples_per_spoke)
+        sample = m_samples_per_spoke - 1;
+
+      const int offset = y * m_image_size + x;
+      pixel_spoke[offset] = spoke;
+      pixel_sample[offset] = static_cast<quint16>(sample);
+      ++spoke_count[spoke];
+    }
+  }
+
+  // Pixels are grouped by spoke, in memory order inside of a spoke
+  m_spoke_begin.assign(m_spokes_per_rotation + 1, 0);
+  for (int s = 0; s < m_spokes_per_rotation; ++s)
+    m_spoke_begin[s + 1] = m_spoke_begin[s] + spoke_count[s];
+
+  m_spoke_pixels.resize(m_spoke_begin[m_spokes_per_rotation]);
+  std::vector<quint32> position(m_spoke_begin.begin(), m_spoke_begin.end() - 1);
+  for (size_t offset = 0; offset < pixel_spoke.size(); ++offset)
+  {
+    if (pixel_spoke[offset] < 0)
+      continue;
+    SpokePixel& pixel = m_spoke_pixels[position[pixel_spoke[offset]]++];
+    pixel.offset = static_cast<quint32>(offset);
+    pixel.sample = pixel_sample[offset];
+  }
+}
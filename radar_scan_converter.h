@@ -0,0 +1,59 @@
+// RadarScanConverter.h : Converts polar radar spokes into a bitmap
+//
+#ifndef RADAR_SCAN_CONVERTER_H
+#define RADAR_SCAN_CONVERTER_H
+#pragma once
+
+#include <vector>
+#include <QtGlobal>
+
+// PPI scan converter. Every pixel of the square image is assigned to one
+// spoke and one range sample in advance, so drawing a spoke is a walk over
+// its precomputed pixel list. Echo intensities are kept in one byte per
+// pixel, faded for trails and colorized to BGRA when a frame is produced.
+class RadarScanConverter
+{
+public:
+  RadarScanConverter(int image_size, int spokes_per_rotation,
+    int samples_per_spoke);
+
+  int ImageSize() const { return m_image_size; }
+  int SpokesPerRotation() const { return m_spokes_per_rotation; }
+  int SamplesPerSpoke() const { return m_samples_per_spoke; }
+
+  // Draws one spoke. Azimuth is the spoke index clockwise from north,
+  // samples are echo intensities from the antenna outward.
+  void AddSpoke(int azimuth, const quint8* samples);
+  // Decreases all of echo intensities, older echoes fade out as trails
+  void Fade(quint8 amount);
+  // Writes premultiplied BGRA pixels, rows top-down
+  void Colorize(uchar* bits, int bytes_per_line) const;
+  // Clears all of echoes
+  void Clear();
+
+private:
+  // Pixel of the image and range sample drawn into it
+  struct SpokePixel
+  {
+    quint32 offset;
+    quint16 sample;
+  };
+
+  void BuildLookupTable();
+
+private:
+  const int                 m_image_size;
+  const int                 m_spokes_per_rotation;
+  const int                 m_samples_per_spoke;
+
+  // Pixels of spoke N are m_spoke_pixels[m_spoke_begin[N]..m_spoke_begin[N+1])
+  std::vector<quint32>      m_spoke_begin;
+  std::vector<SpokePixel>   m_spoke_pixels;
+
+  // Echo intensity per pixel, padded to multiple of 16 for SIMD
+  std::vector<quint8>       m_intensity;
+
+  // Intensity to color table
+  quint32                   m_palette[256];
+};
+#endif // RADAR_SCAN_CONVERTER_H
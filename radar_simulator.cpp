@@ -0,0 +1,222 @@
+// RadarSimulator.cpp : Feeds synthetic radar picture to the user bitmap layer
+//
+
+#include <math.h>
+#include <QElapsedTimer>
+#include <QDebug>
+
+#include "utils.h"
+#include "radar_simulator.h"
+
+namespace
+{
+  const double kPi = 3.14159265358979323846;
+
+  // Antenna and picture parameters
+  const int kSpokesPerRotation = 4096;
+  const int kSamplesPerSpoke = 512;
+  const int kRotationsPerMinute = 48;
+  const int kImageSize = 1024;
+
+  // Echo fades out in about one rotation, whatever the frame interval is
+  const int kFadePerRotation = 256;
+}
+
+RadarSpokeGenerator::RadarSpokeGenerator(int spokes_per_rotation,
+  int samples_per_spoke)
+  : m_spokes_per_rotation(spokes_per_rotation),
+    m_samples_per_spoke(samples_per_spoke),
+    m_targets(),
+    m_seed(12345)
+{
+  const Target targets[] =
+  {
+    { 0.6, 0.35, 2.0, 0.0015, 0.012 },
+    { 2.1, 0.55, 4.5, 0.0020, 0.018 },
+    { 3.9, 0.25, 0.7, 0.0010, 0.010 },
+    { 5.2, 0.75, 3.3, 0.0025, 0.025 }
+  };
+  m_targets.assign(targets, targets + sizeof(targets) / sizeof(targets[0]));
+}
+
+void RadarSpokeGenerator::Generate(int azimuth, int rotation, quint8* samples)
+{
+  const double bearing = 2.0 * kPi * azimuth / m_spokes_per_rotation;
+
+  // Coast line at varying range over the eastern sector
+  int coast = m_samples_per_spoke;
+  if (bearing > 1.0 && bearing < 2.4)
+    coast = static_cast<int>(m_samples_per_spoke *
+      (0.8 + 0.1 * sin(bearing * 7.0) + 0.03 * sin(bearing * 31.0)));
+
+  for (int i = 0; i < m_samples_per_spoke; ++i)
+  {
+    const double range = static_cast<double>(i) / m_samples_per_spoke;
+    int value = 0;
+
+    // Sea clutter decreasing with range
+    if (range < 0.15)
+      value = static_cast<int>((Random() & 0xFF) * (1.0 - range / 0.15));
+    else if ((Random() & 0x3FF) == 0)
+      value = 96; // Sparse noise
+
+    // Range rings
+    if (i % (m_samples_per_spoke / 4) == 0 && i)
+      value = qMax(value, 64);
+
+    if (i >= coast)
+      value = qMax(value, 160 + static_cast<int>(Random() & 0x3F));
+
+    samples[i] = static_cast<quint8>(value);
+  }
+
+  // Targets are moved along their courses every rotation
+  for (size_t t = 0; t < m_targets.size(); ++t)
+  {
+    const Target& target = m_targets[t];
+    double x = target.range * sin(target.bearing) +
+      rotation * target.speed * sin(target.course);
+    double y = target.range * cos(target.bearing) +
+      rotation * target.speed * cos(target.course);
+    double target_range = sqrt(x * x + y * y);
+    if (target_range >= 1.0)
+      continue;
+
+    // Target is seen on spokes within its angular size
+    double target_bearing = atan2(x, y);
+    if (target_bearing < 0.0)
+      target_bearing += 2.0 * kPi;
+    double delta = fabs(target_bearing - bearing);
+    if (delta > kPi)
+      delta = 2.0 * kPi - delta;
+    if (delta * target_range > target.size)
+      continue;
+
+    int first = static_cast<int>((target_range - target.size) * m_samples_per_spoke);
+    int last = static_cast<int>((target_range + target.size) * m_samples_per_spoke);
+    for (int i = qMax(first, 0); i <= last && i < m_samples_per_spoke; ++i)
+      samples[i] = 255;
+  }
+}
+
+quint32 RadarSpokeGenerator::Random()
+{
+  // Linear congruential generator, cheap enough to be called per sample
+  m_seed = m_seed * 1664525u + 1013904223u;
+  return m_seed >> 8;
+}
+
+RadarSimulator::RadarSimulator(const UserBmpLayerRendererSP& renderer,
+  QObject* parent)
+  : QThread(parent),
+    m_renderer(renderer),
+    m_stop(0),
+    m_interval_lock(),
+    m_interval_changed(),
+    m_frame_interval(kFrameInterval)
+{
+}
+
+RadarSimulator::~RadarSimulator()
+{
+  Stop();
+}
+
+void RadarSimulator::Stop()
+{
+  {
+    QMutexLocker lock(&m_interval_lock);
+    m_stop.fetchAndStoreOrdered(1);
+    m_interval_changed.wakeAll();
+  }
+  wait();
+}
+
+void RadarSimulator::SetFrameInterval(int interval)
+{
+  QMutexLocker lock(&m_interval_lock);
+  if (m_frame_interval == interval)
+    return;
+  m_frame_interval = interval;
+  m_interval_changed.wakeAll();
+}
+
+void RadarSimulator::run()
+{
+  if (!m_renderer)
+    return;
+
+  RadarScanConverter converter(kImageSize, kSpokesPerRotation, kSamplesPerSpoke);
+  RadarSpokeGenerator generator(kSpokesPerRotation, kSamplesPerSpoke);
+  std::vector<quint8> samples(kSamplesPerSpoke);
+  QImage image(kImageSize, kImageSize, QImage::Format_ARGB32_Premultiplied);
+
+  const qint64 spokes_per_minute =
+    static_cast<qint64>(kSpokesPerRotation) * kRotationsPerMinute;
+  const qint64 fade_per_minute =
+    static_cast<qint64>(kFadePerRotation) * kRotationsPerMinute;
+
+  QElapsedTimer clock;
+  clock.start();
+  qint64 spokes_done = 0;
+  qint64 fade_done = 0;
+  qint64 convert_time = 0; // ns spent on spokes during this rotation
+  // Rotations converted and their slowest conversion, logged on stop
+  qint64 rotations = 0;
+  qint64 convert_time_max = 0; // ns
+
+  while (!m_stop.fetchAndAddOrdered(0))
+  {
+    // Spokes swept by the antenna since the last frame
+    const qint64 elapsed = clock.elapsed();
+    qint64 spokes_due = elapsed * spokes_per_minute / 60000;
+    // After a stall only the last rotation is drawn
+    if (spokes_due - spokes_done > kSpokesPerRotation)
+      spokes_done = spokes_due - kSpokesPerRotation;
+
+    QElapsedTimer convert_clock;
+    convert_clock.start();
+    for (; spokes_done < spokes_due; ++spokes_done)
+    {
+      int azimuth = static_cast<int>(spokes_done % kSpokesPerRotation);
+      int rotation = static_cast<int>(spokes_done / kSpokesPerRotation);
+      generator.Generate(azimuth, rotation, &samples[0]);
+      converter.AddSpoke(azimuth, &samples[0]);
+
+      if (azimuth == kSpokesPerRotation - 1)
+      {
+        // Conversion, generator included, should stay well below
+        // the 1250 ms of one rotation at 48 RPM
+        convert_time += convert_clock.nsecsElapsed();
+        convert_time_max = qMax(convert_time_max, convert_time);
+        ++rotations;
+        convert_time = 0;
+        convert_clock.restart();
+      }
+    }
+    convert_time += convert_clock.nsecsElapsed();
+
+    // Fade follows the elapsed time as the spokes do, a long frame interval
+    // fades the echo more
+    const qint64 fade_due = elapsed * fade_per_minute / 60000;
+    converter.Fade(static_cast<quint8>(qMin<qint64>(fade_due - fade_done, 255)));
+    fade_done = fade_due;
+    converter.Colorize(image.bits(), image.bytesPerLine());
+    m_renderer->SetBits(image.constBits(), image.width(), image.height(),
+      image.bytesPerLine(), true);
+    emit signalFrameReady();
+
+    // Waiting for the next frame, a new interval or the stop. Nothing is
+    // computed while paused.
+    QMutexLocker lock(&m_interval_lock);
+    while (!m_frame_interval && !m_stop.fetchAndAddOrdered(0))
+      m_interval_changed.wait(&m_interval_lock);
+    if (m_frame_interval && !m_stop.fetchAndAddOrdered(0))
+      m_interval_changed.wait(&m_interval_lock, m_frame_interval);
+  }
+
+  if (rotations > 0 && IsTimingLogEnabled())
+    qDebug() << "Radar:" << rotations << "rotations of" << kSpokesPerRotation
+      << "spokes, slowest converted in" << convert_time_max / 1000000.0
+      << "ms, required rate" << spokes_per_minute / 60 << "spokes/s";
+}
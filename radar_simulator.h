@@ -0,0 +1,82 @@
+// RadarSimulator.h : Feeds synthetic radar picture to the user bitmap layer
+//
+#ifndef RADAR_SIMULATOR_H
+#define RADAR_SIMULATOR_H
+#pragma once
+
+#include <vector>
+#include <QThread>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QImage>
+
+#include "radar_scan_converter.h"
+#include "user_bmp_layer_renderer.h"
+
+// Generates spokes of the synthetic radar: sea clutter near the antenna,
+// range rings, a coast line and a few slowly moving targets
+class RadarSpokeGenerator
+{
+public:
+  RadarSpokeGenerator(int spokes_per_rotation, int samples_per_spoke);
+
+  // Fills samples of the spoke, rotation is the number of the sweep
+  void Generate(int azimuth, int rotation, quint8* samples);
+
+private:
+  struct Target
+  {
+    double bearing;   // radians
+    double range;     // part of the full range
+    double course;    // radians
+    double speed;     // part of the full range per rotation
+    double size;      // part of the full range
+  };
+
+  quint32 Random();
+
+private:
+  const int           m_spokes_per_rotation;
+  const int           m_samples_per_spoke;
+  std::vector<Target> m_targets;
+  quint32             m_seed;
+};
+
+// Runs the scan converter on its own thread at the antenna rate and passes
+// the picture to the renderer every frame interval
+class RadarSimulator : public QThread
+{
+  Q_OBJECT
+
+public:
+  // Interval of frames, while the overlay is shown
+  static const int kFrameInterval = 40; // ms
+
+  explicit RadarSimulator(const UserBmpLayerRendererSP& renderer,
+    QObject* parent = 0);
+  ~RadarSimulator();
+
+  // Stops the thread and waits for it
+  void Stop();
+  // Changes interval of frames, 0 pauses the simulator. The antenna keeps
+  // turning while paused, only the last rotation is drawn on resume.
+  void SetFrameInterval(int interval);
+
+signals:
+  // Emitted from the simulator thread when a new frame is passed
+  void signalFrameReady();
+
+protected:
+  void run();
+
+private:
+  const UserBmpLayerRendererSP m_renderer;
+  QAtomicInt                   m_stop;
+
+  // Interval of frames, the thread waits on the condition between frames
+  QMutex                       m_interval_lock;
+  QWaitCondition               m_interval_changed;
+  int                          m_frame_interval;
+};
+#endif // RADAR_SIMULATOR_H
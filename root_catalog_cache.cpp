@@ -0,0 +1,234 @@
+// root_catalog_cache.cpp : Persistent cache of geodatabase root catalog metadata
+//
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDataStream>
+#include <QDateTime>
+
+#include <base/inc/sdk_any_handler.h>
+#include <base/inc/sdk_string_handler.h>
+#include <base/inc/sdk_results_enum.h>
+#include <datalayer/inc/senc/senc_exchange_set.h>
+#include "root_catalog_cache.h"
+
+using namespace SDK_NAMESPACE;
+using namespace SDK_GDB_NAMESPACE;
+
+namespace
+{
+  // Root catalog file of a SENC geodatabase folder
+  const char kRootCatalogFileName[] = "root.cat";
+
+  const quint32 kCacheMagic = 0x534B4D52; // SKMR
+  const quint32 kCacheVersion = 1;
+
+  // Size and modification time of the root catalog file
+  bool ReadFileStamp(const QString& root_cat_file, qint64& size,
+    qint64& last_modified)
+  {
+    const QFileInfo info(root_cat_file);
+    if (!info.isFile())
+      return false;
+    size = info.size();
+    last_modified = info.lastModified().toMSecsSinceEpoch();
+    return true;
+  }
+}
+
+RootCatalogCache::RootCatalogCache(const QString& file_name)
+  : m_file_name(file_name),
+    m_lock(),
+    m_entries(),
+    m_is_changed(false),
+    m_hits(0),
+    m_misses(0)
+{
+}
+
+bool RootCatalogCache::Load()
+{
+  QFile file(m_file_name);
+  if (!file.open(QIODevice::ReadOnly))
+    return false;
+
+  QDataStream stream(&file);
+  stream.setVersion(QDataStream::Qt_4_8);
+  quint32 magic = 0, version = 0, count = 0;
+  stream >> magic >> version >> count;
+  if (magic != kCacheMagic || version != kCacheVersion)
+    return false;
+
+  Entries entries;
+  for (quint32 c = 0; c < count && stream.status() == QDataStream::Ok; ++c)
+  {
+    QString root_cat_file;
+    Entry entry;
+    quint32 encryption = 0;
+    qint32 bounds[4] = { 0, 0, 0, 0 };
+    stream >> root_cat_file >> entry.m_size >> entry.m_last_modified
+      >> entry.m_info.m_name >> encryption >> entry.m_info.m_has_contents
+      >> entry.m_info.m_dataset_count
+      >> bounds[0] >> bounds[1] >> bounds[2] >> bounds[3];
+    entry.m_info.m_encryption = encryption;
+    entry.m_info.m_bounds.sw.lat = bounds[0];
+    entry.m_info.m_bounds.sw.lon = bounds[1];
+    entry.m_info.m_bounds.ne.lat = bounds[2];
+    entry.m_info.m_bounds.ne.lon = bounds[3];
+
+    // Catalogs, which have been removed, are forgotten
+    if (QFileInfo(root_cat_file).isFile())
+      entries[root_cat_file] = entry;
+  }
+  if (stream.status() != QDataStream::Ok)
+    return false;
+
+  QMutexLocker lock(&m_lock);
+  m_entries.swap(entries);
+  m_is_changed = m_entries.size() != count;
+  return true;
+}
+
+bool RootCatalogCache::Save()
+{
+  Entries entries;
+  {
+    QMutexLocker lock(&m_lock);
+    if (!m_is_changed)
+      return true;
+    entries = m_entries;
+    m_is_changed = false;
+  }
+
+  QDir().mkpath(QFileInfo(m_file_name).path());
+
+  // Written aside and renamed, so a broken file is never read
+  QFile file(m_file_name + ".tmp");
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    return false;
+
+  QDataStream stream(&file);
+  stream.setVersion(QDataStream::Qt_4_8);
+  stream << kCacheMagic << kCacheVersion << static_cast<quint32>(entries.size());
+  for (Entries::const_iterator it = entries.begin(); it != entries.end(); ++it)
+  {
+    const Info& info = it->second.m_info;
+    stream << it->first << it->second.m_size << it->second.m_last_modified
+      << info.m_name << static_cast<quint32>(info.m_encryption)
+      << info.m_has_contents << info.m_dataset_count
+      << static_cast<qint32>(info.m_bounds.sw.lat)
+      << static_cast<qint32>(info.m_bounds.sw.lon)
+      << static_cast<qint32>(info.m_bounds.ne.lat)
+      << static_cast<qint32>(info.m_bounds.ne.lon);
+  }
+  file.close();
+  if (stream.status() != QDataStream::Ok || file.error() != QFile::NoError)
+  {
+    file.remove();
+    return false;
+  }
+
+  QFile::remove(m_file_name);
+  return file.rename(m_file_name);
+}
+
+bool RootCatalogCache::GetInfo(const IWorkspaceFactorySP& wks_factory,
+  const QString& root_cat_path, Info& info)
+{
+  const QString root_cat_file = GetRootCatalogFile(root_cat_path);
+  qint64 size = 0, last_modified = 0;
+  const bool has_stamp = ReadFileStamp(root_cat_file, size, last_modified);
+
+  if (has_stamp)
+  {
+    QMutexLocker lock(&m_lock);
+    Entries::const_iterator it = m_entries.find(root_cat_file);
+    if (it != m_entries.end() && it->second.m_size == size &&
+      it->second.m_last_modified == last_modified)
+    {
+      ++m_hits;
+      info = it->second.m_info;
+      return true;
+    }
+  }
+
+  // Catalog is opened outside of the lock, so other folders are looked up
+  // meanwhile
+  if (!ReadInfo(wks_factory, root_cat_path, info))
+    return false;
+
+  QMutexLocker lock(&m_lock);
+  ++m_misses;
+  if (!has_stamp)
+    return true; // No catalog file to check the entry against
+
+  Entry& entry = m_entries[root_cat_file];
+  entry.m_info = info;
+  entry.m_size = size;
+  entry.m_last_modified = last_modified;
+  m_is_changed = true;
+  return true;
+}
+
+void RootCatalogCache::SetContents(const QString& root_cat_path,
+  quint32 dataset_count, const sdk::GeoIntRect& bounds)
+{
+  QMutexLocker lock(&m_lock);
+  Entries::iterator it = m_entries.find(GetRootCatalogFile(root_cat_path));
+  if (it == m_entries.end())
+    return;
+
+  Info& info = it->second.m_info;
+  info.m_has_contents = true;
+  info.m_dataset_count = dataset_count;
+  info.m_bounds = bounds;
+  m_is_changed = true;
+}
+
+void RootCatalogCache::GetStatistics(quint32& hits, quint32& misses) const
+{
+  QMutexLocker lock(&m_lock);
+  hits = m_hits;
+  misses = m_misses;
+}
+
+QString RootCatalogCache::GetRootCatalogFile(const QString& root_cat_path)
+{
+  const QFileInfo info(root_cat_path);
+  if (info.isDir())
+    return QDir(info.absoluteFilePath()).filePath(kRootCatalogFileName);
+  return info.absoluteFilePath();
+}
+
+bool RootCatalogCache::IsEncrypted(const Info& info)
+{
+  return info.m_encryption != static_cast<SDKUInt32>(senc::kENCA_None);
+}
+
+bool RootCatalogCache::ReadInfo(const IWorkspaceFactorySP& wks_factory,
+  const QString& root_cat_path, Info& info)
+{
+  if (!wks_factory || root_cat_path.isEmpty())
+    return false;
+
+  IRootCatalogSP root_catalog;
+  if (SDK_FAILED(wks_factory->OpenRootCatalog(
+    ScopedString(root_cat_path.toStdWString()), &root_catalog)))
+    return false;
+
+  info = Info();
+
+  ScopedAny db_name;
+  if (SDK_OK(root_catalog->GetGeodatabaseProperty(
+    kRootCatGeodatabaseProperty_GeodatabaseName, db_name)) &&
+    ANY_IS_STR(&db_name))
+    info.m_name = QString::fromStdWString(db_name.GetAsWString());
+
+  ScopedAny encryption;
+  if (SDK_FAILED(root_catalog->GetGeodatabaseProperty(
+    kRootCatGeodatabaseProperty_Encryption, encryption)))
+    return false;
+  encryption.ChangeType(kSDKAnyType_Uint32);
+  info.m_encryption = ANY_UI32(&encryption);
+  return true;
+}
@@ -0,0 +1,86 @@
+// root_catalog_cache.h : Persistent cache of geodatabase root catalog metadata
+//
+#ifndef ROOT_CATALOG_CACHE_H
+#define ROOT_CATALOG_CACHE_H
+#pragma once
+
+#include <map>
+#include <memory>
+
+#include <QMutex>
+#include <QString>
+
+#include <base/inc/geometry/geometry_base_types.h>
+#include <datalayer/inc/geodatabase/gdb_workspace.h>
+
+// Name, encryption, dataset count and bounds of geodatabases by their root
+// catalog file. An entry is used while size and modification time of the
+// root catalog are the same, so the catalog is not opened only to read
+// these properties. The cache is stored in a file and may be used from
+// several threads.
+class RootCatalogCache
+{
+public:
+  struct Info
+  {
+    QString          m_name;
+    SDKUInt32        m_encryption;
+    // Dataset count and bounds are known after the workspace has been
+    // opened once
+    bool             m_has_contents;
+    quint32          m_dataset_count;
+    sdk::GeoIntRect  m_bounds;
+
+    Info() : m_name(), m_encryption(0), m_has_contents(false),
+      m_dataset_count(0), m_bounds() {}
+  };
+
+  explicit RootCatalogCache(const QString& file_name);
+
+  // Reads the stored cache, entries of missing catalogs are dropped
+  bool Load();
+  // Stores the cache if it has been changed
+  bool Save();
+
+  // Returns metadata of the geodatabase folder or root catalog file, the
+  // root catalog is opened only if the cached entry is missing or outdated
+  bool GetInfo(const sdk::gdb::IWorkspaceFactorySP& wks_factory,
+    const QString& root_cat_path, Info& info);
+  // Records dataset count and bounds of the opened workspace
+  void SetContents(const QString& root_cat_path, quint32 dataset_count,
+    const sdk::GeoIntRect& bounds);
+
+  // Number of lookups answered from the cache and from root catalogs
+  void GetStatistics(quint32& hits, quint32& misses) const;
+
+  // Returns root catalog file of the geodatabase folder or the file itself
+  static QString GetRootCatalogFile(const QString& root_cat_path);
+  // Returns true if the database of the root catalog is encrypted
+  static bool IsEncrypted(const Info& info);
+
+private:
+  struct Entry
+  {
+    Info    m_info;
+    // Root catalog file, the entry is valid while it is not changed
+    qint64  m_size;
+    qint64  m_last_modified; // ms since epoch
+  };
+  typedef std::map<QString, Entry> Entries;
+
+  // Reads properties of the root catalog
+  static bool ReadInfo(const sdk::gdb::IWorkspaceFactorySP& wks_factory,
+    const QString& root_cat_path, Info& info);
+
+private:
+  const QString  m_file_name;
+
+  mutable QMutex m_lock;
+  Entries        m_entries;
+  bool           m_is_changed;
+  quint32        m_hits;
+  quint32        m_misses;
+};
+typedef std::tr1::shared_ptr<RootCatalogCache> RootCatalogCacheSP;
+
+#endif // ROOT_CATALOG_CACHE_H
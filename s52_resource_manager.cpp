@@ -10,7 +10,8 @@
 #include "s52_resource_manager.h"
 
 S52ResourceManager::S52ResourceManager()
-  : m_palette_index(sdk::vis::s52::kPaletteIndex_DAY) {
+  : m_palette_index(sdk::vis::s52::kPaletteIndex_DAY),
+    m_last_resource_owner(0) {
 }
 
 S52ResourceManager::~S52ResourceManager() {
@@ -18,14 +19,23 @@ S52ResourceManager::~S52ResourceManager() {
 
 SDKColorF S52ResourceManager::GetColor(
   const sdk::vis::s52::ColorIndexEnum& color_index) {
-  if (!m_sdl_catalog_factory && SDK_FAILED(Init()))
-    return sdk::ColorF();
+  SDKColorF color = sdk::ColorF();
+  {
+    QReadLocker lock(&m_color_lock);
+    if (m_color_table)
+    {
+      LookupColor(color_index, color);
+      return color;
+    }
+  }
 
-  sdk::vis::sdl::ISymbolSetCatalogSP sdl_catalog;
-  if (SDK_FAILED(m_sdl_catalog_factory->GetCurrentCatalog(sdl_catalog)))
+  // Color table is built on first use
+  if (SDK_FAILED(Reload()))
     return sdk::ColorF();
 
-  return GetColor(sdl_catalog, color_index);
+  QReadLocker lock(&m_color_lock);
+  LookupColor(color_index, color);
+  return color;
 }
 
 bool S52ResourceManager::SetPalette(
@@ -33,7 +43,20 @@ bool S52ResourceManager::SetPalette(
   if (palette_index >= SDK_ARRAY_LENGTH(sdk::vis::s52::kPaletteNames))
     return false;
 
-  m_palette_index = palette_index;
+  bool changed = false;
+  {
+    QWriteLocker lock(&m_color_lock);
+    changed = (m_palette_index != palette_index);
+    m_palette_index = palette_index;
+  }
+
+  if (changed)
+  {
+    // Cached brushes are built from the previous palette colors
+    QMutexLocker lock(&m_resources_lock);
+    m_resources.clear();
+  }
+
   return true;
 }
 
@@ -44,23 +67,177 @@ SDKColorF S52ResourceManager::GetColor(
   if (!sdl_catalog)
     return sdk::ColorF();
 
+  bool is_current = false;
+  {
+    QReadLocker lock(&m_color_lock);
+    is_current = m_color_table && m_sdl_catalog &&
+      sdl_catalog.operator->() == m_sdl_catalog.operator->();
+  }
+
+  // Rebuilding the table only when another catalog is given
+  if (!is_current && SDK_FAILED(BuildColorTable(sdl_catalog)))
+    return sdk::ColorF();
+
+  SDKColorF color = sdk::ColorF();
+  QReadLocker lock(&m_color_lock);
+  LookupColor(color_index, color);
+  return color;
+}
+
+SDKResult S52ResourceManager::Reload() {
+  if (SDK_FAILED(Init()))
+    return sdk::Err_Uninitialized;
+
+  sdk::vis::sdl::ISymbolSetCatalogSP sdl_catalog;
+  SDKResult res = m_sdl_catalog_factory->GetCurrentCatalog(sdl_catalog);
+  if (SDK_FAILED(res) || !sdl_catalog)
+    return SDK_FAILED(res) ? res : sdk::Err_Unexpected;
+
+  return BuildColorTable(sdl_catalog);
+}
+
+SDKResult S52ResourceManager::BuildColorTable(
+  const sdk::vis::sdl::ISymbolSetCatalogSP& sdl_catalog)
+{
   sdk::vis::sdl::IPaletteManagerSP palette_manager;
   SDKResult res = sdl_catalog->GetPaletteManager(palette_manager);
   if (SDK_FAILED(res) || !palette_manager)
-    return sdk::ColorF();
+    return SDK_FAILED(res) ? res : sdk::Err_Unexpected;
 
-  SDKUInt32 rgba;
-  res = palette_manager->GetColor(
-    sdk::ScopedString(sdk::vis::s52::kPaletteNames[m_palette_index]), 
-    sdk::ScopedString(sdk::vis::s52::kSymbolSetName), 
-    sdk::ScopedString(sdk::vis::s52::kColorIndexTable[color_index].name), rgba);
-  if (SDK_FAILED(res))
-    return sdk::ColorF();
+  const size_t palette_count = SDK_ARRAY_LENGTH(sdk::vis::s52::kPaletteNames);
+  const size_t color_count = SDK_ARRAY_LENGTH(sdk::vis::s52::kColorIndexTable);
 
-  return sdk::ColorF(rgba);
+  sdk::ScopedString symbol_set_name(sdk::vis::s52::kSymbolSetName);
+
+  ColorTable* table = new ColorTable(palette_count * color_count, sdk::ColorF());
+  ColorTableSP table_holder(table);
+  for (size_t p = 0; p < palette_count; ++p)
+  {
+    sdk::ScopedString palette_name(sdk::vis::s52::kPaletteNames[p]);
+    for (size_t c = 0; c < color_count; ++c)
+    {
+      SDKUInt32 rgba;
+      if (SDK_OK(palette_manager->GetColor(palette_name, symbol_set_name,
+        sdk::ScopedString(sdk::vis::s52::kColorIndexTable[c].name), rgba)))
+        (*table)[p * color_count + c] = sdk::ColorF(rgba);
+    }
+  }
+
+  {
+    QWriteLocker lock(&m_color_lock);
+    m_color_table = table_holder;
+    m_sdl_catalog = sdl_catalog;
+  }
+
+  // Cached brushes may be built from the previous catalog colors
+  QMutexLocker lock(&m_resources_lock);
+  m_resources.clear();
+
+  return sdk::Ok;
+}
+
+bool S52ResourceManager::LookupColor(
+  const sdk::vis::s52::ColorIndexEnum& color_index, SDKColorF& color) const
+{
+  const size_t color_count = SDK_ARRAY_LENGTH(sdk::vis::s52::kColorIndexTable);
+  if (!m_color_table || static_cast<size_t>(color_index) >= color_count)
+    return false;
+
+  color = (*m_color_table)[m_palette_index * color_count + color_index];
+  return true;
+}
+
+S52ResourceManager::ResourceOwnerID S52ResourceManager::CreateResourceOwner()
+{
+  QMutexLocker lock(&m_resources_lock);
+  return ++m_last_resource_owner;
+}
+
+bool S52ResourceManager::GetSolidBrush(ResourceOwnerID owner,
+  const sdk::gfx::RenderTargetSP& render_target,
+  const sdk::vis::s52::ColorIndexEnum& color_index, float alpha,
+  sdk::gfx::RenderTargetBrushSP& brush)
+{
+  brush.Release();
+  if (!render_target)
+    return false;
+
+  // Brushes are keyed by color index and 8-bit alpha
+  SDKUInt32 alpha_key = static_cast<SDKUInt32>(alpha * 255.0f + 0.5f) & 0xFF;
+  SDKUInt32 key = (static_cast<SDKUInt32>(color_index) << 8) | alpha_key;
+
+  // Color is read before locking, the color table may be rebuilt here
+  sdk::ColorF color = GetColor(color_index);
+  color.a = alpha;
+
+  QMutexLocker lock(&m_resources_lock);
+  RenderTargetResources* resources =
+    GetRenderTargetResources(owner, render_target);
+
+  RenderTargetResources::Brushes::iterator it = resources->m_brushes.find(key);
+  if (it != resources->m_brushes.end())
+  {
+    brush = it->second;
+    return true;
+  }
+
+  if (SDK_FAILED(render_target->CreateSolidColorBrush(color, brush)) || !brush)
+    return false;
+
+  resources->m_brushes[key] = brush;
+  return true;
+}
+
+bool S52ResourceManager::GetStrokeStyle(ResourceOwnerID owner,
+  const sdk::gfx::RenderTargetSP& render_target,
+  sdk::gfx::RenderTargetStrokeStyleSP& stroke_style)
+{
+  stroke_style.Release();
+  if (!render_target)
+    return false;
+
+  QMutexLocker lock(&m_resources_lock);
+  RenderTargetResources* resources =
+    GetRenderTargetResources(owner, render_target);
+
+  if (!resources->m_stroke_style)
+  {
+    if (SDK_FAILED(render_target->CreateStrokeStyle(
+      sdk::gfx::StrokeStyleOptions(), NULL, 0, resources->m_stroke_style))
+      || !resources->m_stroke_style)
+      return false;
+  }
+
+  stroke_style = resources->m_stroke_style;
+  return true;
+}
+
+void S52ResourceManager::ReleaseResources(ResourceOwnerID owner)
+{
+  QMutexLocker lock(&m_resources_lock);
+  m_resources.erase(owner);
+}
+
+S52ResourceManager::RenderTargetResources*
+S52ResourceManager::GetRenderTargetResources(ResourceOwnerID owner,
+  const sdk::gfx::RenderTargetSP& render_target)
+{
+  // Previous render target is held until it is replaced, so its address
+  // can not be reused by the new one while resources are cached
+  RenderTargetResources& resources = m_resources[owner];
+  if (resources.m_render_target.operator->() != render_target.operator->())
+  {
+    resources.m_brushes.clear();
+    resources.m_stroke_style.Release();
+    resources.m_render_target = render_target;
+  }
+  return &resources;
 }
 
 SDKResult S52ResourceManager::Init() {
+  // Render threads may build the color table on first use at once, the
+  // factory is created once and is not changed afterwards
+  QMutexLocker lock(&m_init_lock);
   if (m_sdl_catalog_factory)
     return sdk::Ok;
 
@@ -5,12 +5,19 @@
 #define S52_RESOURCE_MANAGER_H
 #pragma once
 
+#include <map>
 #include <memory>
+#include <vector>
+#include <QMutex>
+#include <QReadWriteLock>
 #include <base/inc/platform.h>
 #include <base/inc/base_types.h>
 #include <base/inc/sdk_results_enum.h>
 #include <visualizationlayer/inc/portrayal/sdl/sdl_interface.h>
 #include <visualizationlayer/inc/portrayal/csp/s52_const.h>
+#include <visualizationlayer/inc/graphics/2d_render_target_interface.h>
+#include <visualizationlayer/inc/graphics/2d_render_target_brush_interface.h>
+#include <visualizationlayer/inc/graphics/2d_render_target_stroke_style_interface.h>
 
 class S52ResourceManager;
 typedef std::tr1::shared_ptr<S52ResourceManager> S52ResourceManagerSP;
@@ -27,11 +34,74 @@ public:
   SDKColorF GetColor(const sdk::vis::sdl::ISymbolSetCatalogSP& sdl_catalog,
     const sdk::vis::s52::ColorIndexEnum& color_index);
 
+  // Rebuilds color table from the current SDL catalog, should be called
+  // when the catalog is changed
+  SDKResult Reload();
+
+  // Identifies the renderer, which cached resources belong to
+  typedef SDKUInt32 ResourceOwnerID;
+  // Returns a new resource owner ID, IDs are never reused
+  ResourceOwnerID CreateResourceOwner();
+
+  // Returns cached solid brush of S-52 color for given render target of the
+  // owner. Resources of the owner are recreated when its render target is
+  // changed. All of cached resources are dropped when palette is changed.
+  bool GetSolidBrush(ResourceOwnerID owner,
+    const sdk::gfx::RenderTargetSP& render_target,
+    const sdk::vis::s52::ColorIndexEnum& color_index, float alpha,
+    sdk::gfx::RenderTargetBrushSP& brush);
+  // Returns cached default stroke style for given render target of the owner
+  bool GetStrokeStyle(ResourceOwnerID owner,
+    const sdk::gfx::RenderTargetSP& render_target,
+    sdk::gfx::RenderTargetStrokeStyleSP& stroke_style);
+  // Releases cached resources of the owner, should be called when the owner
+  // is destroyed
+  void ReleaseResources(ResourceOwnerID owner);
+
 protected:
   SDKResult Init();
 
 private:
+  // Resources created by one owner for its render target
+  struct RenderTargetResources
+  {
+    typedef std::map<SDKUInt32, sdk::gfx::RenderTargetBrushSP> Brushes;
+
+    sdk::gfx::RenderTargetSP            m_render_target;
+    Brushes                             m_brushes;
+    sdk::gfx::RenderTargetStrokeStyleSP m_stroke_style;
+  };
+  typedef std::map<ResourceOwnerID, RenderTargetResources> RenderTargetResourcesMap;
+
+  // Returns resources of the owner, dropping them if they were created for
+  // another render target. m_resources_lock should be held.
+  RenderTargetResources* GetRenderTargetResources(ResourceOwnerID owner,
+    const sdk::gfx::RenderTargetSP& render_target);
+
+  // Colors of all palettes, indexed by palette * color count + color index
+  typedef std::vector<SDKColorF> ColorTable;
+  typedef std::tr1::shared_ptr<const ColorTable> ColorTableSP;
+
+  // Reads colors of all palettes from given SDL catalog
+  SDKResult BuildColorTable(const sdk::vis::sdl::ISymbolSetCatalogSP& sdl_catalog);
+  // Reads color from the color table, m_color_lock should be held
+  bool      LookupColor(const sdk::vis::s52::ColorIndexEnum& color_index,
+    SDKColorF& color) const;
+
+private:
+  // SDL catalog factory, created by Init under m_init_lock
+  QMutex                                    m_init_lock;
   sdk::vis::sdl::ISymbolSetCatalogFactorySP m_sdl_catalog_factory;
-  sdk::vis::s52::PaletteIndexEnum m_palette_index;
+
+  // Current palette, color table and the SDL catalog it was built from
+  mutable QReadWriteLock                    m_color_lock;
+  sdk::vis::s52::PaletteIndexEnum           m_palette_index;
+  ColorTableSP                              m_color_table;
+  sdk::vis::sdl::ISymbolSetCatalogSP        m_sdl_catalog;
+
+  // Cached render target resources by owner
+  QMutex                                    m_resources_lock;
+  RenderTargetResourcesMap                  m_resources;
+  ResourceOwnerID                           m_last_resource_owner;
 };
 #endif // S52_RESOURCE_MANAGER_H
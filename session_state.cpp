@@ -0,0 +1,97 @@
+// session_state.cpp : View and workspaces of the last session
+//
+#include <QDir>
+#include <QFileInfo>
+#include <QSettings>
+
+#include "session_state.h"
+
+namespace
+{
+  const int kSessionVersion = 1;
+}
+
+bool SessionState::Load(const QString& file_name)
+{
+  if (!QFileInfo(file_name).isFile())
+    return false;
+
+  QSettings session(file_name, QSettings::IniFormat);
+  if (session.value("version").toInt() != kSessionVersion)
+    return false;
+
+  SessionState state;
+  bool is_valid = true;
+  bool is_ok = false;
+
+  session.beginGroup("view");
+  state.m_latitude = session.value("lat").toDouble(&is_ok);
+  is_valid = is_valid && is_ok;
+  state.m_longitude = session.value("lon").toDouble(&is_ok);
+  is_valid = is_valid && is_ok;
+  state.m_scale = session.value("scale").toDouble(&is_ok);
+  is_valid = is_valid && is_ok && state.m_scale > 0.0;
+  state.m_rotation_angle = session.value("rotation").toFloat(&is_ok);
+  is_valid = is_valid && is_ok;
+  state.m_view_bounds.sw.lat = session.value("south").toInt(&is_ok);
+  is_valid = is_valid && is_ok;
+  state.m_view_bounds.sw.lon = session.value("west").toInt(&is_ok);
+  is_valid = is_valid && is_ok;
+  state.m_view_bounds.ne.lat = session.value("north").toInt(&is_ok);
+  is_valid = is_valid && is_ok;
+  state.m_view_bounds.ne.lon = session.value("east").toInt(&is_ok);
+  is_valid = is_valid && is_ok;
+  state.m_palette_index = session.value("palette").toInt(&is_ok);
+  is_valid = is_valid && is_ok;
+  state.m_display_mode = session.value("display_mode").toInt(&is_ok);
+  is_valid = is_valid && is_ok;
+  session.endGroup();
+  if (!is_valid)
+    return false;
+
+  const int count = session.beginReadArray("workspaces");
+  for (int i = 0; i < count; ++i)
+  {
+    session.setArrayIndex(i);
+    const QString path = session.value("path").toString();
+    if (!path.isEmpty())
+      state.m_workspaces << path;
+  }
+  session.endArray();
+
+  *this = state;
+  return true;
+}
+
+bool SessionState::Save(const QString& file_name) const
+{
+  QDir().mkpath(QFileInfo(file_name).path());
+
+  QSettings session(file_name, QSettings::IniFormat);
+  session.clear();
+  session.setValue("version", kSessionVersion);
+
+  session.beginGroup("view");
+  session.setValue("lat", m_latitude);
+  session.setValue("lon", m_longitude);
+  session.setValue("scale", m_scale);
+  session.setValue("rotation", m_rotation_angle);
+  session.setValue("south", static_cast<int>(m_view_bounds.sw.lat));
+  session.setValue("west", static_cast<int>(m_view_bounds.sw.lon));
+  session.setValue("north", static_cast<int>(m_view_bounds.ne.lat));
+  session.setValue("east", static_cast<int>(m_view_bounds.ne.lon));
+  session.setValue("palette", m_palette_index);
+  session.setValue("display_mode", m_display_mode);
+  session.endGroup();
+
+  session.beginWriteArray("workspaces", m_workspaces.size());
+  for (int i = 0; i < m_workspaces.size(); ++i)
+  {
+    session.setArrayIndex(i);
+    session.setValue("path", m_workspaces.at(i));
+  }
+  session.endArray();
+
+  session.sync();
+  return QSettings::NoError == session.status();
+}
@@ -0,0 +1,40 @@
+// session_state.h : View and workspaces of the last session
+//
+#ifndef SESSION_STATE_H
+#define SESSION_STATE_H
+#pragma once
+
+#include <QString>
+#include <QStringList>
+
+#include <base/inc/geometry/geometry_base_types.h>
+
+// View and workspaces stored on exit, so the next startup opens and renders
+// the workspaces of that view first. The state is stored in an ini file.
+struct SessionState
+{
+  // Scene center, degrees, and scale
+  double           m_latitude;
+  double           m_longitude;
+  double           m_scale;
+  // Viewport rotation, degrees
+  float            m_rotation_angle;
+  // Geographic bounds of the window
+  sdk::GeoIntRect  m_view_bounds;
+  // S-52 palette and display mode
+  int              m_palette_index;
+  int              m_display_mode;
+  // Paths of the workspaces in the order of opening
+  QStringList      m_workspaces;
+
+  SessionState() : m_latitude(0.0), m_longitude(0.0), m_scale(0.0),
+    m_rotation_angle(0.0f), m_view_bounds(), m_palette_index(0),
+    m_display_mode(0), m_workspaces() {}
+
+  // Reads the stored state, fails if there is none or it is incomplete
+  bool Load(const QString& file_name);
+  // Stores the state
+  bool Save(const QString& file_name) const;
+};
+
+#endif // SESSION_STATE_H
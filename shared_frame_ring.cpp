@@ -0,0 +1,263 @@
+// shared_frame_ring.cpp : Ring of BGRA frames in POSIX shared memory
+//
+
+#include "shared_frame_ring.h"
+
+#include <new>
+
+#if defined(Q_OS_UNIX)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  const quint32 kSharedFrameRingMagic = 0x53465252; // "SFRR"
+  const quint32 kSharedFrameRingVersion = 1;
+
+  // Frames start at page boundary
+  const size_t kHeaderSize = 4096;
+
+  QByteArray SharedMemoryName(const QString& name)
+  {
+    // POSIX shared memory names should start with slash
+    return (name.startsWith('/') ? name : QString("/") + name).toLocal8Bit();
+  }
+}
+
+SharedFrameRing::SharedFrameRing()
+  : m_name(),
+    m_is_owner(false),
+    m_header(0),
+    m_size(0),
+    m_read_sequence(0) {
+}
+
+SharedFrameRing::~SharedFrameRing() {
+  Close();
+}
+
+bool SharedFrameRing::Create(const QString& name, int width, int height,
+  int slot_count)
+{
+  Close();
+  if (width <= 0 || height <= 0 || slot_count < 2)
+    return false;
+
+#if defined(Q_OS_UNIX)
+  const size_t bytes_per_line = static_cast<size_t>(width) * 4;
+  const size_t size = kHeaderSize + bytes_per_line * height * slot_count;
+
+  QByteArray shm_name = SharedMemoryName(name);
+  shm_unlink(shm_name.constData()); // Leftover of the crashed producer
+  int fd = shm_open(shm_name.constData(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0)
+    return false;
+
+  bool is_mapped = ftruncate(fd, size) == 0 && Map(fd, size);
+  close(fd);
+  if (!is_mapped)
+  {
+    shm_unlink(shm_name.constData());
+    return false;
+  }
+
+  Header* header = new (m_header) Header();
+  header->width = width;
+  header->height = height;
+  header->bytes_per_line = bytes_per_line;
+  header->slot_count = slot_count;
+  header->version = kSharedFrameRingVersion;
+  // Consumer checks magic first, so it never sees partially filled header
+  header->magic.fetchAndStoreRelease(static_cast<int>(kSharedFrameRingMagic));
+
+  m_name = name;
+  m_is_owner = true;
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool SharedFrameRing::Attach(const QString& name)
+{
+  Close();
+
+#if defined(Q_OS_UNIX)
+  QByteArray shm_name = SharedMemoryName(name);
+  int fd = shm_open(shm_name.constData(), O_RDWR, 0);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  bool is_mapped = fstat(fd, &st) == 0 &&
+    static_cast<size_t>(st.st_size) > kHeaderSize && Map(fd, st.st_size);
+  close(fd);
+  if (!is_mapped)
+    return false;
+
+  // Validating the layout against the size of shared memory
+  const Header* header = m_header;
+  if (static_cast<quint32>(m_header->magic.fetchAndAddAcquire(0)) !=
+    kSharedFrameRingMagic ||
+    header->version != kSharedFrameRingVersion ||
+    header->slot_count < 2 || header->bytes_per_line < header->width * 4 ||
+    kHeaderSize + static_cast<size_t>(header->bytes_per_line) *
+      header->height * header->slot_count > m_size)
+  {
+    Close();
+    return false;
+  }
+
+  m_name = name;
+  m_is_owner = false;
+  m_read_sequence = static_cast<quint32>(
+    m_header->read_sequence.fetchAndAddAcquire(0));
+  return true;
+#else
+  return false;
+#endif
+}
+
+void SharedFrameRing::Close()
+{
+#if defined(Q_OS_UNIX)
+  if (m_header)
+    munmap(m_header, m_size);
+  if (m_is_owner)
+    shm_unlink(SharedMemoryName(m_name).constData());
+#endif
+
+  m_name.clear();
+  m_is_owner = false;
+  m_header = 0;
+  m_size = 0;
+  m_read_sequence = 0;
+}
+
+int SharedFrameRing::Width() const {
+  return m_header ? static_cast<int>(m_header->width) : 0;
+}
+
+int SharedFrameRing::Height() const {
+  return m_header ? static_cast<int>(m_header->height) : 0;
+}
+
+int SharedFrameRing::BytesPerLine() const {
+  return m_header ? static_cast<int>(m_header->bytes_per_line) : 0;
+}
+
+uchar* SharedFrameRing::BeginWrite()
+{
+  if (!m_header)
+    return 0;
+
+  // Only producer changes write sequence
+  quint32 write_sequence = static_cast<quint32>(
+    m_header->write_sequence.fetchAndAddAcquire(0));
+  quint32 read_sequence = static_cast<quint32>(
+    m_header->read_sequence.fetchAndAddAcquire(0));
+
+  // Slot of the frame after the released one may be still read
+  if (write_sequence - read_sequence >= m_header->slot_count)
+  {
+    m_header->dropped.ref();
+    return 0;
+  }
+
+  return Slot(write_sequence);
+}
+
+void SharedFrameRing::EndWrite()
+{
+  if (m_header)
+    m_header->write_sequence.fetchAndAddRelease(1);
+}
+
+bool SharedFrameRing::HasNewFrame() const
+{
+  if (!m_header)
+    return false;
+
+  return static_cast<quint32>(m_header->write_sequence.fetchAndAddAcquire(0)) !=
+    static_cast<quint32>(m_header->read_sequence.fetchAndAddAcquire(0));
+}
+
+const uchar* SharedFrameRing::BeginRead()
+{
+  if (!m_header)
+    return 0;
+
+  quint32 write_sequence = static_cast<quint32>(
+    m_header->write_sequence.fetchAndAddAcquire(0));
+  quint32 read_sequence = static_cast<quint32>(
+    m_header->read_sequence.fetchAndAddAcquire(0));
+  if (write_sequence == read_sequence)
+    return 0;
+
+  // Newest frame is taken, frames between are not shown
+  if (write_sequence - read_sequence > 1)
+    m_header->skipped.fetchAndAddRelaxed(
+      static_cast<int>(write_sequence - read_sequence - 1));
+
+  // Older frames are released at once, so the producer may reuse their
+  // slots while this one is being read
+  m_header->read_sequence.fetchAndStoreRelease(
+    static_cast<int>(write_sequence - 1));
+
+  m_read_sequence = write_sequence;
+  return Slot(write_sequence - 1);
+}
+
+void SharedFrameRing::EndRead()
+{
+  if (!m_header)
+    return;
+
+  // Releases the frame to the producer
+  m_header->read_sequence.fetchAndStoreRelease(
+    static_cast<int>(m_read_sequence));
+  m_header->consumed.ref();
+}
+
+SharedFrameRing::Statistics SharedFrameRing::GetStatistics() const
+{
+  Statistics statistics = { 0, 0, 0, 0 };
+  if (!m_header)
+    return statistics;
+
+  statistics.published = static_cast<quint32>(
+    m_header->write_sequence.fetchAndAddRelaxed(0));
+  statistics.dropped = static_cast<quint32>(
+    m_header->dropped.fetchAndAddRelaxed(0));
+  statistics.consumed = static_cast<quint32>(
+    m_header->consumed.fetchAndAddRelaxed(0));
+  statistics.skipped = static_cast<quint32>(
+    m_header->skipped.fetchAndAddRelaxed(0));
+  return statistics;
+}
+
+bool SharedFrameRing::Map(int fd, size_t size)
+{
+#if defined(Q_OS_UNIX)
+  void* memory = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (MAP_FAILED == memory)
+    return false;
+
+  m_header = static_cast<Header*>(memory);
+  m_size = size;
+  return true;
+#else
+  return false;
+#endif
+}
+
+uchar* SharedFrameRing::Slot(quint32 sequence) const
+{
+  const size_t frame_size =
+    static_cast<size_t>(m_header->bytes_per_line) * m_header->height;
+  return reinterpret_cast<uchar*>(m_header) + kHeaderSize +
+    frame_size * (sequence % m_header->slot_count);
+}
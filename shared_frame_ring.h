@@ -0,0 +1,92 @@
+// shared_frame_ring.h : Ring of BGRA frames in POSIX shared memory
+//
+
+#ifndef SHARED_FRAME_RING_H
+#define SHARED_FRAME_RING_H
+#pragma once
+
+#include <QString>
+#include <QAtomicInt>
+
+// Single producer / single consumer ring of fixed-size BGRA frames, which is
+// shared between processes. Frames are stored in bitmap row order
+// (bottom-up), so the consumer can pass them to the render target as is.
+//
+// Producer never overwrites a frame, which has not been released by the
+// consumer. If the ring is full, the new frame is dropped and counted.
+// Consumer always takes the newest frame, older ones are skipped and counted.
+class SharedFrameRing
+{
+public:
+  // Frame counters, shared by both processes
+  struct Statistics
+  {
+    quint32 published;  // Frames written by the producer
+    quint32 dropped;    // Frames not written, because the ring was full
+    quint32 consumed;   // Frames taken by the consumer
+    quint32 skipped;    // Frames replaced by newer ones before being taken
+  };
+
+  SharedFrameRing();
+  ~SharedFrameRing();
+
+  // Creates the ring (producer side)
+  bool Create(const QString& name, int width, int height, int slot_count);
+  // Attaches to the ring created by another process (consumer side)
+  bool Attach(const QString& name);
+  // Unmaps the ring, the creator also removes it
+  void Close();
+
+  bool IsOpen() const { return m_header != 0; }
+  int  Width() const;
+  int  Height() const;
+  int  BytesPerLine() const;
+
+  // Returns memory of the next slot or NULL, if the ring is full.
+  // EndWrite should be called to publish the frame.
+  uchar*       BeginWrite();
+  void         EndWrite();
+
+  // Returns true, if a frame is published since the last EndRead
+  bool         HasNewFrame() const;
+  // Returns the newest published frame or NULL, if there is no new one.
+  // Frame stays valid until EndRead is called.
+  const uchar* BeginRead();
+  void         EndRead();
+
+  Statistics   GetStatistics() const;
+
+private:
+  // Layout of the beginning of shared memory, frames follow it
+  struct Header
+  {
+    QAtomicInt magic;           // Set last by the producer
+    quint32    version;
+    quint32    width;
+    quint32    height;
+    quint32    bytes_per_line;
+    quint32    slot_count;
+    QAtomicInt write_sequence;  // Number of published frames
+    QAtomicInt read_sequence;   // Frames up to this one are released
+    QAtomicInt dropped;
+    QAtomicInt consumed;
+    QAtomicInt skipped;
+  };
+
+  bool   Map(int fd, size_t size);
+  uchar* Slot(quint32 sequence) const;
+
+  // Disable copying
+  SharedFrameRing(const SharedFrameRing&);
+  SharedFrameRing& operator=(const SharedFrameRing&);
+
+private:
+  QString  m_name;
+  bool     m_is_owner;
+  Header*  m_header;
+  size_t   m_size;
+  // Sequence of the frame being read, released by EndRead
+  quint32  m_read_sequence;
+};
+
+#endif // SHARED_FRAME_RING_H
@@ -23,7 +23,8 @@ QMAKE_CXXFLAGS += -Wno-unused-parameter -Wno-switch -Wno-unused-variable -Wno-un
 LIBS += \
     -lbase_library \
     -lX11 \
-    -lGL
+    -lGL \
+    -lrt
 }
 
 win32 {
@@ -43,23 +44,51 @@ SOURCES += main.cpp\
     step_5_demo_widget.cpp \
     portrayalparametersdlg.cpp \
     featureinfodlg.cpp \
+    feature_info_model.cpp \
+    catalog_label_cache.cpp \
+    feature_attribute_text.cpp \
     enterhwiddlg.cpp \
     databaseupdatehistorydlg.cpp \
+    update_history_loader.cpp \
+    update_history_model.cpp \
+    update_history_summary.cpp \
+    update_history_summary_builder.cpp \
     s52_resource_manager.cpp \
     decoration_renderer.cpp \
     addbookmarkdlg.cpp \
     bookmarksdlg.cpp \
     coverage_renderer.cpp \
     markedfeaturerenderer.cpp \
+    mark_feature_loader.cpp \
+    changed_feature_collector.cpp \
     user_bmp_layer_renderer.cpp \
+    shared_frame_ring.cpp \
+    radar_scan_converter.cpp \
+    radar_simulator.cpp \
+    bitmap_triple_buffer.cpp \
+    pick_index.cpp \
+    pick_index_builder.cpp \
+    hover_picker.cpp \
+    feature_exporter.cpp \
+    workspace_opener.cpp \
+    root_catalog_cache.cpp \
+    chart_directory_watcher.cpp \
+    session_state.cpp \
     glwidget.cpp
 
 HEADERS  += mainwindow.h \
     step_5_demo_widget.h \
     portrayalparametersdlg.h \
     featureinfodlg.h \
+    feature_info_model.h \
+    catalog_label_cache.h \
+    feature_attribute_text.h \
     enterhwiddlg.h \
     databaseupdatehistorydlg.h \
+    update_history_loader.h \
+    update_history_model.h \
+    update_history_summary.h \
+    update_history_summary_builder.h \
     s52_resource_manager.h \
     decoration_renderer.h \
     addbookmarkdlg.h \
@@ -68,7 +97,21 @@ HEADERS  += mainwindow.h \
     coverage_renderer.h \
     mark_unmark_feature_interface.h \
     markedfeaturerenderer.h \
+    mark_feature_loader.h \
+    changed_feature_collector.h \
     user_bmp_layer_renderer.h \
+    shared_frame_ring.h \
+    radar_scan_converter.h \
+    radar_simulator.h \
+    bitmap_triple_buffer.h \
+    pick_index.h \
+    pick_index_builder.h \
+    hover_picker.h \
+    feature_exporter.h \
+    workspace_opener.h \
+    root_catalog_cache.h \
+    chart_directory_watcher.h \
+    session_state.h \
     glwidget.h
 
 FORMS    += mainwindow.ui \
@@ -1,15 +1,23 @@
 #include <sstream>
 #include <QMessageBox>
 #include <QFileDialog>
+#include <QFileInfo>
+#include <QDir>
+#include <QThread>
+#include <QToolTip>
+#include <QElapsedTimer>
+#include <QDebug>
 #include "portrayalparametersdlg.h"
 #include "enterhwiddlg.h"
 #include "addbookmarkdlg.h"
 #include "bookmarksdlg.h"
+#include "utils.h"
 #include "step_5_demo_widget.h"
 #include "ui_step_5_demo_widget.h"
 
 #if defined(SDK_OS_POSIX)
 # include <QX11Info>
+# include <sys/resource.h>
 #endif
 #include <base/inc/sdk_results_enum.h>
 #include <base/inc/sdk_any_handler.h>
@@ -26,12 +34,37 @@
 
 // Lokasi directory menyimpan SENC chart
 #define CHART_DIRECTORY QDir::homePath() + "/.MIT/MAP/"
+// HW_ID dan nama file permit untuk chart terenkripsi di CHART_DIRECTORY
+#define CHART_HW_ID L"56789"
+#define CHART_PERMITS_FILE "PERMIT.TXT"
+// Nama shared memory frame radar/kamera dari proses lain
+#define SHARED_FRAMES_VARIABLE "SHARED_FRAMES_NAME"
+// Jika diset, radar sintetis ditampilkan sebagai pengganti demo GL
+#define RADAR_SIMULATOR_VARIABLE "RADAR_SIMULATOR"
+// Jika diset, hasil pick index dibandingkan dengan hasil FindFeatures SDK
+#define PICK_INDEX_VERIFY_VARIABLE "PICK_INDEX_VERIFY"
+// Jika diset, penggunaan CPU dan laju update overlay dicatat tiap 10 detik
+#define CPU_USAGE_LOG_VARIABLE "CPU_USAGE_LOG"
+// Jumlah thread pembuka workspace saat startup, 1 berarti berurutan
+#define WORKSPACE_OPEN_THREADS_VARIABLE "WORKSPACE_OPEN_THREADS"
+// Lokasi file cache metadata root catalog
+#define ROOT_CATALOG_CACHE_FILE QDir::homePath() + "/.MIT/root_catalog_cache.dat"
+// Lokasi directory ringkasan riwayat update tiap workspace
+#define UPDATE_HISTORY_SUMMARY_DIRECTORY QDir::homePath() + "/.MIT/update_history/"
+// Lokasi file tampilan dan workspace sesi terakhir
+#define SESSION_STATE_FILE QDir::homePath() + "/.MIT/session.ini"
 
 using namespace SDK_NAMESPACE;
 using namespace SDK_GDB_NAMESPACE;
 using namespace SDK_VIS_NAMESPACE;
 using namespace SDK_CRS_NAMESPACE;
 
+namespace
+{
+  // Time the cursor should rest before the tooltip is picked, ms
+  const int kHoverDelay = 20;
+}
+
 step_5_demo_widget::step_5_demo_widget(QWidget *parent)
   : QWidget(parent),
     ui(new Ui::step_5_demo_widget),
@@ -52,7 +85,33 @@ step_5_demo_widget::step_5_demo_widget(QWidget *parent)
     m_coverage_layer(),
     m_marked_feature_layer_renderer(),
     m_marked_feature_layer(),
+    m_mark_feature_loader(),
+    m_changed_feature_collector(),
+    m_pick_index_builder(),
+    m_pick_index(),
+    m_view_generation(0),
+    m_pick_index_request(-1),
+    m_verify_pick_index(!qgetenv(PICK_INDEX_VERIFY_VARIABLE).isEmpty()),
+    m_hover_picker(),
+    m_hover_timer(),
+    m_hover_position(-1, -1),
+    m_hover_move_time(0),
+    m_feature_exporter(),
+    m_export_progress(),
+    m_export_band(),
+    m_is_export_selecting(false),
+    m_export_origin(-1, -1),
     m_wks_factory(),
+    m_catalog_label_cache(new CatalogLabelCache()),
+    m_update_history_summary(
+      new UpdateHistorySummaryBuilder(UPDATE_HISTORY_SUMMARY_DIRECTORY)),
+    m_root_catalog_cache(new RootCatalogCache(ROOT_CATALOG_CACHE_FILE)),
+    m_chart_directory_watcher(),
+    m_attached_workspaces(),
+    m_workspace_paths(),
+    m_startup_timer(),
+    m_is_first_frame_pending(false),
+    m_is_session_saved(false),
     m_feature_info_dlg(),
     m_updatehistory_dlg(),
     m_captured(false),
@@ -61,7 +120,15 @@ step_5_demo_widget::step_5_demo_widget(QWidget *parent)
     m_mousewheel_delta(0),
     m_status_bar_text(L""),
     m_s52_resource_manager(),
-    m_portrayal_name()
+    m_portrayal_name(),
+    m_glWidget(NULL),
+    m_radar_simulator(),
+    m_overlay_update_pending(false),
+    m_overlay_updates(0),
+    m_cpu_usage_clock(),
+    m_cpu_usage_start(0.0),
+    m_is_shared_frames_attached(false),
+    m_is_overlay_paused(true)
 {
   ui->setupUi(this);
 
@@ -72,6 +139,13 @@ step_5_demo_widget::step_5_demo_widget(QWidget *parent)
   qApp->installEventFilter(this);
 
   connect(&m_mouse_wheel_timer, SIGNAL(timeout()), this, SLOT(OnMouseWheelTimeout()));
+  connect(&m_shared_frames_timer, SIGNAL(timeout()), this, SLOT(OnSharedFramesTimeout()));
+  connect(&m_cpu_usage_timer, SIGNAL(timeout()), this, SLOT(OnCpuUsageTimeout()));
+  if (!qgetenv(CPU_USAGE_LOG_VARIABLE).isEmpty())
+    m_cpu_usage_timer.start(10000);
+
+  m_hover_timer.setSingleShot(true);
+  connect(&m_hover_timer, SIGNAL(timeout()), this, SLOT(OnHoverTimeout()));
 }
 
 step_5_demo_widget::~step_5_demo_widget()
@@ -90,9 +164,53 @@ step_5_demo_widget::~step_5_demo_widget()
     m_feature_info_dlg.reset(NULL);
   }
 
-  // Releasing all of previously created SDK components
+  // Detaching from frames of external process
+  m_shared_frames_timer.stop();
+  if (m_user_bmp_layer_renderer)
+  {
+    SharedFrameRing::Statistics statistics =
+      m_user_bmp_layer_renderer->GetSharedFrameStatistics();
+    if (statistics.published && IsTimingLogEnabled())
+      qDebug() << "Shared frames published" << statistics.published
+        << "shown" << statistics.consumed << "skipped" << statistics.skipped
+        << "dropped" << statistics.dropped;
+    m_user_bmp_layer_renderer->DetachSharedFrames();
+  }
+
+  // Stopping the radar simulator thread
+  m_radar_simulator.reset(NULL);
+
+  // Waiting for the pending mark preparation
+  m_mark_feature_loader.reset(NULL);
+  m_changed_feature_collector.reset(NULL);
+
+  // Waiting for the pending pick index building
+  m_pick_index_builder.reset(NULL);
+  m_pick_index.reset();
+
+  // Waiting for the pending tooltip query
+  m_hover_timer.stop();
+  m_hover_picker.reset(NULL);
+
+  // Stopping the running export, its partial file is removed
+  m_feature_exporter.reset(NULL);
+  m_export_progress.reset(NULL);
+
+  // Waiting for the pending chart folder opening
+  m_chart_directory_watcher.reset(NULL);
+
+  // Waiting for the pending update history summary
+  m_update_history_summary.reset(NULL);
+
+  // Root catalogs read since the startup are kept for the next one
+  if (m_root_catalog_cache)
+    m_root_catalog_cache->Save();
+
+  // Releasing all of previously created SDK components, workers using
+  // them are stopped above
   m_s52_resource_manager.reset();
 
+  m_attached_workspaces.clear();
   m_wks_factory.Release();
 
   m_marked_feature_layer_renderer.Release();
@@ -113,6 +231,8 @@ step_5_demo_widget::~step_5_demo_widget()
 
 void step_5_demo_widget::Initialize()
 {
+  m_startup_timer.start();
+
   if (!CreateAndInitScene())
   {
     QMessageBox::critical(this, "Initialization error",
@@ -127,44 +247,242 @@ void step_5_demo_widget::Initialize()
   // Applying S-52 portrayal by default
   SetPortrayalName(std::string(config::kPortrayal_s52));
 
+  // Metadata of known root catalogs, so they are not opened again
+  m_root_catalog_cache->Load();
+
+  // View of the last session replaces the default one, its workspaces
+  // are opened first
+  SessionState session;
+  const bool is_restored = session.Load(SESSION_STATE_FILE);
+  if (is_restored)
+    ApplySessionView(session);
+
+  // Workspaces of chart folders are opened concurrently
+  std::vector<WorkspaceOpener::Entry> background_entries;
+  OpenChartDirectory(is_restored ? &session : NULL, background_entries);
+
+  // First scene render, workspaces opened later only update the scene
+  RenderScene();
+  m_is_first_frame_pending = IsTimingLogEnabled();
+  if (m_is_first_frame_pending)
+    qDebug() << "First frame requested in" << m_startup_timer.elapsed()
+      << "ms," << (is_restored ? "session view restored," : "default view,")
+      << background_entries.size() << "workspaces left for background";
+
+  // Chart folders added or updated later are opened in background
+  m_chart_directory_watcher.reset(new ChartDirectoryWatcher(CHART_DIRECTORY,
+    GetWorkspaceFactory(), m_root_catalog_cache, CHART_HW_ID,
+    CHART_PERMITS_FILE));
+  connect(m_chart_directory_watcher.get(), SIGNAL(signalWorkspaceOpened()),
+    this, SLOT(OnChartWorkspaceOpened()), Qt::QueuedConnection);
+
+  // Workspaces outside of the view are added nearest first, before the
+  // other folders are stamped
+  m_chart_directory_watcher->Open(background_entries);
+  m_chart_directory_watcher->Start();
+}
+
+void step_5_demo_widget::OpenChartDirectory(const SessionState* session,
+  std::vector<WorkspaceOpener::Entry>& background_entries)
+{
+  background_entries.clear();
+
   QDir dir(CHART_DIRECTORY);
   dir.setFilter(QDir::AllDirs | QDir::NoDotAndDotDot);
+  dir.setSorting(QDir::Name);
+  QStringList paths;
   QFileInfoList list = dir.entryInfoList();
-  QString path;
- if (!(list.empty()))
-     {
-      qDebug() << "load peta";
-     for (int i = 0; i < list.size(); ++i) {
-         QFileInfo fileInfo = list.at(i);
-         path = fileInfo.absoluteFilePath();
-
-          // Getting the
-          std::wstring hw_id;
-          std::wstring permits_path;
-          // Getting HW_ID and path to permits file, if needed
-          do
-          {
-            if (!IsDatabaseEncrypted(path.toStdWString()))
-              break; // Database is not encrypted
-
-            // Getting HW_ID and Permits file
-            hw_id = L"56789";
-
-            // HW_ID is specified, PERMITS.TXT file also required
-            QString permit = path + "/PERMIT.TXT";
-            permits_path = permit.toStdWString();
-          }
-          while (false);
-
-      // Opening new geodatabase workspace
-      OpenDatabaseWorkspace(path.toStdWString(), hw_id, permits_path);
-      // Invalidating scene
-      RenderScene();
-     }
-     }
+  for (int i = 0; i < list.size(); ++i)
+    paths << list.at(i).absoluteFilePath();
 
-  // First scene render
-  m_scene_control->UpdateScene(kUpdateSceneFlags_StartRendering);
+  // Workspaces of the last session opened from other locations
+  if (session)
+  {
+    for (int i = 0; i < session->m_workspaces.size(); ++i)
+    {
+      const QFileInfo info(session->m_workspaces.at(i));
+      if (info.isDir() && !paths.contains(info.absoluteFilePath()))
+        paths << info.absoluteFilePath();
+    }
+  }
+  if (paths.empty())
+    return;
+
+  qDebug() << "load peta";
+  QElapsedTimer timer;
+  timer.start();
+
+  std::vector<WorkspaceOpener::Entry> entries(paths.size());
+  for (int i = 0; i < paths.size(); ++i)
+  {
+    const QString& path = paths.at(i);
+    WorkspaceOpener::Entry& entry = entries[i];
+    entry.m_wks_path = path.toStdWString();
+    // HW_ID and PERMITS.TXT file are used if the database is encrypted
+    entry.m_hw_id = CHART_HW_ID;
+    entry.m_permits_path = QDir(path).filePath(CHART_PERMITS_FILE).toStdWString();
+    entry.m_open_time = 0;
+  }
+
+  if (session)
+  {
+    // Workspaces covering the view are opened now, at least the nearest
+    // one, so the first frame shows a chart
+    size_t covering_count = WorkspaceOpener::OrderByView(GetWorkspaceFactory(),
+      m_root_catalog_cache, session->m_view_bounds, entries);
+    covering_count = qMax(covering_count, static_cast<size_t>(1));
+    background_entries.assign(entries.begin() + covering_count, entries.end());
+    entries.resize(covering_count);
+  }
+
+  int thread_count = QThread::idealThreadCount();
+  bool is_set = false;
+  const int env_thread_count =
+    qgetenv(WORKSPACE_OPEN_THREADS_VARIABLE).toInt(&is_set);
+  if (is_set && env_thread_count > 0)
+    thread_count = env_thread_count;
+  WorkspaceOpener::OpenAll(GetWorkspaceFactory(), m_root_catalog_cache,
+    entries, thread_count);
+  const qint64 open_time = timer.elapsed();
+
+  // Workspaces are added to the scene in the folder order, the scene is
+  // rendered once by the caller
+  m_catalog_label_cache->Clear();
+  qint64 max_open_time = 0;
+  size_t opened = 0;
+  for (size_t i = 0; i < entries.size(); ++i)
+  {
+    max_open_time = qMax(max_open_time, entries[i].m_open_time);
+    if (!entries[i].m_wks)
+    {
+      qWarning() << "Failed to open workspace"
+        << QString::fromStdWString(entries[i].m_wks_path);
+      continue;
+    }
+    AttachDatabaseWorkspace(entries[i].m_wks_path, entries[i].m_wks);
+    ++opened;
+  }
+
+  if (IsTimingLogEnabled())
+  {
+    quint32 cache_hits = 0, cache_misses = 0;
+    m_root_catalog_cache->GetStatistics(cache_hits, cache_misses);
+    qDebug() << "Opened" << opened << "of" << entries.size() << "chart folders on"
+      << thread_count << "threads in" << open_time << "ms (slowest"
+      << max_open_time << "ms), attached in"
+      << timer.elapsed() - open_time << "ms, root catalog cache:"
+      << cache_hits << "hits," << cache_misses << "misses";
+  }
+
+  // Cold startup results are stored for the next warm one
+  m_root_catalog_cache->Save();
+}
+
+void step_5_demo_widget::ApplySessionView(const SessionState& session)
+{
+  switch (session.m_palette_index)
+  {
+  case s52::kPaletteIndex_DAY:
+  case s52::kPaletteIndex_DUSK:
+  case s52::kPaletteIndex_NIGHT:
+    SetPaletteType(static_cast<s52::PaletteIndexEnum>(session.m_palette_index));
+    break;
+  default:
+    break;
+  }
+
+  switch (session.m_display_mode)
+  {
+  case kDisplayMode_Base:
+  case kDisplayMode_Standard:
+  case kDisplayMode_Full:
+    SetDisplayMode(static_cast<DisplayModeEnum>(session.m_display_mode));
+    break;
+  default:
+    break;
+  }
+
+  ApplyProjectionParameters(session.m_latitude, session.m_longitude,
+    session.m_scale);
+  SetViewportRotationAngle(session.m_rotation_angle);
+}
+
+void step_5_demo_widget::SaveSession()
+{
+  // Closing from the menu signals the close twice
+  if (!m_scene_control || m_is_session_saved)
+    return;
+  m_is_session_saved = true;
+
+  SessionState session;
+
+  // Getting position of screen center, as for the bookmarks
+  const QRect r = rect();
+  const PointF2D center = WinToGeo(QPoint(r.width() / 2, r.height() / 2));
+  session.m_latitude = center.y;
+  session.m_longitude = center.x;
+
+  ISDKParametersSP scene_param;
+  if (SDK_FAILED(m_scene_control->GetSceneParameters(scene_param)))
+    return;
+  if (SDK_FAILED(scene_param->GetParameter(kSceneParameters_Scale,
+    sdk::SDKAnyReturnHelper<double>(session.m_scale))))
+    return;
+  session.m_rotation_angle = GetViewportRotationAngle();
+
+  // Bounds of the window corners, the view may be rotated
+  const QPoint corners[4] = { r.topLeft(), r.topRight(), r.bottomLeft(),
+    r.bottomRight() };
+  const PointF2D first_corner = WinToGeo(corners[0]);
+  float south = first_corner.y, west = first_corner.x;
+  float north = first_corner.y, east = first_corner.x;
+  for (int i = 1; i < 4; ++i)
+  {
+    const PointF2D corner = WinToGeo(corners[i]);
+    south = qMin(south, corner.y);
+    west = qMin(west, corner.x);
+    north = qMax(north, corner.y);
+    east = qMax(east, corner.x);
+  }
+  session.m_view_bounds.sw.lat = sdk::GeoIntFromDeg(south);
+  session.m_view_bounds.sw.lon = sdk::GeoIntFromDeg(west);
+  session.m_view_bounds.ne.lat = sdk::GeoIntFromDeg(north);
+  session.m_view_bounds.ne.lon = sdk::GeoIntFromDeg(east);
+
+  session.m_palette_index = GetPaletteType();
+  session.m_display_mode = GetDisplayModeType();
+  session.m_workspaces = m_workspace_paths;
+
+  if (!session.Save(SESSION_STATE_FILE))
+    qWarning() << "Failed to store the session";
+}
+
+void step_5_demo_widget::OnChartWorkspaceOpened()
+{
+  if (!m_chart_directory_watcher.get() || !m_scene_control)
+    return;
+
+  std::vector<WorkspaceOpener::Entry> entries;
+  m_chart_directory_watcher->TakeOpened(entries);
+  if (entries.empty())
+    return;
+
+  // Other workspaces and their catalog labels are kept
+  for (size_t i = 0; i < entries.size(); ++i)
+  {
+    AttachDatabaseWorkspace(entries[i].m_wks_path, entries[i].m_wks);
+    if (IsTimingLogEnabled())
+      qDebug() << "Added chart folder"
+        << QString::fromStdWString(entries[i].m_wks_path)
+        << "opened in" << entries[i].m_open_time << "ms,"
+        << m_startup_timer.elapsed() << "ms since startup";
+  }
+
+  // Only the coverage layer and the scene data are invalidated
+  if (m_coverage_layer_renderer && m_coverage_layer)
+    m_coverage_layer->SetDirty(true);
+  if (SDK_FAILED(m_scene_control->UpdateScene(kUpdateSceneFlags_StartRendering)))
+    return;
   update();
 }
 
@@ -216,43 +534,251 @@ DisplayModeEnum step_5_demo_widget::GetDisplayModeType()
 
 bool step_5_demo_widget::MarkFeature(ObjectID& feature_id)
 {
-  if (m_marked_feature_layer_renderer)
+  if (!m_mark_feature_loader.get())
+    return false;
+
+  sdk::crs::IProjectionSP projection;
+  SDKResult get_projection = m_scene_manager->GetProjection(projection);
+  if (!IsSDKResultSucceeded(get_projection) || !projection)
+    return false;
+
+  // Feature geometry is read on worker thread, the view is moved to the
+  // feature in OnMarkFeatureReady, which also reports the failure
+  if (m_changed_feature_collector.get())
+    m_changed_feature_collector->Cancel();
+  m_mark_feature_loader->Request(feature_id, projection);
+  return true;
+}
+
+void step_5_demo_widget::OnRadarFrameReady()
+{
+  GLDataUpdated();
+}
+
+void step_5_demo_widget::OnPickIndexReady()
+{
+  if (!m_pick_index_builder.get())
+    return;
+
+  PickIndexSP index;
+  int generation = 0;
+  if (!m_pick_index_builder->TakeResult(index, generation))
+    return; // Superseded or already taken
+
+  // Index of the previous view is not used
+  if (generation != m_view_generation)
+    return;
+  m_pick_index = index;
+
+  if (m_verify_pick_index && m_pick_index)
+    qDebug() << "Pick index:" << m_pick_index->GetFeatureCount() << "features,"
+      << m_pick_index->GetReferenceCount() << "cell references";
+}
+
+void step_5_demo_widget::OnHoverTimeout()
+{
+  if (!m_hover_picker.get() || !m_scene_control || m_captured)
+    return;
+
+  // Query rectangle is the same as the one of the feature info dialog
+  const int rect_size = static_cast<int>(kFindFeatureUnderCursorRectangleSize);
+  HoverPicker::Query query;
+  query.m_rect = QRect(m_hover_position.x() - rect_size / 2,
+    m_hover_position.y() - rect_size / 2, rect_size, rect_size);
+  query.m_generation = m_view_generation;
+  query.m_move_time = m_hover_move_time;
+  query.m_is_picked = m_pick_index.get() != NULL;
+
+  if (m_pick_index)
   {
-    sdk::crs::IProjectionSP projection;
-    SDKResult get_projection = m_scene_manager->GetProjection(projection);
-    if (!IsSDKResultSucceeded(get_projection) || !projection)
-      return false;
+    // Only features are read on worker, the pick itself takes microseconds
+    m_pick_index->Pick(m_hover_position, query.m_feature_ids);
+    query.m_wks_factory = GetWorkspaceFactory();
+  }
+  else
+  {
+    // Index is being built, features are found by SDK on worker
+    if (SDK_FAILED(m_scene_control->GetSceneInfo(
+      sdk::vis::kSceneInfoFlags_NoFlags, query.m_scene_info)) || !query.m_scene_info)
+      return;
+    if (!CreateWindowRectFilter(query.m_scene_info, QRectF(query.m_rect),
+      query.m_geometry_filter))
+      return;
+  }
 
-    GeoIntPoint feature_object_position;
-    double dataset_min_disp_scale;
-    if (m_marked_feature_layer_renderer->SetMark(feature_id, projection,
-      feature_object_position, dataset_min_disp_scale) && projection)
-    {
-      // Applying new projection center and scale
-      sdk::ISDKParametersSP scene_parameters;
-      if (SDK_FAILED(m_scene_control->GetSceneParameters(scene_parameters)))
-        return false;
-      double curr_scale = 0.0f;
-      if (SDK_FAILED(scene_parameters->GetParameterT(sdk::vis::kSceneParameters_Scale, curr_scale)))
-        return false;
-      double req_scale = curr_scale;
-      if (req_scale > dataset_min_disp_scale)
-        req_scale = dataset_min_disp_scale;
-
-      ApplyProjectionParameters(DegFromGeoInt(feature_object_position.y),
-        DegFromGeoInt(feature_object_position.x), req_scale);
-
-      // Invalidating the scene
-      RenderScene();
-      return true;
-    }
+  m_hover_picker->Request(query);
+}
+
+void step_5_demo_widget::OnHoverTooltipReady()
+{
+  if (!m_hover_picker.get())
+    return;
+
+  HoverPicker::Result result;
+  if (!m_hover_picker->TakeResult(result))
+    return; // Superseded or already taken
+
+  // Tooltip of the previous view is not shown
+  if (result.m_generation != m_view_generation)
+    return;
+
+  if (result.m_text.isEmpty())
+  {
+    QToolTip::hideText();
+    return;
   }
 
-  return false;
+  QToolTip::showText(mapToGlobal(m_current_mouse_position), result.m_text, this);
+  if (m_verify_pick_index)
+    m_hover_picker->AccountLatency(m_hover_picker->Now() - result.m_move_time);
+}
+
+void step_5_demo_widget::OnSharedFramesTimeout()
+{
+  // Layer is repainted only when the producer has published a new frame
+  if (m_user_bmp_layer_renderer && m_user_bmp_layer_renderer->HasNewSharedFrame())
+    GLDataUpdated();
+}
+
+void step_5_demo_widget::OnMarkFeatureReady()
+{
+  if (!m_mark_feature_loader.get() || !m_marked_feature_layer_renderer)
+    return;
+
+  MarkedFeatureRenderer::PreparedMark prepared;
+  bool is_prepared = false;
+  if (!m_mark_feature_loader->TakeResult(prepared, is_prepared))
+    return; // Superseded or already taken
+
+  // Current marks are kept if the feature could not be read
+  if (!is_prepared || !m_marked_feature_layer_renderer->ApplyMark(prepared, true))
+  {
+    QMessageBox::warning(this, tr("Warning"),
+      tr("Failed to mark the feature."));
+    return;
+  }
+
+  // Applying new projection center and scale
+  sdk::ISDKParametersSP scene_parameters;
+  if (SDK_FAILED(m_scene_control->GetSceneParameters(scene_parameters)))
+    return;
+  double curr_scale = 0.0f;
+  if (SDK_FAILED(scene_parameters->GetParameterT(sdk::vis::kSceneParameters_Scale, curr_scale)))
+    return;
+  double req_scale = curr_scale;
+  if (req_scale > prepared.m_min_disp_scale)
+    req_scale = prepared.m_min_disp_scale;
+
+  ApplyProjectionParameters(DegFromGeoInt(prepared.m_position.y),
+    DegFromGeoInt(prepared.m_position.x), req_scale);
+
+  // Invalidating the scene
+  RenderScene();
+}
+
+bool step_5_demo_widget::MarkFeatures(const std::vector<ObjectID>& feature_ids)
+{
+  if (!m_marked_feature_layer_renderer || !m_marked_feature_layer)
+    return false;
+
+  sdk::crs::IProjectionSP projection;
+  SDKResult get_projection = m_scene_manager->GetProjection(projection);
+  if (!IsSDKResultSucceeded(get_projection) || !projection)
+    return false;
+
+  if (m_mark_feature_loader.get())
+    m_mark_feature_loader->Cancel();
+  if (m_changed_feature_collector.get())
+    m_changed_feature_collector->Cancel();
+  m_marked_feature_layer_renderer->RemoveMark();
+  size_t marked = m_marked_feature_layer_renderer->AddMarks(feature_ids,
+    projection);
+
+  // Invalidating the layer
+  m_marked_feature_layer->SetDirty(true);
+
+  m_scene_control->UpdateScene(kUpdateSceneFlags_StartRendering);
+  update();
+
+  return marked > 0;
+}
+
+bool step_5_demo_widget::MarkChangedFeatures(
+  const ChangedFeatureCollector::Since& since)
+{
+  if (!m_changed_feature_collector.get() || !m_scene_control)
+    return false;
+
+  ChangedFeatureCollector::Request request;
+  request.m_since = since;
+  request.m_wks_factory = GetWorkspaceFactory();
+
+  SDKResult get_projection = m_scene_manager->GetProjection(request.m_projection);
+  if (!IsSDKResultSucceeded(get_projection) || !request.m_projection)
+    return false;
+
+  // Datasets intersecting the window are looked through
+  sdk::vis::ISceneInformationSP scene_info;
+  if (SDK_FAILED(m_scene_control->GetSceneInfo(
+    sdk::vis::kSceneInfoFlags_NoFlags, scene_info)) || !scene_info)
+    return false;
+  if (!CreateWindowRectFilter(scene_info, QRectF(rect()),
+    request.m_geometry_filter))
+    return false;
+
+  // Update records and geometries are read on worker threads, the marks are
+  // shown in OnChangedFeaturesReady
+  if (m_mark_feature_loader.get())
+    m_mark_feature_loader->Cancel();
+  m_changed_feature_collector->Start(request);
+  return true;
+}
+
+void step_5_demo_widget::OnChangedFeaturesReady()
+{
+  if (!m_changed_feature_collector.get() || !m_marked_feature_layer_renderer ||
+    !m_marked_feature_layer)
+    return;
+
+  ChangedFeatureCollector::Result result;
+  if (!m_changed_feature_collector->TakeResult(result))
+    return; // Superseded or already taken
+
+  // Current marks are kept if the changes could not be collected
+  if (!result.m_error.isEmpty())
+  {
+    QMessageBox::warning(this, tr("Changed features"), result.m_error);
+    return;
+  }
+
+  // All of marks are drawn by the marked feature layer at once
+  QElapsedTimer timer;
+  timer.start();
+  m_marked_feature_layer_renderer->RemoveMark();
+  size_t marked = m_marked_feature_layer_renderer->ApplyMarks(result.m_marks);
+  if (IsTimingLogEnabled())
+    qDebug() << "Marked" << marked << "changed features in" << timer.elapsed()
+      << "ms";
+
+  // Invalidating the layer
+  m_marked_feature_layer->SetDirty(true);
+  m_scene_control->UpdateScene(kUpdateSceneFlags_StartRendering);
+  update();
+
+  if (result.m_feature_count == 0)
+    QMessageBox::information(this, tr("Changed features"),
+      tr("No features have been changed by %1 updates of %2 datasets in view.")
+      .arg(result.m_update_count).arg(result.m_dataset_count));
 }
 
 bool step_5_demo_widget::UnmarkFeature()
 {
+  // Dropping the marks, which are still being prepared
+  if (m_mark_feature_loader.get())
+    m_mark_feature_loader->Cancel();
+  if (m_changed_feature_collector.get())
+    m_changed_feature_collector->Cancel();
+
   if (m_marked_feature_layer_renderer && m_marked_feature_layer)
   {
     if (m_marked_feature_layer_renderer->RemoveMark())
@@ -272,8 +798,18 @@ bool step_5_demo_widget::UnmarkFeature()
 
 void step_5_demo_widget::paintEvent(QPaintEvent* evt)
 {
-  if (m_scene_control)
-    m_scene_control->UpdateScene(kUpdateSceneFlags_Display);
+  if (!m_scene_control)
+    return;
+  const SDKResult res = m_scene_control->UpdateScene(kUpdateSceneFlags_Display);
+
+  // Time to the first frame shown after the startup render, it is pending
+  // only if TIMING_LOG is set
+  if (m_is_first_frame_pending && SDK_OK(res))
+  {
+    m_is_first_frame_pending = false;
+    qDebug() << "First frame displayed in" << m_startup_timer.elapsed()
+      << "ms since startup";
+  }
 }
 
 void step_5_demo_widget::resizeEvent(QResizeEvent* e)
@@ -287,12 +823,20 @@ void step_5_demo_widget::resizeEvent(QResizeEvent* e)
 
 void step_5_demo_widget::mouseMoveEvent(QMouseEvent* e)
 {
-  if (m_captured && (e->buttons() & Qt::LeftButton))
+  if (m_is_export_selecting && (e->buttons() & Qt::LeftButton))
+  {
+    // Stretching the export rectangle
+    m_export_band->setGeometry(QRect(m_export_origin, e->pos()).normalized());
+  }
+  else if (m_captured && (e->buttons() & Qt::LeftButton))
   {
     float viewport_translate_x =  static_cast<float>(m_captured_mouse_position.x() - e->pos().x());
     float viewport_translate_y = -static_cast<float>(m_captured_mouse_position.y() - e->pos().y());
     m_current_mouse_position = e->pos();
 
+    // No tooltip while dragging
+    CancelHoverTooltip();
+
     // Applying viewport shift
     SetViewportTranslation(viewport_translate_x, viewport_translate_y);
 
@@ -302,6 +846,7 @@ void step_5_demo_widget::mouseMoveEvent(QMouseEvent* e)
   else
   {
     RenderScene();
+    UpdateHoverTooltip(e->pos());
   }
 
   m_current_mouse_position = e->pos();
@@ -310,7 +855,19 @@ void step_5_demo_widget::mouseMoveEvent(QMouseEvent* e)
 
 void step_5_demo_widget::mousePressEvent(QMouseEvent* e)
 {
-  if (e->button() == Qt::LeftButton)
+  CancelHoverTooltip();
+
+  if (e->button() == Qt::LeftButton && (e->modifiers() & Qt::ShiftModifier))
+  {
+    // Starting selection of the export rectangle
+    if (!m_export_band.get())
+      m_export_band.reset(new QRubberBand(QRubberBand::Rectangle, this));
+    m_is_export_selecting = true;
+    m_export_origin = e->pos();
+    m_export_band->setGeometry(QRect(m_export_origin, QSize()));
+    m_export_band->show();
+  }
+  else if (e->button() == Qt::LeftButton)
   {
     // Starting the viewport dragging
     m_captured = true;
@@ -320,7 +877,16 @@ void step_5_demo_widget::mousePressEvent(QMouseEvent* e)
 
 void step_5_demo_widget::mouseReleaseEvent(QMouseEvent* e)
 {
-  if (e->button() == Qt::LeftButton)
+  if (e->button() == Qt::LeftButton && m_is_export_selecting)
+  {
+    // Exporting features of the selected rectangle
+    m_is_export_selecting = false;
+    m_export_band->hide();
+    const QRect rect = QRect(m_export_origin, e->pos()).normalized();
+    if (rect.width() > 1 && rect.height() > 1)
+      ExportFeatures(QRectF(rect));
+  }
+  else if (e->button() == Qt::LeftButton)
   {
     do
     {
@@ -337,12 +903,13 @@ void step_5_demo_widget::mouseReleaseEvent(QMouseEvent* e)
     // Showing feature info dialog
     if (!m_feature_info_dlg.get())
     {
-      m_feature_info_dlg.reset(new FeatureInfoDlg(this, this));
+      m_feature_info_dlg.reset(new FeatureInfoDlg(this,
+        m_catalog_label_cache, this));
       m_feature_info_dlg->setModal(false);
     }
 
     // Trying to find features under cursor
-    IEnumFeatureSP features;
+    std::vector<IFeatureSP> features;
     if (GetFeatureObjectsUnderCursorPosition(e->pos(), features))
       m_feature_info_dlg->FillUpFeaturesInfo(features);
 
@@ -382,11 +949,25 @@ bool step_5_demo_widget::eventFilter(QObject* o, QEvent* e)
     if (e->type() == QEvent::MouseMove)
       mouseMoveEvent(reinterpret_cast<QMouseEvent*>(e));
   }
+
+  // Tooltip is not left behind, when the cursor leaves the chart
+  if (o == this && (e->type() == QEvent::Leave || e->type() == QEvent::Hide))
+    CancelHoverTooltip();
+
+  // Overlay rate follows visibility of the chart and of its window
+  if (o == this || o == window())
+  {
+    if (e->type() == QEvent::Show || e->type() == QEvent::Hide ||
+      e->type() == QEvent::WindowStateChange)
+      UpdateOverlayRate();
+  }
   return false;
 }
 
 void step_5_demo_widget::OnAppClose()
 {
+  // View and workspaces are restored on the next startup
+  SaveSession();
 }
 
 void step_5_demo_widget::OnChangePalette(int palette_id)
@@ -571,7 +1152,8 @@ void step_5_demo_widget::OnGeodatabaseUpdateHistory()
   if (!m_updatehistory_dlg.get())
   {
     m_updatehistory_dlg.reset(new DatabaseUpdateHistoryDlg(this,
-      GetWorkspaceFactory(), this));
+      GetWorkspaceFactory(), m_catalog_label_cache,
+      m_update_history_summary.get(), this));
     m_updatehistory_dlg->setModal(false);
   }
 
@@ -582,6 +1164,37 @@ void step_5_demo_widget::OnGeodatabaseUpdateHistory()
   m_updatehistory_dlg->show();
 }
 
+void step_5_demo_widget::OnExportFeatures()
+{
+  // Exporting features of the whole view
+  ExportFeatures(QRectF(rect()));
+}
+
+void step_5_demo_widget::OnExportProgress(quint64 exported)
+{
+  if (m_export_progress.get())
+    m_export_progress->setLabelText(tr("Exported %1 features...").arg(exported));
+}
+
+void step_5_demo_widget::OnExportFinished(bool succeeded, quint64 exported,
+  QString message)
+{
+  if (m_export_progress.get())
+    m_export_progress->hide();
+
+  if (succeeded)
+    QMessageBox::information(this, tr("Export features"),
+      tr("%1 features exported.").arg(exported));
+  else
+    QMessageBox::warning(this, tr("Export features"), message);
+}
+
+void step_5_demo_widget::OnExportCanceled()
+{
+  if (m_feature_exporter.get())
+    m_feature_exporter->Cancel();
+}
+
 void step_5_demo_widget::OnAddBookmark()
 {
   QRect r = geometry();
@@ -707,7 +1320,7 @@ bool step_5_demo_widget::CreateAndInitScene()
     return false;
   if (SDK_FAILED(layers_manager->CreateLayer(
     ScopedString(L"coverage"),                           // name
-    kSceneLayerPriority_Chart_Decoration + 1,       // priority
+    kSceneLayerPriority_Chart_Decoration + 2,       // priority
     PointF2D(0, 0),                                      // position on scene
     SizeF(kSceneSize.width, kSceneSize.height),          // size of the layer
     kSceneLayerFlag_NoFlags,                        // flags
@@ -726,7 +1339,7 @@ bool step_5_demo_widget::CreateAndInitScene()
     return false;
   if (SDK_FAILED(layers_manager->CreateLayer(
     ScopedString(L"marked_feature"),                         // name
-    kSceneLayerPriority_Chart_Decoration + 2,           // priority
+    kSceneLayerPriority_Chart_Decoration + 3,           // priority
     PointF2D(0, 0),                                          // position on scene
     SizeF(kSceneSize.width, kSceneSize.height),              // size of the layer
     kSceneLayerFlag_NoFlags,                            // flags
@@ -738,6 +1351,34 @@ bool step_5_demo_widget::CreateAndInitScene()
   if (SDK_FAILED(layers_manager->AddLayer(m_marked_feature_layer, kSceneLayerID_Undefined)))
     return false;
 
+  // Marked feature geometry is prepared on worker thread
+  m_mark_feature_loader.reset(
+    new MarkFeatureLoader(m_marked_feature_layer_renderer));
+  connect(m_mark_feature_loader.get(), SIGNAL(signalMarkReady()),
+    this, SLOT(OnMarkFeatureReady()), Qt::QueuedConnection);
+  m_changed_feature_collector.reset(
+    new ChangedFeatureCollector(m_marked_feature_layer_renderer));
+  connect(m_changed_feature_collector.get(), SIGNAL(signalChangesReady()),
+    this, SLOT(OnChangedFeaturesReady()), Qt::QueuedConnection);
+
+  // Features under cursor are looked up in the pick index of the view
+  m_pick_index_builder.reset(new PickIndexBuilder());
+  connect(m_pick_index_builder.get(), SIGNAL(signalIndexReady()),
+    this, SLOT(OnPickIndexReady()), Qt::QueuedConnection);
+
+  // Features under resting cursor are described on worker thread
+  m_hover_picker.reset(new HoverPicker(m_catalog_label_cache));
+  connect(m_hover_picker.get(), SIGNAL(signalTooltipReady()),
+    this, SLOT(OnHoverTooltipReady()), Qt::QueuedConnection);
+
+  // Features are exported on worker threads
+  m_feature_exporter.reset(new FeatureExporter(m_catalog_label_cache));
+  connect(m_feature_exporter.get(), SIGNAL(signalProgress(quint64)),
+    this, SLOT(OnExportProgress(quint64)), Qt::QueuedConnection);
+  connect(m_feature_exporter.get(),
+    SIGNAL(signalFinished(bool, quint64, QString)),
+    this, SLOT(OnExportFinished(bool, quint64, QString)), Qt::QueuedConnection);
+
   // Decoration layer
   m_decoration_layer_renderer = DecorationRendererSP(
     new DecorationRenderer(m_s52_resource_manager));
@@ -745,7 +1386,7 @@ bool step_5_demo_widget::CreateAndInitScene()
     return false;
   if (SDK_FAILED(layers_manager->CreateLayer(
     ScopedString(L"decoration"),                   // name
-    kSceneLayerPriority_Chart_Decoration + 1, // priority
+    kSceneLayerPriority_Chart_Decoration + 4, // priority
     PointF2D(0, 0),                                // position on scene
     SizeF(kSceneSize.width, kSceneSize.height),    // size of the layer
     kSceneLayerFlag_BindToViewport,           // layer is binded to viewport
@@ -772,11 +1413,11 @@ bool step_5_demo_widget::CreateAndInitScene()
     return false;
   if (SDK_FAILED(layers_manager->CreateLayer(
     ScopedString(L"user_bmp_layer"),                         // name
-    kSceneLayerPriority_Chart_Decoration + 1,                                   // priority
+    kSceneLayerPriority_Chart_Decoration + 1,   // right above the chart, below coverage, marks and decoration
     PointF2D(0, 0),                             // position on scene
     SizeF(kSceneSize.width, kSceneSize.height),                                // size of the layer
-    kSceneLayerFlag_PortrayalDependent,         // layer is binded to viewport
-    ScopedString(kMainChartPortrayalLayerName), // portrayal layer name
+    kSceneLayerFlag_NoFlags,                    // own layer, chart portrayal is not re-rendered with it
+    ScopedString(L""),                          // portrayal layer name
     ScopedString(L""),                          // display groups filter
     ScopedAny(m_user_bmp_layer_renderer),                        // renderer
      m_user_bmp_layer, NULL)))                         // reference to the layer, created during addition
@@ -784,11 +1425,36 @@ bool step_5_demo_widget::CreateAndInitScene()
   if (SDK_FAILED(layers_manager->AddLayer(m_user_bmp_layer, kSceneLayerID_Undefined)))
     return false;
 
-  m_glWidget = new GLWidget(this, m_user_bmp_layer_renderer);
-  m_glWidget->show();
-  m_glWidget->hide();
-
+  // Frames of external process are shown instead of GL widget, if the ring
+  // name is given
+  QByteArray shared_frames_name = qgetenv(SHARED_FRAMES_VARIABLE);
+  if (!shared_frames_name.isEmpty() &&
+    m_user_bmp_layer_renderer->AttachSharedFrames(QString(shared_frames_name)))
+  {
+    m_is_shared_frames_attached = true;
+  }
+  else if (!qgetenv(RADAR_SIMULATOR_VARIABLE).isEmpty())
+  {
+    // Synthetic radar picture is anchored to the initial base position,
+    // 6 NM range. It is converted on its own thread
+    const double kRadarRange = 6.0 * 1852.0; // meters
+    m_user_bmp_layer_renderer->SetGeoReference(
+      GeoIntPoint(sdk::GeoIntFromDeg(kTestBaseInitialLongitude),
+        sdk::GeoIntFromDeg(kTestBaseInitialLatitude)), kRadarRange, 0.0f);
+    m_radar_simulator.reset(new RadarSimulator(m_user_bmp_layer_renderer));
+    connect(m_radar_simulator.get(), SIGNAL(signalFrameReady()),
+      this, SLOT(OnRadarFrameReady()), Qt::QueuedConnection);
+    m_radar_simulator->start();
+  }
+  else
+  {
+    m_glWidget = new GLWidget(this, m_user_bmp_layer_renderer);
+    m_glWidget->show();
+    m_glWidget->hide();
+  }
 
+  // Producers are started, if the chart is already shown
+  UpdateOverlayRate();
 
   return true;
 }
@@ -797,12 +1463,104 @@ void step_5_demo_widget::UpdateScene(SDKUInt64 flags) {
   m_scene_control->UpdateScene(flags);
 }
 
+void step_5_demo_widget::UpdateOverlay()
+{
+  if (!m_scene_control || !m_user_bmp_layer)
+    return;
+
+  ++m_overlay_updates;
+
+  // Frames coming faster than the event loop are rendered once
+  if (m_overlay_update_pending)
+    return;
+  m_overlay_update_pending = true;
+  QTimer::singleShot(0, this, SLOT(OnOverlayUpdate()));
+}
+
+void step_5_demo_widget::UpdateOverlayRate()
+{
+  const bool is_shown = m_user_bmp_layer && isVisible();
+  const bool is_minimized = window()->isMinimized();
+  m_is_overlay_paused = !is_shown;
+
+  if (m_glWidget)
+    m_glWidget->setFrameInterval(!is_shown ? 0 :
+      is_minimized ? kOverlayMinimizedInterval : GLWidget::kFrameInterval);
+
+  if (m_radar_simulator.get())
+    m_radar_simulator->SetFrameInterval(!is_shown ? 0 :
+      is_minimized ? kOverlayMinimizedInterval : RadarSimulator::kFrameInterval);
+
+  if (m_is_shared_frames_attached)
+  {
+    if (!is_shown)
+      m_shared_frames_timer.stop();
+    else
+      m_shared_frames_timer.start(is_minimized ?
+        kOverlayMinimizedInterval : kSharedFramesPollInterval);
+  }
+}
+
+void step_5_demo_widget::OnOverlayUpdate()
+{
+  m_overlay_update_pending = false;
+  if (!m_scene_control)
+    return;
+
+  // Overlay is drawn into its layer at the placement of the last scene
+  // rendering and the scene is only displayed again, no layer is rendered
+  if (m_user_bmp_layer_renderer &&
+    SDK_OK(m_user_bmp_layer_renderer->RenderOverlay()))
+  {
+    update();
+    return;
+  }
+
+  // Scene has not rendered the overlay yet, only its layer is rendered
+  m_user_bmp_layer->SetDirty(true);
+  m_scene_control->UpdateScene(kUpdateSceneFlags_StartRendering);
+}
+
+void step_5_demo_widget::OnCpuUsageTimeout()
+{
+#if defined(SDK_OS_POSIX)
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return;
+  double cpu_time = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+    (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+
+  if (m_cpu_usage_clock.isNull())
+  {
+    m_cpu_usage_clock.start();
+    m_cpu_usage_start = cpu_time;
+    m_overlay_updates = 0;
+    return;
+  }
+
+  int elapsed = m_cpu_usage_clock.elapsed();
+  if (elapsed <= 0)
+    return;
+
+  // Usage should stay near zero while the overlay is paused
+  qDebug() << "CPU usage" << (cpu_time - m_cpu_usage_start) * 100000.0 / elapsed
+    << "% with overlay updates at" << m_overlay_updates * 1000.0 / elapsed << "Hz"
+    << (m_is_overlay_paused ? "(overlay paused)" : "");
+
+  m_cpu_usage_clock.restart();
+  m_cpu_usage_start = cpu_time;
+  m_overlay_updates = 0;
+#endif
+}
+
 void step_5_demo_widget::ResizeViewport(
   const unsigned int& width, const unsigned int& height)
 {
   if (!m_scene_control)
     return;
 
+  InvalidatePickIndex();
+
   // Getting scene viewport
   scene::IScene2DViewportBaseSP viewport;
   if (SDK_FAILED(m_scene_control->GetViewport(viewport)))
@@ -831,6 +1589,8 @@ void step_5_demo_widget::SetViewportTranslation(float viewport_translate_x,
   if (!m_scene_control)
     return;
 
+  InvalidatePickIndex();
+
   scene::IScene2DViewportBaseSP viewport;
   if (SDK_FAILED(m_scene_control->GetViewport(viewport)))
     return;
@@ -851,6 +1611,8 @@ void step_5_demo_widget::SetViewportRotationAngle(float rotation_angle)
   if (!m_scene_control)
     return;
 
+  InvalidatePickIndex();
+
   scene::IScene2DViewportBaseSP viewport;
   if (SDK_FAILED(m_scene_control->GetViewport(viewport)))
     return;
@@ -871,6 +1633,8 @@ void step_5_demo_widget::SetViewportZoomRatio(float zoom_ratio)
   if (!m_scene_control)
     return;
 
+  InvalidatePickIndex();
+
   scene::IScene2DViewportBaseSP viewport;
   if (SDK_FAILED(m_scene_control->GetViewport(viewport)))
     return;
@@ -972,11 +1736,19 @@ void step_5_demo_widget::RenderScene()
   if (m_marked_feature_layer_renderer && m_marked_feature_layer)
     m_marked_feature_layer->SetDirty(true);
 
+  // Updating user bitmap layer, its placement is taken from this rendering
+  if (m_user_bmp_layer_renderer && m_user_bmp_layer)
+    m_user_bmp_layer->SetDirty(true);
+
   // Rendering the scene
   if (SDK_FAILED(m_scene_control->UpdateScene(kUpdateSceneFlags_StartRendering)))
     return;
 
   update();
+
+  // Features of the new view are indexed in background, the scene is also
+  // rendered on mouse move, then the index is kept
+  RequestPickIndex();
 }
 
 std::wstring step_5_demo_widget::GetTestDatabasePath()
@@ -999,19 +1771,13 @@ std::wstring step_5_demo_widget::GetTestDatabasePath()
     if (SDK_FAILED(gdb_names->Next(&gdb_path)))
       break;
 
-    // Trying to open the database root catalog
-    IRootCatalogSP cat;
-    if (SDK_FAILED(wks_factory->OpenRootCatalog(gdb_path, &cat)))
-      continue;
-
-    // Getting database name
-    ScopedAny db_name;
-    if (SDK_FAILED(cat->GetGeodatabaseProperty(
-      kRootCatGeodatabaseProperty_GeodatabaseName, db_name)))
-      continue;
-    if (!ANY_IS_STR(&db_name))
+    // Getting database name, the root catalog is opened only if it is
+    // not cached yet
+    RootCatalogCache::Info info;
+    if (!m_root_catalog_cache->GetInfo(wks_factory,
+      QString::fromStdWString(WideFromSDKString(gdb_path)), info))
       continue;
-    if (kTestDatabaseName != db_name.GetAsWString())
+    if (QString::fromStdWString(kTestDatabaseName) != info.m_name)
       continue;
 
     return WideFromSDKString(gdb_path);
@@ -1024,46 +1790,35 @@ std::wstring step_5_demo_widget::GetTestDatabasePath()
 void step_5_demo_widget::OpenDatabaseWorkspace(const std::wstring& wks_path,
   const std::wstring& hw_id, const std::wstring& permits_path)
 {
-  if (wks_path.empty())
+  IWorkspaceSP wks;
+  if (!WorkspaceOpener::Open(GetWorkspaceFactory(), wks_path, hw_id,
+    permits_path, wks))
     return;
 
-  IWorkspaceFactorySP wks_factory = GetWorkspaceFactory();
-  if (!wks_factory)
-    return;
-  IWorkspaceFactoryUtilSP wks_util = 
-    wks_factory.GetInterface<IWorkspaceFactoryUtil>();
-  if (!wks_util)
-    return;
+  // Catalog labels of previous workspaces are not kept
+  m_catalog_label_cache->Clear();
 
-  // Opening workspace
-  IWorkspaceConfigurationSP config;
-  if (SDK_FAILED(wks_factory->CreateWorkspaceConfiguration(&config)))
-    return;
+  AttachDatabaseWorkspace(wks_path, wks);
+}
 
-  if (SDK_FAILED(config->SetConfigurationParameter(
-    kWorkspaceConfigurationParameter_RootPath,
-    ScopedAny(wks_path.c_str()))))
+void step_5_demo_widget::AttachDatabaseWorkspace(const std::wstring& wks_path,
+  const IWorkspaceSP& wks)
+{
+  IWorkspaceFactorySP wks_factory = GetWorkspaceFactory();
+  if (!wks_factory || !wks)
     return;
 
-  // In case HW_ID and Permits file specified, they also should be added to
-  //  configuration parameters
-  if (!hw_id.empty() && !permits_path.empty())
-  {
-    IEncryptionParametersSP encryption_parameters;
-    if (SDK_OK(wks_util->CreateEncryptionParameters(&encryption_parameters))) {
-      encryption_parameters->SetParameter( kEncryptionParameter_S63_HWID, 
-        ScopedAny(hw_id));
-      encryption_parameters->SetParameter(kEncryptionParameter_S63_PermitsPath,
-        ScopedAny(permits_path));
-    }
-    config->SetConfigurationParameter(
-      kWorkspaceConfigurationParameter_EncryptionParameters,
-      ScopedAny(encryption_parameters));
-  }
+  // Catalog labels of the workspace replaced by the reopened folder are
+  // dropped, they hold that workspace
+  IWorkspaceSP& attached_wks = m_attached_workspaces[wks_path];
+  if (attached_wks && attached_wks.operator->() != wks.operator->())
+    m_catalog_label_cache->Remove(attached_wks);
+  attached_wks = wks;
 
-  IWorkspaceSP wks;
-  if (SDK_FAILED(wks_factory->Open(config, &wks)))
-    return;
+  // Update history summary is read or built in background
+  if (m_update_history_summary.get())
+    m_update_history_summary->Request(wks_factory, wks,
+      QString::fromStdWString(wks_path));
 
   // Adding new workspace to scene
   if (!m_scene_manager)
@@ -1074,6 +1829,11 @@ void step_5_demo_widget::OpenDatabaseWorkspace(const std::wstring& wks_path,
     SDKStringHandler(kDataSourceView_TypeName_Navigational),
     kAddDataSourceFlag_ReplaceView, &datasource_view, NULL)))
     return;
+  InvalidatePickIndex();
+
+  const QString path = QString::fromStdWString(wks_path);
+  if (!m_workspace_paths.contains(path))
+    m_workspace_paths << path;
 
   // Inform coverage layer renderer about workspace change
   if (m_coverage_layer_renderer)
@@ -1082,25 +1842,11 @@ void step_5_demo_widget::OpenDatabaseWorkspace(const std::wstring& wks_path,
 
 bool step_5_demo_widget::IsDatabaseEncrypted(const std::wstring& root_cat_path)
 {
-  if (root_cat_path.empty())
-    return false; // No workspace path provided
-
-  IWorkspaceFactorySP wks_factory = GetWorkspaceFactory();
-  if (!wks_factory)
-    return false;
-
-  IRootCatalogSP root_catalog;
-  if (SDK_FAILED(wks_factory->OpenRootCatalog(ScopedString(root_cat_path),
-    &root_catalog)))
+  RootCatalogCache::Info info;
+  if (!m_root_catalog_cache->GetInfo(GetWorkspaceFactory(),
+    QString::fromStdWString(root_cat_path), info))
     return false;
-
-  ScopedAny encryption;
-  if (SDK_FAILED(root_catalog->GetGeodatabaseProperty(
-    kRootCatGeodatabaseProperty_Encryption, encryption)))
-    return false;
-
-  encryption.ChangeType(kSDKAnyType_Uint32);
-  return (ANY_UI32(&encryption) == senc::kENCA_None) ? false : true;
+  return RootCatalogCache::IsEncrypted(info);
 }
 
 void step_5_demo_widget::ApplyProjectionParameters(const double& latitude,
@@ -1109,6 +1855,8 @@ void step_5_demo_widget::ApplyProjectionParameters(const double& latitude,
   if (!m_scene_control)
     return;
 
+  InvalidatePickIndex();
+
   sdk::ISDKParametersSP scene_parameters;
   if (SDK_FAILED(m_scene_control->GetSceneParameters(scene_parameters)))
     return;
@@ -1173,6 +1921,9 @@ void step_5_demo_widget::SetDisplayMode(
     kDisplayGroupsManagerProperty_DisplayMode, ScopedAny(display_mode))))
     return;
 
+  // Other features are shown
+  InvalidatePickIndex();
+
   emit signalUpdateDisplayMenuState();
 }
 
@@ -1188,13 +1939,89 @@ void step_5_demo_widget::SetPortrayalName(const std::string& portrayal_name)
     ScopedString(portrayal_name))))
     return;
 
+  // Other features are shown
+  InvalidatePickIndex();
+
   m_portrayal_name = portrayal_name;
 
+  // Symbol set catalog may be changed along with portrayal
+  if (m_s52_resource_manager)
+    m_s52_resource_manager->Reload();
+
   emit signalUpdatePortrayalMenuState();
 }
 
 bool step_5_demo_widget::GetFeatureObjectsUnderCursorPosition(
-    const QPoint& cursor_position, IEnumFeatureSP& features)
+    const QPoint& cursor_position, std::vector<IFeatureSP>& features)
+{
+  features.clear();
+
+  const QRectF cursor_rect(
+    cursor_position.x() - kFindFeatureUnderCursorRectangleSize / 2.0,
+    cursor_position.y() - kFindFeatureUnderCursorRectangleSize / 2.0,
+    kFindFeatureUnderCursorRectangleSize, kFindFeatureUnderCursorRectangleSize);
+
+  // Pick index of the current view is read without SDK calls
+  if (m_pick_index && !m_verify_pick_index)
+  {
+    std::vector<ObjectID> feature_ids;
+    m_pick_index->Pick(cursor_position, feature_ids);
+    return GetFeatureObjects(feature_ids, features);
+  }
+
+  if (m_pick_index)
+  {
+    // Both ways are timed and their features are compared
+    QElapsedTimer timer;
+    timer.start();
+    std::vector<ObjectID> feature_ids;
+    m_pick_index->Pick(cursor_position, feature_ids);
+    qint64 index_time = timer.nsecsElapsed();
+
+    timer.restart();
+    IEnumFeatureSP found;
+    if (!FindFeatureObjectsInWindowRect(cursor_rect, found))
+      return GetFeatureObjects(feature_ids, features);
+    qint64 sdk_time = timer.nsecsElapsed();
+
+    std::vector<ObjectID> sdk_ids;
+    for (IFeatureSP feature; SDK_OK(found->Next(&feature)); feature.Release())
+    {
+      ObjectID feature_id;
+      if (SDK_OK(feature->GetObjectID(feature_id)))
+        sdk_ids.push_back(feature_id);
+    }
+
+    size_t missing = 0;
+    for (size_t i = 0; i < sdk_ids.size(); ++i)
+    {
+      size_t j = 0;
+      while (j < feature_ids.size() && !IsEqualObjectID(sdk_ids[i], feature_ids[j]))
+        ++j;
+      if (j == feature_ids.size())
+        ++missing;
+    }
+
+    qDebug() << "Pick index:" << feature_ids.size() << "features in"
+      << index_time / 1000.0 << "us, SDK:" << sdk_ids.size() << "features in"
+      << sdk_time / 1000.0 << "us," << missing << "missing in index,"
+      << feature_ids.size() + missing - sdk_ids.size() << "only in index";
+
+    return GetFeatureObjects(feature_ids, features);
+  }
+
+  // Index is being built, features are found by SDK
+  IEnumFeatureSP found;
+  if (!FindFeatureObjectsInWindowRect(cursor_rect, found))
+    return false;
+  for (IFeatureSP feature; SDK_OK(found->Next(&feature)); feature.Release())
+    features.push_back(feature);
+
+  return true;
+}
+
+bool step_5_demo_widget::FindFeatureObjectsInWindowRect(
+  const QRectF& window_rect, IEnumFeatureSP& features)
 {
   features.Release();
 
@@ -1208,38 +2035,107 @@ bool step_5_demo_widget::GetFeatureObjectsUnderCursorPosition(
     sdk::vis::kSceneInfoFlags_NoFlags, scene_info)) || !scene_info)
     return false;
 
-  // Converting cursor position from Window coordinate system to scene coord. system
-  PointD2D cursor_pos(static_cast<double>(cursor_position.x()),
-                      static_cast<double>(cursor_position.y()));
-  sdk::PointD2D sw_pos(cursor_pos.x - kFindFeatureUnderCursorRectangleSize / 2.0f,
-                       cursor_pos.y - kFindFeatureUnderCursorRectangleSize / 2.0f);
-  sdk::PointD2D nw_pos(cursor_pos.x - kFindFeatureUnderCursorRectangleSize / 2.0f,
-                       cursor_pos.y + kFindFeatureUnderCursorRectangleSize / 2.0f);
-  sdk::PointD2D ne_pos(cursor_pos.x + kFindFeatureUnderCursorRectangleSize / 2.0f,
-                       cursor_pos.y + kFindFeatureUnderCursorRectangleSize / 2.0f);
-  sdk::PointD2D se_pos(cursor_pos.x + kFindFeatureUnderCursorRectangleSize / 2.0f,
-                       cursor_pos.y - kFindFeatureUnderCursorRectangleSize / 2.0f);
-  sdk::PointD2D geo_pos[4];
-  if (SDK_FAILED(scene_info->CoordinateTransform(
-    sdk::vis::kTransformType_WinToGeo, sw_pos, geo_pos[0])))
-    return false;
-  if (SDK_FAILED(scene_info->CoordinateTransform(
-    sdk::vis::kTransformType_WinToGeo, nw_pos, geo_pos[1])))
-    return false;
-  if (SDK_FAILED(scene_info->CoordinateTransform(
-    sdk::vis::kTransformType_WinToGeo, ne_pos, geo_pos[2])))
+  geometry::IGeometrySP geometry_filter;
+  if (!CreateWindowRectFilter(scene_info, window_rect, geometry_filter))
     return false;
-  if (SDK_FAILED(scene_info->CoordinateTransform(
-    sdk::vis::kTransformType_WinToGeo, se_pos, geo_pos[3])))
+
+  // Finally, looking for features inside given rectangle
+  if (SDK_FAILED(scene_info->FindFeatures(geometry_filter, NULL, NULL, features)))
     return false;
 
+  return true;
+}
+
+void step_5_demo_widget::ExportFeatures(const QRectF& window_rect)
+{
+  if (!m_feature_exporter.get() || !m_scene_control)
+    return;
+  if (m_feature_exporter->IsRunning())
+  {
+    QMessageBox::information(this, tr("Export features"),
+      tr("The previous export is still running."));
+    return;
+  }
+
+  QString selected_filter;
+  const QString file_name = QFileDialog::getSaveFileName(this,
+    tr("Export features"), QString(),
+    tr("CSV (*.csv);;GeoJSON (*.geojson);;Binary (*.skmf)"), &selected_filter);
+  if (file_name.isEmpty())
+    return;
+
+  FeatureExporter::Request request;
+  request.m_file_name = file_name;
+  request.m_format = FeatureExporter::FormatFromFileName(file_name);
+  if (QFileInfo(file_name).suffix().isEmpty())
+  {
+    // Format of the filter, if user has not typed the extension
+    if (selected_filter.contains("geojson"))
+      request.m_format = FeatureExporter::kFormat_GeoJson;
+    else if (selected_filter.contains("skmf"))
+      request.m_format = FeatureExporter::kFormat_Binary;
+  }
+
+  if (SDK_FAILED(m_scene_control->GetSceneInfo(
+    sdk::vis::kSceneInfoFlags_NoFlags, request.m_scene_info)) ||
+    !request.m_scene_info ||
+    !CreateWindowRectFilter(request.m_scene_info, window_rect,
+    request.m_geometry_filter))
+  {
+    QMessageBox::warning(this, tr("Export features"),
+      tr("Failed to make the export area."));
+    return;
+  }
+
+  if (!m_feature_exporter->Start(request))
+  {
+    QMessageBox::warning(this, tr("Export features"),
+      tr("Failed to create file %1.").arg(file_name));
+    return;
+  }
+
+  // Busy progress, the feature count is not known in advance
+  if (!m_export_progress.get())
+  {
+    m_export_progress.reset(new QProgressDialog(this));
+    m_export_progress->setWindowTitle(tr("Export features"));
+    m_export_progress->setRange(0, 0);
+    m_export_progress->setModal(false);
+    m_export_progress->setAutoClose(false);
+    m_export_progress->setAutoReset(false);
+    connect(m_export_progress.get(), SIGNAL(canceled()),
+      this, SLOT(OnExportCanceled()));
+  }
+  m_export_progress->reset();
+  m_export_progress->setLabelText(tr("Exporting features..."));
+  m_export_progress->show();
+}
+
+bool step_5_demo_widget::CreateWindowRectFilter(
+  const sdk::vis::ISceneInformationSP& scene_info, const QRectF& window_rect,
+  geometry::IGeometrySP& geometry_filter)
+{
+  // Converting rectangle corners from Window coordinate system to geographic
+  sdk::PointD2D corners[4] = {
+    sdk::PointD2D(window_rect.left(), window_rect.top()),
+    sdk::PointD2D(window_rect.left(), window_rect.bottom()),
+    sdk::PointD2D(window_rect.right(), window_rect.bottom()),
+    sdk::PointD2D(window_rect.right(), window_rect.top()) };
+  sdk::PointD2D geo_pos[4];
+  for (size_t i = 0; i < 4; ++i)
+  {
+    if (SDK_FAILED(scene_info->CoordinateTransform(
+      sdk::vis::kTransformType_WinToGeo, corners[i], geo_pos[i])))
+      return false;
+  }
+
   sdk::PointD2D geo_min_pos = geo_pos[0], geo_max_pos = geo_pos[0];
   for (size_t i = 1; i < 4; ++i)
   {
     if (geo_pos[i].x < geo_min_pos.x) geo_min_pos.x = geo_pos[i].x;
-    if (geo_pos[i].x > geo_min_pos.x) geo_max_pos.x = geo_pos[i].x;
+    if (geo_pos[i].x > geo_max_pos.x) geo_max_pos.x = geo_pos[i].x;
     if (geo_pos[i].y < geo_min_pos.y) geo_min_pos.y = geo_pos[i].y;
-    if (geo_pos[i].y > geo_min_pos.y) geo_max_pos.y = geo_pos[i].y;
+    if (geo_pos[i].y > geo_max_pos.y) geo_max_pos.y = geo_pos[i].y;
   }
 
   // Making a rectangle, which will set as a filter to find up the objects,
@@ -1257,19 +2153,152 @@ bool step_5_demo_widget::GetFeatureObjectsUnderCursorPosition(
   if (!wks_util)
     return false;
 
-  geometry::IGeometrySP geometry_filter;
+  geometry_filter.Release();
   if (SDK_FAILED(wks_util->CreateRectGeometryFilter(
     query_rect.sw.lat, query_rect.sw.lon, query_rect.ne.lat, query_rect.ne.lon,
     &geometry_filter)))
     return false;
 
-  // Finally, looking for features inside given rectangle
-  if (SDK_FAILED(scene_info->FindFeatures(geometry_filter, NULL, NULL, features)))
+  return true;
+}
+
+bool step_5_demo_widget::GetFeatureObjects(
+  const std::vector<ObjectID>& feature_ids, std::vector<IFeatureSP>& features)
+{
+  features.clear();
+  if (feature_ids.empty())
+    return true;
+
+  IWorkspaceFactorySP wks_factory = GetWorkspaceFactory();
+  if (!wks_factory)
+    return false;
+  IWorkspaceCollectionSP wks_collection;
+  if (SDK_FAILED(wks_factory->GetWorkspaces(&wks_collection)))
     return false;
 
+  for (size_t i = 0; i < feature_ids.size(); ++i)
+  {
+    IWorkspaceSP wks;
+    if (SDK_FAILED(wks_collection->GetWorkspaceByID(
+      DatasetID_WorkspaceID(feature_ids[i].did), &wks)) || !wks)
+      continue;
+
+    IFeatureSP feature;
+    if (SDK_OK(wks->GetFeature(feature_ids[i], &feature)) && feature)
+      features.push_back(feature);
+  }
+
   return true;
 }
 
+void step_5_demo_widget::InvalidatePickIndex()
+{
+  ++m_view_generation;
+  m_pick_index.reset();
+  if (m_pick_index_builder.get())
+    m_pick_index_builder->Cancel();
+
+  // Tooltip describes features of the previous view
+  CancelHoverTooltip();
+}
+
+void step_5_demo_widget::RequestPickIndex()
+{
+  if (!m_pick_index_builder.get() || !m_scene_control || !m_scene_manager)
+    return;
+  if (m_pick_index_request == m_view_generation)
+    return; // Index of this view is built or being built
+  m_pick_index_request = m_view_generation;
+
+  const QSize window_size = size();
+  if (window_size.isEmpty())
+    return;
+
+  PickIndexBuilder::View view;
+  view.m_window_size = window_size;
+  view.m_generation = m_view_generation;
+
+  if (SDK_FAILED(m_scene_control->GetSceneInfo(
+    sdk::vis::kSceneInfoFlags_NoFlags, view.m_scene_info)) || !view.m_scene_info)
+    return;
+  if (!CreateWindowRectFilter(view.m_scene_info,
+    QRectF(QPointF(0.0, 0.0), QSizeF(window_size)), view.m_geometry_filter))
+    return;
+  if (SDK_FAILED(m_scene_manager->GetProjection(view.m_projection)) ||
+    !view.m_projection)
+    return;
+  ICoordinateTransformationSP coord_transform =
+    GetInterfaceT<ICoordinateTransformation>(view.m_projection);
+  if (!coord_transform)
+    return;
+
+  // Scene to window transformation is affine, it is found from three
+  // window corners and their scene coordinates
+  const QPointF window_points[3] = { QPointF(0.0, 0.0),
+    QPointF(window_size.width(), 0.0), QPointF(0.0, window_size.height()) };
+  sdk::PointF2D scene_points[3];
+  for (size_t i = 0; i < 3; ++i)
+  {
+    sdk::PointD2D geo_pos;
+    if (SDK_FAILED(view.m_scene_info->CoordinateTransform(
+      sdk::vis::kTransformType_WinToGeo,
+      sdk::PointD2D(window_points[i].x(), window_points[i].y()), geo_pos)))
+      return;
+    GeoIntPoint gip(sdk::GeoIntFromDeg(geo_pos.x), sdk::GeoIntFromDeg(geo_pos.y));
+    coord_transform->ForwardIF(1, &gip, &scene_points[i]);
+  }
+
+  const double d1x = scene_points[1].x - scene_points[0].x;
+  const double d1y = scene_points[1].y - scene_points[0].y;
+  const double d2x = scene_points[2].x - scene_points[0].x;
+  const double d2y = scene_points[2].y - scene_points[0].y;
+  const double det = d1x * d2y - d2x * d1y;
+  if (det == 0.0)
+    return;
+  const double w = window_size.width();
+  const double h = window_size.height();
+  const double m11 = w * d2y / det;
+  const double m21 = -w * d2x / det;
+  const double m12 = -h * d1y / det;
+  const double m22 = h * d1x / det;
+  view.m_scene_to_window = QTransform(m11, m12, m21, m22,
+    -(m11 * scene_points[0].x + m21 * scene_points[0].y),
+    -(m12 * scene_points[0].x + m22 * scene_points[0].y));
+
+  m_pick_index_builder->Request(view);
+}
+
+void step_5_demo_widget::UpdateHoverTooltip(const QPoint& cursor_position)
+{
+  if (!m_hover_picker.get())
+    return;
+
+  // Cursor is still inside of the rectangle of the last query, its tooltip
+  // follows the cursor or is still being made
+  if (m_hover_picker->IsCovered(cursor_position, m_view_generation))
+  {
+    HoverPicker::Result last;
+    if (m_hover_picker->GetLastResult(last) && !last.m_text.isEmpty())
+      QToolTip::showText(mapToGlobal(cursor_position), last.m_text, this);
+    return;
+  }
+
+  // Query is started, when the cursor rests for the delay
+  m_hover_picker->Cancel();
+  QToolTip::hideText();
+  m_hover_position = cursor_position;
+  m_hover_move_time = m_hover_picker->Now();
+  m_hover_timer.start(kHoverDelay);
+}
+
+void step_5_demo_widget::CancelHoverTooltip()
+{
+  m_hover_timer.stop();
+  if (m_hover_picker.get())
+    m_hover_picker->Cancel();
+  QToolTip::hideText();
+}
+
 void step_5_demo_widget::UpdateStatusBar()
 {
   // Getting current mouse geo position and scale
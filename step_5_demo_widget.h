@@ -1,6 +1,7 @@
 #ifndef STEP_5_DEMO_WIDGET_H
 #define STEP_5_DEMO_WIDGET_H
 
+#include <map>
 #include <string>
 
 #include <QWidget>
@@ -9,6 +10,10 @@
 #include <QMouseEvent>
 #include <QTime>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QRubberBand>
+#include <QProgressDialog>
 
 #include "featureinfodlg.h"
 #include "databaseupdatehistorydlg.h"
@@ -27,8 +32,18 @@
 #include "decoration_renderer.h"
 #include "coverage_renderer.h"
 #include "markedfeaturerenderer.h"
+#include "mark_feature_loader.h"
+#include "changed_feature_collector.h"
+#include "pick_index_builder.h"
+#include "hover_picker.h"
+#include "catalog_label_cache.h"
+#include "feature_exporter.h"
+#include "workspace_opener.h"
+#include "chart_directory_watcher.h"
+#include "session_state.h"
 
 #include "user_bmp_layer_renderer.h" //des
+#include "radar_simulator.h"
 
 namespace Ui { class step_5_demo_widget; }
 
@@ -43,9 +58,7 @@ public:
   void Initialize();
 
   // Callback from GL widget//des
-  void GLDataUpdated() {
-    m_user_bmp_layer->SetDirty(true);
-    UpdateScene(SDK_VIS_NAMESPACE::kUpdateSceneFlags_StartRendering); }
+  void GLDataUpdated() { UpdateOverlay(); }
 
 
   // Returns current palette type
@@ -60,8 +73,13 @@ public:
   // Returns status bar text
   std::wstring GetStatusBarText() const { return m_status_bar_text; }
 
-  // Marks feature specified by the ObjectID.
+  // Marks feature specified by the ObjectID. Returns true when the mark
+  // request is queued, the result is reported by OnMarkFeatureReady.
   bool MarkFeature(sdk::gdb::ObjectID& feature_id);
+  // Marks all of features specified by the ObjectIDs.
+  bool MarkFeatures(const std::vector<sdk::gdb::ObjectID>& feature_ids);
+  // Marks features changed since the update in the datasets of the view.
+  bool MarkChangedFeatures(const ChangedFeatureCollector::Since& since);
   // Removes the feature object marking.
   bool UnmarkFeature();
 
@@ -79,6 +97,13 @@ private:
 
   // Update scene
   void UpdateScene(SDKUInt64 flags);
+  // Requests drawing of the user bitmap layer only, the scene is not
+  // rendered
+  void UpdateOverlay();
+  // Runs overlay producers at the full rate while the chart is shown,
+  // slows them down while the window is minimized and stops them while
+  // it is hidden
+  void UpdateOverlayRate();
 
 signals:
   void signalUpdatePaletteMenuState();
@@ -101,6 +126,20 @@ private slots:
   void OnAddBookmark();
   void OnBookmarksList();
   void OnChangePortrayal(char*);
+  void OnMarkFeatureReady();
+  void OnChangedFeaturesReady();
+  void OnSharedFramesTimeout();
+  void OnOverlayUpdate();
+  void OnCpuUsageTimeout();
+  void OnRadarFrameReady();
+  void OnPickIndexReady();
+  void OnHoverTimeout();
+  void OnHoverTooltipReady();
+  void OnExportFeatures();
+  void OnExportProgress(quint64 exported);
+  void OnExportFinished(bool succeeded, quint64 exported, QString message);
+  void OnExportCanceled();
+  void OnChartWorkspaceOpened();
 
 protected:
   // Creates new component by factory
@@ -129,9 +168,21 @@ protected:
   // Returns path to TDS
   std::wstring GetTestDatabasePath();
 
+  // Opens workspaces of all of chart folders, the scene is not rendered.
+  // If the session is given, only the workspaces of its view are opened,
+  // the other ones are returned ordered by distance to the view.
+  void         OpenChartDirectory(const SessionState* session,
+    std::vector<WorkspaceOpener::Entry>& background_entries);
+  // Applies view, palette and display mode of the last session
+  void         ApplySessionView(const SessionState& session);
+  // Stores view and workspaces for the next startup
+  void         SaveSession();
   // Opens the database workspace
   void         OpenDatabaseWorkspace(const std::wstring& wks_path,
     const std::wstring& hw_id, const std::wstring& permits_path);
+  // Adds the opened workspace to the scene
+  void         AttachDatabaseWorkspace(const std::wstring& wks_path,
+    const sdk::gdb::IWorkspaceSP& wks);
   // Checks, if database is encrypted
   bool         IsDatabaseEncrypted(const std::wstring& root_cat_path);
 
@@ -159,9 +210,34 @@ protected:
   // Applies new portrayal mode
   void SetPortrayalName(const std::string& portrayal_name);
 
-  // Returns feature objects under cursor position
+  // Returns feature objects under cursor position. They are read from the
+  // pick index, if it is built for the current view, otherwise found by SDK.
   bool GetFeatureObjectsUnderCursorPosition(const QPoint& cursor_position,
+    std::vector<sdk::gdb::IFeatureSP>& features);
+  // Finds feature objects inside of the window rectangle by SDK
+  bool FindFeatureObjectsInWindowRect(const QRectF& window_rect,
     sdk::gdb::IEnumFeatureSP& features);
+  // Makes geometry filter of the window rectangle
+  bool CreateWindowRectFilter(const sdk::vis::ISceneInformationSP& scene_info,
+    const QRectF& window_rect, sdk::geometry::IGeometrySP& geometry_filter);
+  // Exports features inside of the window rectangle into the file chosen
+  // by user
+  void ExportFeatures(const QRectF& window_rect);
+  // Reads feature objects by their ObjectIDs
+  bool GetFeatureObjects(const std::vector<sdk::gdb::ObjectID>& feature_ids,
+    std::vector<sdk::gdb::IFeatureSP>& features);
+
+  // Drops the pick index, the view or its content is changed
+  void InvalidatePickIndex();
+  // Requests building of the pick index for the current view, if it has
+  // not been requested yet
+  void RequestPickIndex();
+
+  // Shows tooltip of features under resting cursor, the query is started
+  // after the cursor stops moving
+  void UpdateHoverTooltip(const QPoint& cursor_position);
+  // Hides the tooltip and drops its pending query
+  void CancelHoverTooltip();
 
   // Updates application status bar
   void UpdateStatusBar();
@@ -207,9 +283,56 @@ protected:
   // Marked feature object renderer
   MarkedFeatureRendererSP               m_marked_feature_layer_renderer;
   sdk::vis::ISceneLayerSP               m_marked_feature_layer;
+  // Marked feature geometry loader
+  std::auto_ptr<MarkFeatureLoader>      m_mark_feature_loader;
+  // Features changed since an update are collected on worker threads
+  std::auto_ptr<ChangedFeatureCollector> m_changed_feature_collector;
+
+  // Features of the current view by window cells, built on worker thread
+  std::auto_ptr<PickIndexBuilder>       m_pick_index_builder;
+  PickIndexSP                           m_pick_index;
+  // Number of the current view, it is changed with every viewport change
+  int                                   m_view_generation;
+  // Number of the view, which index has been requested last
+  int                                   m_pick_index_request;
+  // Picks from the index are compared with SDK results
+  bool                                  m_verify_pick_index;
+
+  // Features under resting cursor are shown in tooltip
+  std::auto_ptr<HoverPicker>            m_hover_picker;
+  // Cursor moves are merged until it rests for kHoverDelay
+  QTimer                                m_hover_timer;
+  QPoint                                m_hover_position;
+  qint64                                m_hover_move_time;
+
+  // Features of the view or of the rectangle selected by Shift+drag are
+  // exported on worker threads
+  std::auto_ptr<FeatureExporter>        m_feature_exporter;
+  std::auto_ptr<QProgressDialog>        m_export_progress;
+  std::auto_ptr<QRubberBand>            m_export_band;
+  bool                                  m_is_export_selecting;
+  QPoint                                m_export_origin;
 
   // Workspace factory instance
   sdk::gdb::IWorkspaceFactorySP         m_wks_factory;
+  // Feature catalog labels of open workspaces
+  CatalogLabelCacheSP                   m_catalog_label_cache;
+  // Update history summaries of open workspaces
+  std::auto_ptr<UpdateHistorySummaryBuilder> m_update_history_summary;
+  // Metadata of geodatabase root catalogs, stored between sessions
+  RootCatalogCacheSP                    m_root_catalog_cache;
+  // Chart folders added or updated while running
+  std::auto_ptr<ChartDirectoryWatcher>  m_chart_directory_watcher;
+  // Workspaces added to the scene by their path
+  std::map<std::wstring, sdk::gdb::IWorkspaceSP> m_attached_workspaces;
+  // Paths of workspaces added to the scene, in the order of adding
+  QStringList                           m_workspace_paths;
+  // Started with Initialize, used to log the startup times
+  QElapsedTimer                         m_startup_timer;
+  // Set by the startup render until the frame is displayed
+  bool                                  m_is_first_frame_pending;
+  // Session is stored once on exit
+  bool                                  m_is_session_saved;
 
   // Feature info dialog
   std::auto_ptr<FeatureInfoDlg>         m_feature_info_dlg;
@@ -242,6 +365,28 @@ protected:
 
   // Source of GL data
   GLWidget*                           m_glWidget;
+  // Source of synthetic radar picture
+  std::auto_ptr<RadarSimulator>       m_radar_simulator;
+
+  // Overlay updates are merged until the event loop is reached
+  bool                                m_overlay_update_pending;
+  // Overlay updates and CPU time since the last CPU usage report, which
+  // is logged periodically both with overlay running and idle, if
+  // CPU_USAGE_LOG is set
+  int                                 m_overlay_updates;
+  QTimer                              m_cpu_usage_timer;
+  QTime                               m_cpu_usage_clock;
+  double                              m_cpu_usage_start;
+
+  // Polling of frames published by external process
+  static const int                    kSharedFramesPollInterval = 16; // ms
+  QTimer                              m_shared_frames_timer;
+  bool                                m_is_shared_frames_attached;
+
+  // Interval of overlay frames while the window is minimized
+  static const int                    kOverlayMinimizedInterval = 1000; // ms
+  // Overlay producers are stopped
+  bool                                m_is_overlay_paused;
 
 };
 
@@ -0,0 +1,458 @@
+// update_history_loader.cpp : Reads workspace update history on worker threads page by page
+//
+#include <sstream>
+
+#include <QRunnable>
+#include <QElapsedTimer>
+#include <QDebug>
+
+#include <base/inc/sdk_any_handler.h>
+#include <base/inc/sdk_string_handler.h>
+#include <base/inc/sdk_results_enum.h>
+#include <base/inc/interfaces/sql/sql_interface.h>
+#include <datalayer/inc/senc/senc_exchange_set.h>
+#include "utils.h"
+#include "update_history_loader.h"
+
+using namespace SDK_NAMESPACE;
+using namespace SDK_GDB_NAMESPACE;
+
+namespace
+{
+  // Rows delivered to the view at once
+  const size_t kPageRows = 256;
+  // Levels of different nodes are read at once, so a large level does not
+  // hold up the others
+  const int kLoaderThreads = 2;
+}
+
+class UpdateHistoryLoader::Task : public QRunnable
+{
+public:
+  Task(UpdateHistoryLoader* loader, int request_id, const Request& request)
+    : m_loader(loader),
+      m_request_id(request_id),
+      m_request(request)
+  {
+  }
+
+  void run()
+  {
+    m_loader->Run(m_request_id, m_request);
+  }
+
+private:
+  UpdateHistoryLoader* m_loader;
+  int                  m_request_id;
+  Request              m_request;
+};
+
+UpdateHistoryLoader::UpdateHistoryLoader(
+  const sdk::gdb::IWorkspaceFactorySP& wks_factory,
+  const CatalogLabelCacheSP& label_cache, QObject* parent)
+  : QObject(parent),
+    m_wks_factory(wks_factory),
+    m_label_cache(label_cache),
+    m_ruin_names(),
+    m_pool(),
+    m_lock(),
+    m_last_request_id(0),
+    m_active(),
+    m_pages()
+{
+  m_pool.setMaxThreadCount(kLoaderThreads);
+
+  // RUIN names are looked up by hash instead of scanning the map table
+  for (size_t c = 0; c < SDK_ARRAY_LENGTH(senc::kRUINMapTable); ++c)
+  {
+    std::wostringstream name;
+    name << senc::kRUINMapTable[c].ruin_name;
+    m_ruin_names.insert(senc::kRUINMapTable[c].ruin,
+      QString::fromStdWString(name.str()));
+  }
+}
+
+UpdateHistoryLoader::~UpdateHistoryLoader()
+{
+  CancelAll();
+  m_pool.waitForDone();
+}
+
+int UpdateHistoryLoader::Load(const Request& request)
+{
+  int request_id;
+  {
+    QMutexLocker lock(&m_lock);
+    request_id = ++m_last_request_id;
+    m_active.insert(request_id);
+  }
+  m_pool.start(new Task(this, request_id, request));
+  return request_id;
+}
+
+void UpdateHistoryLoader::Cancel(int request_id)
+{
+  QMutexLocker lock(&m_lock);
+  m_active.erase(request_id);
+}
+
+void UpdateHistoryLoader::CancelAll()
+{
+  QMutexLocker lock(&m_lock);
+  m_active.clear();
+  m_pages.clear();
+}
+
+void UpdateHistoryLoader::TakePages(std::vector<Page>& pages)
+{
+  pages.clear();
+
+  QMutexLocker lock(&m_lock);
+  for (size_t i = 0; i < m_pages.size(); ++i)
+  {
+    // Pages of cancelled requests are dropped
+    if (m_active.count(m_pages[i].m_request_id))
+      pages.push_back(m_pages[i]);
+    if (m_pages[i].m_is_last)
+      m_active.erase(m_pages[i].m_request_id);
+  }
+  m_pages.clear();
+}
+
+void UpdateHistoryLoader::Run(int request_id, const Request& request)
+{
+  if (!IsActive(request_id))
+    return; // Cancelled while waiting in queue
+
+  QElapsedTimer timer;
+  timer.start();
+
+  Page page;
+  page.m_request_id = request_id;
+  page.m_is_last = false;
+
+  bool is_read = false;
+  do
+  {
+    if (!m_wks_factory)
+    {
+      page.m_error = tr("Workspace factory instance is NULL");
+      break;
+    }
+    sdk::gdb::IWorkspaceCollectionSP wks_collection;
+    if (SDK_FAILED(m_wks_factory->GetWorkspaces(&wks_collection)))
+    {
+      page.m_error = tr("Failed to get workspaces from workspace factory");
+      break;
+    }
+    sdk::gdb::IWorkspaceSP wks;
+    if (SDK_FAILED(wks_collection->GetWorkspace(
+      sdk::ScopedString(request.m_wks_name.toStdWString()), &wks)) || !wks)
+    {
+      page.m_error = tr("Failed to get workspace by name");
+      break;
+    }
+
+    // Getting workspace update history
+    sdk::gdb::IWorkspaceUpdateHistorySP wks_uph;
+    if (SDK_FAILED(wks->GetWorkspaceUpdateHistory(&wks_uph)))
+    {
+      page.m_error = tr("Failed to get workspace update history.");
+      break;
+    }
+
+    switch (request.m_level)
+    {
+    case kLevel_Agencies:
+      is_read = ReadAgencies(request_id, wks_uph, page);
+      break;
+    case kLevel_Datasets:
+      is_read = ReadDatasets(request_id, request, wks_uph, page);
+      break;
+    case kLevel_Updates:
+      is_read = ReadUpdates(request_id, request, wks_uph, page);
+      break;
+    case kLevel_Records:
+      {
+        // Getting labels of workspace feature catalog
+        CatalogLabelsSP labels;
+        if (m_label_cache)
+          labels = m_label_cache->GetLabels(wks, kPRSP_S101);
+        if (!labels)
+        {
+          page.m_error = tr("Failed to get a feature catalog.");
+          break;
+        }
+        is_read = ReadRecords(request_id, request, wks_uph, labels, page);
+      }
+      break;
+    }
+  }
+  while (false);
+
+  if (!is_read && !IsActive(request_id))
+    return;
+
+  if (Deliver(page, true) && IsTimingLogEnabled())
+    qDebug() << "Update history level" << request.m_level << "read in"
+      << timer.elapsed() << "ms" << (is_read ? "" : "with error");
+}
+
+bool UpdateHistoryLoader::ReadAgencies(int request_id,
+  const sdk::gdb::IWorkspaceUpdateHistorySP& wks_uph, Page& page)
+{
+  // Making new query parameters for agencies only
+  IWorkspaceFactoryUtilSP wks_util =
+    m_wks_factory.GetInterface<IWorkspaceFactoryUtil>();
+  IQueryParametersSP parameters;
+  if (!wks_util || SDK_FAILED(wks_util->CreateQueryParameters(&parameters)))
+  {
+    page.m_error = tr("Failed to create query parameters.");
+    return false;
+  }
+  parameters->SetParameter(kUPH_QUERY_AGEN_ONLY, sdk::ScopedAny(true));
+
+  sql::IRowSetSP wks_uph_rs;
+  if (SDK_FAILED(wks_uph->GetWorkspaceUpdateHistory(parameters, &wks_uph_rs)))
+  {
+    page.m_error = tr("Failed to get workspace update history.");
+    return false;
+  }
+
+  if (SDK_OK(wks_uph_rs->MoveFirst()))
+  {
+    do
+    {
+      sdk::ScopedAny agen;
+      if (SDK_FAILED(wks_uph_rs->GetValueByColumnName(
+        senc::kUPHLogTable_AGEN, agen)) || !ANY_IS_STR(&agen))
+        continue;
+
+      Row row;
+      row.m_key = QString::fromStdWString(agen.GetAsWString());
+      row.m_text = row.m_key;
+      row.m_updn = 0;
+      row.m_reference = kEmptyObjectReference;
+      page.m_rows.push_back(row);
+      if (!Deliver(page, false))
+        return false;
+    }
+    while (SDK_OK(wks_uph_rs->MoveNext()));
+  }
+  return IsActive(request_id);
+}
+
+bool UpdateHistoryLoader::ReadDatasets(int request_id, const Request& request,
+  const sdk::gdb::IWorkspaceUpdateHistorySP& wks_uph, Page& page)
+{
+  // Making new query parameters for update history of the agency
+  IWorkspaceFactoryUtilSP wks_util =
+    m_wks_factory.GetInterface<IWorkspaceFactoryUtil>();
+  IQueryParametersSP parameters;
+  if (!wks_util || SDK_FAILED(wks_util->CreateQueryParameters(&parameters)))
+  {
+    page.m_error = tr("Failed to create query parameters.");
+    return false;
+  }
+  parameters->SetParameter(kUPH_QUERY_AGEN_LIST,
+    sdk::ScopedAny(request.m_agen.toStdWString()));
+
+  sql::IRowSetSP wks_uph_rs;
+  if (SDK_FAILED(wks_uph->GetWorkspaceUpdateHistory(parameters, &wks_uph_rs)))
+  {
+    page.m_error = tr("Failed to get workspace update history.");
+    return false;
+  }
+
+  if (SDK_OK(wks_uph_rs->MoveFirst()))
+  {
+    do
+    {
+      // Dataset name
+      sdk::ScopedAny dsnm;
+      if (SDK_FAILED(wks_uph_rs->GetValueByColumnName(
+        senc::kUPHLogTable_DSNM, dsnm)) || !ANY_IS_STR(&dsnm))
+      {
+        page.m_error = tr("Failed to get DSNM from the workspace update history.");
+        return false;
+      }
+
+      Row row;
+      row.m_key = QString::fromStdWString(dsnm.GetAsWString());
+      row.m_text = row.m_key;
+      row.m_updn = 0;
+      row.m_reference = kEmptyObjectReference;
+      page.m_rows.push_back(row);
+      if (!Deliver(page, false))
+        return false;
+    }
+    while (SDK_OK(wks_uph_rs->MoveNext()));
+  }
+  return IsActive(request_id);
+}
+
+bool UpdateHistoryLoader::ReadUpdates(int request_id, const Request& request,
+  const sdk::gdb::IWorkspaceUpdateHistorySP& wks_uph, Page& page)
+{
+  const std::string dsnm = request.m_dsnm.toStdString();
+  sql::IRowSetSP upd_rs;
+  if (SDK_FAILED(wks_uph->GetDatasetUpdateHistory(dsnm.c_str(), &upd_rs)))
+  {
+    page.m_error = tr("Failed to get Update history records.");
+    return false;
+  }
+
+  if (SDK_OK(upd_rs->MoveFirst()))
+  {
+    do
+    {
+      sdk::ScopedAny updn;
+      if (SDK_FAILED(upd_rs->GetValue(kUPH_UPDN, updn)))
+      {
+        page.m_error = tr("Failed to get UPDN.");
+        return false;
+      }
+      updn.ChangeType(kSDKAnyType_Uint32);
+
+      Row row;
+      row.m_updn = ANY_UI32(&updn);
+      row.m_text = QString("UPDN %1").arg(row.m_updn);
+      row.m_reference = kEmptyObjectReference;
+      page.m_rows.push_back(row);
+      if (!Deliver(page, false))
+        return false;
+    }
+    while (SDK_OK(upd_rs->MoveNext()));
+  }
+  return IsActive(request_id);
+}
+
+bool UpdateHistoryLoader::ReadRecords(int request_id, const Request& request,
+  const sdk::gdb::IWorkspaceUpdateHistorySP& wks_uph,
+  const CatalogLabelsSP& labels, Page& page)
+{
+  const std::string dsnm = request.m_dsnm.toStdString();
+  sql::IRowSetSP rec_rs;
+  if (SDK_FAILED(wks_uph->GetDatasetUpdateRecords(dsnm.c_str(),
+    request.m_updn, &rec_rs)))
+  {
+    page.m_error = tr("Failed to get UPDN records.");
+    return false;
+  }
+
+  // Fields of a page are read first, so class names of the page are looked
+  // up in the catalog at once
+  std::vector<RecordFields> records;
+  records.reserve(kPageRows);
+  if (SDK_OK(rec_rs->MoveFirst()))
+  {
+    do
+    {
+      if (!IsActive(request_id))
+        return false;
+
+      sdk::ScopedAny rcid, rind, ruin, objl;
+      if (SDK_FAILED(rec_rs->GetValue(kUPH_REC_RCID, rcid)))
+        page.m_error = tr("Failed to get RCID.");
+      else if (SDK_FAILED(rec_rs->GetValue(kUPH_REC_RIND, rind)))
+        page.m_error = tr("Failed to get RIND.");
+      else if (SDK_FAILED(rec_rs->GetValue(kUPH_REC_RUIN, ruin)))
+        page.m_error = tr("Failed to get RUIN.");
+      else if (SDK_FAILED(rec_rs->GetValue(kUPH_REC_OBJL, objl)))
+        page.m_error = tr("Failed to get OBJL.");
+      if (!page.m_error.isEmpty())
+      {
+        FormatRecords(records, labels, page);
+        return false;
+      }
+      rcid.ChangeType(kSDKAnyType_Uint32);
+      rind.ChangeType(kSDKAnyType_Int32);
+      ruin.ChangeType(kSDKAnyType_Uint32);
+      objl.ChangeType(kSDKAnyType_Uint32);
+
+      RecordFields fields;
+      fields.rcid = ANY_UI32(&rcid);
+      fields.rind = ANY_I32(&rind);
+      fields.ruin = ANY_UI32(&ruin);
+      fields.objl = ANY_UI32(&objl);
+      records.push_back(fields);
+
+      if (records.size() == kPageRows)
+      {
+        FormatRecords(records, labels, page);
+        records.clear();
+        if (!Deliver(page, false))
+          return false;
+      }
+    }
+    while (SDK_OK(rec_rs->MoveNext()));
+  }
+
+  FormatRecords(records, labels, page);
+  return IsActive(request_id);
+}
+
+void UpdateHistoryLoader::FormatRecords(const std::vector<RecordFields>& records,
+  const CatalogLabelsSP& labels, Page& page) const
+{
+  std::vector<sdk::gdb::ClassCode> class_codes(records.size());
+  for (size_t i = 0; i < records.size(); ++i)
+    class_codes[i] = records[i].objl;
+  labels->Prefetch(sdk::gdb::kClassType_FeatureClass, class_codes);
+
+  for (size_t i = 0; i < records.size(); ++i)
+  {
+    const RecordFields& fields = records[i];
+
+    QString text = QString("RCID=%1,RIND=%2,").arg(fields.rcid).arg(fields.rind);
+    QHash<SDKUInt32, QString>::const_iterator ruin_it =
+      m_ruin_names.constFind(fields.ruin);
+    if (ruin_it != m_ruin_names.constEnd())
+      text += QString("RUIN=%1,").arg(*ruin_it);
+    else
+      text += QString("RUIN=%1?,").arg(fields.ruin);
+    text += QString("OBJL=%1").arg(fields.objl);
+
+    // Feature class name
+    std::wstring class_name;
+    if (labels->GetClassName(sdk::gdb::kClassType_FeatureClass, fields.objl,
+      class_name))
+      text += " - " + QString::fromStdWString(class_name);
+
+    Row row;
+    row.m_text = text;
+    row.m_updn = 0;
+    const uint rindex = static_cast<uint>(fields.rind);
+    row.m_reference = (rindex != static_cast<uint>(-1)) ? rindex : kNoObjectReference;
+    page.m_rows.push_back(row);
+  }
+}
+
+bool UpdateHistoryLoader::Deliver(Page& page, bool is_last)
+{
+  if (!is_last && page.m_rows.size() < kPageRows)
+    return IsActive(page.m_request_id);
+
+  page.m_is_last = is_last;
+
+  bool is_first = false;
+  {
+    QMutexLocker lock(&m_lock);
+    if (!m_active.count(page.m_request_id))
+      return false;
+    is_first = m_pages.empty();
+    m_pages.push_back(page);
+  }
+
+  page.m_rows.clear();
+  page.m_error.clear();
+  if (is_first)
+    emit signalPagesReady();
+  return true;
+}
+
+bool UpdateHistoryLoader::IsActive(int request_id) const
+{
+  QMutexLocker lock(&m_lock);
+  return m_active.count(request_id) != 0;
+}
@@ -0,0 +1,141 @@
+// update_history_loader.h : Reads workspace update history on worker threads page by page
+//
+#ifndef UPDATE_HISTORY_LOADER_H
+#define UPDATE_HISTORY_LOADER_H
+#pragma once
+
+#include <set>
+#include <vector>
+
+#include <QObject>
+#include <QMutex>
+#include <QThreadPool>
+#include <QHash>
+#include <QString>
+
+#include <datalayer/inc/geodatabase/gdb_workspace.h>
+#include <datalayer/inc/geodatabase/gdb_update_history.h>
+#include "catalog_label_cache.h"
+
+// Object reference of rows, which are not update records
+const uint kEmptyObjectReference = static_cast<uint>(-1);
+// Object reference of update records, which feature has been deleted
+const uint kNoObjectReference    = static_cast<uint>(-2);
+
+// Reads one level of the update history tree per request: agencies of a
+// workspace, datasets of an agency, updates of a dataset or records of an
+// update. Rows are delivered in pages as they are read, so the view is
+// filled while a large level is still being read. Requests may be
+// cancelled at any time, their pages are dropped.
+class UpdateHistoryLoader : public QObject
+{
+  Q_OBJECT
+
+public:
+  enum Level
+  {
+    kLevel_Agencies = 0,
+    kLevel_Datasets,
+    kLevel_Updates,
+    kLevel_Records
+  };
+
+  // Level to be read and keys of its parent rows
+  struct Request
+  {
+    Level     m_level;
+    QString   m_wks_name;
+    QString   m_agen;      // Datasets
+    QString   m_dsnm;      // Updates and records
+    SDKUInt32 m_updn;      // Records
+  };
+
+  struct Row
+  {
+    QString   m_text;
+    // Agency or dataset name, which is the key of the next level
+    QString   m_key;
+    // Update number of update rows
+    SDKUInt32 m_updn;
+    // RIND of record rows, see object reference constants
+    uint      m_reference;
+  };
+
+  struct Page
+  {
+    int              m_request_id;
+    std::vector<Row> m_rows;
+    // No more pages of the request follow
+    bool             m_is_last;
+    // Reading failed, rows before the failure are delivered
+    QString          m_error;
+  };
+
+  UpdateHistoryLoader(const sdk::gdb::IWorkspaceFactorySP& wks_factory,
+    const CatalogLabelCacheSP& label_cache, QObject* parent = 0);
+  ~UpdateHistoryLoader();
+
+  // Queues the request, returns its identifier
+  int Load(const Request& request);
+  // Stops the request, its pending pages are dropped
+  void Cancel(int request_id);
+  void CancelAll();
+
+  // Takes pages read so far
+  void TakePages(std::vector<Page>& pages);
+
+signals:
+  // Emitted from worker thread when first page is queued for taking
+  void signalPagesReady();
+
+private:
+  class Task;
+  friend class Task;
+
+  // Record fields read before the page is formatted
+  struct RecordFields
+  {
+    SDKUInt32 rcid;
+    SDKInt32  rind;
+    SDKUInt32 ruin;
+    SDKUInt32 objl;
+  };
+
+  // Called by worker task
+  void Run(int request_id, const Request& request);
+
+  // Readers of levels, return false with error if reading fails
+  bool ReadAgencies(int request_id,
+    const sdk::gdb::IWorkspaceUpdateHistorySP& wks_uph, Page& page);
+  bool ReadDatasets(int request_id, const Request& request,
+    const sdk::gdb::IWorkspaceUpdateHistorySP& wks_uph, Page& page);
+  bool ReadUpdates(int request_id, const Request& request,
+    const sdk::gdb::IWorkspaceUpdateHistorySP& wks_uph, Page& page);
+  bool ReadRecords(int request_id, const Request& request,
+    const sdk::gdb::IWorkspaceUpdateHistorySP& wks_uph,
+    const CatalogLabelsSP& labels, Page& page);
+  // Makes record rows of the page, class names are looked up at once
+  void FormatRecords(const std::vector<RecordFields>& records,
+    const CatalogLabelsSP& labels, Page& page) const;
+
+  // Queues the page if it is full or the last one and starts a new page.
+  // Returns false if the request has been cancelled.
+  bool Deliver(Page& page, bool is_last);
+  bool IsActive(int request_id) const;
+
+private:
+  const sdk::gdb::IWorkspaceFactorySP m_wks_factory;
+  const CatalogLabelCacheSP           m_label_cache;
+
+  // RUIN names by RUIN
+  QHash<SDKUInt32, QString>           m_ruin_names;
+
+  QThreadPool                         m_pool;
+
+  mutable QMutex                      m_lock;
+  int                                 m_last_request_id;
+  std::set<int>                       m_active;
+  std::vector<Page>                   m_pages;
+};
+
+#endif // UPDATE_HISTORY_LOADER_H
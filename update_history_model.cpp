@@ -0,0 +1,459 @@
+// update_history_model.cpp : Tree model of workspace update history filled in background
+//
+#include <base/inc/sdk_string_handler.h>
+#include <base/inc/sdk_results_enum.h>
+#include "update_history_model.h"
+
+struct UpdateHistoryModel::Node
+{
+  enum Kind
+  {
+    kKind_Root = 0,
+    kKind_Workspace,
+    kKind_Agency,
+    kKind_Dataset,
+    kKind_Update,
+    kKind_Record,
+    kKind_Text
+  };
+
+  enum State
+  {
+    kState_NotLoaded = 0,
+    kState_Loading,
+    kState_Loaded
+  };
+
+  Node(Kind node_kind, Node* parent_node, int node_row)
+    : kind(node_kind),
+      parent(parent_node),
+      row(node_row),
+      children(),
+      text(),
+      key(),
+      updn(0),
+      reference(kEmptyObjectReference),
+      state(kState_NotLoaded),
+      request_id(0)
+  {
+  }
+
+  ~Node()
+  {
+    for (size_t i = 0; i < children.size(); ++i)
+      delete children[i];
+  }
+
+  // Workspaces, agencies, datasets and updates have children to be read
+  bool IsExpandable() const
+  {
+    return kind != kKind_Root && kind != kKind_Record && kind != kKind_Text;
+  }
+
+  Kind               kind;
+  Node*              parent;
+  int                row;
+  std::vector<Node*> children;
+  QString            text;
+
+  // Workspace, agency or dataset name, update number or object reference
+  // of record
+  QString            key;
+  SDKUInt32          updn;
+  uint               reference;
+
+  // Reading of children, loading nodes end with the placeholder
+  State              state;
+  int                request_id;
+};
+
+UpdateHistoryModel::UpdateHistoryModel(
+  const sdk::gdb::IWorkspaceFactorySP& wks_factory,
+  const CatalogLabelCacheSP& label_cache,
+  const UpdateHistorySummaryBuilder* summaries, QObject* parent)
+  : QAbstractItemModel(parent),
+    m_wks_factory(wks_factory),
+    m_loader(wks_factory, label_cache),
+    m_summaries(summaries),
+    m_root(new Node(Node::kKind_Root, NULL, 0)),
+    m_loading()
+{
+  connect(&m_loader, SIGNAL(signalPagesReady()), this, SLOT(OnPagesReady()),
+    Qt::QueuedConnection);
+  if (m_summaries)
+    connect(m_summaries, SIGNAL(signalSummaryReady()),
+      this, SLOT(OnSummaryReady()), Qt::QueuedConnection);
+}
+
+UpdateHistoryModel::~UpdateHistoryModel()
+{
+  m_loader.CancelAll();
+  delete m_root;
+}
+
+void UpdateHistoryModel::Reset()
+{
+  beginResetModel();
+
+  m_loader.CancelAll();
+  m_loading.clear();
+  delete m_root;
+  m_root = new Node(Node::kKind_Root, NULL, 0);
+
+  // Getting all of opened workspaces
+  sdk::gdb::IWorkspaceCollectionSP wks_collection;
+  SDKUInt32 wks_count = 0;
+  if (m_wks_factory &&
+    SDK_OK(m_wks_factory->GetWorkspaces(&wks_collection)) &&
+    SDK_OK(wks_collection->GetWorkspaceCount(wks_count)))
+  {
+    for (SDKUInt32 c = 0; c < wks_count; ++c)
+    {
+      sdk::ScopedString wks_name;
+      if (SDK_FAILED(wks_collection->GetWorkspaceName(c, wks_name)))
+        continue;
+
+      Node* node = new Node(Node::kKind_Workspace, m_root,
+        static_cast<int>(m_root->children.size()));
+      node->key = QString::fromStdWString(sdk::WideFromSDKString(wks_name));
+      node->text = node->key;
+      m_root->children.push_back(node);
+      AddSummaryNodes(node, false);
+    }
+  }
+
+  endResetModel();
+}
+
+void UpdateHistoryModel::CancelLoading(const QModelIndex& index)
+{
+  Node* node = NodeFromIndex(index);
+  if (!node || node->state != Node::kState_Loading)
+    return;
+
+  m_loader.Cancel(node->request_id);
+  m_loading.erase(node->request_id);
+
+  // Partially read children are dropped, they are read again on expansion
+  RemoveChildren(node);
+  node->state = Node::kState_NotLoaded;
+}
+
+bool UpdateHistoryModel::GetRecord(const QModelIndex& index,
+  std::wstring& wks_name, std::wstring& dsnm, uint& reference) const
+{
+  Node* node = NodeFromIndex(index);
+  if (!node || node->kind != Node::kKind_Record)
+    return false;
+
+  // Record - update - dataset - agency - workspace
+  Node* dataset_node = node->parent->parent;
+  Node* wks_node = dataset_node->parent->parent;
+  wks_name = wks_node->key.toStdWString();
+  dsnm = dataset_node->key.toStdWString();
+  reference = node->reference;
+  return true;
+}
+
+QModelIndex UpdateHistoryModel::index(int row, int column,
+  const QModelIndex& parent) const
+{
+  Node* parent_node = parent.isValid() ? NodeFromIndex(parent) : m_root;
+  if (!parent_node || column != 0 || row < 0 ||
+    row >= static_cast<int>(parent_node->children.size()))
+    return QModelIndex();
+  return createIndex(row, column, parent_node->children[row]);
+}
+
+QModelIndex UpdateHistoryModel::parent(const QModelIndex& child) const
+{
+  Node* node = NodeFromIndex(child);
+  if (!node || !node->parent || node->parent == m_root)
+    return QModelIndex();
+  return IndexFromNode(node->parent);
+}
+
+int UpdateHistoryModel::rowCount(const QModelIndex& parent) const
+{
+  Node* parent_node = parent.isValid() ? NodeFromIndex(parent) : m_root;
+  return parent_node ? static_cast<int>(parent_node->children.size()) : 0;
+}
+
+int UpdateHistoryModel::columnCount(const QModelIndex& /*parent*/) const
+{
+  return 1;
+}
+
+QVariant UpdateHistoryModel::data(const QModelIndex& index, int role) const
+{
+  Node* node = NodeFromIndex(index);
+  if (!node || role != Qt::DisplayRole)
+    return QVariant();
+  return node->text;
+}
+
+bool UpdateHistoryModel::hasChildren(const QModelIndex& parent) const
+{
+  Node* parent_node = parent.isValid() ? NodeFromIndex(parent) : m_root;
+  if (!parent_node)
+    return false;
+
+  // Not read node is expandable, so the view shows it
+  if (parent_node->IsExpandable() && parent_node->state == Node::kState_NotLoaded)
+    return true;
+  return !parent_node->children.empty();
+}
+
+bool UpdateHistoryModel::canFetchMore(const QModelIndex& parent) const
+{
+  Node* node = NodeFromIndex(parent);
+  return node && node->IsExpandable() && node->state == Node::kState_NotLoaded;
+}
+
+void UpdateHistoryModel::fetchMore(const QModelIndex& parent)
+{
+  Node* node = NodeFromIndex(parent);
+  if (!node || !node->IsExpandable() || node->state != Node::kState_NotLoaded)
+    return;
+
+  // Keys of the level are collected from the node and its parents
+  UpdateHistoryLoader::Request request;
+  request.m_updn = 0;
+  Node* level_node = node;
+  switch (node->kind)
+  {
+  case Node::kKind_Update:
+    request.m_level = UpdateHistoryLoader::kLevel_Records;
+    request.m_updn = node->updn;
+    level_node = level_node->parent;
+    request.m_dsnm = level_node->key;
+    level_node = level_node->parent->parent;
+    break;
+  case Node::kKind_Dataset:
+    request.m_level = UpdateHistoryLoader::kLevel_Updates;
+    request.m_dsnm = node->key;
+    level_node = level_node->parent->parent;
+    break;
+  case Node::kKind_Agency:
+    request.m_level = UpdateHistoryLoader::kLevel_Datasets;
+    request.m_agen = node->key;
+    level_node = level_node->parent;
+    break;
+  default:
+    request.m_level = UpdateHistoryLoader::kLevel_Agencies;
+    break;
+  }
+  request.m_wks_name = level_node->key;
+
+  node->state = Node::kState_Loading;
+  node->request_id = m_loader.Load(request);
+  m_loading[node->request_id] = node;
+
+  // Placeholder is shown until the last page comes
+  beginInsertRows(parent, 0, 0);
+  Node* placeholder = new Node(Node::kKind_Text, node, 0);
+  placeholder->text = tr("Loading...");
+  node->children.push_back(placeholder);
+  endInsertRows();
+}
+
+void UpdateHistoryModel::OnPagesReady()
+{
+  std::vector<UpdateHistoryLoader::Page> pages;
+  m_loader.TakePages(pages);
+
+  for (size_t i = 0; i < pages.size(); ++i)
+  {
+    std::map<int, Node*>::iterator it = m_loading.find(pages[i].m_request_id);
+    if (it == m_loading.end())
+      continue; // Cancelled meanwhile
+
+    Node* node = it->second;
+    InsertPage(node, pages[i]);
+    if (!pages[i].m_is_last)
+      continue;
+
+    // Removing the placeholder
+    const int placeholder_row = static_cast<int>(node->children.size()) - 1;
+    beginRemoveRows(IndexFromNode(node), placeholder_row, placeholder_row);
+    delete node->children.back();
+    node->children.pop_back();
+    endRemoveRows();
+
+    node->state = Node::kState_Loaded;
+    m_loading.erase(it);
+  }
+}
+
+void UpdateHistoryModel::OnSummaryReady()
+{
+  // Workspaces, which have not been expanded yet, take their summary
+  for (size_t i = 0; i < m_root->children.size(); ++i)
+  {
+    Node* wks_node = m_root->children[i];
+    if (wks_node->state == Node::kState_NotLoaded)
+      AddSummaryNodes(wks_node, true);
+  }
+}
+
+UpdateHistoryModel::Node* UpdateHistoryModel::NodeFromIndex(
+  const QModelIndex& index) const
+{
+  return index.isValid() ? static_cast<Node*>(index.internalPointer()) : NULL;
+}
+
+QModelIndex UpdateHistoryModel::IndexFromNode(Node* node) const
+{
+  if (!node || node == m_root)
+    return QModelIndex();
+  return createIndex(node->row, 0, node);
+}
+
+bool UpdateHistoryModel::AddSummaryNodes(Node* wks_node, bool is_inserted)
+{
+  UpdateHistorySummarySP summary;
+  if (m_summaries)
+    summary = m_summaries->GetSummary(wks_node->key);
+  if (!summary)
+    return false;
+
+  const std::vector<UpdateHistorySummary::Agency>& agencies = summary->GetAgencies();
+  wks_node->text = tr("%1 (%2 agencies, %3 datasets, %4 update records)")
+    .arg(wks_node->key).arg(agencies.size()).arg(summary->GetDatasetCount())
+    .arg(summary->GetRecordCount());
+  wks_node->state = Node::kState_Loaded;
+  if (is_inserted)
+  {
+    const QModelIndex wks_index = IndexFromNode(wks_node);
+    emit dataChanged(wks_index, wks_index);
+  }
+  if (agencies.empty())
+    return true;
+
+  if (is_inserted)
+    beginInsertRows(IndexFromNode(wks_node), 0,
+      static_cast<int>(agencies.size()) - 1);
+
+  for (size_t a = 0; a < agencies.size(); ++a)
+  {
+    const UpdateHistorySummary::Agency& agency = agencies[a];
+    Node* agency_node = new Node(Node::kKind_Agency, wks_node, static_cast<int>(a));
+    agency_node->key = agency.m_agen;
+    agency_node->text = tr("%1 (%2 datasets)").arg(agency.m_agen)
+      .arg(agency.m_datasets.size());
+    agency_node->state = Node::kState_Loaded;
+    wks_node->children.push_back(agency_node);
+
+    for (size_t d = 0; d < agency.m_datasets.size(); ++d)
+    {
+      const UpdateHistorySummary::Dataset& dataset = agency.m_datasets[d];
+      Node* dataset_node = new Node(Node::kKind_Dataset, agency_node,
+        static_cast<int>(d));
+      dataset_node->key = dataset.m_dsnm;
+      dataset_node->text = tr("%1 (%2 updates, %3 update records)")
+        .arg(dataset.m_dsnm).arg(dataset.m_updates.size())
+        .arg(dataset.m_record_count);
+      if (!dataset.m_updates.empty())
+      {
+        const UpdateHistorySummary::Update& last = dataset.m_updates.back();
+        dataset_node->text += last.m_issue_date.isEmpty() ?
+          tr(", last UPDN %1").arg(last.m_updn) :
+          tr(", last UPDN %1 of %2").arg(last.m_updn).arg(last.m_issue_date);
+      }
+      dataset_node->state = Node::kState_Loaded;
+      agency_node->children.push_back(dataset_node);
+
+      // Records of updates are read on expansion
+      for (size_t u = 0; u < dataset.m_updates.size(); ++u)
+      {
+        const UpdateHistorySummary::Update& update = dataset.m_updates[u];
+        Node* update_node = new Node(Node::kKind_Update, dataset_node,
+          static_cast<int>(u));
+        update_node->updn = update.m_updn;
+        update_node->text = update.m_issue_date.isEmpty() ?
+          tr("UPDN %1 (%2 records)").arg(update.m_updn).arg(update.m_record_count) :
+          tr("UPDN %1 (%2, %3 records)").arg(update.m_updn)
+          .arg(update.m_issue_date).arg(update.m_record_count);
+        dataset_node->children.push_back(update_node);
+      }
+    }
+  }
+
+  if (is_inserted)
+    endInsertRows();
+  return true;
+}
+
+void UpdateHistoryModel::InsertPage(Node* node,
+  const UpdateHistoryLoader::Page& page)
+{
+  // Rows of the next level under the node
+  Node::Kind kind = Node::kKind_Record;
+  switch (node->kind)
+  {
+  case Node::kKind_Workspace: kind = Node::kKind_Agency; break;
+  case Node::kKind_Agency:    kind = Node::kKind_Dataset; break;
+  case Node::kKind_Dataset:   kind = Node::kKind_Update; break;
+  default: break;
+  }
+
+  const int row_count = static_cast<int>(page.m_rows.size()) +
+    (page.m_error.isEmpty() ? 0 : 1);
+  if (!row_count)
+    return;
+
+  const int first = static_cast<int>(node->children.size()) - 1;
+  beginInsertRows(IndexFromNode(node), first, first + row_count - 1);
+
+  Node* placeholder = node->children.back();
+  node->children.pop_back();
+  for (size_t r = 0; r < page.m_rows.size(); ++r)
+  {
+    const UpdateHistoryLoader::Row& row = page.m_rows[r];
+    Node* child = new Node(kind, node, static_cast<int>(node->children.size()));
+    child->text = row.m_text;
+    child->key = row.m_key;
+    child->updn = row.m_updn;
+    child->reference = row.m_reference;
+    node->children.push_back(child);
+  }
+  if (!page.m_error.isEmpty())
+  {
+    Node* child = new Node(Node::kKind_Text, node,
+      static_cast<int>(node->children.size()));
+    child->text = page.m_error;
+    node->children.push_back(child);
+  }
+  placeholder->row = static_cast<int>(node->children.size());
+  node->children.push_back(placeholder);
+
+  endInsertRows();
+}
+
+void UpdateHistoryModel::RemoveChildren(Node* node)
+{
+  if (node->children.empty())
+    return;
+
+  // Children being read are cancelled, so no page comes for deleted node
+  for (size_t i = 0; i < node->children.size(); ++i)
+    CancelSubtree(node->children[i]);
+
+  beginRemoveRows(IndexFromNode(node), 0,
+    static_cast<int>(node->children.size()) - 1);
+  for (size_t i = 0; i < node->children.size(); ++i)
+    delete node->children[i];
+  node->children.clear();
+  endRemoveRows();
+}
+
+void UpdateHistoryModel::CancelSubtree(Node* node)
+{
+  if (node->state == Node::kState_Loading)
+  {
+    m_loader.Cancel(node->request_id);
+    m_loading.erase(node->request_id);
+  }
+  for (size_t i = 0; i < node->children.size(); ++i)
+    CancelSubtree(node->children[i]);
+}
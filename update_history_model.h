@@ -0,0 +1,87 @@
+// update_history_model.h : Tree model of workspace update history filled in background
+//
+#ifndef UPDATE_HISTORY_MODEL_H
+#define UPDATE_HISTORY_MODEL_H
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <QAbstractItemModel>
+
+#include "update_history_loader.h"
+#include "update_history_summary_builder.h"
+
+// Workspaces are listed at once. Agencies, datasets and updates of a
+// workspace are taken from its update history summary, when it is ready.
+// Otherwise they are read by the loader like update records, when their
+// parent item is expanded, and inserted page by page. Collapsing an item,
+// which is still being read, cancels the reading, the item is read again
+// on the next expansion.
+class UpdateHistoryModel : public QAbstractItemModel
+{
+  Q_OBJECT
+
+public:
+  UpdateHistoryModel(const sdk::gdb::IWorkspaceFactorySP& wks_factory,
+    const CatalogLabelCacheSP& label_cache,
+    const UpdateHistorySummaryBuilder* summaries, QObject* parent = 0);
+  ~UpdateHistoryModel();
+
+  // Lists open workspaces, readings in progress are cancelled
+  void Reset();
+  // Cancels reading of children of the item
+  void CancelLoading(const QModelIndex& index);
+
+  // Returns workspace name, dataset name and object reference of the
+  // update record item, false for other items
+  bool GetRecord(const QModelIndex& index, std::wstring& wks_name,
+    std::wstring& dsnm, uint& reference) const;
+
+  // QAbstractItemModel
+  QModelIndex index(int row, int column,
+    const QModelIndex& parent = QModelIndex()) const;
+  QModelIndex parent(const QModelIndex& child) const;
+  int rowCount(const QModelIndex& parent = QModelIndex()) const;
+  int columnCount(const QModelIndex& parent = QModelIndex()) const;
+  QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
+  bool hasChildren(const QModelIndex& parent = QModelIndex()) const;
+  bool canFetchMore(const QModelIndex& parent) const;
+  void fetchMore(const QModelIndex& parent);
+
+private slots:
+  void OnPagesReady();
+  void OnSummaryReady();
+
+private:
+  struct Node;
+
+  Node* NodeFromIndex(const QModelIndex& index) const;
+  QModelIndex IndexFromNode(Node* node) const;
+
+  // Adds agencies, datasets and updates of the workspace node from its
+  // summary, returns false if the summary is not ready
+  bool AddSummaryNodes(Node* wks_node, bool is_inserted);
+
+  // Inserts rows of the page before the loading placeholder
+  void InsertPage(Node* node, const UpdateHistoryLoader::Page& page);
+  // Removes all of children of the node
+  void RemoveChildren(Node* node);
+  // Cancels reading of the node and of its descendants
+  void CancelSubtree(Node* node);
+
+private:
+  const sdk::gdb::IWorkspaceFactorySP m_wks_factory;
+
+  UpdateHistoryLoader m_loader;
+  // Summaries of workspaces, may be NULL
+  const UpdateHistorySummaryBuilder* m_summaries;
+
+  // Invisible root, its children are workspaces
+  Node*               m_root;
+  // Nodes being read by request identifier
+  std::map<int, Node*> m_loading;
+};
+
+#endif // UPDATE_HISTORY_MODEL_H
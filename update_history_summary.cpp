@@ -0,0 +1,341 @@
+// update_history_summary.cpp : Summary of workspace update history by agency and dataset
+//
+#include <algorithm>
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QDataStream>
+#include <QDateTime>
+#include <QCryptographicHash>
+
+#include <base/inc/sdk_any_handler.h>
+#include <base/inc/sdk_string_handler.h>
+#include <base/inc/sdk_results_enum.h>
+#include <base/inc/interfaces/sql/sql_interface.h>
+#include <datalayer/inc/senc/senc_exchange_set.h>
+#include "update_history_summary.h"
+
+using namespace SDK_NAMESPACE;
+using namespace SDK_GDB_NAMESPACE;
+
+namespace
+{
+  const quint32 kSummaryMagic = 0x534B4D55; // SKMU
+  const quint32 kSummaryVersion = 2;
+
+  bool ReadAgencies(const IWorkspaceFactoryUtilSP& wks_util,
+    const IWorkspaceUpdateHistorySP& wks_uph,
+    std::vector<UpdateHistorySummary::Agency>& agencies)
+  {
+    IQueryParametersSP parameters;
+    if (SDK_FAILED(wks_util->CreateQueryParameters(&parameters)))
+      return false;
+    parameters->SetParameter(kUPH_QUERY_AGEN_ONLY, ScopedAny(true));
+
+    sql::IRowSetSP wks_uph_rs;
+    if (SDK_FAILED(wks_uph->GetWorkspaceUpdateHistory(parameters, &wks_uph_rs)))
+      return false;
+
+    if (SDK_OK(wks_uph_rs->MoveFirst()))
+    {
+      do
+      {
+        ScopedAny agen;
+        if (SDK_FAILED(wks_uph_rs->GetValueByColumnName(
+          senc::kUPHLogTable_AGEN, agen)) || !ANY_IS_STR(&agen))
+          continue;
+
+        UpdateHistorySummary::Agency agency;
+        agency.m_agen = QString::fromStdWString(agen.GetAsWString());
+        agencies.push_back(agency);
+      }
+      while (SDK_OK(wks_uph_rs->MoveNext()));
+    }
+    return true;
+  }
+
+  bool ReadDatasets(const IWorkspaceFactoryUtilSP& wks_util,
+    const IWorkspaceUpdateHistorySP& wks_uph,
+    UpdateHistorySummary::Agency& agency)
+  {
+    IQueryParametersSP parameters;
+    if (SDK_FAILED(wks_util->CreateQueryParameters(&parameters)))
+      return false;
+    parameters->SetParameter(kUPH_QUERY_AGEN_LIST,
+      ScopedAny(agency.m_agen.toStdWString()));
+
+    sql::IRowSetSP wks_uph_rs;
+    if (SDK_FAILED(wks_uph->GetWorkspaceUpdateHistory(parameters, &wks_uph_rs)))
+      return false;
+
+    if (SDK_OK(wks_uph_rs->MoveFirst()))
+    {
+      do
+      {
+        ScopedAny dsnm;
+        if (SDK_FAILED(wks_uph_rs->GetValueByColumnName(senc::kUPHLogTable_DSNM,
+          dsnm)) || !ANY_IS_STR(&dsnm))
+          return false;
+
+        UpdateHistorySummary::Dataset dataset;
+        dataset.m_dsnm = QString::fromStdWString(dsnm.GetAsWString());
+        dataset.m_record_count = 0;
+        agency.m_datasets.push_back(dataset);
+      }
+      while (SDK_OK(wks_uph_rs->MoveNext()));
+    }
+    return true;
+  }
+
+  bool ReadUpdates(const IWorkspaceUpdateHistorySP& wks_uph,
+    UpdateHistorySummary::Dataset& dataset)
+  {
+    const std::string dsnm = dataset.m_dsnm.toStdString();
+    sql::IRowSetSP upd_rs;
+    if (SDK_FAILED(wks_uph->GetDatasetUpdateHistory(dsnm.c_str(), &upd_rs)))
+      return false;
+
+    if (SDK_OK(upd_rs->MoveFirst()))
+    {
+      do
+      {
+        ScopedAny updn;
+        if (SDK_FAILED(upd_rs->GetValue(kUPH_UPDN, updn)))
+          return false;
+        updn.ChangeType(kSDKAnyType_Uint32);
+
+        UpdateHistorySummary::Update update;
+        update.m_updn = ANY_UI32(&updn);
+        update.m_record_count = 0;
+
+        ScopedAny isdt;
+        if (SDK_OK(upd_rs->GetValueByColumnName(kUpdateColumn_ISDT, isdt)) &&
+          ANY_IS_STR(&isdt))
+          update.m_issue_date = QString::fromStdWString(isdt.GetAsWString());
+
+        // Records are counted only, they are read on demand by the dialog
+        sql::IRowSetSP rec_rs;
+        if (SDK_OK(wks_uph->GetDatasetUpdateRecords(dsnm.c_str(),
+          update.m_updn, &rec_rs)) && SDK_OK(rec_rs->MoveFirst()))
+        {
+          do
+            ++update.m_record_count;
+          while (SDK_OK(rec_rs->MoveNext()));
+        }
+
+        dataset.m_record_count += update.m_record_count;
+        dataset.m_updates.push_back(update);
+      }
+      while (SDK_OK(upd_rs->MoveNext()));
+    }
+    return true;
+  }
+
+  QDataStream& operator<<(QDataStream& stream,
+    const UpdateHistorySummary::Stamp& stamp)
+  {
+    return stream << stamp.m_file_count << stamp.m_total_size
+      << stamp.m_last_modified;
+  }
+
+  QDataStream& operator>>(QDataStream& stream, UpdateHistorySummary::Stamp& stamp)
+  {
+    return stream >> stamp.m_file_count >> stamp.m_total_size
+      >> stamp.m_last_modified;
+  }
+}
+
+UpdateHistorySummary::UpdateHistorySummary()
+  : m_stamp(),
+    m_agencies()
+{
+  m_stamp.m_file_count = 0;
+  m_stamp.m_total_size = 0;
+  m_stamp.m_last_modified = 0;
+}
+
+bool UpdateHistorySummary::Build(const IWorkspaceFactorySP& wks_factory,
+  const IWorkspaceSP& wks, const Stamp& stamp,
+  const QAtomicInt& sequence, int expected_sequence)
+{
+  m_stamp = stamp;
+  m_agencies.clear();
+
+  if (!wks_factory || !wks)
+    return false;
+  IWorkspaceFactoryUtilSP wks_util =
+    wks_factory.GetInterface<IWorkspaceFactoryUtil>();
+  IWorkspaceUpdateHistorySP wks_uph;
+  if (!wks_util || SDK_FAILED(wks->GetWorkspaceUpdateHistory(&wks_uph)))
+    return false;
+
+  if (!ReadAgencies(wks_util, wks_uph, m_agencies))
+    return false;
+
+  for (size_t a = 0; a < m_agencies.size(); ++a)
+  {
+    if (sequence != expected_sequence)
+      return false;
+    if (!ReadDatasets(wks_util, wks_uph, m_agencies[a]))
+      return false;
+
+    std::vector<Dataset>& datasets = m_agencies[a].m_datasets;
+    for (size_t d = 0; d < datasets.size(); ++d)
+    {
+      if (sequence != expected_sequence)
+        return false;
+      if (!ReadUpdates(wks_uph, datasets[d]))
+        return false;
+    }
+  }
+  return true;
+}
+
+bool UpdateHistorySummary::Load(const QString& cache_directory,
+  const QString& wks_path, const Stamp& stamp)
+{
+  m_agencies.clear();
+
+  QFile file(GetFileName(cache_directory, wks_path));
+  if (!file.open(QIODevice::ReadOnly))
+    return false;
+
+  QDataStream stream(&file);
+  stream.setVersion(QDataStream::Qt_4_8);
+  quint32 magic = 0, version = 0;
+  stream >> magic >> version;
+  if (magic != kSummaryMagic || version != kSummaryVersion)
+    return false;
+
+  // File name is a hash, the path is checked as well
+  QString stored_wks_path;
+  stream >> stored_wks_path >> m_stamp;
+  if (stream.status() != QDataStream::Ok ||
+    stored_wks_path != QDir(wks_path).absolutePath())
+    return false;
+  if (!(m_stamp == stamp))
+    return false; // Workspace has been updated since
+
+  quint32 agency_count = 0;
+  stream >> agency_count;
+  for (quint32 a = 0; a < agency_count && stream.status() == QDataStream::Ok; ++a)
+  {
+    Agency agency;
+    quint32 dataset_count = 0;
+    stream >> agency.m_agen >> dataset_count;
+    for (quint32 d = 0; d < dataset_count && stream.status() == QDataStream::Ok; ++d)
+    {
+      Dataset dataset;
+      quint32 update_count = 0;
+      stream >> dataset.m_dsnm >> dataset.m_record_count >> update_count;
+      for (quint32 u = 0; u < update_count && stream.status() == QDataStream::Ok; ++u)
+      {
+        Update update;
+        quint32 updn = 0;
+        stream >> updn >> update.m_issue_date >> update.m_record_count;
+        update.m_updn = updn;
+        dataset.m_updates.push_back(update);
+      }
+      agency.m_datasets.push_back(dataset);
+    }
+    m_agencies.push_back(agency);
+  }
+
+  if (stream.status() != QDataStream::Ok)
+  {
+    m_agencies.clear();
+    return false;
+  }
+  return true;
+}
+
+bool UpdateHistorySummary::Save(const QString& cache_directory,
+  const QString& wks_path) const
+{
+  QDir().mkpath(cache_directory);
+
+  // Written aside and renamed, so a broken file is never read
+  const QString file_name = GetFileName(cache_directory, wks_path);
+  QFile file(file_name + ".tmp");
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    return false;
+
+  QDataStream stream(&file);
+  stream.setVersion(QDataStream::Qt_4_8);
+  stream << kSummaryMagic << kSummaryVersion << QDir(wks_path).absolutePath()
+    << m_stamp
+    << static_cast<quint32>(m_agencies.size());
+  for (size_t a = 0; a < m_agencies.size(); ++a)
+  {
+    const Agency& agency = m_agencies[a];
+    stream << agency.m_agen << static_cast<quint32>(agency.m_datasets.size());
+    for (size_t d = 0; d < agency.m_datasets.size(); ++d)
+    {
+      const Dataset& dataset = agency.m_datasets[d];
+      stream << dataset.m_dsnm << dataset.m_record_count
+        << static_cast<quint32>(dataset.m_updates.size());
+      for (size_t u = 0; u < dataset.m_updates.size(); ++u)
+      {
+        const Update& update = dataset.m_updates[u];
+        stream << static_cast<quint32>(update.m_updn) << update.m_issue_date
+          << update.m_record_count;
+      }
+    }
+  }
+  file.close();
+  if (stream.status() != QDataStream::Ok || file.error() != QFile::NoError)
+  {
+    file.remove();
+    return false;
+  }
+
+  QFile::remove(file_name);
+  return file.rename(file_name);
+}
+
+UpdateHistorySummary::Stamp UpdateHistorySummary::ReadStamp(const QString& wks_path)
+{
+  Stamp stamp;
+  stamp.m_file_count = 0;
+  stamp.m_total_size = 0;
+  stamp.m_last_modified = 0;
+
+  QDirIterator it(wks_path, QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+  while (it.hasNext())
+  {
+    it.next();
+    const QFileInfo info = it.fileInfo();
+    ++stamp.m_file_count;
+    stamp.m_total_size += info.size();
+    stamp.m_last_modified = std::max(stamp.m_last_modified,
+      static_cast<qint64>(info.lastModified().toMSecsSinceEpoch()));
+  }
+  return stamp;
+}
+
+size_t UpdateHistorySummary::GetDatasetCount() const
+{
+  size_t count = 0;
+  for (size_t a = 0; a < m_agencies.size(); ++a)
+    count += m_agencies[a].m_datasets.size();
+  return count;
+}
+
+quint64 UpdateHistorySummary::GetRecordCount() const
+{
+  quint64 count = 0;
+  for (size_t a = 0; a < m_agencies.size(); ++a)
+    for (size_t d = 0; d < m_agencies[a].m_datasets.size(); ++d)
+      count += m_agencies[a].m_datasets[d].m_record_count;
+  return count;
+}
+
+QString UpdateHistorySummary::GetFileName(const QString& cache_directory,
+  const QString& wks_path)
+{
+  const QByteArray key = QCryptographicHash::hash(
+    QDir(wks_path).absolutePath().toUtf8(), QCryptographicHash::Md5).toHex();
+  return QDir(cache_directory).filePath(QString::fromLatin1(key) + ".dat");
+}
@@ -0,0 +1,99 @@
+// update_history_summary.h : Summary of workspace update history by agency and dataset
+//
+#ifndef UPDATE_HISTORY_SUMMARY_H
+#define UPDATE_HISTORY_SUMMARY_H
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <QString>
+#include <QAtomicInt>
+
+#include <datalayer/inc/geodatabase/gdb_workspace.h>
+#include <datalayer/inc/geodatabase/gdb_update_history.h>
+
+// Issue date column of dataset update history, formatted as YYYYMMDD
+const char kUpdateColumn_ISDT[] = "ISDT";
+
+// Agencies, datasets and updates of one workspace with their counts. It is
+// read from the workspace update history once and stored in a cache
+// directory by the workspace path. The stored summary is used while files of the workspace are
+// not changed, so the update history dialog shows all of levels above the
+// update records without any query.
+class UpdateHistorySummary
+{
+public:
+  struct Update
+  {
+    SDKUInt32 m_updn;
+    // Issue date of the update, empty if it is not known
+    QString   m_issue_date;
+    // Update records, which are features added, changed or deleted
+    quint32   m_record_count;
+  };
+
+  struct Dataset
+  {
+    QString             m_dsnm;
+    std::vector<Update> m_updates;
+    quint64             m_record_count;
+  };
+
+  struct Agency
+  {
+    QString              m_agen;
+    std::vector<Dataset> m_datasets;
+  };
+
+  // Files of the workspace folder, the summary is valid while they are
+  // not changed
+  struct Stamp
+  {
+    quint32 m_file_count;
+    quint64 m_total_size;
+    qint64  m_last_modified; // ms since epoch
+
+    bool operator==(const Stamp& other) const
+    {
+      return m_file_count == other.m_file_count &&
+        m_total_size == other.m_total_size &&
+        m_last_modified == other.m_last_modified;
+    }
+  };
+
+  UpdateHistorySummary();
+
+  // Reads the update history of the workspace. The reading is stopped and
+  // false returned when the sequence number is changed.
+  bool Build(const sdk::gdb::IWorkspaceFactorySP& wks_factory,
+    const sdk::gdb::IWorkspaceSP& wks, const Stamp& stamp,
+    const QAtomicInt& sequence, int expected_sequence);
+
+  // Reads the summary of the workspace folder stored in the cache
+  // directory, false if there is none or it does not match the stamp
+  bool Load(const QString& cache_directory, const QString& wks_path,
+    const Stamp& stamp);
+  // Stores the summary of the workspace folder in the cache directory
+  bool Save(const QString& cache_directory, const QString& wks_path) const;
+
+  // Stamp of current files of the workspace folder
+  static Stamp ReadStamp(const QString& wks_path);
+
+  const std::vector<Agency>& GetAgencies() const { return m_agencies; }
+  // Totals of all of agencies
+  size_t GetDatasetCount() const;
+  quint64 GetRecordCount() const;
+
+private:
+  // Summary file of the workspace folder in the cache directory
+  static QString GetFileName(const QString& cache_directory,
+    const QString& wks_path);
+
+private:
+  Stamp               m_stamp;
+  std::vector<Agency> m_agencies;
+};
+typedef std::tr1::shared_ptr<const UpdateHistorySummary> UpdateHistorySummarySP;
+
+#endif // UPDATE_HISTORY_SUMMARY_H
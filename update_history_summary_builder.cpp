@@ -0,0 +1,154 @@
+// update_history_summary_builder.cpp : Builds update history summaries of open workspaces off the UI thread
+//
+#include <QRunnable>
+#include <QElapsedTimer>
+#include <QDebug>
+
+#include <base/inc/sdk_string_handler.h>
+#include <base/inc/sdk_results_enum.h>
+#include "utils.h"
+#include "update_history_summary_builder.h"
+
+namespace
+{
+  // Returns name of the workspace in the collection of the factory
+  bool GetWorkspaceName(const sdk::gdb::IWorkspaceFactorySP& wks_factory,
+    const sdk::gdb::IWorkspaceSP& wks, QString& wks_name)
+  {
+    sdk::gdb::IWorkspaceCollectionSP wks_collection;
+    SDKUInt32 wks_count = 0;
+    if (SDK_FAILED(wks_factory->GetWorkspaces(&wks_collection)) ||
+      SDK_FAILED(wks_collection->GetWorkspaceCount(wks_count)))
+      return false;
+
+    for (SDKUInt32 c = 0; c < wks_count; ++c)
+    {
+      sdk::ScopedString name;
+      sdk::gdb::IWorkspaceSP collection_wks;
+      if (SDK_FAILED(wks_collection->GetWorkspaceName(c, name)) ||
+        SDK_FAILED(wks_collection->GetWorkspace(name, &collection_wks)))
+        continue;
+      if (collection_wks.operator->() == wks.operator->())
+      {
+        wks_name = QString::fromStdWString(sdk::WideFromSDKString(name));
+        return true;
+      }
+    }
+    return false;
+  }
+}
+
+class UpdateHistorySummaryBuilder::Task : public QRunnable
+{
+public:
+  Task(UpdateHistorySummaryBuilder* builder, int sequence,
+    const sdk::gdb::IWorkspaceFactorySP& wks_factory,
+    const sdk::gdb::IWorkspaceSP& wks, const QString& wks_path)
+    : m_builder(builder),
+      m_sequence(sequence),
+      m_wks_factory(wks_factory),
+      m_wks(wks),
+      m_wks_path(wks_path)
+  {
+  }
+
+  void run()
+  {
+    m_builder->Build(m_sequence, m_wks_factory, m_wks, m_wks_path);
+  }
+
+private:
+  UpdateHistorySummaryBuilder*  m_builder;
+  int                           m_sequence;
+  sdk::gdb::IWorkspaceFactorySP m_wks_factory;
+  sdk::gdb::IWorkspaceSP        m_wks;
+  QString                       m_wks_path;
+};
+
+UpdateHistorySummaryBuilder::UpdateHistorySummaryBuilder(
+  const QString& cache_directory, QObject* parent)
+  : QObject(parent),
+    m_cache_directory(cache_directory),
+    m_pool(),
+    m_sequence(0),
+    m_lock(),
+    m_summaries()
+{
+  m_pool.setMaxThreadCount(1);
+}
+
+UpdateHistorySummaryBuilder::~UpdateHistorySummaryBuilder()
+{
+  Cancel();
+  m_pool.waitForDone();
+}
+
+void UpdateHistorySummaryBuilder::Request(
+  const sdk::gdb::IWorkspaceFactorySP& wks_factory,
+  const sdk::gdb::IWorkspaceSP& wks, const QString& wks_path)
+{
+  if (!wks_factory || !wks || wks_path.isEmpty())
+    return;
+  m_pool.start(new Task(this, m_sequence, wks_factory, wks, wks_path));
+}
+
+void UpdateHistorySummaryBuilder::Cancel()
+{
+  m_sequence.fetchAndAddOrdered(1);
+
+  QMutexLocker lock(&m_lock);
+  m_summaries.clear();
+}
+
+UpdateHistorySummarySP UpdateHistorySummaryBuilder::GetSummary(
+  const QString& wks_name) const
+{
+  QMutexLocker lock(&m_lock);
+  std::map<QString, UpdateHistorySummarySP>::const_iterator it =
+    m_summaries.find(wks_name);
+  return it != m_summaries.end() ? it->second : UpdateHistorySummarySP();
+}
+
+void UpdateHistorySummaryBuilder::Build(int sequence,
+  const sdk::gdb::IWorkspaceFactorySP& wks_factory,
+  const sdk::gdb::IWorkspaceSP& wks, const QString& wks_path)
+{
+  if (sequence != m_sequence)
+    return; // Cancelled while waiting in queue
+
+  QElapsedTimer timer;
+  timer.start();
+
+  QString wks_name;
+  if (!GetWorkspaceName(wks_factory, wks, wks_name))
+    return;
+
+  // Stored summary is used while the workspace files are the same
+  const UpdateHistorySummary::Stamp stamp =
+    UpdateHistorySummary::ReadStamp(wks_path);
+  std::tr1::shared_ptr<UpdateHistorySummary> summary(new UpdateHistorySummary());
+  const bool is_loaded = summary->Load(m_cache_directory, wks_path, stamp);
+  if (!is_loaded)
+  {
+    if (!summary->Build(wks_factory, wks, stamp, m_sequence, sequence))
+      return;
+    if (!summary->Save(m_cache_directory, wks_path))
+      qWarning() << "Update history summary: failed to store for" << wks_path;
+  }
+
+  if (IsTimingLogEnabled())
+    qDebug() << "Update history summary of" << wks_name << ":"
+      << summary->GetAgencies().size() << "agencies,"
+      << summary->GetDatasetCount() << "datasets,"
+      << summary->GetRecordCount() << "records,"
+      << (is_loaded ? "loaded in" : "built in") << timer.elapsed() << "ms";
+
+  {
+    QMutexLocker lock(&m_lock);
+    if (sequence != m_sequence)
+      return; // Cancelled while being built
+    m_summaries[wks_name] = summary;
+  }
+
+  emit signalSummaryReady();
+}
@@ -0,0 +1,64 @@
+// update_history_summary_builder.h : Builds update history summaries of open workspaces off the UI thread
+//
+#ifndef UPDATE_HISTORY_SUMMARY_BUILDER_H
+#define UPDATE_HISTORY_SUMMARY_BUILDER_H
+#pragma once
+
+#include <map>
+#include <QObject>
+#include <QMutex>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QString>
+
+#include "update_history_summary.h"
+
+// Makes the summary of every opened workspace on a worker thread. The
+// summary stored in the cache directory is used if the workspace files
+// have not been changed, otherwise it is read from the update history and
+// stored again.
+class UpdateHistorySummaryBuilder : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit UpdateHistorySummaryBuilder(const QString& cache_directory,
+    QObject* parent = 0);
+  ~UpdateHistorySummaryBuilder();
+
+  // Queues summary of the workspace opened from the folder
+  void Request(const sdk::gdb::IWorkspaceFactorySP& wks_factory,
+    const sdk::gdb::IWorkspaceSP& wks, const QString& wks_path);
+  // Drops pending requests and all of summaries
+  void Cancel();
+
+  // Returns summary of the workspace, empty if it is not ready
+  UpdateHistorySummarySP GetSummary(const QString& wks_name) const;
+
+signals:
+  // Emitted from worker thread when a summary is ready
+  void signalSummaryReady();
+
+private:
+  class Task;
+  friend class Task;
+
+  // Called by worker task
+  void Build(int sequence, const sdk::gdb::IWorkspaceFactorySP& wks_factory,
+    const sdk::gdb::IWorkspaceSP& wks, const QString& wks_path);
+
+private:
+  // Directory of stored summaries
+  const QString  m_cache_directory;
+
+  // Single worker, workspaces are summarized one by one
+  QThreadPool    m_pool;
+
+  // Sequence number of the latest cancellation
+  QAtomicInt     m_sequence;
+
+  // Ready summaries by workspace name
+  mutable QMutex m_lock;
+  std::map<QString, UpdateHistorySummarySP> m_summaries;
+};
+#endif // UPDATE_HISTORY_SUMMARY_BUILDER_H
@@ -3,35 +3,106 @@
 
 #include <base/inc/sdk_string_handler.h>
 #include <base/inc/sdk_array_handler.h>
+#include <base/inc/sdk_any_handler.h>
 #include <base/inc/base_library/base_types_functions.h>
 #include <base/inc/color/color_base_types_helpers.h>
+#include <base/inc/math/matrix3x2.h>
+#include <geometry/inc/coordinate_systems/crs_const.h>
+#include <geometry/inc/coordinate_systems/crs_basic_transformation.inl>
 #include <visualizationlayer/inc/vis_const.h>
 #include <visualizationlayer/inc/graphics/2d_render_target_interface.h>
 #include <visualizationlayer/inc/portrayal/sdl/sdl_interface.h>
 #include <visualizationlayer/inc/portrayal/csp/s52_const.h>
 #include <visualizationlayer/inc/visman/layers_manager_interface.h>
+#include "utils.h"
 #include "user_bmp_layer_renderer.h"
 
+#include <cstring>
+#include <QDebug>
+
 #if defined(SDK_OS_LINUX)
 #include <sys/types.h>
 #include <unistd.h>
 #endif
 
-using namespace SDK_NAMESPACE;
-//using namespace SDK_GFX_NAMESPACE;
-using namespace sdk::gfx; // Define has been added in the latest sdk release
-using namespace SDK_VIS_NAMESPACE;
-using namespace SDK_SCENE_NAMESPACE;
+using namespace SDK_NAMESPACE;
+using namespace SDK_CRS_NAMESPACE;
+//using namespace SDK_GFX_NAMESPACE;
+using namespace sdk::gfx; // Define has been added in the latest sdk release
+using namespace SDK_VIS_NAMESPACE;
+using namespace SDK_SCENE_NAMESPACE;
+
+namespace
+{
+  // Mip levels are not made smaller than this size
+  const int kMinMipSize = 32;
+
+  // Size of the bitmap tile, small dirty rectangles recreate few of them
+  const int kTileSize = 256;
+
+  // Halves the image averaging 2x2 pixel blocks, pixels are premultiplied.
+  // Only pixels of the half image within the rectangle are computed, the
+  // whole image is computed when it is recreated.
+  void DownsampleHalf(const uchar* bits, int width, int height,
+    int bytes_per_line, const QRect& rect, QImage& half)
+  {
+    const int half_width = qMax(1, width / 2);
+    const int half_height = qMax(1, height / 2);
+    QRect half_rect = rect;
+    if (half.width() != half_width || half.height() != half_height) {
+      half = QImage(half_width, half_height, QImage::Format_ARGB32_Premultiplied);
+      half_rect = half.rect();
+    }
+    half_rect &= half.rect();
+
+    for (int y = half_rect.top(); y <= half_rect.bottom(); ++y) {
+      const uchar* row0 = bits + qMin(2 * y, height - 1) * bytes_per_line;
+      const uchar* row1 = bits + qMin(2 * y + 1, height - 1) * bytes_per_line;
+      uchar* dest = half.scanLine(y);
+      for (int x = half_rect.left(); x <= half_rect.right(); ++x) {
+        const int x0 = qMin(2 * x, width - 1) * 4;
+        const int x1 = qMin(2 * x + 1, width - 1) * 4;
+        for (int c = 0; c < 4; ++c)
+          dest[x * 4 + c] = static_cast<uchar>(
+            (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+      }
+    }
+  }
+}
 
 UserBmpLayerRenderer::UserBmpLayerRenderer()
   : m_ref(0),
     m_render_target(),
-    m_bitmap(),
-    m_image(),
-    m_is_new_data(false) {
+    m_tiles(),
+    m_tile_columns(0),
+    m_bitmap_width(0),
+    m_bitmap_height(0),
+    m_mip_images(),
+    m_mip_bitmaps(),
+    m_mip_level_count(0),
+    m_mip_dirty_rect(),
+    m_render_sequence(0),
+    m_upload_clock(),
+    m_full_upload_bytes(0),
+    m_partial_upload_bytes(0),
+    m_frame_clock(),
+    m_frame_count(0),
+    m_latency_sum(0),
+    m_latency_max(0),
+    m_write_time_max(0),
+    m_frames(),
+    m_shared_frames(),
+    m_is_geo_referenced(false),
+    m_geo_center(),
+    m_geo_range(0.0),
+    m_geo_rotation(0.0f),
+    m_geo_generation(0),
+    m_placement(),
+    m_is_placed(false) {
 }
 
 UserBmpLayerRenderer::~UserBmpLayerRenderer() {
+  ReportStatistics();
 }
 
 SDKUInt32 UserBmpLayerRenderer::AddRef() const throw() {
@@ -92,6 +163,7 @@ SDKResult UserBmpLayerRenderer::SetContext(
       return Err_InternalError;
 
     // Get render target (used only when bitmap is not found)
+    QMutexLocker render_lock(&m_render_lock);
     if (SDK_FAILED(render_target_resource->GetRenderTarget(m_render_target)))
       return Err_InternalError;
 
@@ -107,54 +179,209 @@ SDKResult UserBmpLayerRenderer::Render(
 
   try {
 
-    bool is_new_data = false;
-    QImage image;
+    Placement placement;
+    GeoIntPoint geo_center;
+    double geo_range = 0.0;
+    quint32 geo_generation = 0;
+    {
+      QMutexLocker lock(&m_lock);
+      placement.is_geo_referenced = m_is_geo_referenced;
+      placement.rotation = m_geo_rotation;
+      geo_center = m_geo_center;
+      geo_range = m_geo_range;
+      geo_generation = m_geo_generation;
+    }
+
+    // Size of the anchored bitmap on the scene, it is taken from the
+    // projection in the same way as in CoverageRenderer
+    if (placement.is_geo_referenced) {
+      ScopedAny any_projection;
+      if (SDK_FAILED(context->GetParameter(kSceneRendererParameter_Projection, any_projection)))
+        return Err_InternalError;
+      if (ANY_TYPE(&any_projection) != kSDKAnyType_SDKComponentPtr)
+        return Err_InternalError;
+      IProjectionSP projection(
+        GetInterfaceT<IProjection>(ANY_COMPONENT(&any_projection)));
+      ICoordinateTransformationSP coord_transform(
+        GetInterfaceT<ICoordinateTransformation>(projection));
+      if (!projection || !coord_transform)
+        return Err_InternalError;
+
+      IProjectionParametersSP proj_param;
+      if (SDK_FAILED(projection->GetProjectionParameters(&proj_param)) || !proj_param)
+        return Err_InternalError;
+      double scale = 0.0;
+      double resolution = 0.0;
+      if (SDK_FAILED(proj_param->GetParameterValueByID(kProjPar_ScaleFactor, scale)) ||
+        SDK_FAILED(proj_param->GetParameterValueByID(kProjPar_CoordinateUnit, resolution)) ||
+        scale <= 0.0 || resolution <= 0.0)
+        return Err_InternalError;
+
+      coord_transform->ForwardIF(1, &geo_center, &placement.center);
+      placement.extent = static_cast<float>(2.0 * geo_range / (resolution * scale));
+    }
+
+    {
+      // Placement is kept for overlay updates, unless the anchor has been
+      // changed meanwhile
+      QMutexLocker lock(&m_lock);
+      m_placement = placement;
+      m_is_placed = geo_generation == m_geo_generation;
+    }
+
+    QMutexLocker render_lock(&m_render_lock);
+    return RenderFrame(placement);
+  }
+  catch (...) {}
+
+  return Err_InternalError;
+}
+
+SDKResult UserBmpLayerRenderer::RenderOverlay() {
+
+  try {
+
+    Placement placement;
     {
-      QMutexLocker lock(&m_lock);
-      if (m_is_new_data) {
-        image.swap(m_image);
-        is_new_data = true;
-        m_is_new_data = false; // Data has been taken
+      QMutexLocker lock(&m_lock);
+      if (!m_is_placed)
+        return Err_Uninitialized;
+      placement = m_placement;
+    }
+
+    QMutexLocker render_lock(&m_render_lock);
+    if (!m_render_target)
+      return Err_Uninitialized;
+    return RenderFrame(placement);
+  }
+  catch (...) {}
+
+  return Err_InternalError;
+}
+
+SDKResult UserBmpLayerRenderer::RenderFrame(const Placement& placement) {
+
+  const bool is_geo_referenced = placement.is_geo_referenced;
+  const float dest_extent = placement.extent;
+  const SDKPointF2D dest_center = placement.center;
+
+  bool is_shared = false;
+  {
+    QMutexLocker lock(&m_lock);
+    is_shared = m_shared_frames.get() != NULL;
+    if (is_shared) {
+      // Newest shared frame is uploaded without intermediate copy,
+      // its slot is released right after the upload
+      const uchar* bits = m_shared_frames->BeginRead();
+      if (bits) {
+        bool is_uploaded = UploadBitmap(bits,
+          m_shared_frames->Width(), m_shared_frames->Height(),
+          m_shared_frames->BytesPerLine());
+        // Mip levels can be built only while the slot is held
+        m_mip_level_count = is_uploaded ? 1 : 0;
+        m_mip_dirty_rect = QRect();
+        if (is_uploaded && is_geo_referenced)
+          BuildMipLevels(SelectMipLevel(dest_extent), bits,
+            m_shared_frames->Width(), m_shared_frames->Height(),
+            m_shared_frames->BytesPerLine());
+        m_shared_frames->EndRead();
+        if (!is_uploaded)
+          return Err_InternalError;
+        AccountUpload(static_cast<qint64>(m_shared_frames->BytesPerLine()) *
+          m_shared_frames->Height(), 0);
       }
     }
+  }
 
-    if (is_new_data) { // Recreate bitmap
-      image = image.mirrored(false, true);
-      sdk::Size size(image.width(), image.height());
-      sdk::gfx::RenderTargetBitmapSP bitmap;
-      if (SDK_FAILED(m_render_target->CreateBitmapFromRawData(size, 
-        image.bytesPerLine(), kPixelFormat_BGRA_8888, image.constBits(), bitmap)))
+  // Newest frame of SetBits is taken without waiting for the producer,
+  // it stays unchanged until the next Acquire
+  const BitmapTripleBuffer::Frame* frame = is_shared ? NULL : m_frames.Acquire();
+  if (frame) {
+    AccountFrame(*frame);
+
+    // Dirty rectangles are relative to the previous frame, so they are
+    // enough only if no frame has been dropped in between
+    const QImage& image = frame->image;
+    bool is_full_update = frame->is_full_update ||
+      frame->sequence != m_render_sequence + 1;
+    m_render_sequence = frame->sequence;
+
+    qint64 bytes = 0;
+    if (!is_full_update &&
+      UploadDirtyRects(image, frame->dirty_rects, bytes)) {
+      AccountUpload(0, bytes);
+      // Mip levels are updated within the changed region, when they
+      // are drawn next time
+      for (size_t i = 0; i < frame->dirty_rects.size(); ++i)
+        m_mip_dirty_rect |= frame->dirty_rects[i];
+    }
+    else {
+      m_mip_level_count = 0;
+      m_mip_dirty_rect = QRect();
+      if (!UploadBitmap(image.constBits(), image.width(),
+        image.height(), image.bytesPerLine()))
         return Err_InternalError;
-      m_bitmap = bitmap;
+      AccountUpload(static_cast<qint64>(image.byteCount()), 0);
+      m_mip_level_count = 1;
     }
+  }
+
+  // Draw bitmap
+  if (!m_tiles.empty()) {
+    RTAutoStartFinishDraw auto_start_finish_draw(m_render_target);
+    if (!auto_start_finish_draw.IsDrawStarted())
+      return Err_InternalError;
 
-    // Draw bitmap
-    if (m_bitmap) {
-      RTAutoStartFinishDraw auto_start_finish_draw(m_render_target);
-      if (!auto_start_finish_draw.IsDrawStarted())
-        return Err_InternalError;
+    m_render_target->FillBackground(sdk::ColorF(0.0f, 0.0f, 0.0f, 0.0f));
 
-      m_render_target->FillBackground(sdk::ColorF(0.0f, 0.0f, 0.0f, 0.0f));
+    if (is_geo_referenced) {
+      // Precomputed level close to the size on the scene is drawn, so
+      // large bitmaps are not minified every frame
+      int level = SelectMipLevel(dest_extent);
+      const BitmapTripleBuffer::Frame* current = m_frames.Current();
+      if (level > 0 && current && !is_shared &&
+        (level >= m_mip_level_count || !m_mip_dirty_rect.isNull()))
+        BuildMipLevels(level, current->image.constBits(),
+          current->image.width(), current->image.height(),
+          current->image.bytesPerLine());
+      level = qMax(0, qMin(level, m_mip_level_count - 1));
 
       Size bitmap_size;
-      if (SDK_FAILED(m_bitmap->GetSize(bitmap_size)))
+      if (level > 0 && (!m_mip_bitmaps[level] ||
+        SDK_FAILED(m_mip_bitmaps[level]->GetSize(bitmap_size))))
         return Err_InternalError;
 
-      // Source bitmap is centered and enlarged four times
-      SizeF source_size(bitmap_size.width, bitmap_size.height);
-      RectF2D source_rect(sdk::PointF2D(0.0f, 0.0f), source_size);
-      SizeF dest_size(bitmap_size.width * 4, bitmap_size.height * 4);
-      RectF2D dest_rect(
-        sdk::PointF2D(-dest_size.width / 2, -dest_size.height / 2), dest_size);
+      // Bitmap center is moved to the anchor and turned around it
+      CMatrix3X2 matrix_translate;
+      matrix_translate.Translate(dest_center.x, dest_center.y);
+      CMatrix3X2 matrix_rotate;
+      matrix_rotate.Rotate(-placement.rotation);
+      m_render_target->RemoveTransformationMatrixes();
+      m_render_target->PushTransformationMatrix(matrix_translate);
+      m_render_target->PushTransformationMatrix(matrix_rotate);
+
+      if (level > 0) {
+        RectF2D source_rect(sdk::PointF2D(0.0f, 0.0f),
+          SizeF(bitmap_size.width, bitmap_size.height));
+        RectF2D dest_rect(sdk::PointF2D(-dest_extent / 2, -dest_extent / 2),
+          SizeF(dest_extent, dest_extent));
+        m_render_target->DrawBitmap(m_mip_bitmaps[level], source_rect,
+          dest_rect);
+      }
+      else {
+        DrawTiles(-dest_extent / 2, -dest_extent / 2,
+          dest_extent / m_bitmap_width, dest_extent / m_bitmap_height);
+      }
 
-      m_render_target->DrawBitmap(m_bitmap, source_rect, dest_rect);
+      m_render_target->RemoveTransformationMatrixes();
+      return Ok;
     }
 
-    return Ok;
+    // Source bitmap is centered and enlarged four times
+    DrawTiles(-m_bitmap_width * 2.0f, -m_bitmap_height * 2.0f, 4.0f, 4.0f);
   }
-  catch (...) {}
 
-  return Err_InternalError;
+  return Ok;
 }
 
 SDKResult UserBmpLayerRenderer::SetProperty(const sdk::SDKPropertyID& id, 
@@ -168,7 +395,7 @@ SDKResult UserBmpLayerRenderer::GetProperty(const sdk::SDKPropertyID& id,
 // This property has been added in the latest sdk release
 //   switch (id) {
 //     case kSceneRendererProperty_IsDirty: {
-//       QMutexLocker lock(&m_lock);
+//       QMutexLocker lock(&m_lock);
 //       value = ScopedAny(m_is_new_data);
 //       break;
 //     }
@@ -179,11 +406,318 @@ SDKResult UserBmpLayerRenderer::GetProperty(const sdk::SDKPropertyID& id,
   return Err_NotImpl; 
 }
 
-void UserBmpLayerRenderer::SetBits(QImage& image) {
+bool UserBmpLayerRenderer::AttachSharedFrames(const QString& name) {
+
+  std::auto_ptr<SharedFrameRing> shared_frames(new SharedFrameRing());
+  if (!shared_frames->Attach(name))
+    return false;
+
+  QMutexLocker lock(&m_lock);
+  m_shared_frames = shared_frames;
+  return true;
+}
+
+void UserBmpLayerRenderer::DetachSharedFrames() {
+
+  QMutexLocker lock(&m_lock);
+  m_shared_frames.reset(NULL);
+}
+
+bool UserBmpLayerRenderer::HasNewSharedFrame() const {
+
+  QMutexLocker lock(&m_lock);
+  return m_shared_frames.get() && m_shared_frames->HasNewFrame();
+}
+
+SharedFrameRing::Statistics UserBmpLayerRenderer::GetSharedFrameStatistics() const {
+
+  QMutexLocker lock(&m_lock);
+  if (!m_shared_frames.get()) {
+    SharedFrameRing::Statistics statistics = { 0, 0, 0, 0 };
+    return statistics;
+  }
+  return m_shared_frames->GetStatistics();
+}
+
+bool UserBmpLayerRenderer::CreateBitmap(RenderTargetBitmapSP& bitmap,
+  const uchar* bits, int width, int height, int bytes_per_line) {
+
+  if (!m_render_target)
+    return false;
+
+  sdk::Size size(width, height);
+  sdk::gfx::RenderTargetBitmapSP new_bitmap;
+  if (SDK_FAILED(m_render_target->CreateBitmapFromRawData(size, 
+    bytes_per_line, kPixelFormat_BGRA_8888, bits, new_bitmap)))
+    return false;
+  bitmap = new_bitmap;
+  return true;
+}
+
+bool UserBmpLayerRenderer::UploadBitmap(const uchar* bits, int width,
+  int height, int bytes_per_line) {
+
+  m_tile_columns = (width + kTileSize - 1) / kTileSize;
+  const int tile_rows = (height + kTileSize - 1) / kTileSize;
+  m_bitmap_width = width;
+  m_bitmap_height = height;
+  m_tiles.assign(m_tile_columns * tile_rows, RenderTargetBitmapSP());
+
+  for (size_t i = 0; i < m_tiles.size(); ++i) {
+    if (!UploadTile(i, bits, bytes_per_line)) {
+      m_tiles.clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+bool UserBmpLayerRenderer::UploadTile(size_t index, const uchar* bits,
+  int bytes_per_line) {
+
+  // Tile is read from the whole bitmap pixels with their stride
+  const int left = static_cast<int>(index % m_tile_columns) * kTileSize;
+  const int top = static_cast<int>(index / m_tile_columns) * kTileSize;
+  return CreateBitmap(m_tiles[index], bits + top * bytes_per_line + left * 4,
+    qMin(kTileSize, m_bitmap_width - left), qMin(kTileSize, m_bitmap_height - top),
+    bytes_per_line);
+}
+
+void UserBmpLayerRenderer::DrawTiles(float dest_left, float dest_top,
+  float scale_x, float scale_y) {
+
+  for (size_t i = 0; i < m_tiles.size(); ++i) {
+    const int left = static_cast<int>(i % m_tile_columns) * kTileSize;
+    const int top = static_cast<int>(i / m_tile_columns) * kTileSize;
+    const int width = qMin(kTileSize, m_bitmap_width - left);
+    const int height = qMin(kTileSize, m_bitmap_height - top);
+
+    RectF2D source_rect(sdk::PointF2D(0.0f, 0.0f), SizeF(width, height));
+    RectF2D dest_rect(
+      sdk::PointF2D(dest_left + left * scale_x, dest_top + top * scale_y),
+      SizeF(width * scale_x, height * scale_y));
+    m_render_target->DrawBitmap(m_tiles[i], source_rect, dest_rect);
+  }
+}
+
+int UserBmpLayerRenderer::SelectMipLevel(float dest_size) const {
+
+  if (m_tiles.empty())
+    return 0;
+
+  // Halving stops before the level gets smaller than the drawn size
+  int size = qMax(m_bitmap_width, m_bitmap_height);
+  int level = 0;
+  while ((size >> (level + 1)) >= kMinMipSize &&
+    static_cast<float>(size >> (level + 1)) >= dest_size)
+    ++level;
+  return level;
+}
+
+bool UserBmpLayerRenderer::BuildMipLevels(int level, const uchar* bits,
+  int width, int height, int bytes_per_line) {
+
+  if (m_mip_level_count < 1)
+    return false;
+
+  if (static_cast<int>(m_mip_images.size()) <= level) {
+    m_mip_images.resize(level + 1);
+    m_mip_bitmaps.resize(level + 1);
+  }
+
+  // Each level is made from the previous one. Built levels are updated
+  // within the halved dirty region, new levels are made whole.
+  const int built_count = m_mip_level_count;
+  QRect dirty_rect = m_mip_dirty_rect;
+  for (int l = 1; l <= qMax(level, built_count - 1); ++l) {
+    if (!dirty_rect.isNull())
+      dirty_rect = QRect(QPoint(dirty_rect.left() / 2, dirty_rect.top() / 2),
+        QPoint(dirty_rect.right() / 2, dirty_rect.bottom() / 2));
+    const bool is_built = l < built_count;
+    if (is_built && dirty_rect.isNull())
+      continue;
+
+    const QRect rect = is_built ? dirty_rect : QRect(0, 0, width, height);
+    if (l == 1)
+      DownsampleHalf(bits, width, height, bytes_per_line, rect, m_mip_images[1]);
+    else
+      DownsampleHalf(m_mip_images[l - 1].constBits(), m_mip_images[l - 1].width(),
+        m_mip_images[l - 1].height(), m_mip_images[l - 1].bytesPerLine(),
+        rect, m_mip_images[l]);
+
+    const QImage& image = m_mip_images[l];
+    if (!CreateBitmap(m_mip_bitmaps[l], image.constBits(), image.width(),
+      image.height(), image.bytesPerLine())) {
+      m_mip_level_count = l; // Levels from this one are rebuilt whole
+      m_mip_dirty_rect = QRect();
+      return false;
+    }
+    m_mip_level_count = qMax(m_mip_level_count, l + 1);
+  }
+
+  m_mip_dirty_rect = QRect();
+  return true;
+}
+
+void UserBmpLayerRenderer::SetGeoReference(const GeoIntPoint& center,
+  double range_meters, float rotation) {
+
+  QMutexLocker lock(&m_lock);
+  m_is_geo_referenced = range_meters > 0.0;
+  m_geo_center = center;
+  m_geo_range = range_meters;
+  m_geo_rotation = rotation;
+  ++m_geo_generation;
+  m_is_placed = false;
+}
+
+void UserBmpLayerRenderer::ClearGeoReference() {
+
+  QMutexLocker lock(&m_lock);
+  m_is_geo_referenced = false;
+  ++m_geo_generation;
+  m_is_placed = false;
+}
+
+bool UserBmpLayerRenderer::UploadDirtyRects(const QImage& image,
+  const std::vector<QRect>& dirty_rects, qint64& bytes) {
+
+  if (m_tiles.empty() || dirty_rects.empty() ||
+    m_bitmap_width != image.width() || m_bitmap_height != image.height())
+    return false;
+
+  // Each touched tile is recreated once, even if several rectangles
+  // intersect it
+  std::vector<bool> is_dirty(m_tiles.size(), false);
+  for (size_t i = 0; i < dirty_rects.size(); ++i) {
+    const QRect rect = dirty_rects[i].intersected(image.rect());
+    if (rect.isEmpty())
+      continue;
+    for (int row = rect.top() / kTileSize; row <= rect.bottom() / kTileSize; ++row)
+      for (int column = rect.left() / kTileSize;
+        column <= rect.right() / kTileSize; ++column)
+        is_dirty[row * m_tile_columns + column] = true;
+  }
+
+  bytes = 0;
+  for (size_t i = 0; i < m_tiles.size(); ++i) {
+    if (!is_dirty[i])
+      continue;
+    if (!UploadTile(i, image.constBits(), image.bytesPerLine()))
+      return false; // Whole bitmap is uploaded then
+
+    Size tile_size;
+    if (SDK_OK(m_tiles[i]->GetSize(tile_size)))
+      bytes += static_cast<qint64>(tile_size.width) * 4 * tile_size.height;
+  }
+
+  return true;
+}
+
+void UserBmpLayerRenderer::AccountUpload(qint64 full_bytes,
+  qint64 partial_bytes) {
+
+  if (m_upload_clock.isNull())
+    m_upload_clock.start();
+
+  m_full_upload_bytes += full_bytes;
+  m_partial_upload_bytes += partial_bytes;
+}
+
+void UserBmpLayerRenderer::ReportStatistics() const {
+
+  if (!IsTimingLogEnabled())
+    return;
+
+  // Average upload rate over the layer lifetime
+  if (!m_upload_clock.isNull()) {
+    const int elapsed = qMax(m_upload_clock.elapsed(), 1);
+    qDebug() << "User bitmap upload, bytes/s: full frames"
+      << m_full_upload_bytes * 1000 / elapsed
+      << "dirty tiles" << m_partial_upload_bytes * 1000 / elapsed;
+  }
+
+  // Producer write time is the whole stall of the producer, it does not
+  // depend on rendering since no lock is shared
+  if (!m_frame_clock.isNull() && m_frame_count > 0) {
+    const int elapsed = qMax(m_frame_clock.elapsed(), 1);
+    qDebug() << "User bitmap frames/s:" << m_frame_count * 1000 / elapsed
+      << "dropped" << m_frames.DroppedCount()
+      << "latency ms: avg" << m_latency_sum / m_frame_count / 1000000.0
+      << "max" << m_latency_max / 1000000.0
+      << "producer write max ms" << m_write_time_max / 1000000.0;
+  }
+}
+
+void UserBmpLayerRenderer::AccountFrame(
+  const BitmapTripleBuffer::Frame& frame) {
+
+  if (m_frame_clock.isNull())
+    m_frame_clock.start();
 
-  QMutexLocker lock(&m_lock);
-  m_image.swap(image);
-  m_is_new_data = true;
+  const qint64 latency = m_frames.Now() - frame.publish_time;
+  ++m_frame_count;
+  m_latency_sum += latency;
+  m_latency_max = qMax(m_latency_max, latency);
+  m_write_time_max = qMax(m_write_time_max, frame.write_time);
 }
 
+void UserBmpLayerRenderer::SetBits(const uchar* bits, int width, int height,
+  int bytes_per_line, bool is_top_down, const std::vector<QRect>& dirty_rects) {
+
+  if (!bits || width <= 0 || height <= 0)
+    return;
+
+  BitmapTripleBuffer::Frame& frame = m_frames.BeginWrite();
+  const BitmapTripleBuffer::Frame* last_frame = m_frames.LastPublished();
+
+  // Slot buffer is reused, if size is not changed
+  bool is_full_update = dirty_rects.empty() || !last_frame ||
+    last_frame->image.width() != width || last_frame->image.height() != height;
+  if (frame.image.width() != width || frame.image.height() != height) {
+    frame.image = QImage(width, height, QImage::Format_ARGB32_Premultiplied);
+    frame.stale_rects.assign(1, frame.image.rect());
+  }
+
+  const int row_size = qMin(bytes_per_line, frame.image.bytesPerLine());
+  frame.dirty_rects.clear();
+  if (is_full_update) {
+    for (int row = 0; row < height; ++row) {
+      const uchar* source = bits + (is_top_down ? height - 1 - row : row) * bytes_per_line;
+      memcpy(frame.image.scanLine(row), source, row_size);
+    }
+  }
+  else {
+    // Slot is brought up to date with the last published frame first
+    const QRect frame_rect(0, 0, width, height);
+    for (size_t i = 0; i < frame.stale_rects.size(); ++i) {
+      QRect rect = frame.stale_rects[i].intersected(frame_rect);
+      for (int row = rect.top(); row <= rect.bottom(); ++row)
+        memcpy(frame.image.scanLine(row) + rect.left() * 4,
+          last_frame->image.constScanLine(row) + rect.left() * 4, rect.width() * 4);
+    }
+
+    for (size_t i = 0; i < dirty_rects.size(); ++i) {
+      QRect rect = dirty_rects[i].intersected(frame_rect);
+      if (rect.isEmpty())
+        continue;
+
+      // Rectangle in bitmap rows
+      if (is_top_down)
+        rect.moveTop(height - 1 - rect.bottom());
+
+      for (int row = rect.top(); row <= rect.bottom(); ++row) {
+        const uchar* source = bits +
+          (is_top_down ? height - 1 - row : row) * bytes_per_line;
+        memcpy(frame.image.scanLine(row) + rect.left() * 4,
+          source + rect.left() * 4, rect.width() * 4);
+      }
+
+      frame.dirty_rects.push_back(rect);
+    }
+  }
+  frame.is_full_update = is_full_update;
+
+  m_frames.Publish();
+}
 
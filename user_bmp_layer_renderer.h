@@ -2,14 +2,20 @@
 //
 #pragma once
 
+#include <memory>
 #include <vector>
+#include <QRect>
+#include <QTime>
 #include <base/inc/platform.h>
 #include <base/inc/sdk_results_enum.h>
 #include <base/inc/sdk_ref_ptr.h>
+#include <base/inc/geometry/geometry_base_types.h>
 #include <visualizationlayer/inc/scene/renderer_interface.h>
 #include <visualizationlayer/inc/scene/layer_resource_interface.h>
 #include <visualizationlayer/inc/scene/texture_interface.h>
 #include "glwidget.h"
+#include "shared_frame_ring.h"
+#include "bitmap_triple_buffer.h"
 
 class UserBmpLayerRenderer;
 typedef sdk::SDKRefPtr<UserBmpLayerRenderer> UserBmpLayerRendererSP;
@@ -40,7 +46,85 @@ public:
     const sdk::SDKPropertyID& id, 
     SDKAny& value) const throw();
 
-  void SetBits(QImage& image);
+  // Copies BGRA pixels of the new frame. Rows of the bitmap are stored
+  // bottom-up, top-down source rows are flipped during the copy.
+  // If dirty rectangles are given (in source coordinates), only they are
+  // copied and updated in the bitmap, the rest of the frame is kept.
+  // Called from one producer thread, it never waits for rendering.
+  void SetBits(const uchar* bits, int width, int height, int bytes_per_line,
+    bool is_top_down,
+    const std::vector<QRect>& dirty_rects = std::vector<QRect>());
+
+  // Anchors the bitmap to geographic position. Center of the bitmap is
+  // placed at the position, half of its width covers the range and it is
+  // turned clockwise by the rotation (degrees). Without anchor the bitmap
+  // is drawn centered on the scene.
+  void SetGeoReference(const sdk::GeoIntPoint& center, double range_meters,
+    float rotation);
+  void ClearGeoReference();
+
+  // Uploads the newest frame and draws it into the layer render target at
+  // the placement of the last scene rendering, so the overlay is updated
+  // without rendering the scene. Fails until the scene has rendered the
+  // layer with the current anchor.
+  SDKResult RenderOverlay();
+
+  // Attaches to the ring of frames published by another process. While
+  // attached, frames are uploaded straight from shared memory and SetBits
+  // data is ignored.
+  bool AttachSharedFrames(const QString& name);
+  void DetachSharedFrames();
+  // Returns true, if a new frame is waiting in the shared ring
+  bool HasNewSharedFrame() const;
+  // Returns counters of the shared ring
+  SharedFrameRing::Statistics GetSharedFrameStatistics() const;
+
+private:
+  // Position of the bitmap on the scene
+  struct Placement
+  {
+    bool        is_geo_referenced;
+    SDKPointF2D center;
+    float       extent;
+    float       rotation;   // degrees
+
+    Placement() : is_geo_referenced(false), extent(0.0f), rotation(0.0f) {
+      center.x = 0.0f;
+      center.y = 0.0f;
+    }
+  };
+
+  // Uploads the newest frame and draws it, m_render_lock should be held
+  SDKResult RenderFrame(const Placement& placement);
+  // Creates bitmap from the pixels
+  bool CreateBitmap(sdk::gfx::RenderTargetBitmapSP& bitmap, const uchar* bits,
+    int width, int height, int bytes_per_line);
+  // Recreates all of tiles of the bitmap from the pixels
+  bool UploadBitmap(const uchar* bits, int width, int height,
+    int bytes_per_line);
+  // Recreates one tile from the pixels of the whole bitmap
+  bool UploadTile(size_t index, const uchar* bits, int bytes_per_line);
+  // Draws tiles of the bitmap, its top left corner is placed at the given
+  // point and the bitmap is enlarged by the scales
+  void DrawTiles(float dest_left, float dest_top, float scale_x,
+    float scale_y);
+  // Returns mip level, which is not smaller than the size on the scene
+  int  SelectMipLevel(float dest_size) const;
+  // Builds mip levels up to given one from level 0 pixels. Levels built
+  // before are only updated within m_mip_dirty_rect.
+  bool BuildMipLevels(int level, const uchar* bits, int width, int height,
+    int bytes_per_line);
+  // Recreates tiles touched by the regions from the image, bytes is set to
+  // the size of the recreated tiles
+  bool UploadDirtyRects(const QImage& image,
+    const std::vector<QRect>& dirty_rects, qint64& bytes);
+  // Counts uploaded bytes, the rate is logged by ReportStatistics
+  void AccountUpload(qint64 full_bytes, qint64 partial_bytes);
+  // Counts frame handoff latency, it is logged by ReportStatistics
+  void AccountFrame(const BitmapTripleBuffer::Frame& frame);
+  // Logs statistics collected since the layer was created, if TIMING_LOG
+  // is set
+  void ReportStatistics() const;
 
 private:
   // Number of references
@@ -49,11 +133,56 @@ private:
   // Render target
   sdk::gfx::RenderTargetSP  m_render_target;
 
-  // Current bitmap
-  sdk::gfx::RenderTargetBitmapSP m_bitmap;
+  // Current bitmap split into tiles of kTileSize, stored by rows. Changed
+  // regions are uploaded by recreating only the tiles they touch.
+  std::vector<sdk::gfx::RenderTargetBitmapSP> m_tiles;
+  int                                         m_tile_columns;
+  // Size of the current bitmap
+  int                                         m_bitmap_width;
+  int                                         m_bitmap_height;
+  // Halved copies of the bitmap, index is the mip level (level 0 is m_tiles)
+  std::vector<QImage>                         m_mip_images;
+  std::vector<sdk::gfx::RenderTargetBitmapSP> m_mip_bitmaps;
+  // Number of mip levels built from the current bitmap, including level 0
+  int                                         m_mip_level_count;
+  // Region of level 0 changed since the mip levels were built
+  QRect                                       m_mip_dirty_rect;
+  // Sequence of the frame uploaded to the bitmap
+  quint32        m_render_sequence;
+
+  // Upload statistics since the first upload
+  QTime          m_upload_clock;
+  qint64         m_full_upload_bytes;
+  qint64         m_partial_upload_bytes;
+
+  // Handoff statistics since the first frame
+  QTime          m_frame_clock;
+  int            m_frame_count;
+  qint64         m_latency_sum;      // ns
+  qint64         m_latency_max;      // ns
+  qint64         m_write_time_max;   // ns
+
+  // Frames of SetBits, m_lock is not taken on this path
+  BitmapTripleBuffer m_frames;
+
+  // Serializes drawing of the scene rendering and of the overlay updates
+  QMutex         m_render_lock;
+
+  // Guards shared frames, geographic anchor and placement
+  mutable QMutex m_lock;
+
+  // Frames of external process
+  std::auto_ptr<SharedFrameRing> m_shared_frames;
+
+  // Geographic anchor of the bitmap
+  bool             m_is_geo_referenced;
+  sdk::GeoIntPoint m_geo_center;
+  double           m_geo_range;
+  float            m_geo_rotation;
+  // Changed with the anchor, placement of an older anchor is not kept
+  quint32          m_geo_generation;
 
-  // Source of data
-  mutable QMutex m_lock;
-  QImage         m_image;
-  bool           m_is_new_data;
+  // Placement of the last scene rendering, used by RenderOverlay
+  Placement        m_placement;
+  bool             m_is_placed;
 };
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <stdio.h>
+#include <QtGlobal>
 #include <base/inc/platform.h>
 #include <base/inc/base_library/base_types_functions.h>
 
@@ -13,6 +14,15 @@
 # include <unistd.h>
 #endif
 
+// Jika diset, waktu proses dan statistik cache dicatat dengan qDebug
+#define TIMING_LOG_VARIABLE "TIMING_LOG"
+
+// Returns true, if timings and statistics should be logged
+inline bool IsTimingLogEnabled()
+{
+  return !qgetenv(TIMING_LOG_VARIABLE).isEmpty();
+}
+
 inline std::wstring Uint64ToWString(SDKUInt64 val)
 {
   char str[32];
@@ -0,0 +1,225 @@
+// workspace_opener.cpp : Opens geodatabase workspaces of chart folders on worker threads
+//
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include <QRunnable>
+#include <QThreadPool>
+#include <QElapsedTimer>
+
+#include <base/inc/sdk_any_handler.h>
+#include <base/inc/sdk_string_handler.h>
+#include <base/inc/sdk_results_enum.h>
+#include <base/inc/geometry/geometry_base_types_helpers.h>
+#include <datalayer/inc/geodatabase/gdb_dataset.h>
+#include "workspace_opener.h"
+
+using namespace SDK_NAMESPACE;
+using namespace SDK_GDB_NAMESPACE;
+
+namespace
+{
+  // Gap between two ranges, 0 if they overlap
+  double GetGap(double min1, double max1, double min2, double max2)
+  {
+    if (max1 < min2)
+      return min2 - max1;
+    if (max2 < min1)
+      return min1 - max2;
+    return 0.0;
+  }
+}
+
+class WorkspaceOpener::Task : public QRunnable
+{
+public:
+  Task(const IWorkspaceFactorySP& wks_factory,
+    const RootCatalogCacheSP& root_catalog_cache, Entry& entry)
+    : m_wks_factory(wks_factory),
+      m_root_catalog_cache(root_catalog_cache),
+      m_entry(entry)
+  {
+  }
+
+  void run()
+  {
+    // Each task writes its own entry only
+    OpenEntry(m_wks_factory, m_root_catalog_cache, m_entry);
+  }
+
+private:
+  IWorkspaceFactorySP m_wks_factory;
+  RootCatalogCacheSP  m_root_catalog_cache;
+  Entry&              m_entry;
+};
+
+void WorkspaceOpener::OpenAll(const IWorkspaceFactorySP& wks_factory,
+  const RootCatalogCacheSP& root_catalog_cache, std::vector<Entry>& entries,
+  int thread_count)
+{
+  QThreadPool pool;
+  pool.setMaxThreadCount(qMax(1, thread_count));
+  for (size_t i = 0; i < entries.size(); ++i)
+    pool.start(new Task(wks_factory, root_catalog_cache, entries[i]));
+  pool.waitForDone();
+}
+
+bool WorkspaceOpener::OpenEntry(const IWorkspaceFactorySP& wks_factory,
+  const RootCatalogCacheSP& root_catalog_cache, Entry& entry)
+{
+  QElapsedTimer timer;
+  timer.start();
+  entry.m_wks.Release();
+
+  const QString wks_path = QString::fromStdWString(entry.m_wks_path);
+  RootCatalogCache::Info info;
+  if (!root_catalog_cache ||
+    !root_catalog_cache->GetInfo(wks_factory, wks_path, info) ||
+    !RootCatalogCache::IsEncrypted(info))
+  {
+    entry.m_hw_id.clear();
+    entry.m_permits_path.clear();
+  }
+  const bool is_opened = Open(wks_factory, entry.m_wks_path, entry.m_hw_id,
+    entry.m_permits_path, entry.m_wks);
+  if (is_opened && root_catalog_cache && !info.m_has_contents)
+  {
+    // Contents are read once, then they are taken from the cache
+    quint32 dataset_count = 0;
+    sdk::GeoIntRect bounds;
+    if (ReadContents(entry.m_wks, dataset_count, bounds))
+      root_catalog_cache->SetContents(wks_path, dataset_count, bounds);
+  }
+  entry.m_open_time = timer.elapsed();
+  return is_opened;
+}
+
+bool WorkspaceOpener::Open(const IWorkspaceFactorySP& wks_factory,
+  const std::wstring& wks_path, const std::wstring& hw_id,
+  const std::wstring& permits_path, IWorkspaceSP& wks)
+{
+  if (wks_path.empty() || !wks_factory)
+    return false;
+
+  IWorkspaceFactoryUtilSP wks_util =
+    wks_factory.GetInterface<IWorkspaceFactoryUtil>();
+  if (!wks_util)
+    return false;
+
+  // Opening workspace
+  IWorkspaceConfigurationSP config;
+  if (SDK_FAILED(wks_factory->CreateWorkspaceConfiguration(&config)))
+    return false;
+
+  if (SDK_FAILED(config->SetConfigurationParameter(
+    kWorkspaceConfigurationParameter_RootPath,
+    ScopedAny(wks_path.c_str()))))
+    return false;
+
+  // In case HW_ID and Permits file specified, they also should be added to
+  //  configuration parameters
+  if (!hw_id.empty() && !permits_path.empty())
+  {
+    IEncryptionParametersSP encryption_parameters;
+    if (SDK_OK(wks_util->CreateEncryptionParameters(&encryption_parameters))) {
+      encryption_parameters->SetParameter( kEncryptionParameter_S63_HWID,
+        ScopedAny(hw_id));
+      encryption_parameters->SetParameter(kEncryptionParameter_S63_PermitsPath,
+        ScopedAny(permits_path));
+    }
+    config->SetConfigurationParameter(
+      kWorkspaceConfigurationParameter_EncryptionParameters,
+      ScopedAny(encryption_parameters));
+  }
+
+  return SDK_OK(wks_factory->Open(config, &wks)) && wks;
+}
+
+bool WorkspaceOpener::ReadContents(const IWorkspaceSP& wks,
+  quint32& dataset_count, sdk::GeoIntRect& bounds)
+{
+  dataset_count = 0;
+  if (!wks)
+    return false;
+
+  IEnumDatasetIDSP dataset_ids;
+  if (SDK_FAILED(wks->GetDatasetIDs(NULL, NULL, &dataset_ids)) || !dataset_ids)
+    return false;
+
+  DatasetID did;
+  while (SDK_OK(dataset_ids->Next(&did)))
+  {
+    IDatasetSP dataset;
+    geometry::IEnvelopeSP envelope;
+    SDKEnvelope2DI coordinates;
+    if (SDK_FAILED(wks->GetDataset(did, &dataset)) || !dataset ||
+      SDK_FAILED(dataset->GetBounds(&envelope)) || !envelope ||
+      SDK_FAILED(envelope->GetCoordinates(kSDKAnyType_GeoInt,
+      &coordinates.xmin, &coordinates.ymin,
+      &coordinates.xmax, &coordinates.ymax)))
+      continue;
+
+    if (0 == dataset_count)
+    {
+      bounds.sw.lon = coordinates.xmin;
+      bounds.sw.lat = coordinates.ymin;
+      bounds.ne.lon = coordinates.xmax;
+      bounds.ne.lat = coordinates.ymax;
+    }
+    else
+    {
+      bounds.sw.lon = std::min(bounds.sw.lon, coordinates.xmin);
+      bounds.sw.lat = std::min(bounds.sw.lat, coordinates.ymin);
+      bounds.ne.lon = std::max(bounds.ne.lon, coordinates.xmax);
+      bounds.ne.lat = std::max(bounds.ne.lat, coordinates.ymax);
+    }
+    ++dataset_count;
+  }
+  return true;
+}
+
+size_t WorkspaceOpener::OrderByView(const IWorkspaceFactorySP& wks_factory,
+  const RootCatalogCacheSP& root_catalog_cache,
+  const sdk::GeoIntRect& view_bounds, std::vector<Entry>& entries)
+{
+  const double kPi = 3.14159265358979323846;
+
+  // Longitude gap is shortened towards the poles, the antimeridian is not
+  // taken into account
+  const double view_lat = 0.5 * (DegFromGeoInt(view_bounds.sw.lat) +
+    DegFromGeoInt(view_bounds.ne.lat));
+  const double lon_factor = std::cos(view_lat * kPi / 180.0);
+
+  std::vector<std::pair<double, size_t> > order;
+  order.reserve(entries.size());
+  for (size_t i = 0; i < entries.size(); ++i)
+  {
+    double distance = 0.0;
+    RootCatalogCache::Info info;
+    if (root_catalog_cache && root_catalog_cache->GetInfo(wks_factory,
+      QString::fromStdWString(entries[i].m_wks_path), info) &&
+      info.m_has_contents)
+    {
+      const double lat_gap = GetGap(view_bounds.sw.lat, view_bounds.ne.lat,
+        info.m_bounds.sw.lat, info.m_bounds.ne.lat);
+      const double lon_gap = lon_factor * GetGap(view_bounds.sw.lon,
+        view_bounds.ne.lon, info.m_bounds.sw.lon, info.m_bounds.ne.lon);
+      distance = std::sqrt(lat_gap * lat_gap + lon_gap * lon_gap);
+    }
+    order.push_back(std::make_pair(distance, i));
+  }
+  std::sort(order.begin(), order.end());
+
+  std::vector<Entry> ordered;
+  ordered.reserve(entries.size());
+  size_t covering_count = 0;
+  for (size_t i = 0; i < order.size(); ++i)
+  {
+    if (order[i].first <= 0.0)
+      ++covering_count;
+    ordered.push_back(entries[order[i].second]);
+  }
+  entries.swap(ordered);
+  return covering_count;
+}
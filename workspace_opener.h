@@ -0,0 +1,67 @@
+// workspace_opener.h : Opens geodatabase workspaces of chart folders on worker threads
+//
+#ifndef WORKSPACE_OPENER_H
+#define WORKSPACE_OPENER_H
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <QtGlobal>
+
+#include <datalayer/inc/geodatabase/gdb_workspace.h>
+#include "root_catalog_cache.h"
+
+// Configures and opens workspaces of several folders concurrently. Only
+// the workspaces are opened, attaching them to the scene is left to the
+// caller, so it is done on the UI thread in the order of the folders.
+class WorkspaceOpener
+{
+public:
+  // Folder to be opened and its workspace
+  struct Entry
+  {
+    std::wstring           m_wks_path;
+    // HW_ID and permits file, used only if the database is encrypted
+    std::wstring           m_hw_id;
+    std::wstring           m_permits_path;
+    // Empty if the workspace failed to open
+    sdk::gdb::IWorkspaceSP m_wks;
+    // Time of configuring and opening, ms
+    qint64                 m_open_time;
+  };
+
+  // Opens the workspaces using up to thread_count threads, the call
+  // returns when all of them are done. Entries keep their order. Root
+  // catalogs are looked up in the cache, which also gets contents of
+  // workspaces opened for the first time.
+  static void OpenAll(const sdk::gdb::IWorkspaceFactorySP& wks_factory,
+    const RootCatalogCacheSP& root_catalog_cache, std::vector<Entry>& entries,
+    int thread_count);
+
+  // Opens the workspace of the entry on the calling thread, HW_ID and
+  // permits are dropped if the database is not encrypted
+  static bool OpenEntry(const sdk::gdb::IWorkspaceFactorySP& wks_factory,
+    const RootCatalogCacheSP& root_catalog_cache, Entry& entry);
+
+  // Configures and opens the workspace of the folder
+  static bool Open(const sdk::gdb::IWorkspaceFactorySP& wks_factory,
+    const std::wstring& wks_path, const std::wstring& hw_id,
+    const std::wstring& permits_path, sdk::gdb::IWorkspaceSP& wks);
+
+  // Counts datasets of the workspace and unites their bounds
+  static bool ReadContents(const sdk::gdb::IWorkspaceSP& wks,
+    quint32& dataset_count, sdk::GeoIntRect& bounds);
+
+  // Orders the entries by distance of their cached bounds to the view
+  // bounds and returns the number of leading entries, which cover the
+  // view. Entries of unknown bounds are taken as covering. The order of
+  // folders is kept for equal distances.
+  static size_t OrderByView(const sdk::gdb::IWorkspaceFactorySP& wks_factory,
+    const RootCatalogCacheSP& root_catalog_cache,
+    const sdk::GeoIntRect& view_bounds, std::vector<Entry>& entries);
+
+private:
+  class Task;
+};
+#endif // WORKSPACE_OPENER_H